@@ -34,6 +34,8 @@ typedef unsigned int	    u_24;
 typedef unsigned int	    u_32;
 typedef unsigned long long int	    u_64;
 
+#include <time.h>
+
 #include "raven/defines.h"
 
 /********************************************************
@@ -129,6 +131,7 @@ struct mechanism {
   struct DOF joint[MAX_DOF_PER_MECH];
   u_08 inputs;                  // input pins
   u_08 outputs;                 // output pins
+  struct timespec enc_stamp;    // when the last encoder packet was read
 };
 
 inline bool mechIsGold(const mechanism& mech) { return mech.type == GOLD_ARM; }
@@ -145,6 +148,8 @@ struct robot_device {
   u_08 runlevel;	// nothing/init/joints/kinematics/e-stop
   u_08 sublevel;	// which experimental mode are we running
   int  surgeon_mode;	// Clutching/indexing state - 1==engaged; 0==disengaged
+  u_32 param_seq;	// param_pass::seq of the last command applied
+  struct timespec param_rx;	// its param_pass::master_rx
   struct mechanism mech [MAX_MECH_PER_DEV];
 };
 
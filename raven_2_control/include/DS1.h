@@ -29,6 +29,7 @@ struct param_pass {
   int    dac_d[MAX_MECH_PER_DEV * MAX_DOF_PER_MECH];       // desired dac level
   float  jpos_d[MAX_MECH_PER_DEV * MAX_DOF_PER_MECH];    // desired joint coordinates
   float  jvel_d[MAX_MECH_PER_DEV * MAX_DOF_PER_MECH];    // desired joint velocity
+  float  mpos_d[MAX_MECH_PER_DEV * MAX_DOF_PER_MECH];    // desired motor position (motor_position_control only)
   float  kp[MAX_MECH_PER_DEV * MAX_DOF_PER_MECH];        // position gain
   float  kd[MAX_MECH_PER_DEV * MAX_DOF_PER_MECH];        // derivative gain
   struct position xd[MAX_MECH_PER_DEV];		  // desired end-point position
@@ -37,6 +38,8 @@ struct param_pass {
   char   cmdStr[200];
   int    surgeon_mode;
   int    robotControlMode;
+  u_32   seq;                                 // bumped by every update of the command (latency provenance)
+  struct timespec master_rx;                  // kernel receive time of the newest master packet in it (zero if none)
 };
 
 inline void print_param_pass(param_pass* p) {
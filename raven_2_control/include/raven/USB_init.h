@@ -51,6 +51,8 @@ typedef struct
 
 //Function Prototypes
 int USBInit(struct device *device0);
+int USBInitSim(struct device *device0);
+int USBInitReplay(struct device *device0);
 void USBShutdown(void);
 
 void USBShutdown(void);
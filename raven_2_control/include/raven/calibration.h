@@ -0,0 +1,61 @@
+/*
+ * calibration.h
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: agent
+ */
+
+#ifndef CALIBRATION_H_
+#define CALIBRATION_H_
+
+#include <stdint.h>
+
+#include "DS0.h"
+
+/*
+ * Per-board calibration, one binary file per arm serial:
+ *   ~/.ros/calibration/arm_<serial>.cal
+ *
+ * The file is a header (magic, format version, record size, CRC-32 of the
+ * record) followed by a CalibrationRecord. It is mapped and checked on load,
+ * and written to a temporary file, synced and renamed over the old one, so a
+ * crash leaves either the old or the new calibration, never part of one.
+ *
+ * A record holds the fields its flags say were saved. The transmission ratios
+ * are the ones the encoder offsets were computed with; offsets saved under
+ * other ratios are not used.
+ */
+
+#define CALIBRATION_VERSION 1
+
+#define CALIBRATION_OFFSETS 0x1
+#define CALIBRATION_GAINS   0x2
+#define CALIBRATION_TR      0x4
+
+struct CalibrationRecord {
+	int32_t serial;
+	uint32_t fields;   // CALIBRATION_* flags of the fields that hold values
+
+	int32_t enc_offset[MAX_DOF_PER_MECH];
+	float kp[MAX_DOF_PER_MECH];
+	float kd[MAX_DOF_PER_MECH];
+	float ki[MAX_DOF_PER_MECH];
+	float tr[MAX_DOF_PER_MECH];
+};
+
+// False if the board has no calibration or it is unreadable; record is then empty but for the serial
+bool calibrationLoad(int serial, CalibrationRecord& record);
+
+// Replaces the given fields of the board's calibration with those of values, keeping the others
+bool calibrationUpdate(const CalibrationRecord& values, uint32_t fields);
+
+/*
+ * The same from a low-priority writer thread, for callers that can't wait on
+ * the disk. The update is only queued, so it is safe from the rt thread; one
+ * thread at a time may queue. Without a running writer it is written at once.
+ */
+void calibrationUpdateAsync(const CalibrationRecord& values, uint32_t fields);
+void calibrationWriterStart();
+void calibrationWriterStop();    // writes out everything queued first
+
+#endif /* CALIBRATION_H_ */
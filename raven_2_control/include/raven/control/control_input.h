@@ -18,6 +18,72 @@
 POINTER_TYPES(ControlInput)
 POINTER_TYPES(OldControlInput)
 
+#define CONTROL_INPUT_MAX_ARMS 4
+
+/*
+ * Input kinds, used to check the type of an input (and cast to it) without RTTI.
+ * The KIND of a class is its own bit or'ed with the KIND of its parent,
+ * so an input is a T if (input.kind() & T::KIND) == T::KIND.
+ * SeparateArmControlInput<T> also carries the bit of its arm data type T.
+ *
+ * A class with two ControlInput bases sets its KIND in both, plus
+ * CONTROL_INPUT_KIND_MULTIPLE_BASES; a static cast from one of its bases may
+ * land on the wrong subobject, so controlInputCast() uses RTTI for those.
+ */
+enum ControlInputKind {
+	CONTROL_INPUT_KIND_OLD                    = 1 << 0,
+	CONTROL_INPUT_KIND_MULTIPLE               = 1 << 1,
+	CONTROL_INPUT_KIND_DUAL                   = 1 << 2,
+	CONTROL_INPUT_KIND_SINGLE_ARM             = 1 << 3,
+	CONTROL_INPUT_KIND_MOTOR_VALUES           = 1 << 4,
+	CONTROL_INPUT_KIND_MOTOR_POSITION         = 1 << 5,
+	CONTROL_INPUT_KIND_MOTOR_VELOCITY         = 1 << 6,
+	CONTROL_INPUT_KIND_MOTOR_TORQUE           = 1 << 7,
+	CONTROL_INPUT_KIND_JOINT_VALUES           = 1 << 8,
+	CONTROL_INPUT_KIND_JOINT_POSITION         = 1 << 9,
+	CONTROL_INPUT_KIND_JOINT_VELOCITY         = 1 << 10,
+	CONTROL_INPUT_KIND_END_EFFECTOR_POSE      = 1 << 11,
+	CONTROL_INPUT_KIND_END_EFFECTOR_INSERTION = 1 << 12,
+	CONTROL_INPUT_KIND_END_EFFECTOR_GRASP     = 1 << 13,
+	CONTROL_INPUT_KIND_SEPARATE_ARM           = 1 << 14,
+	CONTROL_INPUT_KIND_OLD_ARMS               = 1 << 15,
+	CONTROL_INPUT_KIND_MOTOR_ARMS             = 1 << 16,
+	CONTROL_INPUT_KIND_JOINT_ARMS             = 1 << 17,
+	CONTROL_INPUT_KIND_POSE_ARMS              = 1 << 18,
+	CONTROL_INPUT_KIND_GRASP_ARMS             = 1 << 19,
+	CONTROL_INPUT_KIND_MULTIPLE_BASES         = 1 << 30
+};
+
+#define CONTROL_INPUT_KIND(kindBits,ParentClass) static const unsigned int KIND = (kindBits) | ParentClass::KIND;
+
+/* The kind bit of SeparateArmControlInput<T>, declared next to each arm data type T */
+template<typename T>
+struct ControlInputArmDataKind;
+
+#define CONTROL_INPUT_ARM_DATA_KIND(DataType,kindBits) \
+	template<> struct ControlInputArmDataKind<DataType> { static const unsigned int KIND = (kindBits); };
+
+/*
+ * Fixed channels of a MultipleControlInput. A channel type is declared next to
+ * its input class (e.g. MotorPositionChannel in motor_input.h), which makes the
+ * lookup a static array index with the type known at compile time.
+ */
+enum ControlInputChannelId {
+	CONTROL_INPUT_CHANNEL_POSITION = 0,
+	CONTROL_INPUT_CHANNEL_VELOCITY,
+	CONTROL_INPUT_CHANNEL_POSE,
+	CONTROL_INPUT_CHANNEL_GRASP,
+	NUM_CONTROL_INPUT_CHANNELS
+};
+
+template<class InputType,ControlInputChannelId Id>
+struct ControlInputChannel {
+	typedef InputType Type;
+	typedef boost::shared_ptr<InputType> Ptr;
+	typedef boost::shared_ptr<const InputType> ConstPtr;
+	static const ControlInputChannelId ID = Id;
+};
+
 class MasterModeStatus;
 
 typedef std::map<Arm::IdType,MasterModeStatus> MasterModeStatusMap;
@@ -64,43 +130,115 @@ class ControlInput {
 	friend class Controller;
 private:
 	static std::map<std::pair<Arm::IdType,std::string>,ControlInputPtr> CONTROL_INPUT;
-	static OldControlInputPtr OLD_CONTROL_INPUT;
+	static OldControlInputPtr OLD_CONTROL_INPUT[3];
+	static volatile unsigned int OLD_CONTROL_INPUT_STATE;
+	static int OLD_CONTROL_INPUT_PUBLISHED;
+	static int OLD_CONTROL_INPUT_UPDATE_DEPTH;
+	static OldControlInputPtr OLD_CONTROL_INPUT_RT;
+	static volatile unsigned int OLD_CONTROL_INPUT_RT_SEQ;
+	static volatile unsigned int OLD_CONTROL_INPUT_RT_BASE[3];
+	static int OLD_CONTROL_INPUT_RT_DEPTH;
+	static unsigned int copyNewestOldControlInput(OldControlInput& dst);
+	static void initOldControlInput();
 	static ControlInputPtr getControlInput(Arm::IdType armId, const std::string& type);
 protected:
 	ros::Time timestamp_;
+	unsigned int kind_;
 public:
+	static const unsigned int KIND = 0;
+
+	ControlInput() : kind_(KIND) {}
 	virtual ~ControlInput() {}
 
+	unsigned int kind() const { return kind_; }
+
 	virtual ros::Time timestamp() const { return timestamp_; }
 	virtual void setTimestamp(ros::Time time) { timestamp_ = time; }
 	void updateTimestamp() { setTimestamp(ros::Time::now()); }
 
 	virtual Arm::IdList armIds() const=0;
 	size_t numArms() const { return armIds().size(); }
-	bool hasArmId(Arm::IdType id) const { return std::find(armIds().begin(),armIds().end(),id) != armIds().end(); }
+	bool hasArmId(Arm::IdType id) const { Arm::IdList ids = armIds(); return std::find(ids.begin(),ids.end(),id) != ids.end(); }
 
 	virtual void setFrom(DeviceConstPtr dev) = 0;
 
 	static void setControlInput(Arm::IdType armId, const std::string& type, ControlInputPtr input);
 
 	template<class C>
-	static boost::shared_ptr<C> getControlInput(Arm::IdType armId, const std::string& type) {
-		return boost::dynamic_pointer_cast<C,ControlInput>(getControlInput(armId, type));
-	}
-
+	static boost::shared_ptr<C> getControlInput(Arm::IdType armId, const std::string& type);
+
+	/*
+	 * The old input is triple-buffered: writers fill a private back buffer
+	 * between oldControlInputUpdateBegin() and oldControlInputUpdateEnd(),
+	 * which publishes it with a single atomic swap. getOldControlInput()
+	 * picks up the newest published buffer without locking and must only
+	 * be called from the rt thread; other threads use oldControlInputSnapshot().
+	 *
+	 * The rt thread writes with oldControlInputRtUpdateBegin()/End() instead,
+	 * which never lock: it edits the buffer it reads in place and mirrors it
+	 * to a slot of its own that the other writers build on. Its writes win;
+	 * an update another thread started before the rt thread's latest write
+	 * is dropped.
+	 */
 	static OldControlInputPtr getOldControlInput();
+	static OldControlInputPtr oldControlInputSnapshot();
+	static void oldControlInputSnapshot(OldControlInput& into);
 	static OldControlInputPtr oldControlInputUpdateBegin();
 	static void oldControlInputUpdateEnd();
+	static OldControlInputPtr oldControlInputRtUpdateBegin();
+	static void oldControlInputRtUpdateEnd();
 
 };
 
+template<class T>
+struct ControlInputKindMatch {
+	static bool matches(const ControlInput& input) { return (input.kind() & T::KIND) == T::KIND; }
+};
+
+/* Replacement for dynamic_pointer_cast between ControlInput types */
+template<class T,class U>
+boost::shared_ptr<T> controlInputCast(const boost::shared_ptr<U>& input) {
+	if (input && ControlInputKindMatch<T>::matches(*input)) {
+		if (input->kind() & CONTROL_INPUT_KIND_MULTIPLE_BASES) {
+			return boost::dynamic_pointer_cast<T>(input);
+		}
+		return boost::static_pointer_cast<T>(input);
+	}
+	return boost::shared_ptr<T>();
+}
+
+template<class T,class U>
+boost::shared_ptr<const T> controlInputCast(const boost::shared_ptr<const U>& input) {
+	if (input && ControlInputKindMatch<T>::matches(*input)) {
+		if (input->kind() & CONTROL_INPUT_KIND_MULTIPLE_BASES) {
+			return boost::dynamic_pointer_cast<const T>(input);
+		}
+		return boost::static_pointer_cast<const T>(input);
+	}
+	return boost::shared_ptr<const T>();
+}
+
+template<class C>
+boost::shared_ptr<C> ControlInput::getControlInput(Arm::IdType armId, const std::string& type) {
+	return controlInputCast<C>(getControlInput(armId, type));
+}
+
 class MultipleControlInput : public ControlInput {
 public:
 	typedef std::map<std::string,ControlInputPtr> Map;
 	typedef std::map<std::string,ControlInputConstPtr> ConstMap;
 private:
 	Map inputs_;
+	ControlInputPtr channels_[NUM_CONTROL_INPUT_CHANNELS];
 public:
+	CONTROL_INPUT_KIND(CONTROL_INPUT_KIND_MULTIPLE,ControlInput)
+
+	static const char* const CHANNEL_NAMES[NUM_CONTROL_INPUT_CHANNELS];
+	static const unsigned int CHANNEL_KINDS[NUM_CONTROL_INPUT_CHANNELS];
+	static int channelIdFromName(const std::string& name);
+
+	MultipleControlInput() { kind_ = KIND; }
+
 	virtual ros::Time timestamp() const;
 	virtual void setTimestamp(ros::Time time);
 
@@ -121,36 +259,56 @@ public:
 
 	template<class T>
 	boost::shared_ptr<T> getInput(const std::string& name) {
-		ControlInputPtr p = getInput(name);
-		boost::shared_ptr<T> out = boost::dynamic_pointer_cast<T>(p);
-		return out;
+		return controlInputCast<T>(getInput(name));
 	}
 
 	template<class T>
 	boost::shared_ptr<const T> getInput(const std::string& name) const {
-		ControlInputConstPtr p = getInput(name);
-		boost::shared_ptr<const T> out = boost::dynamic_pointer_cast<const T>(p);
-		return out;
+		return controlInputCast<T>(getInput(name));
 	}
 
 	template<class T>
 	bool getInput(const std::string& name,boost::shared_ptr<T>& input) {
-		ControlInputPtr p = getInput(name);
-		input = boost::dynamic_pointer_cast<T>(p);
+		input = controlInputCast<T>(getInput(name));
 		return input.get();
 	}
 
 	template<class T>
 	bool getInput(const std::string& name,boost::shared_ptr<const T>& input) const {
-		ControlInputConstPtr p = getInput(name);
-		input = boost::dynamic_pointer_cast<T>(p);
+		input = controlInputCast<T>(getInput(name));
 		return input.get();
 	}
+
+	/* The channel slots only ever hold inputs of the channel's type (checked on set), so no cast check is needed */
+	template<class Channel>
+	typename Channel::Ptr channel() {
+		return boost::static_pointer_cast<typename Channel::Type>(channels_[Channel::ID]);
+	}
+
+	template<class Channel>
+	typename Channel::ConstPtr channel() const {
+		return boost::static_pointer_cast<const typename Channel::Type>(channels_[Channel::ID]);
+	}
+
+	template<class Channel>
+	void setChannel(typename Channel::Ptr input) {
+		setInput(CHANNEL_NAMES[Channel::ID],input);
+	}
 };
 POINTER_TYPES(MultipleControlInput)
 
+class DualControlInputBase : public ControlInput {
+public:
+	CONTROL_INPUT_KIND(CONTROL_INPUT_KIND_DUAL,ControlInput)
+
+	DualControlInputBase() { kind_ = KIND; }
+
+	virtual unsigned int firstKind() const=0;
+	virtual unsigned int secondKind() const=0;
+};
+
 template<typename T1,typename T2>
-class DualControlInput : public ControlInput {
+class DualControlInput : public DualControlInputBase {
 public:
 	typedef boost::shared_ptr<T1> FirstPtr;
 	typedef boost::shared_ptr<const T1> FirstConstPtr;
@@ -166,6 +324,9 @@ protected:
 	FirstPtr first_;
 	SecondPtr second_;
 public:
+	virtual unsigned int firstKind() const { return T1::KIND; }
+	virtual unsigned int secondKind() const { return T2::KIND; }
+
 	virtual ros::Time timestamp() const {
 		ros::Time stamp = first_->timestamp();
 		if (second_->timestamp() > stamp) {
@@ -203,6 +364,17 @@ public:
 	void setSecond(SecondPtr newSecond) { second_ = newSecond; }
 };
 
+template<typename T1,typename T2>
+struct ControlInputKindMatch<DualControlInput<T1,T2> > {
+	static bool matches(const ControlInput& input) {
+		if (!(input.kind() & CONTROL_INPUT_KIND_DUAL)) {
+			return false;
+		}
+		const DualControlInputBase& dual = static_cast<const DualControlInputBase&>(input);
+		return dual.firstKind() == T1::KIND && dual.secondKind() == T2::KIND;
+	}
+};
+
 template<typename T>
 class SeparateArmControlInput : public ControlInput {
 private:
@@ -211,12 +383,26 @@ private:
 			Arm::IdType id = armIds_.at(i);
 			arms_.push_back(T(id,Device::numMotorsOnArmById(id),Device::numJointsOnArmById(id)));
 		}
+		Arm::IdList deviceIds = Device::armIds();
+		for (size_t i=0;i<CONTROL_INPUT_MAX_ARMS;i++) {
+			armSlots_[i] = -1;
+			if (i >= deviceIds.size()) {
+				continue;
+			}
+			for (size_t j=0;j<armIds_.size();j++) {
+				if (armIds_[j] == deviceIds[i]) {
+					armSlots_[i] = j;
+				}
+			}
+		}
 	}
 protected:
 	Arm::IdList armIds_;
 	std::vector<T> arms_;
+	int armSlots_[CONTROL_INPUT_MAX_ARMS]; // index into arms_ for each device arm index, or -1
 
 	SeparateArmControlInput(const Arm::IdList& armIds) {
+		kind_ = KIND;
 		armIds_ = armIds;
 		init();
 	}
@@ -225,6 +411,8 @@ public:
 
 	typedef boost::shared_ptr<SeparateArmControlInput<T> > Ptr;
 
+	CONTROL_INPUT_KIND(CONTROL_INPUT_KIND_SEPARATE_ARM | ControlInputArmDataKind<T>::KIND,ControlInput)
+
 	virtual Arm::IdList armIds() const { return armIds_; }
 	const Arm::IdList& ids() const { return armIds_; }
 	bool hasId(Arm::IdType id) const { return hasArmId(id); }
@@ -233,6 +421,27 @@ public:
 	T& arm(size_t i) { return arms_.at(i); }
 	const T& arm(size_t i) const { return arms_.at(i); }
 
+	/* Data for the arm at index i of the device, or NULL if the input does not have that arm */
+	T* armByIndex(size_t i) {
+		return (i < CONTROL_INPUT_MAX_ARMS && armSlots_[i] >= 0) ? &arms_[armSlots_[i]] : NULL;
+	}
+	const T* armByIndex(size_t i) const {
+		return (i < CONTROL_INPUT_MAX_ARMS && armSlots_[i] >= 0) ? &arms_[armSlots_[i]] : NULL;
+	}
+
+	/* Like armById, but returns NULL instead of throwing */
+	T* findArmById(Arm::IdType id) {
+		for (size_t i=0;i<armIds_.size();i++) {
+			if (id == armIds_[i]) {
+				return &arms_[i];
+			}
+		}
+		return NULL;
+	}
+	const T* findArmById(Arm::IdType id) const {
+		return const_cast<SeparateArmControlInput<T>*>(this)->findArmById(id);
+	}
+
 	T& armById(Arm::IdType id) {
 		for (size_t i=0;i<armIds_.size();i++) {
 			if (id == armIds_.at(i)) {
@@ -301,75 +510,92 @@ static boost::shared_ptr<SingleArmControlInputSubClass> createSingleArmControlIn
 #include <memory>
 #include <LinearMath/btTransform.h>
 
-#define ARM_INPUT_DATA_ENSURE_SIZE(field) do { if (field->size() <= i) { const_cast<OldArmInputData*>(this)->field->resize(i+1); } } while(false)
+/*
+ * Fixed-size per-arm record for the old input. Everything is stored inline
+ * (no heap, no lazy resizing), so copying one is a plain member copy and the
+ * double-buffered OldControlInput can be republished without reallocating.
+ */
+#define OLD_ARM_INPUT_MAX_MOTORS 8
+#define OLD_ARM_INPUT_MAX_JOINTS 8
 
 class OldArmInputData {
 private:
-	std::auto_ptr<std::vector<float> > motorPositions_;
-	std::auto_ptr<std::vector<float> > motorVelocities_;
-	std::auto_ptr<std::vector<float> > motorTorques_;
-	std::auto_ptr<std::vector<float> > jointPositions_;
-	std::auto_ptr<std::vector<float> > jointVelocities_;
-
-	std::auto_ptr<btTransform> pose_;
-	std::auto_ptr<float> grasp_;
+	size_t numMotors_;
+	size_t numJoints_;
+
+	float motorPositions_[OLD_ARM_INPUT_MAX_MOTORS];
+	float motorVelocities_[OLD_ARM_INPUT_MAX_MOTORS];
+	float motorTorques_[OLD_ARM_INPUT_MAX_MOTORS];
+	float jointPositions_[OLD_ARM_INPUT_MAX_JOINTS];
+	float jointVelocities_[OLD_ARM_INPUT_MAX_JOINTS];
+
+	btTransform pose_;
+	float grasp_;
 public:
-	OldArmInputData(const OldArmInputData& other);
+	typedef Eigen::Map<Eigen::VectorXf> Values;
+	typedef Eigen::Map<const Eigen::VectorXf> ConstValues;
+
 	OldArmInputData(int id,size_t numMotors,size_t numJoints);
-	//OldArmInputData();
 
-	std::vector<float>& motorPositions() { return *motorPositions_; }
-	const std::vector<float>& motorPositions() const { return *motorPositions_; }
-	Eigen::Map<const Eigen::VectorXf> motorPositionVector() const { return Eigen::Map<const Eigen::VectorXf>(&motorPositions_->at(0),motorPositions_->size()); }
-	Eigen::Map<Eigen::VectorXf> motorPositionVector() { return Eigen::Map<Eigen::VectorXf>(&motorPositions_->at(0),motorPositions_->size()); }
+	size_t numMotors() const { return numMotors_; }
+	size_t numJoints() const { return numJoints_; }
 
-	float& motorPosition(size_t i) { do { if (motorPositions_->size() <= i) { const_cast<OldArmInputData*>(this)->motorPositions_->resize(i+1); } } while(false); return motorPositions_->at(i); }
-	const float& motorPosition(size_t i) const { ARM_INPUT_DATA_ENSURE_SIZE(motorPositions_); return motorPositions_->at(i); }
+	Values motorPositions() { return Values(motorPositions_,numMotors_); }
+	ConstValues motorPositions() const { return ConstValues(motorPositions_,numMotors_); }
+	Values motorPositionVector() { return motorPositions(); }
+	ConstValues motorPositionVector() const { return motorPositions(); }
 
-	std::vector<float>& motorVelocities() { return *motorVelocities_; }
-	const std::vector<float>& motorVelocities() const { return *motorVelocities_; }
-	Eigen::Map<const Eigen::VectorXf> motorVelocityVector() const { return Eigen::Map<const Eigen::VectorXf>(&motorVelocities_->at(0),motorVelocities_->size()); }
-	Eigen::Map<Eigen::VectorXf> motorVelocityVector() { return Eigen::Map<Eigen::VectorXf>(&motorVelocities_->at(0),motorVelocities_->size()); }
+	float& motorPosition(size_t i) { return motorPositions_[i]; }
+	const float& motorPosition(size_t i) const { return motorPositions_[i]; }
 
-	float& motorVelocity(size_t i) { ARM_INPUT_DATA_ENSURE_SIZE(motorVelocities_); return motorVelocities_->at(i); }
-	const float& motorVelocity(size_t i) const { ARM_INPUT_DATA_ENSURE_SIZE(motorVelocities_); return motorVelocities_->at(i); }
+	Values motorVelocities() { return Values(motorVelocities_,numMotors_); }
+	ConstValues motorVelocities() const { return ConstValues(motorVelocities_,numMotors_); }
+	Values motorVelocityVector() { return motorVelocities(); }
+	ConstValues motorVelocityVector() const { return motorVelocities(); }
 
-	std::vector<float>& motorTorques() { return *motorTorques_; }
-	const std::vector<float>& motorTorques() const { return *motorTorques_; }
-	Eigen::Map<const Eigen::VectorXf> motorTorqueVector() const { return Eigen::Map<const Eigen::VectorXf>(&motorTorques_->at(0),motorTorques_->size()); }
-	Eigen::Map<Eigen::VectorXf> motorTorqueVector() { return Eigen::Map<Eigen::VectorXf>(&motorTorques_->at(0),motorTorques_->size()); }
+	float& motorVelocity(size_t i) { return motorVelocities_[i]; }
+	const float& motorVelocity(size_t i) const { return motorVelocities_[i]; }
 
-	float& motorTorque(size_t i) { ARM_INPUT_DATA_ENSURE_SIZE(motorTorques_); return motorTorques_->at(i); }
-	const float& motorTorque(size_t i) const { ARM_INPUT_DATA_ENSURE_SIZE(motorTorques_); return motorTorques_->at(i); }
+	Values motorTorques() { return Values(motorTorques_,numMotors_); }
+	ConstValues motorTorques() const { return ConstValues(motorTorques_,numMotors_); }
+	Values motorTorqueVector() { return motorTorques(); }
+	ConstValues motorTorqueVector() const { return motorTorques(); }
 
-	std::vector<float> jointPositions() { return *jointPositions_; }
-	const std::vector<float> jointPositions() const { return *jointPositions_; }
-	Eigen::Map<const Eigen::VectorXf> jointPositionVector() const { return Eigen::Map<const Eigen::VectorXf>(&jointPositions_->at(0),jointPositions_->size()); }
-	Eigen::Map<Eigen::VectorXf> jointPositionVector() { return Eigen::Map<Eigen::VectorXf>(&jointPositions_->at(0),jointPositions_->size()); }
+	float& motorTorque(size_t i) { return motorTorques_[i]; }
+	const float& motorTorque(size_t i) const { return motorTorques_[i]; }
 
-	float& jointPosition(size_t i) { ARM_INPUT_DATA_ENSURE_SIZE(jointPositions_); return jointPositions_->at(i); }
-	const float& jointPosition(size_t i) const { ARM_INPUT_DATA_ENSURE_SIZE(jointPositions_); return jointPositions_->at(i); }
+	Values jointPositions() { return Values(jointPositions_,numJoints_); }
+	ConstValues jointPositions() const { return ConstValues(jointPositions_,numJoints_); }
+	Values jointPositionVector() { return jointPositions(); }
+	ConstValues jointPositionVector() const { return jointPositions(); }
 
-	std::vector<float>& jointVelocities() { return *jointVelocities_; }
-	const std::vector<float>& jointVelocities() const { return *jointVelocities_; }
-	Eigen::Map<const Eigen::VectorXf> jointVelocityVector() const { return Eigen::Map<const Eigen::VectorXf>(&jointVelocities_->at(0),jointVelocities_->size()); }
-	Eigen::Map<Eigen::VectorXf> jointVelocityVector() { return Eigen::Map<Eigen::VectorXf>(&jointVelocities_->at(0),jointVelocities_->size()); }
+	float& jointPosition(size_t i) { return jointPositions_[i]; }
+	const float& jointPosition(size_t i) const { return jointPositions_[i]; }
 
-	float& jointVelocity(size_t i) { ARM_INPUT_DATA_ENSURE_SIZE(jointVelocities_); return jointVelocities_->at(i); }
-	const float& jointVelocity(size_t i) const { ARM_INPUT_DATA_ENSURE_SIZE(jointVelocities_); return jointVelocities_->at(i); }
+	Values jointVelocities() { return Values(jointVelocities_,numJoints_); }
+	ConstValues jointVelocities() const { return ConstValues(jointVelocities_,numJoints_); }
+	Values jointVelocityVector() { return jointVelocities(); }
+	ConstValues jointVelocityVector() const { return jointVelocities(); }
 
-	btTransform& pose() { return *pose_; }
-	const btTransform& pose() const { return *pose_; }
+	float& jointVelocity(size_t i) { return jointVelocities_[i]; }
+	const float& jointVelocity(size_t i) const { return jointVelocities_[i]; }
 
-	float& grasp() { return *grasp_; }
-	const float& grasp() const { return *grasp_; }
+	btTransform& pose() { return pose_; }
+	const btTransform& pose() const { return pose_; }
+
+	float& grasp() { return grasp_; }
+	const float& grasp() const { return grasp_; }
 };
+CONTROL_INPUT_ARM_DATA_KIND(OldArmInputData,CONTROL_INPUT_KIND_OLD_ARMS)
 
 class OldControlInput : public SeparateArmControlInput<OldArmInputData> {
 public:
+	CONTROL_INPUT_KIND(CONTROL_INPUT_KIND_OLD,SeparateArmControlInput<OldArmInputData>)
+
 	OldControlInput();
 
 	virtual void setFrom(DeviceConstPtr dev);
+	void copyFrom(const OldControlInput& other);
 
 	Eigen::VectorXf motorPositionVector() const;
 	Eigen::VectorXf motorVelocityVector() const;
@@ -99,15 +99,12 @@ public:
 	virtual ControlInputPtr getInput() const { return input_; }
 	template<class T>
 	boost::shared_ptr<T> getInput() const {
-		ControlInputPtr p = getInput();
-		boost::shared_ptr<T> out = boost::dynamic_pointer_cast<T>(p);
-		return out;
+		return controlInputCast<T>(getInput());
 	}
 
 	template<class T>
 	bool getInput(boost::shared_ptr<T>& input) const {
-		ControlInputPtr p = getInput();
-		input = boost::dynamic_pointer_cast<T>(p);
+		input = controlInputCast<T>(getInput());
 		return input.get();
 	}
 
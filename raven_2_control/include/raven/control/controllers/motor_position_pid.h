@@ -10,15 +10,14 @@
 
 #include <raven/control/controller.h>
 #include <raven/control/input/motor_input.h>
-
-#include <Eigen/Core>
+#include <raven/control/pid_kernel.h>
 
 struct MotorPositionPIDState : public ControllerState {
-	Eigen::VectorXf positionErrorIntegral;
-	MotorPositionPIDState(DevicePtr dev) : ControllerState(dev), positionErrorIntegral() {}
+	PIDKernelState kernel;
+	MotorPositionPIDState(DevicePtr dev) : ControllerState(dev), kernel() {}
 	virtual ControllerStatePtr clone(DevicePtr dev) const {
 		MotorPositionPIDState* newState = new MotorPositionPIDState(dev);
-		newState->positionErrorIntegral = positionErrorIntegral;
+		newState->kernel = kernel;
 		return ControllerStatePtr(newState);
 	}
 };
@@ -37,9 +36,7 @@ public:
 	};
 private:
 	std::vector<ArmGains> gains_;
-	Eigen::VectorXf KP_;
-	Eigen::VectorXf KI_;
-	Eigen::VectorXf KD_;
+	PIDKernelGains kernelGains_; // gains_ laid out by kernel lane (arm index, motor index)
 
 	virtual ControllerStatePtr internalApplyControl(DevicePtr device);
 public:
@@ -20,10 +20,13 @@ public:
 	float& value() { return *value_; }
 	const float& value() const { return *value_; }
 };
+CONTROL_INPUT_ARM_DATA_KIND(EndEffectorGraspData,CONTROL_INPUT_KIND_GRASP_ARMS)
 
 class EndEffectorGraspInput : public SeparateArmControlInput<EndEffectorGraspData> {
 public:
-	EndEffectorGraspInput(const Arm::IdList& ids) : SeparateArmControlInput<EndEffectorGraspData>(ids) {}
+	CONTROL_INPUT_KIND(CONTROL_INPUT_KIND_END_EFFECTOR_GRASP,SeparateArmControlInput<EndEffectorGraspData>)
+
+	EndEffectorGraspInput(const Arm::IdList& ids) : SeparateArmControlInput<EndEffectorGraspData>(ids) { kind_ = KIND; }
 
 	std::vector<float> values() const;
 
@@ -31,9 +34,13 @@ public:
 };
 POINTER_TYPES(EndEffectorGraspInput)
 
+typedef ControlInputChannel<EndEffectorGraspInput,CONTROL_INPUT_CHANNEL_GRASP> EndEffectorGraspChannel;
+
 class SingleArmEndEffectorGraspInput : public EndEffectorGraspInput, public SingleArmControlInput<EndEffectorGraspData> {
 public:
-	SingleArmEndEffectorGraspInput(Arm::IdType id) : EndEffectorGraspInput(Arm::IdList(1,id)) {}
+	CONTROL_INPUT_KIND(CONTROL_INPUT_KIND_SINGLE_ARM,EndEffectorGraspInput)
+
+	SingleArmEndEffectorGraspInput(Arm::IdType id) : EndEffectorGraspInput(Arm::IdList(1,id)) { kind_ = KIND; }
 	SINGLE_ARM_CONTROL_INPUT_METHODS(EndEffectorGraspData)
 
 	float& value() { return data().value(); }
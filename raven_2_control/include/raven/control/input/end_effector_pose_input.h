@@ -25,11 +25,14 @@ public:
 	btTransform& value() { return *value_; }
 	const btTransform& value() const { return *value_; }
 };
+CONTROL_INPUT_ARM_DATA_KIND(EndEffectorPoseData,CONTROL_INPUT_KIND_POSE_ARMS)
 
 class EndEffectorPoseInput : public SeparateArmControlInput<EndEffectorPoseData> {
 protected:
 	bool relative_;
 public:
+	CONTROL_INPUT_KIND(CONTROL_INPUT_KIND_END_EFFECTOR_POSE,SeparateArmControlInput<EndEffectorPoseData>)
+
 	EndEffectorPoseInput(const Arm::IdList& ids);
 	EndEffectorPoseInput(const Arm::IdList& ids,bool relative);
 
@@ -44,10 +47,14 @@ public:
 };
 POINTER_TYPES(EndEffectorPoseInput)
 
+typedef ControlInputChannel<EndEffectorPoseInput,CONTROL_INPUT_CHANNEL_POSE> EndEffectorPoseChannel;
+
 class EndEffectorPoseAndInsertionInput : public EndEffectorPoseInput {
 protected:
 	std::map<Arm::IdType,float> insertions_;
 public:
+	CONTROL_INPUT_KIND(CONTROL_INPUT_KIND_END_EFFECTOR_INSERTION,EndEffectorPoseInput)
+
 	EndEffectorPoseAndInsertionInput(const Arm::IdList& ids);
 
 	virtual void setRelative(bool value = true) { if (!value) { throw std::runtime_error("EndEffectorPoseAndInsertionInput cannot be set to absolute!"); } }
@@ -68,6 +75,8 @@ POINTER_TYPES(EndEffectorPoseAndInsertionInput)
 
 class SingleArmEndEffectorPoseInput : public EndEffectorPoseInput, public SingleArmControlInput<EndEffectorPoseData> {
 public:
+	CONTROL_INPUT_KIND(CONTROL_INPUT_KIND_SINGLE_ARM,EndEffectorPoseInput)
+
 	SingleArmEndEffectorPoseInput(Arm::IdType id);
 	SingleArmEndEffectorPoseInput(Arm::IdType id, bool relative);
 	SINGLE_ARM_CONTROL_INPUT_METHODS(EndEffectorPoseData)
@@ -81,6 +90,8 @@ POINTER_TYPES(SingleArmEndEffectorPoseInput)
 
 class SingleArmEndEffectorPoseAndInsertionInput : public EndEffectorPoseAndInsertionInput, public SingleArmEndEffectorPoseInput {
 public:
+	CONTROL_INPUT_KIND(CONTROL_INPUT_KIND_SINGLE_ARM | CONTROL_INPUT_KIND_END_EFFECTOR_INSERTION,EndEffectorPoseInput)
+
 	SingleArmEndEffectorPoseAndInsertionInput(Arm::IdType id);
 
 	virtual void setRelative(bool value = true) { if (!value) { throw std::runtime_error("SingleArmEndEffectorPoseAndInsertionInput cannot be set to absolute!"); } }
@@ -27,11 +27,14 @@ public:
 	const Eigen::VectorXf& values() const { return *values_; }
 
 };
+CONTROL_INPUT_ARM_DATA_KIND(JointArmData,CONTROL_INPUT_KIND_JOINT_ARMS)
 
 class JointValuesInput : public SeparateArmControlInput<JointArmData> {
 protected:
-	JointValuesInput(const Arm::IdList& ids) : SeparateArmControlInput<JointArmData>(ids) {}
+	JointValuesInput(const Arm::IdList& ids) : SeparateArmControlInput<JointArmData>(ids) { kind_ = KIND; }
 public:
+	CONTROL_INPUT_KIND(CONTROL_INPUT_KIND_JOINT_VALUES,SeparateArmControlInput<JointArmData>)
+
 	float& valueByOldType(int type);
 	const float& valueByOldType(int type) const;
 
@@ -44,14 +47,18 @@ public:
 
 class JointPositionInput : public JointValuesInput {
 public:
-	JointPositionInput(const Arm::IdList& ids) : JointValuesInput(ids) {}
+	CONTROL_INPUT_KIND(CONTROL_INPUT_KIND_JOINT_POSITION,JointValuesInput)
+
+	JointPositionInput(const Arm::IdList& ids) : JointValuesInput(ids) { kind_ = KIND; }
 	virtual void setFrom(DeviceConstPtr dev);
 };
 POINTER_TYPES(JointPositionInput)
 
 class JointVelocityInput : public JointValuesInput {
 public:
-	JointVelocityInput(const Arm::IdList& ids) : JointValuesInput(ids) {}
+	CONTROL_INPUT_KIND(CONTROL_INPUT_KIND_JOINT_VELOCITY,JointValuesInput)
+
+	JointVelocityInput(const Arm::IdList& ids) : JointValuesInput(ids) { kind_ = KIND; }
 	virtual void setFrom(DeviceConstPtr dev);
 };
 POINTER_TYPES(JointVelocityInput)
@@ -71,7 +78,9 @@ public:
 
 class SingleArmJointPositionInput : public JointPositionInput, public SingleArmJointValuesInput {
 public:
-	SingleArmJointPositionInput(Arm::IdType armId) : JointPositionInput(Arm::IdList(1,armId)) {}
+	CONTROL_INPUT_KIND(CONTROL_INPUT_KIND_SINGLE_ARM,JointPositionInput)
+
+	SingleArmJointPositionInput(Arm::IdType armId) : JointPositionInput(Arm::IdList(1,armId)) { kind_ = KIND; }
 	SINGLE_ARM_CONTROL_INPUT_METHODS(JointArmData)
 	virtual void setFrom(DeviceConstPtr dev);
 };
@@ -79,7 +88,9 @@ POINTER_TYPES(SingleArmJointPositionInput)
 
 class SingleArmJointVelocityInput : public JointVelocityInput, public SingleArmJointValuesInput {
 public:
-	SingleArmJointVelocityInput(Arm::IdType armId) : JointVelocityInput(Arm::IdList(1,armId)) {}
+	CONTROL_INPUT_KIND(CONTROL_INPUT_KIND_SINGLE_ARM,JointVelocityInput)
+
+	SingleArmJointVelocityInput(Arm::IdType armId) : JointVelocityInput(Arm::IdList(1,armId)) { kind_ = KIND; }
 	SINGLE_ARM_CONTROL_INPUT_METHODS(JointArmData)
 	virtual void setFrom(DeviceConstPtr dev);
 };
@@ -27,12 +27,15 @@ public:
 	const Eigen::VectorXf& values() const { return *values_; }
 
 };
+CONTROL_INPUT_ARM_DATA_KIND(MotorArmData,CONTROL_INPUT_KIND_MOTOR_ARMS)
 
 class MotorValuesInput : public SeparateArmControlInput<MotorArmData> {
 protected:
-	MotorValuesInput(const Arm::IdList& ids) : SeparateArmControlInput<MotorArmData>(ids) {}
+	MotorValuesInput(const Arm::IdList& ids) : SeparateArmControlInput<MotorArmData>(ids) { kind_ = KIND; }
 
 public:
+	CONTROL_INPUT_KIND(CONTROL_INPUT_KIND_MOTOR_VALUES,SeparateArmControlInput<MotorArmData>)
+
 	float& valueByOldType(int type);
 	const float& valueByOldType(int type) const;
 
@@ -45,21 +48,30 @@ public:
 
 class MotorPositionInput : public MotorValuesInput {
 public:
-	MotorPositionInput(const Arm::IdList& ids) : MotorValuesInput(ids) {}
+	CONTROL_INPUT_KIND(CONTROL_INPUT_KIND_MOTOR_POSITION,MotorValuesInput)
+
+	MotorPositionInput(const Arm::IdList& ids) : MotorValuesInput(ids) { kind_ = KIND; }
 	virtual void setFrom(DeviceConstPtr dev);
 };
 POINTER_TYPES(MotorPositionInput)
 
 class MotorVelocityInput : public MotorValuesInput {
 public:
-	MotorVelocityInput(const Arm::IdList& ids) : MotorValuesInput(ids) {}
+	CONTROL_INPUT_KIND(CONTROL_INPUT_KIND_MOTOR_VELOCITY,MotorValuesInput)
+
+	MotorVelocityInput(const Arm::IdList& ids) : MotorValuesInput(ids) { kind_ = KIND; }
 	virtual void setFrom(DeviceConstPtr dev);
 };
 POINTER_TYPES(MotorVelocityInput)
 
+typedef ControlInputChannel<MotorPositionInput,CONTROL_INPUT_CHANNEL_POSITION> MotorPositionChannel;
+typedef ControlInputChannel<MotorVelocityInput,CONTROL_INPUT_CHANNEL_VELOCITY> MotorVelocityChannel;
+
 class MotorTorqueInput : public MotorValuesInput {
 public:
-	MotorTorqueInput(const Arm::IdList& ids) : MotorValuesInput(ids) {}
+	CONTROL_INPUT_KIND(CONTROL_INPUT_KIND_MOTOR_TORQUE,MotorValuesInput)
+
+	MotorTorqueInput(const Arm::IdList& ids) : MotorValuesInput(ids) { kind_ = KIND; }
 	virtual void setFrom(DeviceConstPtr dev);
 };
 POINTER_TYPES(MotorTorqueInput);
@@ -82,7 +94,9 @@ public:
 
 class SingleArmMotorPositionInput : public MotorPositionInput, public SingleArmMotorValuesInput {
 public:
-	SingleArmMotorPositionInput(Arm::IdType armId) : MotorPositionInput(Arm::IdList(1,armId)) {}
+	CONTROL_INPUT_KIND(CONTROL_INPUT_KIND_SINGLE_ARM,MotorPositionInput)
+
+	SingleArmMotorPositionInput(Arm::IdType armId) : MotorPositionInput(Arm::IdList(1,armId)) { kind_ = KIND; }
 	SINGLE_ARM_CONTROL_INPUT_METHODS(MotorArmData)
 	virtual void setFrom(DeviceConstPtr dev);
 };
@@ -90,7 +104,9 @@ POINTER_TYPES(SingleArmMotorPositionInput)
 
 class SingleArmMotorVelocityInput : public MotorVelocityInput, public SingleArmMotorValuesInput {
 public:
-	SingleArmMotorVelocityInput(Arm::IdType armId) : MotorVelocityInput(Arm::IdList(1,armId)) {}
+	CONTROL_INPUT_KIND(CONTROL_INPUT_KIND_SINGLE_ARM,MotorVelocityInput)
+
+	SingleArmMotorVelocityInput(Arm::IdType armId) : MotorVelocityInput(Arm::IdList(1,armId)) { kind_ = KIND; }
 	SINGLE_ARM_CONTROL_INPUT_METHODS(MotorArmData)
 	virtual void setFrom(DeviceConstPtr dev);
 };
@@ -98,7 +114,9 @@ POINTER_TYPES(SingleArmMotorVelocityInput)
 
 class SingleArmMotorTorqueInput : public MotorTorqueInput, public SingleArmMotorValuesInput {
 public:
-	SingleArmMotorTorqueInput(Arm::IdType armId) : MotorTorqueInput(Arm::IdList(1,armId)) {}
+	CONTROL_INPUT_KIND(CONTROL_INPUT_KIND_SINGLE_ARM,MotorTorqueInput)
+
+	SingleArmMotorTorqueInput(Arm::IdType armId) : MotorTorqueInput(Arm::IdList(1,armId)) { kind_ = KIND; }
 	SINGLE_ARM_CONTROL_INPUT_METHODS(MotorArmData)
 	virtual void setFrom(DeviceConstPtr dev);
 };
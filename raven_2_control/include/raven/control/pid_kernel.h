@@ -0,0 +1,90 @@
+/*
+ * pid_kernel.h
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: agent
+ */
+
+#ifndef PID_KERNEL_H_
+#define PID_KERNEL_H_
+
+#include <stddef.h>
+
+/*
+ * Fixed-size motor position PID kernel.
+ *
+ * All arrays are laid out in lanes using the old combined joint index
+ * (arm index * PID_KERNEL_LANES_PER_ARM + joint index), so lane i
+ * of the kernel is DOF_types[i] / joint->type == i in the old code.
+ * The NO_CONNECTION lanes (3 and 11) are never active.
+ *
+ * The kernel processes all lanes at once (four at a time with SSE).
+ * Lanes with active[i] == 0 output zero torque and keep their integral.
+ */
+
+#define PID_KERNEL_MAX_ARMS 2
+#define PID_KERNEL_LANES_PER_ARM 8
+#define PID_KERNEL_MAX_MOTORS_PER_ARM (PID_KERNEL_LANES_PER_ARM - 1) // motor lists have no NO_CONNECTION entry
+#define PID_KERNEL_SIZE (PID_KERNEL_MAX_ARMS * PID_KERNEL_LANES_PER_ARM)
+
+#define PID_KERNEL_ALIGN __attribute__((aligned(16)))
+
+// Default cap used by the old cappedPositionError for joints without a specific limit
+#define PID_KERNEL_NO_LIMIT 100000.f
+
+struct PIDKernelGains {
+	float kp[PID_KERNEL_SIZE] PID_KERNEL_ALIGN;
+	float ki[PID_KERNEL_SIZE] PID_KERNEL_ALIGN;
+	float kd[PID_KERNEL_SIZE] PID_KERNEL_ALIGN;
+
+	float maxPositionError[PID_KERNEL_SIZE] PID_KERNEL_ALIGN;   // |pos_d - pos| is capped at this (cappedPositionError)
+	float maxVelocity[PID_KERNEL_SIZE] PID_KERNEL_ALIGN;        // |vel| is capped at this (cappedVelocity)
+	float maxVelocityDesired[PID_KERNEL_SIZE] PID_KERNEL_ALIGN; // |vel_d| is capped at this (cappedVelocityDesired)
+	float maxIntegral[PID_KERNEL_SIZE] PID_KERNEL_ALIGN;        // anti-windup clamp on the integrated error
+
+	PIDKernelGains() { clear(); }
+	void clear();
+};
+
+struct PIDKernelState {
+	float errorIntegral[PID_KERNEL_SIZE] PID_KERNEL_ALIGN;
+
+	PIDKernelState() { reset(); }
+	void reset();
+};
+
+struct PIDKernelIO {
+	// inputs
+	float active[PID_KERNEL_SIZE] PID_KERNEL_ALIGN; // 1 to control the lane, 0 to skip it
+	float position[PID_KERNEL_SIZE] PID_KERNEL_ALIGN;
+	float velocity[PID_KERNEL_SIZE] PID_KERNEL_ALIGN;
+	float positionDesired[PID_KERNEL_SIZE] PID_KERNEL_ALIGN;
+	float velocityDesired[PID_KERNEL_SIZE] PID_KERNEL_ALIGN;
+
+	// outputs
+	float torque[PID_KERNEL_SIZE] PID_KERNEL_ALIGN;
+	float positionError[PID_KERNEL_SIZE] PID_KERNEL_ALIGN; // after capping
+	float velocityError[PID_KERNEL_SIZE] PID_KERNEL_ALIGN; // after capping
+
+	PIDKernelIO() { clear(); }
+	void clear();
+};
+
+inline size_t pidKernelLane(size_t armIndex, size_t jointIndex) {
+	return armIndex * PID_KERNEL_LANES_PER_ARM + jointIndex;
+}
+
+// the new device skips the NO_CONNECTION joint index in its motor lists
+inline size_t pidKernelLaneForMotor(size_t armIndex, size_t motorIndex) {
+	return pidKernelLane(armIndex, motorIndex < 3 ? motorIndex : motorIndex + 1);
+}
+
+/**
+ * Runs one PID step over every lane.
+ * tau = kp * err + ki * integral(err) + kd * (vel_d - vel)
+ * If resetIntegral is true, the integral of the active lanes is zeroed instead of accumulated.
+ * Returns a bitmask (bit i = lane i) of active lanes whose position error was capped.
+ */
+unsigned int pidKernelApply(const PIDKernelGains& gains, PIDKernelState& state, PIDKernelIO& io, float dt, bool resetIntegral);
+
+#endif /* PID_KERNEL_H_ */
@@ -0,0 +1,105 @@
+/*
+ * flight_recorder.h
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: agent
+ */
+
+#ifndef FLIGHT_RECORDER_H_
+#define FLIGHT_RECORDER_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string>
+#include <vector>
+
+#include "DS0.h"
+#include "DS1.h"
+#include "USB_init.h"
+#include "get_USB_packet.h"
+
+/*
+ * Flight recorder and deterministic replay of the rt loop.
+ *
+ * With --record-file, every servo loop's inputs and outputs go to a file:
+ * the loop clock, the raw USB packet read from each board, the master
+ * command getRcvdParams() delivered, and the raw packet written to each board.
+ * The rt thread only copies the loop into a ring; a low priority thread writes
+ * it out.
+ *
+ * With --replay-file, r2_control runs the same loop (stateMachine,
+ * updateDeviceState, controlRaven and the Controller path) on a recording
+ * instead of the hardware and the network: the USB reads return the recorded
+ * packets, getRcvdParams() is replaced by the recorded command, and the loop
+ * clock (LoopClock, and ros::Time) is the recorded time. There is no sleep
+ * between loops, so it runs as fast as the loop does. Every packet written is
+ * compared with the recorded one and the DAC differences are reported at the
+ * end; r2_control exits with 1 if there were any.
+ *
+ * The recording has to start with r2_control, and the replay needs the same
+ * parameters (gains, --arm, etc.) for the results to match. ROS commands and
+ * console input are not recorded.
+ */
+
+#define FLIGHT_RECORD_MAGIC "R2FLIGHT"
+#define FLIGHT_RECORD_VERSION 1
+// read_len/write_len of a board that wasn't read/written in the loop
+#define FLIGHT_NOT_CALLED (-0x8000)
+
+struct FlightBoard {
+	int16_t read_len;           // what usb_read returned
+	int16_t write_len;
+	uint8_t read[IN_LENGTH];
+	uint8_t write[OUT_LENGTH];
+};
+
+struct FlightLoop {
+	uint64_t loop;              // gTime
+	int64_t stamp;              // LoopClock, ns
+	uint8_t rcvd;               // getRcvdParams() returned true; params is only set then
+	struct param_pass params;
+	struct FlightBoard boards[MAX_MECH];
+};
+
+struct FlightHeader {
+	char magic[8];
+	uint32_t version;
+	uint32_t loop_size;         // sizeof(FlightLoop), which has to match to replay
+	uint32_t num_boards;
+	int32_t serials[MAX_MECH];  // board order of FlightLoop::boards
+};
+
+/************************ recording ************************/
+
+// After USBInit, before the rt thread starts
+bool flightRecorderStart(const std::string& filename);
+// Writes out what is queued
+void flightRecorderStop();
+
+// Called from the rt thread. Never block; do nothing unless recording.
+void flightRecordLoopBegin(unsigned long loop);
+void flightRecordUsbRead(int id, const void* buffer, int result);
+void flightRecordUsbWrite(int id, const void* buffer, int result);
+void flightRecordRcvdParams(bool rcvd, const struct param_pass* params);
+void flightRecordLoopEnd();
+
+/************************ replay ************************/
+
+bool replayOpen(const std::string& filename);
+bool replaying();
+
+// The boards of the recording, for USBInit
+void replayBoardSerials(std::vector<int>& serials);
+
+// Called from the rt thread at the top of each loop: loads the next recorded
+// loop and sets the loop clock. False at the end of the recording.
+bool replayNextLoop();
+
+int replayUsbRead(int id, void* buffer, size_t len);
+int replayUsbWrite(int id, const void* buffer, size_t len);
+bool replayRcvdParams(struct param_pass* params);
+
+// Prints the comparison; returns the number of loops whose output differed
+unsigned long replayReport();
+
+#endif /* FLIGHT_RECORDER_H_ */
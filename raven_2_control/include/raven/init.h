@@ -11,6 +11,7 @@
 #include "fwd_cable_coupling.h"
 #include "motor.h"
 #include "USB_init.h"
+#include "saveload.h"
 
 #define JOINT_ENABLED    1
 
@@ -25,6 +26,10 @@ void initDOFs(struct device *device0);
 
 /// Get ravengains from ROS parameter server.
 int init_ravengains(ros::NodeHandle n, struct device *device0);
+/// Read the gains from the parameter server; false (and zero gains) if they aren't all there
+bool fetch_ravengains(ros::NodeHandle n, RavenGains& gains);
+/// Set the gains of the arms in device0
+void apply_ravengains(const RavenGains& gains, struct device *device0);
 
 /// set the starting xyz coordinate (pos_d = pos)
 void setStartXYZ(struct device *device0);
@@ -0,0 +1,62 @@
+/*
+ * batch_kinematics.h
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: agent
+ */
+
+#ifndef BATCH_KINEMATICS_H_
+#define BATCH_KINEMATICS_H_
+
+#include <raven/kinematics/kinematics.h>
+#include <raven/state/arm.h>
+
+#include <vector>
+
+/*
+ * Forward and inverse kinematics over many poses or joint vectors for one arm,
+ * for planners and workspace analysis rather than the rt loop.
+ * The work is split over worker threads, each solving on its own clone of the
+ * prototype arm, so the prototype (and the live device) is never modified.
+ * Joint vectors are in the arm's joint order, as in Arm::jointPositionVector().
+ */
+
+struct BatchInverseKinematicsResult {
+	std::vector<Eigen::VectorXf> joints;
+	std::vector<unsigned char> valid;
+	std::vector<unsigned int> jointsOutsideLimits; // InverseKinematicsReport::jointsOutsideLimits()
+
+	size_t size() const { return valid.size(); }
+	void resize(size_t n);
+	size_t numValid() const;
+};
+
+class BatchKinematics {
+private:
+	ArmPtr prototype_;
+	size_t numThreads_;
+	InverseKinematicsOptions options_;
+
+	void inverseRange(const std::vector<btTransform>& poses, const std::vector<float>& grasps,
+			BatchInverseKinematicsResult& result, size_t begin, size_t end) const;
+	void forwardRange(const std::vector<Eigen::VectorXf>& joints, std::vector<btTransform>& poses,
+			size_t begin, size_t end) const;
+	size_t threadsFor(size_t numItems) const;
+public:
+	/* numThreads == 0 uses one thread per core */
+	BatchKinematics(ArmConstPtr prototype, size_t numThreads=0);
+
+	size_t numThreads() const { return numThreads_; }
+	void setNumThreads(size_t numThreads);
+
+	const InverseKinematicsOptions& options() const { return options_; }
+	void setOptions(const InverseKinematicsOptions& options);
+
+	/* grasps is either empty (use the prototype's grasp) or one per pose */
+	void inverse(const std::vector<btTransform>& poses, const std::vector<float>& grasps, BatchInverseKinematicsResult& result) const;
+	void inverse(const std::vector<btTransform>& poses, BatchInverseKinematicsResult& result) const;
+
+	void forward(const std::vector<Eigen::VectorXf>& joints, std::vector<btTransform>& poses) const;
+};
+
+#endif /* BATCH_KINEMATICS_H_ */
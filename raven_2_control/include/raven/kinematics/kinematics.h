@@ -24,6 +24,9 @@
 
 class Arm;
 
+#define KINEMATICS_MAX_ARMS 2
+#define KINEMATICS_DEFAULT_INCREMENTAL_THRESHOLD 0.1f
+
 class InverseKinematicsOptions {
 	friend class KinematicSolver;
 private:
@@ -32,8 +35,14 @@ private:
 
 	bool truncateJointDifferences_;
 	std::map<Joint::IdType,float> maxJointDifferences_;
+
+	bool incremental_;
+	float incrementalThreshold_;
+
+	bool verbose_;
 public:
-	InverseKinematicsOptions() : checkJointLimits_(true), truncateJointsAtLimits_(true), truncateJointDifferences_(false) {}
+	InverseKinematicsOptions() : checkJointLimits_(true), truncateJointsAtLimits_(true), truncateJointDifferences_(false),
+			incremental_(false), incrementalThreshold_(KINEMATICS_DEFAULT_INCREMENTAL_THRESHOLD), verbose_(true) {}
 
 	bool checkJointLimits() const;
 	void setCheckJointLimits(bool on);
@@ -52,25 +61,77 @@ public:
 
 	void clearMaxJointDifference(Joint::IdType type);
 	void clearMaxJointDifferences();
+
+	/*
+	 * Incremental mode solves only the elbow branch of the arm's previous
+	 * solution, and only falls back to solving both branches if that one
+	 * is out of limits or any of shoulder/elbow/roll jumps more than the
+	 * threshold (rad).
+	 */
+	bool incremental() const;
+	void setIncremental(bool on);
+
+	float incrementalThreshold() const;
+	void setIncrementalThreshold(float threshold);
+
+	/* Print the validity distances of failed solves (off for batch solves) */
+	bool verbose() const;
+	void setVerbose(bool on);
 };
 
+inline unsigned int jointLimitBit(Joint::IdType joint) { return 1u << joint.value(); }
+
 class InverseKinematicsReport {
 	friend class KinematicSolver;
 private:
 	bool success_;
+	bool incremental_;
+	unsigned int jointsOutsideLimits_;
+
+	void setLimit(Joint::IdType joint, float validity);
 public:
 	InverseKinematicsReport();
 	virtual ~InverseKinematicsReport() {}
 
 	bool success() const { return success_; }
+	bool incremental() const { return incremental_; } // solved from the previous branch alone
+
+	/* jointLimitBit() of every joint that was outside its limits in a failed solve */
+	unsigned int jointsOutsideLimits() const { return jointsOutsideLimits_; }
+	bool outsideLimits(Joint::IdType joint) const { return jointsOutsideLimits_ & jointLimitBit(joint); }
 };
 POINTER_TYPES(InverseKinematicsReport)
 
+/* Elbow branch and joints of an arm's last inverse() solution. An aggregate, so it can be thread-local */
+struct InverseKinematicsWarmStart {
+	int branch; // -1 if there is no previous solution
+	float ths;
+	float the;
+	float thr;
+
+	void set(int b, float s, float e, float r) { branch = b; ths = s; the = e; thr = r; }
+};
+
+struct InverseKinematicsStats {
+	unsigned long hits;       // incremental solves that kept the previous branch
+	unsigned long misses;     // incremental solves that fell back to both branches
+	unsigned long fullSolves; // solves of both branches, including misses
+	double incrementalTime;   // seconds spent in hits
+	double fullTime;          // seconds spent in full solves
+
+	InverseKinematicsStats() : hits(0), misses(0), fullSolves(0), incrementalTime(0), fullTime(0) {}
+
+	double hitRate() const;
+	double timeSaved() const; // seconds, estimated from the average full solve time
+	void log() const;
+};
+
 class KinematicSolver;
 typedef boost::shared_ptr<KinematicSolver> KinematicSolverPtr;
 
 class KinematicSolver {
 	friend class Arm;
+	friend class BatchKinematics;
 private:
 	Arm* arm_;
 
@@ -83,7 +144,7 @@ private:
 	InverseKinematicsReportPtr invKinReport_;
 	ros::Time invKinTimestamp_;
 
-	virtual InverseKinematicsReportPtr internalInverseSoln(const btTransform& pose, Arm* soln,const InverseKinematicsOptions& options) const;
+	virtual InverseKinematicsReportPtr internalInverseSoln(const btTransform& pose, Arm* soln,const InverseKinematicsOptions& options,InverseKinematicsWarmStart* warm) const;
 public:
 	KinematicSolver(Arm* arm);
 	virtual void cloneInto(KinematicSolverPtr& other,Arm* arm) const;
@@ -99,6 +160,11 @@ public:
 	InverseKinematicsReportPtr inverseSoln(const btTransform& pose, boost::shared_ptr<Arm>& soln) const;
 	virtual InverseKinematicsReportPtr inverseSoln(const btTransform& pose, boost::shared_ptr<Arm>& soln,const InverseKinematicsOptions& options) const;
 
+	// totals over every thread, also exported as the r2_ik_* metrics
+	static InverseKinematicsStats incrementalStats();
+	// forgets the calling thread's previous solutions
+	static void resetIncrementalState();
+
 	Eigen::VectorXf jointVector() const { return jointPositionVector(); }
 	Eigen::VectorXf jointPositionVector() const;
 	Eigen::VectorXf jointVelocityVector() const;
@@ -0,0 +1,45 @@
+/*
+ * latency.h
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: agent
+ */
+
+#ifndef LATENCY_H_
+#define LATENCY_H_
+
+#include "DS0.h"
+
+/*
+ * End-to-end latency of the servo loop, measured from stamps carried with the
+ * data rather than from per-stage timers:
+ *
+ *   encoder -> DAC  mechanism::enc_stamp, set by getUSBPacket when the encoder
+ *                   packet is read, to the write of that board's DAC packet
+ *   master -> DAC   param_pass::master_rx, the kernel receive time of the master
+ *                   packet, carried by teleopIntoDS1, getRcvdParams and
+ *                   updateDeviceState (robot_device::param_rx) to the first DAC
+ *                   write of that command, identified by param_pass::seq
+ *
+ * Both go to the r2_encoder_to_dac_seconds and r2_master_to_dac_seconds
+ * histograms. Commands that were replaced in DS1 before any DAC write carried
+ * them show up as gaps in the sequence and are counted.
+ *
+ * --latency-bench keeps every sample for a number of seconds, then prints the
+ * distributions and r2_control exits. --latency-bench-load adds threads that
+ * keep the CPUs and the cache busy. No hardware is needed:
+ *   rosrun raven_2_control r2_control --sim-usb --no-console --latency-bench 30 --latency-bench-load 4 &
+ *   rosrun raven_2_control teleop_sim --rate 1000 --duration 30
+ */
+
+// Called from the rt thread after each board's DAC packet is written. Never blocks.
+void latencyRecordDacWrite(const struct robot_device* device0, const struct mechanism* mech);
+
+// Before the rt thread starts
+void latencyBenchStart(float seconds, int loadThreads);
+// Called from the rt thread every loop; true once the bench has run for its time
+bool latencyBenchDone();
+// Stops the load threads and prints the distributions; nothing unless benchmarking
+void latencyBenchReport();
+
+#endif /* LATENCY_H_ */
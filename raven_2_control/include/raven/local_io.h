@@ -14,14 +14,16 @@
 #include "defines.h"
 #include "fifo.h"
 #include "USB_init.h"
+#include "network_layer.h"
 
 int initLocalioData(void);
 
 // update controller state w/ toolkit input
-void teleopIntoDS1(struct u_struct*);
+// rx_stamp is the kernel receive time of the packet, used for latency reporting (may be NULL)
+void teleopIntoDS1(struct u_struct*,const struct timespec* rx_stamp=NULL);
 
 // fifo handler to recv command data
-int recieveUserspace(void *u,int size);
+int recieveUserspace(void *u,int size,const struct timespec* rx_stamp=NULL);
 
 void writeUpdate(struct param_pass*);
 
@@ -33,6 +35,9 @@ bool getRcvdParams(struct param_pass*);
 
 bool peekRcvdParams(struct param_pass*);
 
+// Receive times of the master packets in the last getRcvdParams() copies
+bool getRcvdTeleopStamp(struct TeleopRxStamp*);
+
 void updateMasterRelativeOrigin(struct device *device0);
 
 //int init_ravenstate_publishing(ros::NodeHandle &n);
@@ -17,6 +17,21 @@ int log_err_throttle(float interval,const char* fmt,...);
 
 int err_msg(const char* fmt,...);
 
+/*
+ * Deferred logging. After log_start_async(), the functions above only copy
+ * the format and the raw arguments (and the text of %s arguments) into
+ * a lock-free ring owned by the calling thread. A background thread formats
+ * and writes them, in the order they were logged. Logging never blocks on I/O;
+ * a thread whose ring is full loses the message, and the losses are reported.
+ * Before log_start_async() and after log_stop_async(), messages are written
+ * on the calling thread as before.
+ */
+void log_start_async();
+void log_stop_async();    // writes out everything queued first
+// Sets up the calling thread's ring now rather than on its first message
+void log_prepare_thread();
+unsigned int log_dropped();
+
 
 //#define USE_TRACER
 #define USE_TRACER_VERBOSE
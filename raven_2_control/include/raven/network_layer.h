@@ -6,5 +6,96 @@
  *
  *********************************************/
 
- extern void* network_process(void* );
+#ifndef NETWORK_LAYER_H
+#define NETWORK_LAYER_H
 
+#include <time.h>
+
+// Max number of packets pulled off the socket per recvmmsg call
+#define NET_RX_BATCH 16
+// How long the receive thread sleeps on an empty socket before checking for shutdown
+#define NET_RX_POLL_MSEC 500
+// Max number of feedback packets handed to the socket per sendmmsg call
+#define NET_TX_BATCH 16
+
+struct robot_device;
+
+// Kernel receive times of the master packets merged into one DS1 update
+struct TeleopRxStamp {
+    unsigned int sequence;   // newest packet applied
+    unsigned int packets;    // packets merged since the last DAC write
+    struct timespec oldest;  // receive time of the first merged packet
+    struct timespec newest;  // receive time of the last merged packet
+};
+
+/*
+ * Single-producer/single-consumer ring used to hand records between the
+ * receive, rt and network logging threads.
+ * N must be a power of two.  push() never blocks; a full ring drops the record.
+ */
+template<typename T, unsigned int N>
+struct NetworkRing
+{
+    T items[N];
+    volatile unsigned int head;
+    volatile unsigned int tail;
+    volatile unsigned int dropped;
+
+    NetworkRing() : head(0), tail(0), dropped(0) {}
+
+    bool push(const T& item)
+    {
+        unsigned int h = head;
+        if (h - tail >= N)
+        {
+            __sync_fetch_and_add(&dropped, 1);
+            return false;
+        }
+        items[h & (N-1)] = item;
+        __sync_synchronize();
+        head = h + 1;
+        return true;
+    }
+
+    unsigned int size() const
+    {
+        return head - tail;
+    }
+
+    bool pop(T& item)
+    {
+        unsigned int t = tail;
+        if (t == head)
+            return false;
+        __sync_synchronize();
+        item = items[t & (N-1)];
+        __sync_synchronize();
+        tail = t + 1;
+        return true;
+    }
+};
+
+extern void* network_process(void* );
+
+struct u_struct;
+
+// Called from the rt thread once per servo cycle to play out the teleop jitter buffer
+void teleopJitterTick();
+
+// Called from the rt thread by getRcvdParams; takes the motion played out by
+// teleopJitterTick() since the last call. Never blocks.
+bool teleopJitterTake(struct u_struct& u, struct timespec& rx);
+
+// Called from the rt thread once per servo cycle; queues master feedback at --feedback-rate.
+// Never blocks.
+void networkQueueFeedback(const struct robot_device* device0);
+
+// Called after a master packet is applied to DS1, with its kernel receive time.
+// Never blocks.
+void networkRecordDS1Update(const struct timespec& rx);
+
+// Called from the rt thread after the DAC write that carried the packets in stamp.
+// Queues a latency record for the network logging thread; never blocks.
+void networkRecordDacWrite(const struct TeleopRxStamp& stamp);
+
+#endif
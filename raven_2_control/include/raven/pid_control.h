@@ -22,6 +22,7 @@
 
 //Function Prototypes
 void mpos_PD_control(struct DOF *joint, int reset_I=0);
+void mpos_PD_control_all(struct device *device0, int reset_I=0);
 float jvel_PI_control(struct DOF*, int);
 
 #endif // PD_CONTROL_H
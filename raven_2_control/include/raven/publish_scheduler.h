@@ -0,0 +1,228 @@
+/*
+ * publish_scheduler.h
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: agent
+ */
+
+#ifndef PUBLISH_SCHEDULER_H_
+#define PUBLISH_SCHEDULER_H_
+
+#include "struct.h"
+#include "network_layer.h"
+
+#include <time.h>
+#include <string>
+#include <vector>
+#include <boost/function.hpp>
+#include <boost/shared_ptr.hpp>
+#include <tf/transform_datatypes.h>
+
+#include <geometry_msgs/PoseArray.h>
+#include <geometry_msgs/PoseStamped.h>
+#include <sensor_msgs/JointState.h>
+#include <raven_2_msgs/RavenState.h>
+#include <raven_2_msgs/RavenArrayState.h>
+
+// Samples kept for the 1000 Hz state topic between batches; power of two
+#define PUBLISH_SAMPLE_RING_SIZE 64
+
+/*
+ * Raw state copied by the rt thread once per servo cycle. Plain data, so taking
+ * a snapshot is a memcpy: no ros calls, no allocation.
+ */
+struct PublishSnapshot {
+	struct robot_device device;
+	int seq;
+	struct timespec stamp;
+	u_08 runlevel;
+	u_08 sublevel;
+	bool pedal_down;      // RunLevel::getPedal()
+	bool runlevel_pedal;  // RunLevel::isPedalDown()
+	bool estop;
+	t_controlmode controlMode;
+	btVector3 master_position[2];
+	btMatrix3x3 master_orientation[2];
+	btVector3 master_raw_position[2];
+	btMatrix3x3 master_raw_orientation[2];
+};
+
+/*
+ * Messages derived from one snapshot. A frame is built at most once per
+ * snapshot, by whichever publisher asks for it first, and shared read-only by
+ * the rest. The messages are published by pointer, so intraprocess subscribers
+ * get them without a copy.
+ */
+struct PublishFrame {
+	PublishSnapshot snapshot;
+	std_msgs::Header header;
+
+	raven_2_msgs::RavenStatePtr raven_state;
+	raven_2_msgs::RavenArrayStatePtr array_state;
+	sensor_msgs::JointStatePtr joint_state;
+
+	int numArms;
+	int armIds[MAX_MECH_PER_DEV];
+	geometry_msgs::PoseArrayPtr tool_poses;           // in armIds order
+	geometry_msgs::PoseArrayPtr command_poses;
+	geometry_msgs::PoseStampedPtr tool_pose[MAX_MECH_PER_DEV];
+	geometry_msgs::PoseStampedPtr command_pose[MAX_MECH_PER_DEV];
+	geometry_msgs::PoseStampedPtr master_pose[MAX_MECH_PER_DEV];
+	geometry_msgs::PoseStampedPtr master_pose_raw[MAX_MECH_PER_DEV];
+};
+
+/*
+ * Count of message buffers created or grown by the publishers. It should stop
+ * moving once every pool has filled; the scheduler warns if it doesn't.
+ */
+unsigned int publishAllocations();
+void publishAllocated();
+
+/*
+ * A message handed to ros::Publisher::publish() by pointer may still be held
+ * by a subscriber queue after the call returns, so it can't be overwritten.
+ * get() hands out a message nobody else holds and only allocates when they are
+ * all in use; in steady state that is never. One thread at a time.
+ */
+template<typename T>
+class MessagePool {
+	std::vector<boost::shared_ptr<T> > items_;
+public:
+	boost::shared_ptr<T> get() {
+		for (size_t i=0;i<items_.size();i++) {
+			if (items_[i].unique()) {
+				return items_[i];
+			}
+		}
+		items_.push_back(boost::shared_ptr<T>(new T()));
+		publishAllocated();
+		return items_.back();
+	}
+	// Lets go of msg's old message first, so it can be handed straight back
+	void renew(boost::shared_ptr<T>& msg) {
+		msg.reset();
+		msg = get();
+	}
+	size_t size() const { return items_.size(); }
+};
+
+/*
+ * Message arrays are sized from the device topology the first time a pooled
+ * message is filled and only overwritten after that. messageSlot() is element
+ * i, growing the array if it is short; messageResize() sets the length outright,
+ * to presize an array or to drop what a smaller topology left behind.
+ */
+template<typename V>
+inline typename V::reference
+messageSlot(V& v, size_t i) {
+	if (i >= v.size()) {
+		v.resize(i+1);
+		publishAllocated();
+	}
+	return v[i];
+}
+
+template<typename V>
+inline void
+messageResize(V& v, size_t n) {
+	if (v.size() != n) {
+		if (n > v.size()) {
+			publishAllocated();
+		}
+		v.resize(n);
+	}
+}
+
+typedef boost::shared_ptr<const PublishFrame> PublishFrameConstPtr;
+
+// Fills in everything but frame.snapshot, taking messages from the pools. Defined with the publishers in ros_io.cpp
+void buildPublishFrame(PublishFrame& frame);
+
+/*
+ * Latest-value handoff from one writer to one reader, triple buffered like the
+ * old control input. The writer fills back() and calls publish(); the reader
+ * calls acquire() and, if it returns true, reads front(). Neither side blocks.
+ */
+template<typename T>
+struct LatestBuffer {
+	T items[3];
+	volatile unsigned int state; // back | middle << 2 | front << 4 | fresh
+
+	LatestBuffer() : state(0 | (1 << 2) | (2 << 4)) {}
+
+	T& back() { return items[state & 3]; }
+	const T& front() const { return items[(state >> 4) & 3]; }
+
+	void publish() {
+		unsigned int s, n;
+		do {
+			s = state;
+			n = ((s >> 2) & 3) | ((s & 3) << 2) | (s & (3 << 4)) | 0x40;
+		} while (!__sync_bool_compare_and_swap(&state, s, n));
+	}
+
+	bool acquire() {
+		unsigned int s, n;
+		do {
+			s = state;
+			if (!(s & 0x40)) {
+				return false;
+			}
+			n = (s & 3) | (((s >> 4) & 3) << 2) | (((s >> 2) & 3) << 4);
+		} while (!__sync_bool_compare_and_swap(&state, s, n));
+		return true;
+	}
+};
+
+/*
+ * Runs the ros publishers off the rt thread.
+ *
+ * The rt thread calls capture() once per cycle, which copies the device state
+ * into a lock-free buffer and returns. Each topic gets its own low priority
+ * thread that wakes at the topic's rate, picks up the newest frame and
+ * publishes it, so a slow or added topic costs the rt loop nothing. A topic
+ * thread that misses its slot skips it and counts it as dropped.
+ */
+class PublishScheduler {
+public:
+	typedef boost::function<void (const PublishFrame&)> FrameFunction;
+	typedef boost::function<void ()> SampleFunction;
+
+	struct Topic {
+		std::string name;
+		double rate;
+		FrameFunction publishFrame;
+		SampleFunction publishSamples;
+		volatile unsigned int published;
+		volatile unsigned int dropped;
+	};
+
+private:
+	static LatestBuffer<PublishSnapshot> LATEST;
+	static NetworkRing<PublishSnapshot,PUBLISH_SAMPLE_RING_SIZE> SAMPLES;
+	static std::vector<Topic*> TOPICS;
+	static volatile bool RUNNING;
+
+	static void run(Topic* topic);
+
+public:
+	// Called from the rt thread once per servo cycle. Never blocks.
+	static void capture(struct robot_device* device0);
+
+	// Newest frame, built from the newest snapshot if it hasn't been yet. NULL before the first capture().
+	static PublishFrameConstPtr latestFrame();
+
+	// Every snapshot since the last call, oldest first. One caller only.
+	static bool popSample(PublishSnapshot& sample);
+	static unsigned int samplesQueued() { return SAMPLES.size(); }
+	static unsigned int samplesDropped() { return SAMPLES.dropped; }
+
+	// rate in Hz; a rate <= 0 leaves the topic off. Call before start().
+	static void addTopic(const std::string& name, double rate, FrameFunction publish);
+	static void addSampleTopic(const std::string& name, double rate, SampleFunction publish);
+
+	static void start();
+	static void stop();
+};
+
+#endif /* PUBLISH_SCHEDULER_H_ */
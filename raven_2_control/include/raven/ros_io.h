@@ -15,7 +15,10 @@
 #include "USB_init.h"
 #include "local_io.h"
 
+// Subscribers and publishers; the rt loop's spinOnce() runs their callbacks
 void init_ros_topics(ros::NodeHandle &n,struct robot_device* device0);
+// Services, trajectories and the nodelet manager, on spinners of their own
+void init_ros_services(ros::NodeHandle &n);
 void publish_ros(struct robot_device* dev,param_pass currParams);
 
 #include <raven_2_msgs/RavenCommand.h>
@@ -56,6 +56,7 @@ public:
 
 	DeviceType type_;
 	ros::Time timestamp_;
+	struct timespec updateBegan_;  // by beginUpdate(), for the pipeline's encoder stage
 
 	ArmList arms_;
 	ArmList disabledArms_;
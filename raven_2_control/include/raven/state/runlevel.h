@@ -95,7 +95,7 @@ private:
 	static std::map<std::string,int> NAMED_INTERVALS;
 	static boost::thread_specific_ptr< std::map<std::string,CountInfo> > NAMED_COUNTS;
 
-	static boost::thread_specific_ptr<int> LOOP_NUMBER;
+	static __thread int LOOP_NUMBER;  // a plain int so the per-call-site counts below can be inlined
 	static int MAIN_LOOP_NUMBER;
 
 	static boost::thread_specific_ptr<timespec> LOOP_TIME;
@@ -104,7 +104,8 @@ private:
 	static boost::thread_specific_ptr<timespec> LOOP_TIME_DELTA;
 	static timespec MAIN_LOOP_TIME_DELTA;
 
-	static int internalGet();
+	static inline int internalGet() { return LOOP_NUMBER; }
+	static void internalInitTime();
 	static timespec internalGetTime();
 	static timespec internalGetTimeDelta();
 
@@ -146,7 +147,7 @@ public:
 	static int getNamedCount(const std::string& name);
 
 	static bool once(const std::string& name);
-#define LOOP_NUMBER_ONCE(file,line) if (::LoopNumber::once(STRINGIFY(file) STRINGIFY(line))) //use: LOOP_NUMBER_ONCE(__FILE__,__LINE__) { }
+#define LOOP_NUMBER_ONCE(file,line) if (::LoopNumber::once(LOOP_NUMBER_SITE)) //use: LOOP_NUMBER_ONCE(__FILE__,__LINE__) { }
 
 	static bool only(const std::string& name, int limit);
 	static bool onlyAfter(const std::string& name, int min);
@@ -157,5 +158,40 @@ public:
 	static bool onlyEveryAfter(const std::string& name, int min);
 	static bool onlyEveryAfter(const std::string& name, int min, int interval);
 
+	/*
+	 * The same counts kept in a thread-local static at the call site instead of
+	 * a map keyed by name, so they cost an increment and a branch. Pass
+	 * LOOP_NUMBER_SITE: LoopNumber::onlyEvery(LOOP_NUMBER_SITE,4,5000).
+	 * A zeroed CountInfo has not been counted yet.
+	 */
+	static inline int count(CountInfo& site) {
+		int loop = LOOP_NUMBER;
+		if (__builtin_expect(site.count == 0,0)) {
+			site.count = 1;
+			site.loop = loop;
+		} else if (site.loop != loop) {
+			site.count++;
+			site.loop = loop;
+		}
+		return site.count;
+	}
+	static inline bool once(CountInfo& site) { return count(site) <= 1; }
+	static inline bool only(CountInfo& site, int limit) { return count(site) <= limit; }
+	static inline bool onlyAfter(CountInfo& site, int min) { return count(site) > min; }
+	static inline bool onlyEvery(CountInfo& site, int limit, int interval) {
+		if (interval == -1 || LOOP_NUMBER % interval != 0) {
+			return false;
+		}
+		return only(site,limit);
+	}
+	static inline bool onlyEveryAfter(CountInfo& site, int min, int interval) {
+		if (interval == -1 || LOOP_NUMBER % interval != 0) {
+			return false;
+		}
+		return onlyAfter(site,min);
+	}
 };
+
+// A count private to the call site (and thread) it appears at
+#define LOOP_NUMBER_SITE (*({ static __thread ::LoopNumber::CountInfo _loop_number_site_ = {0,0}; &_loop_number_site_; }))
 #endif /* RUNLEVEL_H_ */
@@ -0,0 +1,70 @@
+/*
+ * update_pipeline.h
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: agent
+ */
+
+#ifndef UPDATE_PIPELINE_H_
+#define UPDATE_PIPELINE_H_
+
+#include <stdint.h>
+#include <time.h>
+#include <string>
+
+#include <raven/state/arm.h>
+
+// Arms timed separately; any beyond share the last slot
+#define UPDATE_PIPELINE_MAX_ARMS 4
+
+/*
+ * The state update of one tick, as explicit stages run in order for each arm:
+ *
+ *   encoders        motor values set by the caller between begin() and finish()
+ *   state filter    the arm's state motor filter
+ *   control filter  the arm's control motor filter
+ *   coupling        motors -> joints, or joints -> motors if the joints were set
+ *
+ * Between begin() and finish() the arms hold their updates, so a motor or joint
+ * setter only marks its arm dirty instead of recoupling the arm. finish() runs
+ * coupling once for each arm that was marked, and not at all for the others.
+ * Forward kinematics is not a stage: nothing reads a pose from the arm, so
+ * its consumers compute it when they need it.
+ *
+ * Every stage is timed, per arm and in total, for the rt thread to read back.
+ */
+class UpdatePipeline {
+public:
+	enum Stage { ENCODERS, STATE_FILTER, CONTROL_FILTER, COUPLING, NUM_STAGES };
+
+	struct StageStats {
+		int64_t last;          // ns, over all arms, in the last tick
+		int64_t max;
+		int64_t total;
+		unsigned long ticks;
+		unsigned long runs;    // arm runs; fewer than ticks * arms when arms were clean
+	};
+
+	// Called after each stage of each arm, e.g. to copy out filter timing
+	typedef void (*StageObserver)(size_t armIndex, const ArmPtr& arm, Stage stage, int64_t nsec);
+
+private:
+	static StageStats STATS[NUM_STAGES];
+	static int64_t ARM_LAST[UPDATE_PIPELINE_MAX_ARMS][NUM_STAGES];
+
+	static void record(size_t armIndex, Stage stage, int64_t nsec);
+
+	UpdatePipeline() {}
+public:
+	static void begin(const ArmList& arms, struct timespec& began);
+	// Returns whether any arm changed
+	static bool finish(const ArmList& arms, const struct timespec& began, StageObserver observer=NULL);
+
+	static const char* stageName(Stage stage);
+	static const StageStats& stats(Stage stage) { return STATS[stage]; }
+	static int64_t armStageTime(size_t armIndex, Stage stage);
+	static void resetStats();
+	static std::string statsString();
+};
+
+#endif /* UPDATE_PIPELINE_H_ */
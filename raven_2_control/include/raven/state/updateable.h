@@ -18,6 +18,8 @@
 #include <stdexcept>
 
 #include "log.h"
+#include <raven/util/trace.h>
+#include <raven/util/timing.h>
 
 class Updateable;
 
@@ -43,6 +45,7 @@ public:
 
 	inline bool update() {
 		TRACER_ENTER_SCOPE_OF(this,"update()");
+		TRACE_SCOPE(TRACE_STATE,"Updateable::update");
 		bool ret = true;
 		if (ROS_UNLIKELY(useInternalUpdate_)) {
 			ret = internalUpdate();
@@ -57,7 +60,7 @@ public:
 		return ret;
 	}
 
-	/*virtual*/ inline void updateTimestamp(ros::Time t = ros::Time::now()) {
+	/*virtual*/ inline void updateTimestamp(ros::Time t = LoopClock::now()) {
 		timestamp_ = t;
 		if (isImmediateUpdate()) {
 			update();
@@ -103,6 +106,7 @@ protected:
 
 	/*virtual*/ inline void notify(Updateable* sender) {
 		TRACER_ENTER_SCOPE_OF(this,"notify() from %s@%p",typeid(*sender).name(),sender);
+		TRACE_SCOPE(TRACE_STATE,"Updateable::notify");
 		if (sender->getUpdateableTimestamp() <= getUpdateableTimestamp()) {
 			return;
 		}
@@ -0,0 +1,80 @@
+/*
+ * state_message.h
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: agent
+ */
+
+#ifndef STATE_MESSAGE_H_
+#define STATE_MESSAGE_H_
+
+#include "struct.h"
+#include "utils.h"
+#include "publish_scheduler.h"
+
+#include <string>
+#include <tf/transform_datatypes.h>
+
+#include <geometry_msgs/Pose.h>
+#include <raven_2_msgs/JointCommand.h>
+#include <raven_2_msgs/RavenState.h>
+#include <raven_2_msgs/RavenArrayState.h>
+
+/*
+ * Filling the raven_state and raven_array_state messages from a publish
+ * snapshot. The messages are filled in place through messageSlot() and
+ * messageResize(), so once their arrays have grown to the device topology
+ * refilling them doesn't allocate.
+ */
+
+// The last command for an arm's joint, if there is one
+typedef bool (*JointCommandLookup)(const std::string& arm_name,int joint_type,raven_2_msgs::JointCommand& cmd);
+
+// Everything but the header and master mode; commands may be NULL, for none
+void fillRavenState(raven_2_msgs::RavenState& raven_state,const PublishSnapshot& snapshot,JointCommandLookup commands);
+// The same state, one array per field
+void fillRavenArrayState(raven_2_msgs::RavenArrayState& array_state,const raven_2_msgs::RavenState& raven_state);
+
+float rosGraspFromMech(int armId,int grasp);
+void getRosArmType(const u_16& type, uint8_t& ros);
+
+inline geometry_msgs::Pose toRos(position pos,orientation ori,btMatrix3x3 transform=btMatrix3x3::getIdentity()) {
+	btQuaternion rot;
+	(toBt(ori.R) * transform).getRotation(rot);
+	geometry_msgs::Point p;
+	p.x = ((float)pos.x) / MICRON_PER_M;
+	p.y = ((float)pos.y) / MICRON_PER_M;
+	p.z = ((float)pos.z) / MICRON_PER_M;
+	geometry_msgs::Quaternion q;
+	rot.normalize();
+	q.x = rot.x();
+	q.y = rot.y();
+	q.z = rot.z();
+	q.w = rot.w();
+	geometry_msgs::Pose pose;
+	pose.position = p;
+	pose.orientation  = q;
+	return pose;
+}
+
+inline geometry_msgs::Pose toRos(const btTransform& pose,btMatrix3x3 transform=btMatrix3x3::getIdentity()) {
+	btMatrix3x3 rot_mat = pose.getBasis() * transform;
+	btQuaternion rot;
+	rot_mat.getRotation(rot);
+	geometry_msgs::Point p;
+	p.x = pose.getOrigin().x();
+	p.y = pose.getOrigin().y();
+	p.z = pose.getOrigin().z();
+	geometry_msgs::Quaternion q;
+	rot.normalize();
+	q.x = rot.x();
+	q.y = rot.y();
+	q.z = rot.z();
+	q.w = rot.w();
+	geometry_msgs::Pose pose_msg;
+	pose_msg.position = p;
+	pose_msg.orientation  = q;
+	return pose_msg;
+}
+
+#endif /* STATE_MESSAGE_H_ */
@@ -0,0 +1,47 @@
+/*
+ * status_service.h
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: agent
+ */
+
+#ifndef STATUS_SERVICE_H_
+#define STATUS_SERVICE_H_
+
+#include <stdint.h>
+#include <string>
+
+/*
+ * Status of the running system, served as text on a local Unix socket so any
+ * number of terminals can watch it (rosrun raven_2_control r2_status) without
+ * the console thread.
+ *
+ * A client connects, optionally sends one request line, and gets one reply:
+ *   status   (or nothing) runlevel, modes, joints, timing, faults
+ *   timing   loop timing histograms only
+ *   faults   fault counters only
+ *   reset    clears the histograms
+ *
+ * The robot state comes from the publish scheduler's newest snapshot, so all
+ * of it is from the same servo cycle. The rt thread only bumps counters here.
+ * The fault counters and loop timing are also exported as metrics.
+ */
+
+enum StatusFault {
+	STATUS_FAULT_USB_READ,
+	STATUS_FAULT_USB_WRITE,
+	STATUS_FAULT_OVER_TIME,
+	STATUS_FAULT_OVERDRIVE,
+	NUM_STATUS_FAULTS
+};
+
+// Called from the rt thread at the end of each cycle. Never blocks.
+void statusRecordLoop(int64_t start_ns, int64_t end_ns);
+// Never blocks.
+void statusCountFault(StatusFault fault);
+
+// Starts the server thread; false if the socket can't be set up
+bool initStatusService(const std::string& path);
+void stopStatusService();
+
+#endif /* STATUS_SERVICE_H_ */
@@ -44,6 +44,7 @@ enum t_controlmode{
     multi_dof_sinusoid     = 7,
     joint_torque_control = 8,
     trajectory_control = 9,
+    motor_position_control = 10,
     LAST_TYPE
     } ;
 
@@ -0,0 +1,117 @@
+/*
+ * teleop_jitter_buffer.h
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: agent
+ */
+
+#ifndef TELEOP_JITTER_BUFFER_H_
+#define TELEOP_JITTER_BUFFER_H_
+
+#include <stdint.h>
+#include <time.h>
+
+#include "itp_teleoperation.h"
+#include "network_layer.h"
+
+#define TELEOP_JITTER_ARMS 2                 // arms in a u_struct
+#define TELEOP_JITTER_SIZE 64                // packets held for playout
+#define TELEOP_JITTER_TRANSIT_WINDOW 128     // packets used for the clock offset estimate
+#define TELEOP_JITTER_DEFAULT_MAX_DELAY 20000000 // ns
+#define TELEOP_JITTER_MAX_GAP 50000000       // ns; longer gaps between packets are not interpolated across
+#define TELEOP_JITTER_RESET_TRANSIT 1000000000 // ns; transit changes bigger than this mean the sender clock restarted
+
+/*
+ * Adaptive playout buffer for timestamped master packets.
+ *
+ * The network thread push()es packets with the master's send time and the kernel
+ * receive time. The rt thread calls tick() once per servo cycle, which plays the
+ * master motion out at
+ *   send time = now - (min transit + delay)
+ * interpolating positions linearly and orientations by slerp between packets.
+ * min transit is the smallest receive - send difference over the last
+ * TELEOP_JITTER_TRANSIT_WINDOW packets, which absorbs the clock offset between
+ * master and slave. delay tracks one packet interval (needed to have the next
+ * packet to interpolate towards) plus 3x the RFC 3550 interarrival jitter, capped
+ * at maxDelay, so a clean link adds only the packet interval.
+ *
+ * tick() emits the increment since the last tick as an ordinary u_struct, so the
+ * output is applied to DS1 like any other packet. Grasp increments are handed
+ * out once per packet reached, however many ticks a packet is held for. Once the newest packet
+ * has been played out, tick() returns false until more arrive, so the master
+ * connection timeout still works.
+ */
+class TeleopJitterBuffer {
+public:
+	struct Stats {
+		int64_t delay;     // current playout delay (ns)
+		int64_t jitter;    // interarrival jitter estimate (ns)
+		int64_t interval;  // master send interval estimate (ns)
+		int64_t transit;   // min receive - send (ns), includes the clock offset
+		unsigned int late; // packets that arrived after their playout time had passed
+		unsigned int resets;
+	};
+
+private:
+	struct Input {
+		struct u_struct u;
+		int64_t send;
+		struct timespec rx;
+	};
+
+	struct Entry {
+		int64_t send;
+		struct timespec rx;
+		struct u_struct u;                          // buttons, surgeon mode and orientation
+		double position[TELEOP_JITTER_ARMS][3];     // sum of the deltas up to and including this packet
+		int64_t grasp[TELEOP_JITTER_ARMS];          // sum of the grasp increments, likewise
+	};
+
+	NetworkRing<Input,256> input_;
+
+	int64_t maxDelay_;
+
+	Entry entries_[TELEOP_JITTER_SIZE];
+	unsigned int first_;
+	unsigned int count_;
+
+	int64_t transits_[TELEOP_JITTER_TRANSIT_WINDOW];
+	unsigned int numTransits_;
+	int64_t minTransit_;
+	int64_t lastTransit_;
+	int64_t jitter_;
+	int64_t interval_;
+	int64_t delay_;
+
+	double position_[TELEOP_JITTER_ARMS][3];        // position of the newest entry
+	int64_t emitted_[TELEOP_JITTER_ARMS][3];        // sum of the deltas handed out by tick()
+	int64_t grasp_[TELEOP_JITTER_ARMS];             // grasp of the newest entry
+	int64_t graspEmitted_[TELEOP_JITTER_ARMS];      // sum of the grasp increments handed out by tick()
+	int64_t playedUntil_;                           // send time of the last tick() output
+	bool playedNewest_;
+
+	unsigned int late_;
+	unsigned int resets_;
+
+	Entry& entry(unsigned int i) { return entries_[(first_ + i) % TELEOP_JITTER_SIZE]; }
+
+	void add(const Input& in);
+	void restart();
+
+public:
+	TeleopJitterBuffer(int64_t maxDelay=TELEOP_JITTER_DEFAULT_MAX_DELAY);
+
+	void setMaxDelay(int64_t maxDelay) { maxDelay_ = maxDelay; }
+	int64_t maxDelay() const { return maxDelay_; }
+
+	// network thread
+	bool push(const struct u_struct& u, int64_t sendTime, const struct timespec& rx);
+
+	// rt thread
+	bool tick(int64_t now, struct u_struct& out, struct timespec& rx);
+
+	// unsynchronized; approximate when called off the rt thread
+	Stats stats() const;
+};
+
+#endif /* TELEOP_JITTER_BUFFER_H_ */
@@ -0,0 +1,185 @@
+/*
+ * teleop_protocol.h
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: agent
+ */
+
+#ifndef TELEOP_PROTOCOL_H_
+#define TELEOP_PROTOCOL_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "itp_teleoperation.h"
+
+/*
+ * Versioned binary master->slave teleop packet.
+ *
+ * All fields are little-endian regardless of host byte order; doubles are IEEE 754.
+ *
+ * header (20 bytes)
+ *   uint32 magic            TELEOP_PROTOCOL_MAGIC ("RVT2")
+ *   uint8  version          TELEOP_PROTOCOL_VERSION
+ *   uint8  num_arms         1..TELEOP_MAX_ARMS
+ *   uint16 flags            TELEOP_FLAG_*
+ *   uint32 sequence         packet sequence number; 0 = reflect, as in u_struct
+ *   uint64 sender_time_ns   master clock at send time (any epoch, must be monotonic)
+ * arm (56 bytes) x num_arms
+ *   uint8  id               teleop arm id (0 gold, 1 green, as in u_struct)
+ *   uint8  buttons
+ *   uint16 reserved
+ *   uint32 sequence         sequence number of this arm's commands, counted per arm from 1
+ *   int32  delta[3]         position increment in microns
+ *   double rotation[4]      absolute orientation quaternion x,y,z,w
+ *   int32  grasp            +32767 = 100% closing torque, -32768 = 100% opening
+ * uint32 crc                CRC-32 (IEEE 802.3) of everything before it
+ *
+ * Each arm is its own command stream: an arm's commands are applied in the
+ * order of its own sequence numbers, so losing or reordering one arm's commands
+ * doesn't hold back the others. The packet sequence number is only used for
+ * reflection and the receive statistics.
+ *
+ * Legacy u_struct packets are still accepted; they never start with the magic
+ * and never have a v2 packet length.
+ *
+ * Slave->master feedback, sent to masters that speak v2 (legacy masters get a v_struct).
+ *
+ * header (36 bytes)
+ *   uint32 magic            TELEOP_FEEDBACK_MAGIC ("RVF2")
+ *   uint8  version          TELEOP_PROTOCOL_VERSION
+ *   uint8  num_arms         1..TELEOP_MAX_ARMS
+ *   uint8  runlevel
+ *   uint8  sublevel
+ *   uint32 sequence         feedback sequence number
+ *   uint32 master_sequence  newest master packet received
+ *   uint64 master_time_ns   sender_time_ns of that packet, echoed for round trip timing
+ *   uint32 hold_time_ns     time between receiving that packet and sending this one
+ *   uint64 slave_time_ns    slave clock when the state was sampled
+ * arm (16 bytes) x num_arms
+ *   uint8  id
+ *   uint8  surgeon_engaged
+ *   uint16 joint_flags      bit j = joint j of the arm is at a hard stop
+ *   float  force[3]         position error force estimate (N)
+ * uint32 crc
+ */
+
+#define TELEOP_PROTOCOL_MAGIC 0x32545652u // "RVT2"
+#define TELEOP_FEEDBACK_MAGIC 0x32465652u // "RVF2"
+#define TELEOP_PROTOCOL_VERSION 2
+
+#define TELEOP_MAX_ARMS 4
+
+#define TELEOP_FLAG_SURGEON_ENGAGED 0x0001
+
+#define TELEOP_HEADER_SIZE 20
+#define TELEOP_ARM_SIZE 56
+#define TELEOP_CRC_SIZE 4
+#define TELEOP_PACKET_SIZE(num_arms) (TELEOP_HEADER_SIZE + (num_arms) * TELEOP_ARM_SIZE + TELEOP_CRC_SIZE)
+#define TELEOP_MAX_PACKET_SIZE TELEOP_PACKET_SIZE(TELEOP_MAX_ARMS)
+
+#define TELEOP_FEEDBACK_HEADER_SIZE 36
+#define TELEOP_FEEDBACK_ARM_SIZE 16
+#define TELEOP_FEEDBACK_SIZE(num_arms) (TELEOP_FEEDBACK_HEADER_SIZE + (num_arms) * TELEOP_FEEDBACK_ARM_SIZE + TELEOP_CRC_SIZE)
+#define TELEOP_MAX_FEEDBACK_SIZE TELEOP_FEEDBACK_SIZE(TELEOP_MAX_ARMS)
+
+struct TeleopArmCommand {
+	uint8_t id;
+	uint8_t buttons;
+	uint32_t sequence;
+	int32_t delta[3];
+	double rotation[4];
+	int32_t grasp;
+};
+
+struct TeleopPacket {
+	uint32_t sequence;
+	uint64_t senderTime;
+	uint16_t flags;
+	uint8_t numArms;
+	TeleopArmCommand arms[TELEOP_MAX_ARMS];
+
+	bool surgeonEngaged() const { return flags & TELEOP_FLAG_SURGEON_ENGAGED; }
+};
+
+struct TeleopFeedbackArm {
+	uint8_t id;
+	uint8_t surgeonEngaged;
+	uint16_t jointFlags;
+	float force[3];
+};
+
+struct TeleopFeedbackPacket {
+	uint32_t sequence;
+	uint8_t runlevel;
+	uint8_t sublevel;
+	uint32_t masterSequence;
+	uint64_t masterTime;
+	uint32_t holdTime;
+	uint64_t slaveTime;
+	uint8_t numArms;
+	TeleopFeedbackArm arms[TELEOP_MAX_ARMS];
+};
+
+enum TeleopDecodeResult {
+	TELEOP_DECODE_OK,
+	TELEOP_DECODE_NOT_V2,
+	TELEOP_DECODE_BAD_VERSION,
+	TELEOP_DECODE_BAD_LENGTH,
+	TELEOP_DECODE_BAD_CRC
+};
+
+const char* teleopDecodeResultString(int result);
+
+// true if buf starts with the v2 magic
+bool teleopIsV2Packet(const uint8_t* buf, size_t len);
+
+// Returns the number of bytes written, or 0 if len is too small or numArms is out of range
+size_t teleopEncode(const TeleopPacket& packet, uint8_t* buf, size_t len);
+
+// Returns a TeleopDecodeResult; packet is only valid for TELEOP_DECODE_OK
+int teleopDecode(const uint8_t* buf, size_t len, TeleopPacket& packet);
+
+size_t teleopEncodeFeedback(const TeleopFeedbackPacket& packet, uint8_t* buf, size_t len);
+
+// TELEOP_DECODE_NOT_V2 here means buf doesn't start with the feedback magic
+int teleopDecodeFeedback(const uint8_t* buf, size_t len, TeleopFeedbackPacket& packet);
+
+/*
+ * Master sequence number handling of network_process, shared with teleop_sim so
+ * the simulator can predict what the slave does with a given arrival order.
+ * Only TELEOP_SEQ_APPLIED packets are put into DS1.
+ */
+enum TeleopSequenceResult {
+	TELEOP_SEQ_APPLIED,      // next in sequence
+	TELEOP_SEQ_REFLECT,      // sequence 0
+	TELEOP_SEQ_SKIPPED,      // jumped ahead; taken as the new sequence number but not applied
+	TELEOP_SEQ_DUPLICATE,    // same as the last sequence number
+	TELEOP_SEQ_RESET,        // more than TELEOP_SEQ_RESET_GAP behind; the master restarted
+	TELEOP_SEQ_OUT_OF_ORDER, // behind, but not by enough to be a reset
+	TELEOP_SEQ_NUM_RESULTS
+};
+
+#define TELEOP_SEQ_RESET_GAP 1000
+
+const char* teleopSequenceResultString(int result);
+
+// Classifies sequence against seq, the last sequence number taken, and updates seq
+int teleopCheckSequence(unsigned int& seq, unsigned int sequence);
+
+/**
+ * Runs teleopCheckSequence on the stream of each arm of packet, with seqs
+ * indexed by arm id, and removes the arms that aren't TELEOP_SEQ_APPLIED.
+ * Returns the number of arms left.
+ */
+int teleopCheckArmSequences(unsigned int seqs[TELEOP_MAX_ARMS], TeleopPacket& packet);
+
+/**
+ * Fills u from packet for the old teleopIntoDS1 path.
+ * Deltas, buttons and grasps of arms missing from the packet are zeroed; their
+ * orientation is left as it was in u, so pass the previous u_struct to hold it.
+ * Returns the number of arms in the packet that don't fit in a u_struct.
+ */
+int teleopPacketToUStruct(const TeleopPacket& packet, struct u_struct& u);
+
+#endif /* TELEOP_PROTOCOL_H_ */
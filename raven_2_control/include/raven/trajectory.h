@@ -7,6 +7,7 @@
 */
 
 #include "struct.h"
+#include "trajectory_plan.h"
 
 #include <ros/ros.h>
 
@@ -27,11 +28,30 @@ int update_sinusoid_position_trajectory(struct DOF*);
 int update_linear_sinusoid_position_trajectory(struct DOF*);
 int update_position_trajectory(struct DOF*);
 
+// Precompute traj (--trajectory-interpolation) and hand it to the rt thread. Any thread.
 bool setTrajectory(const param_pass_trajectory& traj);
 bool clearTrajectory();
 bool hasTrajectory();
-bool getTrajectory(param_pass_trajectory& traj);
+
+/*
+ * Streaming. The setpoint being played is kept as a point, so the arm doesn't jump
+ * when the trajectory changes under it. The hold after the last point of segment
+ * (total_duration - last time_from_start) carries over; segment.begin_time is ignored.
+ * Both return false without changing anything if the controller doesn't match
+ * the trajectory being played.
+ */
+// Continue the trajectory being played; segment times are from its last point, or from now if it has ended.
+bool appendTrajectory(const param_pass_trajectory& segment);
+// Play the current trajectory up to preempt_time (now if earlier), then segment, whose times are from there.
+bool preemptTrajectory(double preempt_time, const param_pass_trajectory& segment);
+
+// Setpoint of the trajectory being played at time t, or its last point after that.
+// False if no trajectory is loaded or it has ended.
+bool getTrajectorySetpoint(double t, t_controlmode& controller, param_pass& param);
+// Absolute times of the first and last points of the trajectory loaded. False if none.
+bool getTrajectoryExtent(double& begin_time, double& end_time, size_t& num_points);
 
 BOOST_ENUM(TrajectoryStatus, (NO_TRAJECTORY)(BEFORE_START)(OK)(ENDED));
 
-TrajectoryStatus getCurrentTrajectoryParams(t_controlmode& controller,param_pass& param);
+// rt thread only. Lock free; O(1) per call while time moves forward.
+TrajectoryStatus getCurrentTrajectoryParams(t_controlmode& controller,param_pass& param,TrajectoryVelocity* vel=NULL);
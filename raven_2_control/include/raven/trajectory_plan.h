@@ -0,0 +1,98 @@
+/*
+ * trajectory_plan.h
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: agent
+ */
+
+#ifndef TRAJECTORY_PLAN_H_
+#define TRAJECTORY_PLAN_H_
+
+#include "struct.h"
+
+#include <string>
+#include <vector>
+
+enum TrajectoryInterpolation {
+	TRAJECTORY_INTERP_STEP,     // hold each point until the next one, as before
+	TRAJECTORY_INTERP_CUBIC,    // C1 cubic Hermite through the points
+	TRAJECTORY_INTERP_QUINTIC   // quintic Hermite, zero acceleration at the points
+};
+
+TrajectoryInterpolation trajectoryInterpolationFromString(const std::string& str);
+
+// Setpoint velocities that have no slot in param_pass
+struct TrajectoryVelocity {
+	float xd[MAX_MECH_PER_DEV][3]; // microns/s
+};
+
+/*
+ * Trajectory precomputed for playback by the rt thread.
+ *
+ * The constructor does all the work: it finds the param_pass fields that change
+ * along the trajectory (end effector position and grasp, joint and motor positions,
+ * orientation), and computes monotone tangents for them. With cubic
+ * interpolation the curve never overshoots a point; with quintic it can.
+ * Orientation is slerped. Everything else is held from the
+ * last point passed, as the old step playback did.
+ *
+ * sample() keeps a cursor on the current segment, so playing a trajectory forward
+ * costs O(1) per tick however many points it has, and it doesn't allocate.
+ * A plan is used by one thread at a time.
+ */
+class TrajectoryPlan {
+public:
+	enum Status { EMPTY, BEFORE_START, OK, ENDED };
+
+private:
+	// interpolated scalar fields of param_pass
+	enum ChannelType { CHANNEL_XD, CHANNEL_GRASP, CHANNEL_JPOS, CHANNEL_MPOS };
+	struct Channel {
+		int type;
+		int index;    // mech for CHANNEL_XD/CHANNEL_GRASP, joint for CHANNEL_JPOS/CHANNEL_MPOS
+		int axis;     // x/y/z for CHANNEL_XD
+	};
+
+	double beginTime_;
+	double endTime_;
+	t_controlmode controlMode_;
+	TrajectoryInterpolation interpolation_;
+
+	std::vector<double> times_;           // absolute time of each point
+	std::vector<param_pass> params_;      // step-held fields
+	std::vector<Channel> channels_;
+	std::vector<double> values_;          // [point * channels + channel]
+	std::vector<double> tangents_;        // d value / dt at each point
+	bool rotates_[MAX_MECH_PER_DEV];      // orientation varies for the mech
+	std::vector<double> quats_;           // [(point * MAX_MECH_PER_DEV + mech) * 4], x y z w
+
+	size_t cursor_;
+
+	static double channelValue(const param_pass& p, const Channel& c);
+	static void setChannelValue(param_pass& p, const Channel& c, double v);
+	void addChannelIfVaries(int type, int index, int axis);
+	void computeTangents();
+	size_t findSegment(double t);
+
+public:
+	TrajectoryPlan();
+	TrajectoryPlan(const param_pass_trajectory& traj, TrajectoryInterpolation interpolation);
+
+	bool empty() const { return times_.empty(); }
+	size_t size() const { return times_.size(); }
+	double beginTime() const { return beginTime_; }
+	double endTime() const { return endTime_; }
+	t_controlmode controlMode() const { return controlMode_; }
+	TrajectoryInterpolation interpolation() const { return interpolation_; }
+	int numChannels() const { return channels_.size(); }
+
+	// Setpoint at absolute time t. param is only written for OK; vel may be NULL.
+	Status sample(double t, param_pass& param, TrajectoryVelocity* vel=NULL);
+
+	// intrusive list used to hand finished plans back from the rt thread
+	TrajectoryPlan* retiredNext;
+	// the handoff that gave the plan to the rt thread, see trajectory.cpp
+	unsigned int handoffSeq;
+};
+
+#endif /* TRAJECTORY_PLAN_H_ */
@@ -184,11 +184,73 @@ struct Config : public rosx::ConfigGroup {
 	bool disable_gold_grasp2;
 	bool use_new_cable_coupling;
 	bool use_new_kinematics;
+	bool use_pid_kernel;
+	bool verify_pid_kernel;
+	bool use_incremental_ik;
+	int net_busy_poll_usec;
+	bool disable_teleop_jitter_buffer;
+	int teleop_jitter_max_usec;
+	int feedback_rate;
+	int feedback_batch_usec;
+	int feedback_port;
+	float feedback_stiffness;
+	bool sim_usb;
+	std::string trajectory_interpolation;
+	double state_publish_rate;
+	double fast_state_publish_rate;
+	double joint_states_publish_rate;
+	double tool_pose_publish_rate;
+	double command_pose_publish_rate;
+	double master_pose_publish_rate;
+	bool nodelet_manager;
+	bool sync_log;
+	std::string trace_file;
+	std::string status_socket;
+	bool no_console;
+	int metrics_port;
+	std::string metrics_socket;
+	std::string record_file;
+	std::string replay_file;
+	float latency_bench;
+	int latency_bench_load;
+	bool gains_cache;
+	int memory_pool_mb;
 
 	Config() : rosx::ConfigGroup() {
 		ConfigGroup_flag(disable_gold_grasp2);
 		ConfigGroup_flag(use_new_cable_coupling);
 		ConfigGroup_flag(use_new_kinematics);
+		ConfigGroup_flag(use_pid_kernel);
+		ConfigGroup_flag(verify_pid_kernel);
+		ConfigGroup_flag(use_incremental_ik);
+		ConfigGroup_optionWithHelp(net_busy_poll_usec,int,"SO_BUSY_POLL time for the teleop socket (0 = off)",0);
+		ConfigGroup_flag(disable_teleop_jitter_buffer);
+		ConfigGroup_optionWithHelp(teleop_jitter_max_usec,int,"max playout delay of the teleop jitter buffer",20000);
+		ConfigGroup_optionWithHelp(feedback_rate,int,"rate (Hz, up to 1000) of feedback sent to the master (0 = off)",0);
+		ConfigGroup_optionWithHelp(feedback_batch_usec,int,"interval between feedback sendmmsg batches",2000);
+		ConfigGroup_optionWithHelp(feedback_port,int,"master port for feedback (0 = the port packets come from)",0);
+		ConfigGroup_optionWithHelp(feedback_stiffness,float,"N/m applied to the position error for the feedback force",100.f);
+		ConfigGroup_optionWithHelp(trajectory_interpolation,std::string,"step, cubic or quintic interpolation between trajectory points","cubic");
+		ConfigGroup_optionWithHelp(state_publish_rate,double,"rate (Hz) of raven_state and raven_state/array (0 = off)",100.);
+		ConfigGroup_optionWithHelp(fast_state_publish_rate,double,"rate (Hz) of the batches on raven_state/1000Hz (0 = off)",100.);
+		ConfigGroup_optionWithHelp(joint_states_publish_rate,double,"rate (Hz) of joint_states (0 = off)",100.);
+		ConfigGroup_optionWithHelp(tool_pose_publish_rate,double,"rate (Hz) of the tool_pose topics (0 = off)",10.);
+		ConfigGroup_optionWithHelp(command_pose_publish_rate,double,"rate (Hz) of the tool_pose/command topics (0 = off)",10.);
+		ConfigGroup_optionWithHelp(master_pose_publish_rate,double,"rate (Hz) of the master_pose topics (0 = off)",10.);
+		ConfigGroup_flagWithHelp(nodelet_manager,"let nodelets be loaded into r2_control, where they get the state messages without serialization");
+		ConfigGroup_optionWithHelp(trace_file,std::string,"record the trace points compiled in with TRACE_CATEGORIES and write them to this file as a Chrome trace on shutdown","");
+		ConfigGroup_flagWithHelp(sync_log,"write log messages on the calling thread, as before, instead of from the log thread");
+		ConfigGroup_optionWithHelp(status_socket,std::string,"Unix socket to serve the status on for r2_status (empty for none)","/tmp/r2_control_status");
+		ConfigGroup_flagWithHelp(no_console,"don't start the interactive console; watch the robot with r2_status instead");
+		ConfigGroup_optionWithHelp(metrics_port,int,"serve Prometheus metrics on http://127.0.0.1:<port>/metrics (0 for none)",0);
+		ConfigGroup_optionWithHelp(metrics_socket,std::string,"serve Prometheus metrics over HTTP on this Unix socket (empty for none)","/tmp/r2_control_metrics");
+		ConfigGroup_optionWithHelp(record_file,std::string,"record every loop's USB packets and master commands to this file for --replay-file","");
+		ConfigGroup_optionWithHelp(replay_file,std::string,"run the control loop on a recording instead of the hardware and network, as fast as it goes, and compare the DAC commands","");
+		ConfigGroup_optionWithHelp(latency_bench,float,"measure encoder->DAC and master->DAC latency for this many seconds, print the distributions and exit (0 = off)",0.f);
+		ConfigGroup_optionWithHelp(latency_bench_load,int,"threads loading the CPUs and cache during --latency-bench",0);
+		ConfigGroup_flagWithHelp(gains_cache,"start on the gains cached in ~/.ros instead of reading the parameter server first; a mismatch found once running is logged, not applied");
+		ConfigGroup_optionWithHelp(memory_pool_mb,int,"heap (MB) locked and prefaulted at startup; the heap's growth is logged at shutdown",64);
+		ConfigGroup_flagWithHelp(sim_usb,"run without hardware: simulated gold and green boards with fixed encoders");
 //		ConfigGroup_option(param1,float);
 //		ConfigGroup_option(param2_has_default,std::string,"thedefault");
 //		ConfigGroup_options(param3,"v,param-number-three",int);
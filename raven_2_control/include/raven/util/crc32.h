@@ -0,0 +1,17 @@
+/*
+ * crc32.h
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: agent
+ */
+
+#ifndef CRC32_H_
+#define CRC32_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+// CRC-32 (IEEE 802.3), as used by the teleop packets and the calibration files
+uint32_t crc32Ieee(const void* data, size_t len);
+
+#endif /* CRC32_H_ */
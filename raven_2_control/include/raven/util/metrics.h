@@ -0,0 +1,126 @@
+/*
+ * metrics.h
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: agent
+ */
+
+#ifndef METRICS_H_
+#define METRICS_H_
+
+#include <stdint.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+/*
+ * Counters, gauges and histograms for monitoring, exported in the Prometheus
+ * text format.
+ *
+ * Metrics are declared where they are updated, usually as file statics:
+ *
+ *   static MetricCounter usb_errors("r2_usb_errors_total","USB packet errors","direction=\"read\"");
+ *   ...
+ *   usb_errors.inc();
+ *
+ * Constructing a metric registers it (without locking), so statics are
+ * exported from the start. Updates are single atomic operations and can come
+ * from any thread, the rt thread included. Metrics sharing a name are one
+ * family and must differ in their labels. Metrics are never unregistered, so
+ * anything constructed at runtime has to live until exit.
+ *
+ * MetricsExporter serves /metrics over HTTP on a localhost TCP port and/or a
+ * Unix socket (curl --unix-socket), from a low priority thread.
+ */
+
+class Metric {
+public:
+	enum Type { COUNTER, GAUGE, HISTOGRAM };
+private:
+	static Metric* volatile HEAD;
+	Metric* next_;
+	std::string name_;
+	std::string help_;
+	std::string labels_;
+	Type type_;
+
+	Metric(const Metric&);
+	Metric& operator=(const Metric&);
+protected:
+	Metric(Type type, const std::string& name, const std::string& help, const std::string& labels);
+	// "{labels}", with extra label text (e.g. le="0.001") added
+	std::string labelString(const std::string& extra="") const;
+public:
+	virtual ~Metric() {}
+
+	Type type() const { return type_; }
+	const std::string& name() const { return name_; }
+	const std::string& help() const { return help_; }
+	const std::string& labels() const { return labels_; }
+
+	// Writes the sample lines (not HELP/TYPE)
+	virtual void writeSamples(std::string& out) const = 0;
+
+	// Every registered metric, grouped by name in registration order
+	static std::vector<const Metric*> all();
+	// Every registered metric in the text exposition format
+	static std::string exposition();
+};
+
+class MetricCounter : public Metric {
+	volatile uint64_t value_;
+public:
+	MetricCounter(const std::string& name, const std::string& help, const std::string& labels="")
+		: Metric(COUNTER,name,help,labels), value_(0) {}
+
+	void inc(uint64_t n=1) { __sync_fetch_and_add(&value_,n); }
+	uint64_t value() const { return value_; }
+
+	virtual void writeSamples(std::string& out) const;
+};
+
+class MetricGauge : public Metric {
+	// the bits of a double, so the value can be swapped atomically
+	volatile uint64_t bits_;
+
+	static uint64_t toBits(double v) { uint64_t b; memcpy(&b,&v,sizeof(b)); return b; }
+	static double fromBits(uint64_t b) { double v; memcpy(&v,&b,sizeof(v)); return v; }
+public:
+	MetricGauge(const std::string& name, const std::string& help, const std::string& labels="")
+		: Metric(GAUGE,name,help,labels), bits_(toBits(0)) {}
+
+	void set(double v) { bits_ = toBits(v); }
+	void add(double d);
+	double value() const { return fromBits(bits_); }
+
+	virtual void writeSamples(std::string& out) const;
+};
+
+class MetricHistogram : public Metric {
+	std::vector<double> bounds_;      // upper bounds, ascending; +Inf is implied
+	volatile uint64_t* counts_;       // per bucket, not cumulative; bounds_.size()+1 of them
+	volatile uint64_t sumBits_;
+public:
+	// bounds are the bucket upper bounds, ascending
+	MetricHistogram(const std::string& name, const std::string& help, const std::vector<double>& bounds, const std::string& labels="");
+	virtual ~MetricHistogram();
+
+	void observe(double v);
+	uint64_t count() const;
+	double sum() const;
+
+	// bounds from start, multiplying by factor, count of them
+	static std::vector<double> exponentialBounds(double start, double factor, int count);
+
+	virtual void writeSamples(std::string& out) const;
+};
+
+class MetricsExporter {
+	MetricsExporter() {}
+public:
+	// port 0 and an empty socket path leave that side off; false if nothing could be opened
+	static bool start(int port, const std::string& socketPath);
+	static void stop();
+};
+
+#endif /* METRICS_H_ */
@@ -0,0 +1,46 @@
+/*
+ * startup.h
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: agent
+ */
+
+#ifndef STARTUP_H_
+#define STARTUP_H_
+
+#include <stdint.h>
+#include <string>
+
+/*
+ * Per-phase timing of startup. A phase is timed from construction to end()
+ * (or destruction), from any thread, so phases run in parallel show up with
+ * overlapping times:
+ *
+ *   {
+ *     StartupPhase phase("boards");
+ *     ...
+ *   }
+ *   ...
+ *   StartupPhase::report();
+ *
+ * report() logs every phase with its start relative to process start, and
+ * exports them as r2_startup_phase_seconds{phase="..."}.
+ */
+
+class StartupPhase {
+	std::string name_;
+	int64_t start_;
+	bool ended_;
+
+	StartupPhase(const StartupPhase&);
+	StartupPhase& operator=(const StartupPhase&);
+public:
+	StartupPhase(const std::string& name);
+	~StartupPhase() { end(); }
+
+	void end();
+
+	static void report();
+};
+
+#endif /* STARTUP_H_ */
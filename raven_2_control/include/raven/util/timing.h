@@ -355,4 +355,27 @@ struct TempTiming {
 };
 
 
+/*
+ * The time of the current servo loop, sampled once by the rt thread at the
+ * top of the loop (or set to the recorded time when replaying a flight
+ * recording). Code that runs in the loop uses this instead of
+ * ros::Time::now(), so everything in one loop sees the same time and a replay
+ * sees the times of the recording. Before the first loop it is the wall clock.
+ */
+class LoopClock {
+	static volatile int64_t NOW_NSEC;
+	LoopClock() {}
+public:
+	static ros::Time now() {
+		int64_t nsec = NOW_NSEC;
+		if (!nsec) {
+			return ros::Time::now();
+		}
+		ros::Time t;
+		t.fromNSec(nsec);
+		return t;
+	}
+	static void set(const ros::Time& t) { NOW_NSEC = t.toNSec(); }
+};
+
 #endif /* TIMING_H_ */
@@ -0,0 +1,133 @@
+/*
+ * trace.h
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: agent
+ */
+
+#ifndef TRACE_H_
+#define TRACE_H_
+
+#include <stdint.h>
+#include <time.h>
+#include <string>
+
+/*
+ * Scope tracing for profiling the rt loop.
+ *
+ * Trace points belong to a category, and only the categories in
+ * TRACE_CATEGORIES (set at build time, e.g. -DTRACE_CATEGORIES=0x3) are
+ * compiled in; the rest compile to nothing. A compiled-in trace point records
+ * a 24 byte event (cycle counter, name, enter/exit) in a ring owned by the
+ * calling thread, and only while trace_start() is in effect. Nothing is
+ * formatted or written until trace_write_chrome(), which produces a Chrome
+ * trace (chrome://tracing, Perfetto) of the last TRACE_RING_SIZE events of
+ * every thread.
+ *
+ * Names must outlive the trace: string literals or typeid().name().
+ */
+
+#define TRACE_LOOP    0x01  // rt loop phases
+#define TRACE_STATE   0x02  // Device and Updateable updates
+#define TRACE_CONTROL 0x04  // controllers
+#define TRACE_IO      0x08  // usb and network
+
+#ifndef TRACE_CATEGORIES
+#define TRACE_CATEGORIES 0
+#endif
+
+// Events kept per thread; power of two
+#ifndef TRACE_RING_SIZE
+#define TRACE_RING_SIZE (1 << 16)
+#endif
+
+#define TRACE_ENABLED(category) (((TRACE_CATEGORIES) & (category)) != 0)
+
+struct TraceEvent {
+	uint64_t ticks;
+	const char* name;
+	unsigned char phase;     // 'B', 'E' or 'i'
+	unsigned char category;
+};
+
+struct TraceRing {
+	TraceEvent events[TRACE_RING_SIZE];
+	volatile uint64_t count;   // events ever recorded; the ring holds the last TRACE_RING_SIZE
+	int tid;
+	const char* thread_name;
+	TraceRing* next;
+};
+
+extern volatile bool trace_recording;
+extern __thread TraceRing* trace_ring;
+TraceRing* trace_thread_ring();
+
+inline uint64_t
+trace_ticks() {
+#if defined(__i386__) || defined(__x86_64__)
+	uint32_t lo, hi;
+	__asm__ __volatile__("rdtsc" : "=a"(lo), "=d"(hi));
+	return ((uint64_t)hi << 32) | lo;
+#else
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC,&ts);
+	return ts.tv_sec * (uint64_t)1000000000 + ts.tv_nsec;
+#endif
+}
+
+inline void
+trace_event(int category, const char* name, char phase) {
+	if (!trace_recording) {
+		return;
+	}
+	TraceRing* ring = trace_ring;
+	if (__builtin_expect(!ring,0)) {
+		ring = trace_thread_ring();
+	}
+	uint64_t n = ring->count;
+	TraceEvent& e = ring->events[n & (TRACE_RING_SIZE-1)];
+	e.ticks = trace_ticks();
+	e.name = name;
+	e.phase = phase;
+	e.category = category;
+	ring->count = n + 1;
+}
+
+template<bool Enabled>
+struct TraceScope {
+	TraceScope(int, const char*) {}
+};
+
+template<>
+struct TraceScope<true> {
+	int category_;
+	const char* name_;
+	TraceScope(int category, const char* name) : category_(category), name_(name) {
+		trace_event(category_,name_,'B');
+	}
+	~TraceScope() {
+		trace_event(category_,name_,'E');
+	}
+};
+
+#define TRACE_CONCAT_(a,b) a##b
+#define TRACE_CONCAT(a,b) TRACE_CONCAT_(a,b)
+
+// Traces the rest of the enclosing scope
+#define TRACE_SCOPE(category,name) TraceScope<TRACE_ENABLED(category)> TRACE_CONCAT(_trace_scope_,__LINE__)(category,name)
+// For spans that aren't a scope; every TRACE_BEGIN needs its TRACE_END
+#define TRACE_BEGIN(category,name) do { if (TRACE_ENABLED(category)) { trace_event(category,name,'B'); } } while(0)
+#define TRACE_END(category,name) do { if (TRACE_ENABLED(category)) { trace_event(category,name,'E'); } } while(0)
+#define TRACE_INSTANT(category,name) do { if (TRACE_ENABLED(category)) { trace_event(category,name,'i'); } } while(0)
+
+// Whether any trace points were compiled in here
+inline bool trace_compiled_in() { return TRACE_CATEGORIES != 0; }
+
+void trace_start();
+void trace_stop();
+// Allocates the calling thread's ring now rather than at its first event, if recording
+void trace_prepare_thread(const char* thread_name);
+// Stops recording and writes everything recorded; false if the file can't be written
+bool trace_write_chrome(const std::string& filename);
+
+#endif /* TRACE_H_ */
@@ -1,5 +1,22 @@
+#ifndef SAVELOAD_H
+#define SAVELOAD_H
+
 #include "struct.h"
 
+// PID gains by arm id, as they are read from the parameter server
+struct RavenGains {
+  float kp[MAX_MECH][MAX_DOF_PER_MECH];
+  float kd[MAX_MECH][MAX_DOF_PER_MECH];
+  float ki[MAX_MECH][MAX_DOF_PER_MECH];
+};
+
+// Encoder offsets from homing, kept per arm in ~/.ros/calibration (see calibration.h)
 bool loadOffsets(device& dev);
 bool saveOffsets(device& dev);
 bool saveDOFInfo();
+
+// Cache of the last gains read from the parameter server, kept with the offsets
+bool loadGains(RavenGains& gains);
+bool saveGains(const RavenGains& gains);
+
+#endif
@@ -19,6 +19,12 @@
 #include <ros/console.h>
 
 #include <raven/state/initializer.h>
+#include <raven/util/config.h>
+#include <raven/util/startup.h>
+#include "flight_recorder.h"
+
+#include <boost/bind.hpp>
+#include <boost/thread/thread.hpp>
 
 //Four device files for connection to four boards
 #define BRL_USB_DEV_DIR     "/dev/"
@@ -31,6 +37,11 @@
 std::vector<int> boardFile;
 std::map<int,int> boardFPs;
 
+// --sim-usb: no board files are opened, reads return encoder packets with all encoders at zero
+static bool usb_sim = false;
+// --replay-file: no board files are opened, reads return the recorded packets
+static bool usb_replay = false;
+
 extern USBStruct USBBoards;
 extern int NUM_MECH;
 
@@ -64,10 +75,9 @@ int get_board_id_from_filename(string s)
 	return atoi(tmp.c_str());
 }
 
-int write_zeros_to_board(int boardid)
+static void fill_zeros_packet(unsigned char* buffer_out)
 {
     short int tmp = DAC_OFFSET;
-    unsigned char buffer_out[MAX_OUT_LENGTH];
 
     buffer_out[0]= DAC;        //Type of USB packet
     buffer_out[1]= MAX_DOF_PER_MECH; //Number of DAC channels
@@ -76,6 +86,12 @@ int write_zeros_to_board(int boardid)
         buffer_out[2*i+3] = (char)tmp>>8;
     }
     buffer_out[OUT_LENGTH-1] = 0x00;
+}
+
+int write_zeros_to_board(int boardid)
+{
+    unsigned char buffer_out[MAX_OUT_LENGTH];
+    fill_zeros_packet(buffer_out);
 
     //Write the packet to the USB Driver
     if(usb_write(boardid, &buffer_out, OUT_LENGTH )!= OUT_LENGTH){
@@ -86,6 +102,46 @@ int write_zeros_to_board(int boardid)
 
 }
 
+// One board file, brought up on its own thread by USBInit
+struct BoardBringUp
+{
+    string file;
+    int fd;
+    int open_errno;
+    bool reset_ok;
+    bool zeros_ok;
+};
+
+/**
+ * bringUpBoard() - open, reset, drain and zero one board
+ *
+ * Touches nothing shared, so the boards can come up in parallel; USBInit registers them afterwards.
+ */
+static void bringUpBoard(BoardBringUp* board)
+{
+    StartupPhase phase("board " + board->file);
+    string boardStr = BRL_USB_DEV_DIR + board->file;
+    char buf[10]; //buffer to be used for clearing usb read buffers
+
+    /// Open usb dev
+    board->fd = open(boardStr.c_str(), O_RDWR|O_NONBLOCK);    //Is NONBLOCK mode required??// open board chardev
+    if (board->fd <= 0)
+    {
+        board->open_errno = errno;
+        return;
+    }
+
+    /// Setup usb dev.  ioctl() performs an initialization in driver.
+    board->reset_ok = ioctl(board->fd, BRL_RESET_BOARD) == 0;
+
+    while (read(board->fd,buf,10)>0); //Clear buffers
+    ///TODO: Needs request encoder test. Not implemented in driver yet.
+
+    unsigned char buffer_out[MAX_OUT_LENGTH];
+    fill_zeros_packet(buffer_out);
+    board->zeros_ok = write(board->fd, buffer_out, OUT_LENGTH) == OUT_LENGTH;
+}
+
 /**
  * USBInit() - initialize the USB modules
  *
@@ -100,11 +156,15 @@ int write_zeros_to_board(int boardid)
  */
 int USBInit(struct device *device0)
 {
-    char buf[10]; //buffer to be used for clearing usb read buffers
     string boardStr;
     int boardid = 0;
     int okboards = 0;
 
+    if (replaying())
+        return USBInitReplay(device0);
+    if (RavenConfig.sim_usb)
+        return USBInitSim(device0);
+
     // Get list of files in dev dir
     vector<string> files = vector<string>();
     getdir(BRL_USB_DEV_DIR, files);
@@ -114,8 +174,21 @@ int USBInit(struct device *device0)
         ROS_INFO("    %s", files[i].c_str());
     }
 
+    //Open and reset available boards, all at once: each takes a few USB round trips
+    vector<BoardBringUp> bringUps(files.size());
+    boost::thread_group bringUpThreads;
+    for (uint i=0;i<files.size();i++)
+    {
+        bringUps[i].file = files[i];
+        bringUps[i].fd = -1;
+        bringUps[i].open_errno = 0;
+        bringUps[i].reset_ok = false;
+        bringUps[i].zeros_ok = false;
+        bringUpThreads.create_thread(boost::bind(bringUpBoard, &bringUps[i]));
+    }
+    bringUpThreads.join_all();
+
     //Initialize all active USB Boards
-    //Open and reset available boards
     USBBoards.activeAtStart=0;
     for (uint i=0;i<files.size();i++)
     {
@@ -123,20 +196,18 @@ int USBInit(struct device *device0)
         boardStr += files[i];
         boardid = get_board_id_from_filename(files[i]);
 
-        /// Open usb dev
-        int tmp_fileHandle = open(boardStr.c_str(), O_RDWR|O_NONBLOCK);    //Is NONBLOCK mode required??// open board chardev
+        int tmp_fileHandle = bringUps[i].fd;
         if (tmp_fileHandle <=0 )
         {
+            errno = bringUps[i].open_errno;
             perror("ERROR: coultn't open board");
             errno=0;
             continue; //Failed to open board, move to next one
         }
 
-        /// Setup usb dev.  ioctl() performs an initialization in driver.
-        if ( ioctl(tmp_fileHandle, BRL_RESET_BOARD) != 0)
+        if (!bringUps[i].reset_ok)
         {
             ROS_ERROR("ERROR: ioctl error opening board %s", boardStr.c_str());
-            errno = 0;
         }
         log_msg ("Boards Opened");
 
@@ -175,11 +246,7 @@ int USBInit(struct device *device0)
         boardFPs[boardid] = tmp_fileHandle;   // Map serial (i) to fileHandle (tmp_fileHandle)
         USBBoards.activeAtStart++;            // Increment board count
 
-        while (read(boardFile[i],buf,10)>0); //Clear buffers
-        ///TODO: Needs request encoder test. Not implemented in driver yet.
-        ///TODO: Clear read buffers.
-
-        if ( write_zeros_to_board(boardid) != 0){
+        if ( !bringUps[i].zeros_ok ){
             ROS_ERROR("Warning: failed initial board reset (set-to-zero)");
         }
     }
@@ -194,6 +261,70 @@ int USBInit(struct device *device0)
     return USBBoards.activeAtStart;
 }
 
+// Boards with these serials, in this order, with nothing opened
+static int addSimulatedBoards(struct device *device0, const std::vector<int>& serials)
+{
+    USBBoards.activeAtStart=0;
+    for (size_t i=0;i<serials.size() && i<MAX_MECH;i++)
+    {
+        int boardid = serials[i];
+        if (boardid == GREEN_ARM_SERIAL)
+        {
+            log_msg("  Green Arm on simulated board #%d.",boardid);
+            device0->mech[i].type = GREEN_ARM;
+#ifdef USE_NEW_DEVICE
+            DeviceInitializer::addArm(boardid,armNameFromSerial(boardid),Arm::Type::GREEN,Arm::ToolType::GRASPER_10MM);
+#endif
+        }
+        else
+        {
+            log_msg("  Gold Arm on simulated board #%d.",boardid);
+            device0->mech[i].type = GOLD_ARM;
+#ifdef USE_NEW_DEVICE
+            DeviceInitializer::addArm(boardid,armNameFromSerial(boardid),Arm::Type::GOLD,Arm::ToolType::GRASPER_10MM);
+#endif
+        }
+        USBBoards.boards.push_back(boardid);
+        USBBoards.activeAtStart++;
+    }
+
+    NUM_MECH = USBBoards.activeAtStart;
+    return USBBoards.activeAtStart;
+}
+
+/**
+ * USBInitSim() - set up simulated gold and green arm boards for --sim-usb
+ *
+ * \return number of simulated boards
+ *
+ */
+int USBInitSim(struct device *device0)
+{
+    std::vector<int> serials;
+    serials.push_back(GOLD_ARM_SERIAL);
+    serials.push_back(GREEN_ARM_SERIAL);
+
+    usb_sim = true;
+    log_msg("  Simulating USB boards; no hardware will be driven");
+    return addSimulatedBoards(device0, serials);
+}
+
+/**
+ * USBInitReplay() - set up the boards of the recording for --replay-file
+ *
+ * \return number of boards in the recording
+ *
+ */
+int USBInitReplay(struct device *device0)
+{
+    std::vector<int> serials;
+    replayBoardSerials(serials);
+
+    usb_replay = true;
+    log_msg("  Replaying recorded USB boards; no hardware will be driven");
+    return addSimulatedBoards(device0, serials);
+}
+
 /**
  * USBShutdown() - shutsdown the USB modules. The function sets the DAC outputs to zero before shutting down.
  *
@@ -231,8 +362,28 @@ Read from usb board with serial number id
 */
 int usb_read(int id, void *buffer, size_t len)
 {
-    int fp = boardFPs[id]; // get file pointer from serial number
-    return read(fp, buffer, len);
+    int result;
+    if (usb_replay)
+        return replayUsbRead(id, buffer, len);
+    else if (usb_sim)
+    {
+        // encoder packet: type, channel count, input pins, then 3 bytes per channel
+        const size_t sim_len = 3 + 3*MAX_DOF_PER_MECH;
+        if (len < sim_len)
+            return -EINVAL;
+        unsigned char* buf = (unsigned char*)buffer;
+        memset(buf, 0, sim_len);
+        buf[0] = ENC;
+        buf[1] = MAX_DOF_PER_MECH;
+        result = sim_len;
+    }
+    else
+    {
+        int fp = boardFPs[id]; // get file pointer from serial number
+        result = read(fp, buffer, len);
+    }
+    flightRecordUsbRead(id, buffer, result);
+    return result;
 }
 
 /**
@@ -243,8 +394,18 @@ Write to usb board with serial number id
 */
 int usb_write(int id, void *buffer, size_t len)
 {
-    int fp = boardFPs[id]; // get file pointer from serial number
-    return write(fp, buffer, len);       // read current enc values from board
+    int result;
+    if (usb_replay)
+        return replayUsbWrite(id, buffer, len);
+    else if (usb_sim)
+        result = len;
+    else
+    {
+        int fp = boardFPs[id]; // get file pointer from serial number
+        result = write(fp, buffer, len);       // read current enc values from board
+    }
+    flightRecordUsbWrite(id, buffer, result);
+    return result;
 }
 
 
@@ -257,6 +418,8 @@ int usb_write(int id, void *buffer, size_t len)
 int usb_reset_encoders(int boardid)
 {
     log_msg("Resetting encoders on board %d", boardid);
+    if (usb_sim || usb_replay)
+        return 0;
 
     int fp = boardFPs[boardid]; // get file pointer from serial number
     //const size_t USB_MAX_OUT_LEN = 512;
@@ -0,0 +1,260 @@
+/*
+ * calibration.cpp
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: agent
+ */
+
+#include "calibration.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+
+#include <string>
+
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp>
+
+#include "log.h"
+#include "network_layer.h"
+#include <raven/util/crc32.h>
+
+// nice value of the writer thread
+#define CALIBRATION_THREAD_NICE 10
+// how often the writer looks for updates
+#define CALIBRATION_WRITE_INTERVAL_USEC 100000
+
+struct CalibrationHeader {
+	char magic[4];
+	uint32_t version;
+	uint32_t record_size;
+	uint32_t crc;
+};
+
+static const char CALIBRATION_MAGIC[4] = { 'R', '2', 'C', 'B' };
+
+// read-modify-write of a file is one update at a time
+static boost::mutex calibration_mutex;
+
+struct CalibrationUpdate {
+	CalibrationRecord values;
+	uint32_t fields;
+};
+
+// an update per arm at most, a few times a session
+static NetworkRing<CalibrationUpdate,8> calibration_ring;
+static volatile bool calibration_running = false;
+static boost::thread* calibration_thread = NULL;
+
+static std::string
+rosDir() {
+	const char* home = getenv("HOME");
+	return std::string(home ? home : ".") + "/.ros";
+}
+
+static std::string
+calibrationDir() {
+	return rosDir() + "/calibration";
+}
+
+static std::string
+calibrationPath(int serial) {
+	char name[32];
+	snprintf(name,sizeof(name),"/arm_%d.cal",serial);
+	return calibrationDir() + name;
+}
+
+static uint32_t
+recordCrc(const CalibrationRecord& record) {
+	return crc32Ieee(&record,sizeof(record));
+}
+
+static void
+emptyRecord(int serial, CalibrationRecord& record) {
+	memset(&record,0,sizeof(record));
+	record.serial = serial;
+}
+
+bool
+calibrationLoad(int serial, CalibrationRecord& record) {
+	emptyRecord(serial,record);
+	std::string path = calibrationPath(serial);
+	int fd = open(path.c_str(),O_RDONLY);
+	if (fd < 0) {
+		return false;
+	}
+	struct stat st;
+	size_t size = sizeof(CalibrationHeader) + sizeof(CalibrationRecord);
+	if (fstat(fd,&st) || st.st_size != (off_t)size) {
+		log_warn("Calibration %s has the wrong size; ignoring it",path.c_str());
+		close(fd);
+		return false;
+	}
+	void* map = mmap(NULL,size,PROT_READ,MAP_PRIVATE,fd,0);
+	close(fd);
+	if (map == MAP_FAILED) {
+		log_err("Couldn't map calibration %s: %s",path.c_str(),strerror(errno));
+		return false;
+	}
+
+	const CalibrationHeader* header = (const CalibrationHeader*)map;
+	const CalibrationRecord* stored = (const CalibrationRecord*)(header + 1);
+	bool ok = false;
+	if (memcmp(header->magic,CALIBRATION_MAGIC,sizeof(CALIBRATION_MAGIC))) {
+		log_warn("%s is not a calibration file; ignoring it",path.c_str());
+	} else if (header->version != CALIBRATION_VERSION || header->record_size != sizeof(CalibrationRecord)) {
+		log_warn("Calibration %s is version %u, not %u; ignoring it",path.c_str(),header->version,CALIBRATION_VERSION);
+	} else if (header->crc != recordCrc(*stored) || stored->serial != serial) {
+		log_warn("Calibration %s is corrupt; ignoring it",path.c_str());
+	} else {
+		record = *stored;
+		ok = true;
+	}
+	munmap(map,size);
+	return ok;
+}
+
+static bool
+writeAll(int fd, const void* data, size_t size) {
+	const char* p = (const char*)data;
+	while (size) {
+		ssize_t n = write(fd,p,size);
+		if (n < 0 && errno == EINTR) {
+			continue;
+		}
+		if (n <= 0) {
+			return false;
+		}
+		p += n;
+		size -= n;
+	}
+	return true;
+}
+
+static bool
+calibrationSave(const CalibrationRecord& record) {
+	std::string dir = calibrationDir();
+	mkdir(rosDir().c_str(),0755);
+	if (mkdir(dir.c_str(),0755) && errno != EEXIST) {
+		log_err("Couldn't create %s: %s",dir.c_str(),strerror(errno));
+		return false;
+	}
+
+	CalibrationHeader header;
+	memcpy(header.magic,CALIBRATION_MAGIC,sizeof(CALIBRATION_MAGIC));
+	header.version = CALIBRATION_VERSION;
+	header.record_size = sizeof(CalibrationRecord);
+	header.crc = recordCrc(record);
+
+	std::string path = calibrationPath(record.serial);
+	std::string tmpPath = path + ".tmp";
+	int fd = open(tmpPath.c_str(),O_WRONLY | O_CREAT | O_TRUNC,0644);
+	if (fd < 0) {
+		log_err("Couldn't write calibration %s: %s",tmpPath.c_str(),strerror(errno));
+		return false;
+	}
+	bool ok = writeAll(fd,&header,sizeof(header)) && writeAll(fd,&record,sizeof(record)) && fsync(fd) == 0;
+	ok = close(fd) == 0 && ok;
+	if (!ok || rename(tmpPath.c_str(),path.c_str())) {
+		log_err("Couldn't write calibration %s: %s",path.c_str(),strerror(errno));
+		unlink(tmpPath.c_str());
+		return false;
+	}
+
+	// the rename itself survives a crash once the directory is synced
+	int dirFd = open(dir.c_str(),O_RDONLY);
+	if (dirFd >= 0) {
+		fsync(dirFd);
+		close(dirFd);
+	}
+	return true;
+}
+
+bool
+calibrationUpdate(const CalibrationRecord& values, uint32_t fields) {
+	boost::mutex::scoped_lock lock(calibration_mutex);
+	CalibrationRecord record;
+	calibrationLoad(values.serial,record);
+	if (fields & CALIBRATION_OFFSETS) {
+		memcpy(record.enc_offset,values.enc_offset,sizeof(record.enc_offset));
+	}
+	if (fields & CALIBRATION_GAINS) {
+		memcpy(record.kp,values.kp,sizeof(record.kp));
+		memcpy(record.kd,values.kd,sizeof(record.kd));
+		memcpy(record.ki,values.ki,sizeof(record.ki));
+	}
+	if (fields & CALIBRATION_TR) {
+		memcpy(record.tr,values.tr,sizeof(record.tr));
+	}
+	record.fields |= fields;
+	return calibrationSave(record);
+}
+
+static void
+drainCalibrationRing() {
+	CalibrationUpdate update;
+	while (calibration_ring.pop(update)) {
+		calibrationUpdate(update.values,update.fields);
+	}
+}
+
+static void
+calibrationWriterProcess() {
+	struct sched_param param;
+	param.sched_priority = 0;
+	if (sched_setscheduler(0,SCHED_OTHER,&param) == -1) {
+		log_err("sched_setscheduler failed for the calibration writer");
+	}
+	setpriority(PRIO_PROCESS,0,CALIBRATION_THREAD_NICE);
+
+	unsigned int dropped = 0;
+	while (calibration_running) {
+		drainCalibrationRing();
+		if (calibration_ring.dropped != dropped) {
+			log_err("Calibration writer fell behind; %u updates were not saved",calibration_ring.dropped - dropped);
+			dropped = calibration_ring.dropped;
+		}
+		usleep(CALIBRATION_WRITE_INTERVAL_USEC);
+	}
+	drainCalibrationRing();
+}
+
+void
+calibrationUpdateAsync(const CalibrationRecord& values, uint32_t fields) {
+	if (!calibration_running) {
+		calibrationUpdate(values,fields);
+		return;
+	}
+	CalibrationUpdate update;
+	update.values = values;
+	update.fields = fields;
+	calibration_ring.push(update);
+}
+
+void
+calibrationWriterStart() {
+	if (calibration_running) {
+		return;
+	}
+	calibration_running = true;
+	calibration_thread = new boost::thread(calibrationWriterProcess);
+}
+
+void
+calibrationWriterStop() {
+	if (!calibration_running) {
+		return;
+	}
+	calibration_running = false;
+	calibration_thread->join();
+	delete calibration_thread;
+	calibration_thread = NULL;
+}
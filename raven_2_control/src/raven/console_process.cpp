@@ -89,7 +89,7 @@ void *console_process(void *)
 					ss << " " << masterModeToString(*itr);
 				}
 				ss << ", current mode is " << masterModeToString(masterMode);
-				log_warn(ss.str().c_str());
+				log_warn("%s",ss.str().c_str());
         	} else if (!masterModeIsNone(masterMode)) {
         		log_msg("In master mode %s",masterModeToString(masterMode).c_str());
         	}
@@ -101,7 +101,7 @@ void *console_process(void *)
 					ss << " " << controlModeToString(*itr);
 				}
 				ss << ", current mode is " << controlModeToString(controlMode);
-				log_warn(ss.str().c_str());
+				log_warn("%s",ss.str().c_str());
 			}
 
             log_msg("[[\t'C'  : toggle console messages ]]");
@@ -291,7 +291,7 @@ void outputRobotState(){
     int mechnum=0;
 #ifdef USE_NEW_DEVICE
     DevicePtr dev = Device::current();
-    OldControlInputPtr input = ControlInput::getOldControlInput();
+    OldControlInputPtr input = ControlInput::oldControlInputSnapshot();
 #endif
     while (loop_over_mechs(&device0,_mech,mechnum)) {
 #ifdef USE_NEW_DEVICE
@@ -581,7 +581,7 @@ void outputRobotState(){
 	std::cout << ss.str();
 
 
-	std::cout << "grasp " << Controller::getControlInput<OldControlInput>(std::string("old"))->arm(0).grasp() << std::endl;
+	std::cout << "grasp " << ControlInput::oldControlInputSnapshot()->arm(0).grasp() << std::endl;
 */
 
     /*
@@ -13,14 +13,46 @@
 #include <boost/thread/mutex.hpp>
 #include <boost/thread/recursive_mutex.hpp>
 
+#include <sched.h>
+#include <string.h>
+#include <algorithm>
+
 #include <raven/state/runlevel.h>
 
+#include "log.h"
+
 boost::mutex inputMutex;
 std::map<std::pair<Arm::IdType,std::string>,ControlInputPtr> ControlInput::CONTROL_INPUT;
 
 
-boost::recursive_mutex oldInputMutex;
-OldControlInputPtr ControlInput::OLD_CONTROL_INPUT;
+/*
+ * Triple buffer state: indices of the back (being written), middle (last
+ * published, not yet picked up) and front (being read by the rt thread)
+ * buffers, plus a flag set when the middle buffer is newer than the front.
+ * Zero means the buffers have not been created yet.
+ */
+#define OLD_INPUT_BACK(state) ((state) & 3)
+#define OLD_INPUT_MIDDLE(state) (((state) >> 2) & 3)
+#define OLD_INPUT_FRONT(state) (((state) >> 4) & 3)
+#define OLD_INPUT_FRESH 0x40
+#define OLD_INPUT_STATE(back,middle,front) ((back) | ((middle) << 2) | ((front) << 4))
+
+boost::recursive_mutex oldInputMutex; // serializes writers other than the rt thread, never taken by it
+OldControlInputPtr ControlInput::OLD_CONTROL_INPUT[3];
+volatile unsigned int ControlInput::OLD_CONTROL_INPUT_STATE = 0;
+int ControlInput::OLD_CONTROL_INPUT_PUBLISHED = 0;
+int ControlInput::OLD_CONTROL_INPUT_UPDATE_DEPTH = 0;
+
+/*
+ * The rt thread's writer slot. OLD_CONTROL_INPUT_RT_SEQ is a sequence lock,
+ * odd while the rt thread writes its front buffer or the slot.
+ * OLD_CONTROL_INPUT_RT_BASE[i] is the sequence buffer i was built on; a buffer
+ * built on an older sequence misses an rt write.
+ */
+OldControlInputPtr ControlInput::OLD_CONTROL_INPUT_RT;
+volatile unsigned int ControlInput::OLD_CONTROL_INPUT_RT_SEQ = 0;
+volatile unsigned int ControlInput::OLD_CONTROL_INPUT_RT_BASE[3] = { 0, 0, 0 };
+int ControlInput::OLD_CONTROL_INPUT_RT_DEPTH = 0;
 
 boost::mutex masterMutex;
 std::map<Arm::IdType,MasterMode2> MasterMode2::MASTER_MODES;
@@ -147,29 +179,177 @@ ControlInput::getControlInput(Arm::IdType arm, const std::string& type) {
 	return input;
 }
 
+void
+ControlInput::initOldControlInput() {
+	boost::recursive_mutex::scoped_lock lock(oldInputMutex);
+	if (OLD_CONTROL_INPUT_STATE) {
+		return;
+	}
+	for (int i=0;i<3;i++) {
+		OLD_CONTROL_INPUT[i].reset(new OldControlInput());
+	}
+	OLD_CONTROL_INPUT_RT.reset(new OldControlInput());
+	OLD_CONTROL_INPUT_PUBLISHED = 2;
+	__sync_synchronize();
+	OLD_CONTROL_INPUT_STATE = OLD_INPUT_STATE(0,1,2);
+}
+
 OldControlInputPtr
 ControlInput::getOldControlInput() {
-	boost::mutex::scoped_lock(inputMutex);
-	OldControlInputPtr ptr;
-	if (ROS_UNLIKELY(!OLD_CONTROL_INPUT)) {
-		OLD_CONTROL_INPUT.reset(new OldControlInput());
+	if (ROS_UNLIKELY(!OLD_CONTROL_INPUT_STATE)) {
+		initOldControlInput();
+	}
+	unsigned int state = OLD_CONTROL_INPUT_STATE;
+	// the front buffer stays put while the rt thread is writing it
+	if (OLD_CONTROL_INPUT_RT_DEPTH) {
+		return OLD_CONTROL_INPUT[OLD_INPUT_FRONT(state)];
+	}
+	bool swapped_in = false;
+	while (state & OLD_INPUT_FRESH) {
+		unsigned int swapped = OLD_INPUT_STATE(OLD_INPUT_BACK(state),OLD_INPUT_FRONT(state),OLD_INPUT_MIDDLE(state));
+		unsigned int prev = __sync_val_compare_and_swap(&OLD_CONTROL_INPUT_STATE,state,swapped);
+		if (prev == state) {
+			state = swapped;
+			swapped_in = true;
+		} else {
+			state = prev;
+		}
+	}
+	int front = OLD_INPUT_FRONT(state);
+	if (swapped_in && OLD_CONTROL_INPUT_RT_BASE[front] != OLD_CONTROL_INPUT_RT_SEQ) {
+		// built before our last write, which wins
+		OLD_CONTROL_INPUT_RT_SEQ++;
+		__sync_synchronize();
+		OLD_CONTROL_INPUT[front]->copyFrom(*OLD_CONTROL_INPUT_RT);
+		OLD_CONTROL_INPUT_RT_BASE[front] = OLD_CONTROL_INPUT_RT_SEQ + 1;
+		__sync_synchronize();
+		OLD_CONTROL_INPUT_RT_SEQ++;
+	}
+	return OLD_CONTROL_INPUT[front];
+}
+
+/*
+ * Copies the newest input to dst: the last published buffer, or the rt slot if
+ * the rt thread wrote since that buffer was built. Returns the rt sequence dst
+ * is built on. Called with oldInputMutex held.
+ */
+unsigned int
+ControlInput::copyNewestOldControlInput(OldControlInput& dst) {
+	int published = OLD_CONTROL_INPUT_PUBLISHED;
+	while (true) {
+		unsigned int seq = OLD_CONTROL_INPUT_RT_SEQ;
+		if (seq & 1) {
+			// the rt thread is mid-write, which takes microseconds
+			sched_yield();
+			continue;
+		}
+		__sync_synchronize();
+		// the published buffer may be the rt thread's front, so it is read under the sequence too
+		bool fromSlot = OLD_CONTROL_INPUT_RT_BASE[published] != seq;
+		dst.copyFrom(fromSlot ? *OLD_CONTROL_INPUT_RT : *OLD_CONTROL_INPUT[published]);
+		__sync_synchronize();
+		if (OLD_CONTROL_INPUT_RT_SEQ == seq) {
+			return seq;
+		}
 	}
-	ptr = OLD_CONTROL_INPUT;
-	return ptr;
+}
+
+OldControlInputPtr
+ControlInput::oldControlInputSnapshot() {
+	OldControlInputPtr copy(new OldControlInput());
+	oldControlInputSnapshot(*copy);
+	return copy;
+}
+
+void
+ControlInput::oldControlInputSnapshot(OldControlInput& into) {
+	if (ROS_UNLIKELY(!OLD_CONTROL_INPUT_STATE)) {
+		initOldControlInput();
+	}
+	boost::recursive_mutex::scoped_lock lock(oldInputMutex);
+	copyNewestOldControlInput(into);
 }
 
 OldControlInputPtr
 ControlInput::oldControlInputUpdateBegin() {
 	TRACER_ENTER_SCOPE("ControlInput::oldControlInputUpdateBegin()");
+	if (ROS_UNLIKELY(!OLD_CONTROL_INPUT_STATE)) {
+		initOldControlInput();
+	}
 	oldInputMutex.lock();
-	return getOldControlInput();
+	// only writers move the back buffer, so it is stable while we hold the lock
+	int backIndex = OLD_INPUT_BACK(OLD_CONTROL_INPUT_STATE);
+	OldControlInputPtr back = OLD_CONTROL_INPUT[backIndex];
+	if (OLD_CONTROL_INPUT_UPDATE_DEPTH++ == 0) {
+		OLD_CONTROL_INPUT_RT_BASE[backIndex] = copyNewestOldControlInput(*back);
+	}
+	return back;
 }
 void
 ControlInput::oldControlInputUpdateEnd() {
 	TRACER_ENTER_SCOPE("ControlInput::oldControlInputUpdateEnd()");
+	if (--OLD_CONTROL_INPUT_UPDATE_DEPTH == 0) {
+		unsigned int state = OLD_CONTROL_INPUT_STATE;
+		while (true) {
+			unsigned int swapped = OLD_INPUT_STATE(OLD_INPUT_MIDDLE(state),OLD_INPUT_BACK(state),OLD_INPUT_FRONT(state)) | OLD_INPUT_FRESH;
+			unsigned int prev = __sync_val_compare_and_swap(&OLD_CONTROL_INPUT_STATE,state,swapped);
+			if (prev == state) {
+				break;
+			}
+			state = prev;
+		}
+		OLD_CONTROL_INPUT_PUBLISHED = OLD_INPUT_BACK(state);
+	}
 	oldInputMutex.unlock();
 }
 
+OldControlInputPtr
+ControlInput::oldControlInputRtUpdateBegin() {
+	TRACER_ENTER_SCOPE("ControlInput::oldControlInputRtUpdateBegin()");
+	OldControlInputPtr front = getOldControlInput();
+	if (OLD_CONTROL_INPUT_RT_DEPTH++ == 0) {
+		OLD_CONTROL_INPUT_RT_SEQ++;
+		__sync_synchronize();
+	}
+	return front;
+}
+
+void
+ControlInput::oldControlInputRtUpdateEnd() {
+	TRACER_ENTER_SCOPE("ControlInput::oldControlInputRtUpdateEnd()");
+	if (--OLD_CONTROL_INPUT_RT_DEPTH == 0) {
+		int front = OLD_INPUT_FRONT(OLD_CONTROL_INPUT_STATE);
+		OLD_CONTROL_INPUT_RT->copyFrom(*OLD_CONTROL_INPUT[front]);
+		OLD_CONTROL_INPUT_RT_BASE[front] = OLD_CONTROL_INPUT_RT_SEQ + 1;
+		__sync_synchronize();
+		OLD_CONTROL_INPUT_RT_SEQ++;
+	}
+}
+
+const char* const MultipleControlInput::CHANNEL_NAMES[NUM_CONTROL_INPUT_CHANNELS] = {
+		"position",
+		"velocity",
+		"pose",
+		"grasp"
+};
+
+const unsigned int MultipleControlInput::CHANNEL_KINDS[NUM_CONTROL_INPUT_CHANNELS] = {
+		CONTROL_INPUT_KIND_MOTOR_POSITION,
+		CONTROL_INPUT_KIND_MOTOR_VELOCITY,
+		CONTROL_INPUT_KIND_END_EFFECTOR_POSE,
+		CONTROL_INPUT_KIND_END_EFFECTOR_GRASP
+};
+
+int
+MultipleControlInput::channelIdFromName(const std::string& name) {
+	for (int i=0;i<NUM_CONTROL_INPUT_CHANNELS;i++) {
+		if (name == CHANNEL_NAMES[i]) {
+			return i;
+		}
+	}
+	return -1;
+}
+
 ros::Time
 MultipleControlInput::timestamp() const {
 	ros::Time stamp(0);
@@ -240,42 +420,51 @@ MultipleControlInput::getInput(const std::string& name) const {
 
 void
 MultipleControlInput::setInput(const std::string& name,ControlInputPtr input) {
+	int channelId = channelIdFromName(name);
+	if (channelId >= 0) {
+		if (input && (input->kind() & CHANNEL_KINDS[channelId]) != CHANNEL_KINDS[channelId]) {
+			log_err("Input for channel %s has the wrong type!",name.c_str());
+			return;
+		}
+		channels_[channelId] = input;
+	}
 	inputs_[name] = input;
 }
 void
 MultipleControlInput::removeInput(const std::string& name) {
+	int channelId = channelIdFromName(name);
+	if (channelId >= 0) {
+		channels_[channelId].reset();
+	}
 	inputs_.erase(name);
 }
 void
 MultipleControlInput::clearInputs() {
+	for (int i=0;i<NUM_CONTROL_INPUT_CHANNELS;i++) {
+		channels_[i].reset();
+	}
 	inputs_.clear();
 }
 
 
-OldArmInputData::OldArmInputData(const OldArmInputData& other) : //id_(other.id_),
-			motorPositions_(new std::vector<float>(other.motorPositions_->begin(),other.motorPositions_->end())),
-			motorVelocities_(new std::vector<float>(other.motorVelocities_->begin(),other.motorVelocities_->end())),
-			motorTorques_(new std::vector<float>(other.motorTorques_->begin(),other.motorTorques_->end())),
-			jointPositions_(new std::vector<float>(other.jointPositions_->begin(),other.jointPositions_->end())),
-			jointVelocities_(new std::vector<float>(other.jointVelocities_->begin(),other.jointVelocities_->end())),
-			pose_(new btTransform(*(other.pose_))), grasp_(new float(*(other.grasp_))) {
-
-}
-
-//OldArmInputData::OldArmInputData(int id) : id_(id),
-//OldArmInputData::OldArmInputData() :
 OldArmInputData::OldArmInputData(int id,size_t numMotors,size_t numJoints) :
-		motorPositions_(new std::vector<float>(numMotors,0)),
-		motorVelocities_(new std::vector<float>(numMotors,0)),
-		motorTorques_(new std::vector<float>(numMotors,0)),
-		jointPositions_(new std::vector<float>(numJoints,0)),
-		jointVelocities_(new std::vector<float>(numJoints,0)),
-		pose_(new btTransform(btTransform::getIdentity())), grasp_(new float(0)) {
-
+		numMotors_(std::min(numMotors,(size_t)OLD_ARM_INPUT_MAX_MOTORS)),
+		numJoints_(std::min(numJoints,(size_t)OLD_ARM_INPUT_MAX_JOINTS)),
+		pose_(btTransform::getIdentity()), grasp_(0) {
+	if (numMotors > OLD_ARM_INPUT_MAX_MOTORS || numJoints > OLD_ARM_INPUT_MAX_JOINTS) {
+		log_err("Arm %d has %d motors and %d joints, old input only holds %d and %d",
+				id,(int)numMotors,(int)numJoints,OLD_ARM_INPUT_MAX_MOTORS,OLD_ARM_INPUT_MAX_JOINTS);
+	}
+	memset(motorPositions_,0,sizeof(motorPositions_));
+	memset(motorVelocities_,0,sizeof(motorVelocities_));
+	memset(motorTorques_,0,sizeof(motorTorques_));
+	memset(jointPositions_,0,sizeof(jointPositions_));
+	memset(jointVelocities_,0,sizeof(jointVelocities_));
 }
 
 
 OldControlInput::OldControlInput() : SeparateArmControlInput<OldArmInputData>(Device::armIds()) {
+	kind_ = KIND;
 	/*static DevicePtr device;
 	FOREACH_ARM_IN_CURRENT_DEVICE(arm,device) {
 		arms_.push_back(OldArmInputData(arm->id()));
@@ -307,6 +496,15 @@ OldControlInput::setFrom(DeviceConstPtr dev) {
 	}
 }
 
+void
+OldControlInput::copyFrom(const OldControlInput& other) {
+	// the arm records are fixed-size, so this never allocates
+	for (size_t i=0;i<arms_.size() && i<other.arms_.size();i++) {
+		arms_[i] = other.arms_[i];
+	}
+	timestamp_ = other.timestamp_;
+}
+
 Eigen::VectorXf OldControlInput::motorPositionVector() const {
 	size_t numEl = 0;
 	for (size_t i=0;i<arms_.size();i++) {
@@ -11,6 +11,7 @@
 #include <raven/control/input/motor_input.h>
 
 #include <raven/util/timing.h>
+#include <raven/util/trace.h>
 
 #include <set>
 #include <stdexcept>
@@ -83,6 +84,7 @@ int
 Controller::executeInProcessControl() {
 	static DevicePtr holdPosDev;
 	TRACER_ENTER_SCOPE("Controller::executeInProcessControl()");
+	TRACE_SCOPE(TRACE_CONTROL,"Controller::executeInProcessControl");
 	TimingInfo t_info;
 
 	Arm::IdList holdPosIds; // = Device::disabledArmIds();
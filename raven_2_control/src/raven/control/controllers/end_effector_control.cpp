@@ -7,6 +7,8 @@
 
 #include <raven/control/controllers/end_effector_control.h>
 
+#include <raven/util/config.h>
+
 #include "log.h"
 #include <algorithm>
 
@@ -26,6 +28,10 @@ EndEffectorController::internalApplyControl(DevicePtr device) {
 		state.reset(new EndEffectorControlState(device));
 	}
 
+	if (!motorInput) {
+		motorInput.reset(new MotorPositionInput(Device::armIds()));
+	}
+
 	DevicePtr devTmp;
 
 	EndEffectorPoseInputPtr poseInput;
@@ -34,8 +40,8 @@ EndEffectorController::internalApplyControl(DevicePtr device) {
 
 	MultipleControlInputPtr multiInput = getInput<MultipleControlInput>();
 	if (multiInput) {
-		poseInput = multiInput->getInput<EndEffectorPoseInput>("pose");
-		graspInput = multiInput->getInput<EndEffectorGraspInput>("grasp");
+		poseInput = multiInput->channel<EndEffectorPoseChannel>();
+		graspInput = multiInput->channel<EndEffectorGraspChannel>();
 
 		if (!poseInput && !graspInput) {
 			//TODO: complain
@@ -51,42 +57,60 @@ EndEffectorController::internalApplyControl(DevicePtr device) {
 
 	if (graspInput) {
 		device->cloneInto(internalDevice);
-		FOREACH_ARM_IN_DEVICE_AND_ID_LIST(arm,internalDevice,graspInput->ids()) {
-			arm->getJointById(Joint::IdType::GRASP_)->setPosition(graspInput->armById(arm->id()).value());
+		for (size_t i=0;i<internalDevice->numArms();i++) {
+			const EndEffectorGraspData* grasp = graspInput->armByIndex(i);
+			if (grasp) {
+				internalDevice->arm(i)->getJointById(Joint::IdType::GRASP_)->setPosition(grasp->value());
+			}
 		}
 		devTmp = internalDevice;
 	} else if (oldControlInput) {
 		device->cloneInto(internalDevice);
-		FOREACH_ARM_IN_DEVICE(arm,internalDevice) {
-			arm->getJointById(Joint::IdType::GRASP_)->setPosition(oldControlInput->armById(arm->id()).grasp());
+		for (size_t i=0;i<internalDevice->numArms();i++) {
+			const OldArmInputData* old = oldControlInput->armByIndex(i);
+			if (old) {
+				internalDevice->arm(i)->getJointById(Joint::IdType::GRASP_)->setPosition(old->grasp());
+			}
 		}
 		devTmp = internalDevice;
 	} else {
 		devTmp = device;
 	}
 
-	FOREACH_ARM_IN_DEVICE(arm,devTmp) {
+	EndEffectorPoseAndInsertionInputPtr withInsertion = controlInputCast<EndEffectorPoseAndInsertionInput>(poseInput);
+	for (size_t i=0;i<devTmp->numArms();i++) {
+		ArmPtr arm = devTmp->arm(i);
+		MotorArmData* motorData = motorInput->armByIndex(i);
+		if (!motorData) {
+			continue;
+		}
+		const EndEffectorPoseData* poseData = poseInput ? poseInput->armByIndex(i) : NULL;
+		const OldArmInputData* old = oldControlInput ? oldControlInput->armByIndex(i) : NULL;
 		btTransform pose;
-		if (poseInput and poseInput->hasId(arm->id())) {
+		if (poseData) {
 			if (poseInput->absolute()) {
-				pose = poseInput->armById(arm->id()).value();
+				pose = poseData->value();
 			} else {
-				pose.setOrigin(device->getArmById(arm->id())->pose().getOrigin() + poseInput->armById(arm->id()).value().getOrigin());
-				pose.setRotation(poseInput->armById(arm->id()).value().getRotation());
-				EndEffectorPoseAndInsertionInputPtr withInsertion = boost::dynamic_pointer_cast<EndEffectorPoseAndInsertionInput>(poseInput);
+				pose.setOrigin(device->arm(i)->pose().getOrigin() + poseData->value().getOrigin());
+				pose.setRotation(poseData->value().getRotation());
 				if (withInsertion && withInsertion->hasInsertion(arm->id())) {
 					//FIXME: insertion
 				}
 			}
+		} else if (old) {
+			pose = old->pose();
 		} else {
-			pose = oldControlInput->armById(arm->id()).pose();
+			motorData->values() = device->arm(i)->motorPositionVector();
+			continue;
 		}
-		InverseKinematicsReportPtr report = arm->kinematics().inverse(pose);
+		InverseKinematicsOptions ikOptions = arm->kinematics().getDefaultIKOptions();
+		ikOptions.setIncremental(RavenConfig.use_incremental_ik);
+		InverseKinematicsReportPtr report = arm->kinematics().inverse(pose,ikOptions);
 		if (report->success()) {
-			motorInput->armById(arm->id()).values() = arm->motorPositionVector();
+			motorData->values() = arm->motorPositionVector();
 		} else {
 			log_err_throttle(0.25,"inv kinematics bad! %f",0.1);
-			motorInput->armById(arm->id()).values() = device->getArmById(arm->id())->motorPositionVector();
+			motorData->values() = device->arm(i)->motorPositionVector();
 		}
 	}
 
@@ -10,15 +10,38 @@
 
 #include <boost/algorithm/string.hpp>
 #include <string>
+#include <algorithm>
 
 #include <raven/util/stringify.h>
 
 #include <iostream>
 #include "log.h"
 
+static bool
+setLanesFromInput(const MotorValuesInput& input, size_t armIndex, float* lanes) {
+	const MotorArmData* data = input.armByIndex(armIndex);
+	if (!data) {
+		return false;
+	}
+	const Eigen::VectorXf& values = data->values();
+	for (int j=0;j<values.rows() && j<PID_KERNEL_MAX_MOTORS_PER_ARM;j++) {
+		lanes[pidKernelLaneForMotor(armIndex,j)] = values(j);
+	}
+	return true;
+}
+
+static bool
+setLanesFromInput(const OldArmInputData::ConstValues& values, size_t armIndex, float* lanes) {
+	for (int j=0;j<values.rows() && j<PID_KERNEL_MAX_MOTORS_PER_ARM;j++) {
+		lanes[pidKernelLaneForMotor(armIndex,j)] = values(j);
+	}
+	return values.rows() != 0;
+}
+
 ControllerStatePtr
 MotorPositionPID::internalApplyControl(DevicePtr device) {
 	static MotorList motorsForUpdate;
+	static PIDKernelIO io;
 	TRACER_ENTER("MotorPositionPID::internalApplyControl()");
 
 	MotorPositionPIDStatePtr lastState = getLastState<MotorPositionPIDState>();
@@ -27,105 +50,72 @@ MotorPositionPID::internalApplyControl(DevicePtr device) {
 		state.reset(new MotorPositionPIDState(device));
 	}
 
-	Eigen::VectorXf pos = device->motorPositionVector();
-	Eigen::VectorXf vel = device->motorVelocityVector();
-
-	Eigen::VectorXf pos_d;
-	Eigen::VectorXi pos_d_armIds;
-	Eigen::VectorXi pos_d_motorIds;
-	Eigen::VectorXf vel_d;
-	Eigen::VectorXi vel_d_armIds;
-	Eigen::VectorXi vel_d_motorIds;
-
 	MotorPositionInputPtr posInput;
 	MotorVelocityInputPtr velInput;
 	DualControlInput<MotorPositionInput,MotorVelocityInput>::Ptr dualInput;
 	MultipleControlInputPtr multiInput;
-
-	Arm::IdSet ids;
-
-	bool using_old = false;
+	OldControlInputPtr oldControlInput;
 
 	if (getInput(posInput)) {
-		posInput->fullVector(pos_d,pos_d_armIds,pos_d_motorIds);
-		Arm::idSetAdd(ids,posInput->ids());
+		//nothing
 	} else if (getInput(velInput)){
-		velInput->fullVector(vel_d,vel_d_armIds,vel_d_motorIds);
-		Arm::idSetAdd(ids,velInput->ids());
+		//nothing
 	} else if (getInput(dualInput)) {
-		dualInput->first()->fullVector(pos_d,pos_d_armIds,pos_d_motorIds);
-		dualInput->second()->fullVector(vel_d,vel_d_armIds,vel_d_motorIds);
-		Arm::idSetAdd(ids,dualInput->armIds());
+		posInput = dualInput->first();
+		velInput = dualInput->second();
 	} else if (getInput(multiInput)) {
-		if (multiInput->getInput("position",posInput)) {
-			posInput->fullVector(pos_d,pos_d_armIds,pos_d_motorIds);
-			Arm::idSetAdd(ids,posInput->ids());
-		}
-		if (multiInput->getInput("velocity",velInput)) {
-			velInput->fullVector(vel_d,vel_d_armIds,vel_d_motorIds);
-			Arm::idSetAdd(ids,velInput->ids());
-		}
+		posInput = multiInput->channel<MotorPositionChannel>();
+		velInput = multiInput->channel<MotorVelocityChannel>();
 	} else {
-		using_old = true;
-		OldControlInputPtr oldControlInput = ControlInput::getOldControlInput();
-		pos_d = oldControlInput->motorPositionVector();
-		vel_d = oldControlInput->motorVelocityVector();
+		oldControlInput = ControlInput::getOldControlInput();
 	}
 
-	if (pos_d.rows() == 0) {
-		if (vel_d.rows() == 0) {
-			//TODO: nothing
-		} else {
-			pos_d.setZero(vel_d.rows());
+	io.clear();
+	size_t numArms = std::min(device->numArms(),(size_t)PID_KERNEL_MAX_ARMS);
+	for (size_t i=0;i<numArms;i++) {
+		ArmPtr arm = device->arm(i);
+		const MotorList& motors = arm->motors();
+		size_t numMotors = std::min(motors.size(),(size_t)PID_KERNEL_MAX_MOTORS_PER_ARM);
+		for (size_t j=0;j<numMotors;j++) {
+			size_t lane = pidKernelLaneForMotor(i,j);
+			io.position[lane] = motors[j]->position();
+			io.velocity[lane] = motors[j]->velocity();
+			io.positionDesired[lane] = motors[j]->position();
 		}
-	} else if (vel_d.rows() == 0) {
-		vel_d.setZero(pos_d.rows());
-	}
 
-	Eigen::VectorXf pos_err = pos_d - pos;
-	Eigen::VectorXf vel_err = vel_d - vel;
+		bool hasInput = false;
+		if (oldControlInput) {
+			const OldArmInputData* data = oldControlInput->armByIndex(i);
+			if (data) {
+				hasInput = setLanesFromInput(data->motorPositions(),i,io.positionDesired);
+				setLanesFromInput(data->motorVelocities(),i,io.velocityDesired);
+			}
+		} else {
+			if (posInput && setLanesFromInput(*posInput,i,io.positionDesired)) {
+				hasInput = true;
+			}
+			if (velInput && setLanesFromInput(*velInput,i,io.velocityDesired)) {
+				hasInput = true;
+			}
+		}
 
-	Eigen::VectorXf int_err(pos_err.rows());
-	if (!lastState || getResetState()) {
-		int_err.setZero();
-	} else {
-		int_err = lastState->positionErrorIntegral + pos_err * (lastState->device->timestamp() - device->timestamp()).toSec();
-		if (!using_old) {
-			for (int i=0;i<int_err.rows();i++) {
-				if (pos_d_armIds(i) < 0) {
-					int_err(i) = lastState->positionErrorIntegral(i);
-				}
+		if (hasInput) {
+			for (size_t j=0;j<numMotors;j++) {
+				io.active[pidKernelLaneForMotor(i,j)] = 1;
 			}
 		}
 	}
-	state->positionErrorIntegral = int_err;
-
-	Eigen::VectorXf p_term = KP_.cwiseProduct(pos_err);
-	Eigen::VectorXf i_term = KI_.cwiseProduct(int_err);
-	Eigen::VectorXf d_term = KD_.cwiseProduct(vel_err);
-	//log_msg_throttle(0.25,"pos err %f",pos_err(0));
-
-	Eigen::VectorXf values1 = p_term + i_term;
-	Eigen::VectorXf values2 = i_term + d_term;
-	Eigen::VectorXf values3 = p_term + d_term;
 
-	Eigen::VectorXf values = p_term + i_term + d_term;
+	bool resetIntegral = !lastState || getResetState();
+	float dt = lastState ? (device->timestamp() - lastState->device->timestamp()).toSec() : 0;
+	pidKernelApply(kernelGains_,state->kernel,io,dt,resetIntegral);
 
-	float tmp = -1;
-	size_t begin_ind = 0;
-	for (size_t i=0;i<device->arms().size();i++) {
+	for (size_t i=0;i<numArms;i++) {
 		device->arm(i)->controlMotorFilter()->getMotorsForUpdate(motorsForUpdate);
-		Eigen::VectorXf armVals = values.segment(begin_ind,motorsForUpdate.size());
-
-		for (size_t j=0;j<motorsForUpdate.size();j++) {
-			float val = armVals(j);
-			if (val!=0) { tmp = val; }
-			motorsForUpdate[j]->setTorque(val);
+		for (size_t j=0;j<motorsForUpdate.size() && j<PID_KERNEL_MAX_MOTORS_PER_ARM;j++) {
+			motorsForUpdate[j]->setTorque(io.torque[pidKernelLaneForMotor(i,j)]);
 		}
-
-		begin_ind += motorsForUpdate.size();
 	}
-	//log_msg_throttle(0.25,"tmp: %f",tmp);
 
 	TRACER_LEAVE();
 	return state;
@@ -151,7 +141,6 @@ MotorPositionPID::internalApplyControl(DevicePtr device) {
 
 MotorPositionPID::MotorPositionPID() : Controller(1) {
 	TRACER_ENTER_SCOPE("MotorPositionPID::MotorPositionPID()");
-	size_t totalSize = 0;
 	FOREACH_ARM_ID(armId) {
 		ArmGains armGains;
 		armGains.id = armId;
@@ -174,22 +163,16 @@ MotorPositionPID::MotorPositionPID() : Controller(1) {
 			g.KD = kd_gains[i];
 			armGains.gains.push_back(g);
 		}
-		totalSize += kp_gains.size();
 		gains_.push_back(armGains);
 	}
 
-	KP_.resize(totalSize);
-	KI_.resize(totalSize);
-	KD_.resize(totalSize);
-
-	size_t startInd = 0;
-	for (size_t i=0;i<gains_.size();i++) {
-		for (size_t j=0;j<gains_[i].gains.size();j++) {
-			KP_[startInd + j] = gains_[i].gains[j].KP;
-			KI_[startInd + j] = gains_[i].gains[j].KI;
-			KD_[startInd + j] = gains_[i].gains[j].KD;
+	for (size_t i=0;i<gains_.size() && i<PID_KERNEL_MAX_ARMS;i++) {
+		for (size_t j=0;j<gains_[i].gains.size() && j<PID_KERNEL_MAX_MOTORS_PER_ARM;j++) {
+			size_t lane = pidKernelLaneForMotor(i,j);
+			kernelGains_.kp[lane] = gains_[i].gains[j].KP;
+			kernelGains_.ki[lane] = gains_[i].gains[j].KI;
+			kernelGains_.kd[lane] = gains_[i].gains[j].KD;
 		}
-		startInd += gains_[i].gains.size();
 	}
 }
 
@@ -10,9 +10,11 @@
 #include <sstream>
 
 EndEffectorPoseInput::EndEffectorPoseInput(const Arm::IdList& ids) : SeparateArmControlInput<EndEffectorPoseData>(ids), relative_(false) {
+	kind_ = KIND;
 
 }
 EndEffectorPoseInput::EndEffectorPoseInput(const Arm::IdList& ids,bool relative) : SeparateArmControlInput<EndEffectorPoseData>(ids), relative_(relative) {
+	kind_ = KIND;
 
 }
 
@@ -35,6 +37,7 @@ EndEffectorPoseInput::setFrom(DeviceConstPtr dev) {
 
 
 EndEffectorPoseAndInsertionInput::EndEffectorPoseAndInsertionInput(const Arm::IdList& ids) : EndEffectorPoseInput(ids,true) {
+	kind_ = KIND;
 
 }
 
@@ -69,9 +72,11 @@ EndEffectorPoseAndInsertionInput::clearInsertions() {
 }
 
 SingleArmEndEffectorPoseInput::SingleArmEndEffectorPoseInput(Arm::IdType id) : EndEffectorPoseInput(Arm::IdList(1,id)) {
+	kind_ = KIND;
 
 }
 SingleArmEndEffectorPoseInput::SingleArmEndEffectorPoseInput(Arm::IdType id, bool relative) : EndEffectorPoseInput(Arm::IdList(1,id),relative) {
+	kind_ = KIND;
 
 }
 
@@ -82,6 +87,9 @@ SingleArmEndEffectorPoseInput::setFrom(DeviceConstPtr dev) {
 }
 
 SingleArmEndEffectorPoseAndInsertionInput::SingleArmEndEffectorPoseAndInsertionInput(Arm::IdType id) : EndEffectorPoseAndInsertionInput(Arm::IdList(1,id)), SingleArmEndEffectorPoseInput(id) {
+	// this class has two ControlInput bases; set the kind of both
+	EndEffectorPoseAndInsertionInput::kind_ = KIND | CONTROL_INPUT_KIND_MULTIPLE_BASES;
+	SingleArmEndEffectorPoseInput::kind_ = KIND | CONTROL_INPUT_KIND_MULTIPLE_BASES;
 
 }
 
@@ -0,0 +1,122 @@
+/*
+ * pid_kernel.cpp
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: agent
+ */
+
+#include <raven/control/pid_kernel.h>
+
+#include <float.h>
+#include <string.h>
+
+#ifdef __SSE__
+#include <xmmintrin.h>
+#endif
+
+void
+PIDKernelGains::clear() {
+	memset(kp,0,sizeof(kp));
+	memset(ki,0,sizeof(ki));
+	memset(kd,0,sizeof(kd));
+	for (int i=0;i<PID_KERNEL_SIZE;i++) {
+		maxPositionError[i] = PID_KERNEL_NO_LIMIT;
+		maxVelocity[i] = FLT_MAX;
+		maxVelocityDesired[i] = FLT_MAX;
+		maxIntegral[i] = FLT_MAX;
+	}
+}
+
+void
+PIDKernelState::reset() {
+	memset(errorIntegral,0,sizeof(errorIntegral));
+}
+
+void
+PIDKernelIO::clear() {
+	memset(this,0,sizeof(*this));
+}
+
+#ifdef __SSE__
+
+static inline __m128 clamp_ps(__m128 value, __m128 limit) {
+	return _mm_max_ps(_mm_min_ps(value,limit),_mm_sub_ps(_mm_setzero_ps(),limit));
+}
+
+static inline __m128 select_ps(__m128 mask, __m128 ifTrue, __m128 ifFalse) {
+	return _mm_or_ps(_mm_and_ps(mask,ifTrue),_mm_andnot_ps(mask,ifFalse));
+}
+
+unsigned int
+pidKernelApply(const PIDKernelGains& g, PIDKernelState& s, PIDKernelIO& io, float dt, bool resetIntegral) {
+	const __m128 zero = _mm_setzero_ps();
+	const __m128 vdt = _mm_set1_ps(dt);
+	const __m128 reset = resetIntegral ? _mm_cmpeq_ps(zero,zero) : zero;
+	unsigned int capped = 0;
+
+	for (int i=0;i<PID_KERNEL_SIZE;i+=4) {
+		__m128 active = _mm_cmpneq_ps(_mm_loadu_ps(io.active+i),zero);
+
+		__m128 err_raw = _mm_sub_ps(_mm_loadu_ps(io.positionDesired+i),_mm_loadu_ps(io.position+i));
+		__m128 err = clamp_ps(err_raw,_mm_loadu_ps(g.maxPositionError+i));
+		capped |= ((unsigned int)_mm_movemask_ps(_mm_and_ps(active,_mm_cmpneq_ps(err,err_raw)))) << i;
+
+		__m128 vel = clamp_ps(_mm_loadu_ps(io.velocity+i),_mm_loadu_ps(g.maxVelocity+i));
+		__m128 vel_d = clamp_ps(_mm_loadu_ps(io.velocityDesired+i),_mm_loadu_ps(g.maxVelocityDesired+i));
+		__m128 err_vel = _mm_sub_ps(vel_d,vel);
+
+		__m128 int_prev = _mm_loadu_ps(s.errorIntegral+i);
+		__m128 int_new = clamp_ps(_mm_add_ps(int_prev,_mm_mul_ps(err,vdt)),_mm_loadu_ps(g.maxIntegral+i));
+		int_new = select_ps(reset,zero,int_new);
+		int_new = select_ps(active,int_new,int_prev);
+
+		__m128 p_term = _mm_mul_ps(err,_mm_loadu_ps(g.kp+i));
+		__m128 i_term = _mm_mul_ps(int_new,_mm_loadu_ps(g.ki+i));
+		__m128 d_term = _mm_mul_ps(err_vel,_mm_loadu_ps(g.kd+i));
+		__m128 tau = _mm_and_ps(active,_mm_add_ps(_mm_add_ps(p_term,i_term),d_term));
+
+		_mm_storeu_ps(s.errorIntegral+i,int_new);
+		_mm_storeu_ps(io.torque+i,tau);
+		_mm_storeu_ps(io.positionError+i,_mm_and_ps(active,err));
+		_mm_storeu_ps(io.velocityError+i,_mm_and_ps(active,err_vel));
+	}
+	return capped;
+}
+
+#else
+
+static inline float clamp(float value, float limit) {
+	return value > limit ? limit : (value < -limit ? -limit : value);
+}
+
+unsigned int
+pidKernelApply(const PIDKernelGains& g, PIDKernelState& s, PIDKernelIO& io, float dt, bool resetIntegral) {
+	unsigned int capped = 0;
+	for (int i=0;i<PID_KERNEL_SIZE;i++) {
+		if (io.active[i] == 0) {
+			io.torque[i] = 0;
+			io.positionError[i] = 0;
+			io.velocityError[i] = 0;
+			continue;
+		}
+		float err_raw = io.positionDesired[i] - io.position[i];
+		float err = clamp(err_raw,g.maxPositionError[i]);
+		if (err != err_raw) {
+			capped |= 1u << i;
+		}
+		float err_vel = clamp(io.velocityDesired[i],g.maxVelocityDesired[i]) - clamp(io.velocity[i],g.maxVelocity[i]);
+
+		if (resetIntegral) {
+			s.errorIntegral[i] = 0;
+		} else {
+			s.errorIntegral[i] = clamp(s.errorIntegral[i] + err * dt,g.maxIntegral[i]);
+		}
+
+		io.torque[i] = err * g.kp[i] + s.errorIntegral[i] * g.ki[i] + err_vel * g.kd[i];
+		io.positionError[i] = err;
+		io.velocityError[i] = err_vel;
+	}
+	return capped;
+}
+
+#endif
@@ -33,7 +33,7 @@ void* control_process(void* ) {
 
 	log_msg("Waiting for input");
 	while (ros::ok()) {
-		if (!ControlInput::getOldControlInput()->arm(0).motorVelocities().empty()) {
+		if (ControlInput::oldControlInputSnapshot()->arm(0).numMotors() != 0) {
 			break;
 		}
 		ros::Duration(0.1).sleep();
@@ -0,0 +1,434 @@
+/*
+ * flight_recorder.cpp
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: agent
+ */
+
+#include "flight_recorder.h"
+
+#include <errno.h>
+#include <sched.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/resource.h>
+
+#include <algorithm>
+
+#include <boost/thread/thread.hpp>
+#include <ros/ros.h>
+
+#include <raven/util/timing.h>
+
+#include "log.h"
+#include "defines.h"
+#include "network_layer.h"
+
+// nice value of the writer thread
+#define FLIGHT_THREAD_NICE 10
+// how often the writer drains the ring
+#define FLIGHT_WRITE_INTERVAL_USEC 5000
+
+/************************ recording ************************/
+
+extern USBStruct USBBoards;
+
+// about a megabyte; the writer drains it every 5 loops
+static NetworkRing<FlightLoop,1024> flight_ring;
+static FlightLoop flight_current;
+static FlightHeader flight_header;
+static bool flight_recording = false;
+
+static FILE* flight_file = NULL;
+static std::string flight_filename;
+static volatile bool flight_running = false;
+static boost::thread* flight_thread = NULL;
+static unsigned long flight_written = 0;
+
+static int
+boardIndex(const FlightHeader& header, int id) {
+	for (unsigned int i=0;i<header.num_boards;i++) {
+		if (header.serials[i] == id) {
+			return i;
+		}
+	}
+	return -1;
+}
+
+static void
+drainFlightRing() {
+	FlightLoop loop;
+	while (flight_ring.pop(loop)) {
+		if (fwrite(&loop,sizeof(loop),1,flight_file) != 1) {
+			log_err_throttle(5,"Error writing flight recording %s: %s",flight_filename.c_str(),strerror(errno));
+			continue;
+		}
+		flight_written++;
+	}
+}
+
+static void
+flightRecorderProcess() {
+	struct sched_param param;
+	param.sched_priority = 0;
+	if (sched_setscheduler(0, SCHED_OTHER, &param) == -1) {
+		log_err("sched_setscheduler failed for the flight recorder");
+	}
+	setpriority(PRIO_PROCESS, 0, FLIGHT_THREAD_NICE);
+
+	unsigned int dropped = 0;
+	while (flight_running) {
+		drainFlightRing();
+		if (flight_ring.dropped != dropped) {
+			// a replay stops at the first gap
+			log_err("Flight recorder fell behind and dropped %u loops; the recording can only be replayed up to the first gap",
+					flight_ring.dropped - dropped);
+			dropped = flight_ring.dropped;
+		}
+		usleep(FLIGHT_WRITE_INTERVAL_USEC);
+	}
+	drainFlightRing();
+}
+
+bool
+flightRecorderStart(const std::string& filename) {
+	memset(&flight_header,0,sizeof(flight_header));
+	memcpy(flight_header.magic,FLIGHT_RECORD_MAGIC,sizeof(flight_header.magic));
+	flight_header.version = FLIGHT_RECORD_VERSION;
+	flight_header.loop_size = sizeof(FlightLoop);
+	flight_header.num_boards = 0;
+	for (size_t i=0;i<USBBoards.boards.size() && i<MAX_MECH;i++) {
+		flight_header.serials[i] = USBBoards.boards[i];
+		flight_header.num_boards++;
+	}
+
+	flight_file = fopen(filename.c_str(),"wb");
+	if (!flight_file) {
+		log_err("Could not open flight recording %s: %s",filename.c_str(),strerror(errno));
+		return false;
+	}
+	if (fwrite(&flight_header,sizeof(flight_header),1,flight_file) != 1) {
+		log_err("Error writing flight recording %s: %s",filename.c_str(),strerror(errno));
+		fclose(flight_file);
+		flight_file = NULL;
+		return false;
+	}
+	flight_filename = filename;
+	flight_running = true;
+	flight_thread = new boost::thread(flightRecorderProcess);
+	flight_recording = true;
+	log_msg("Recording every loop to %s",filename.c_str());
+	return true;
+}
+
+void
+flightRecorderStop() {
+	if (!flight_running) {
+		return;
+	}
+	flight_recording = false;
+	flight_running = false;
+	flight_thread->join();
+	delete flight_thread;
+	flight_thread = NULL;
+	fclose(flight_file);
+	flight_file = NULL;
+	log_msg("Recorded %lu loops to %s",flight_written,flight_filename.c_str());
+}
+
+void
+flightRecordLoopBegin(unsigned long loop) {
+	if (!flight_recording) {
+		return;
+	}
+	flight_current.loop = loop;
+	flight_current.stamp = LoopClock::now().toNSec();
+	flight_current.rcvd = 0;
+	for (int i=0;i<MAX_MECH;i++) {
+		flight_current.boards[i].read_len = FLIGHT_NOT_CALLED;
+		flight_current.boards[i].write_len = FLIGHT_NOT_CALLED;
+	}
+}
+
+void
+flightRecordUsbRead(int id, const void* buffer, int result) {
+	int b;
+	if (!flight_recording || (b = boardIndex(flight_header,id)) < 0) {
+		return;
+	}
+	FlightBoard& board = flight_current.boards[b];
+	board.read_len = result;
+	if (result > 0) {
+		memcpy(board.read,buffer,std::min((size_t)result,sizeof(board.read)));
+	}
+}
+
+void
+flightRecordUsbWrite(int id, const void* buffer, int result) {
+	int b;
+	if (!flight_recording || (b = boardIndex(flight_header,id)) < 0) {
+		return;
+	}
+	FlightBoard& board = flight_current.boards[b];
+	board.write_len = result;
+	if (result > 0) {
+		memcpy(board.write,buffer,std::min((size_t)result,sizeof(board.write)));
+	}
+}
+
+void
+flightRecordRcvdParams(bool rcvd, const struct param_pass* params) {
+	if (!flight_recording) {
+		return;
+	}
+	flight_current.rcvd = rcvd;
+	if (rcvd) {
+		memcpy(&flight_current.params,params,sizeof(flight_current.params));
+	}
+}
+
+void
+flightRecordLoopEnd() {
+	if (!flight_recording) {
+		return;
+	}
+	flight_ring.push(flight_current);
+}
+
+/************************ replay ************************/
+
+static FILE* replay_file = NULL;
+static std::string replay_filename;
+static FlightHeader replay_header;
+static FlightLoop replay_loop;
+
+static unsigned long replay_loops = 0;
+static uint64_t replay_first_loop = 0;
+static int64_t replay_first_stamp = 0;
+static struct timespec replay_started;
+
+// comparison of the current loop
+static bool replay_loop_open = false;
+static bool replay_written[MAX_MECH];
+static bool replay_loop_differs = false;
+
+// comparison of the whole replay
+static unsigned long replay_differing_loops = 0;
+static unsigned long replay_write_mismatches = 0;   // writes that happened in one run but not the other
+static unsigned long replay_output_mismatches = 0;  // output pin byte
+static int replay_max_dac_diff[MAX_MECH][MAX_DOF_PER_MECH];
+static unsigned long replay_dac_diffs[MAX_MECH][MAX_DOF_PER_MECH];
+static bool replay_have_first = false;
+static uint64_t replay_first_diff_loop = 0;
+static int replay_first_diff_board = 0;
+static int replay_first_diff_channel = 0;
+static int replay_first_diff_recorded = 0;
+static int replay_first_diff_replayed = 0;
+
+static inline int
+dacFromPacket(const uint8_t* packet, int channel) {
+	unsigned int raw = packet[2*channel+2] | (packet[2*channel+3] << 8);
+	return (int)raw - DAC_OFFSET;
+}
+
+static void
+finishReplayLoop() {
+	if (!replay_loop_open) {
+		return;
+	}
+	replay_loop_open = false;
+	for (unsigned int b=0;b<replay_header.num_boards;b++) {
+		if (!replay_written[b] && replay_loop.boards[b].write_len != FLIGHT_NOT_CALLED) {
+			replay_write_mismatches++;
+			replay_loop_differs = true;
+		}
+	}
+	if (replay_loop_differs) {
+		replay_differing_loops++;
+	}
+}
+
+bool
+replayOpen(const std::string& filename) {
+	replay_file = fopen(filename.c_str(),"rb");
+	if (!replay_file) {
+		log_err("Could not open recording %s: %s",filename.c_str(),strerror(errno));
+		return false;
+	}
+	if (fread(&replay_header,sizeof(replay_header),1,replay_file) != 1
+			|| memcmp(replay_header.magic,FLIGHT_RECORD_MAGIC,sizeof(replay_header.magic)) != 0) {
+		log_err("%s is not a flight recording",filename.c_str());
+		fclose(replay_file);
+		replay_file = NULL;
+		return false;
+	}
+	if (replay_header.version != FLIGHT_RECORD_VERSION || replay_header.loop_size != sizeof(FlightLoop)
+			|| replay_header.num_boards > MAX_MECH) {
+		log_err("%s was recorded by an incompatible r2_control (version %u, %u bytes per loop)",
+				filename.c_str(),replay_header.version,replay_header.loop_size);
+		fclose(replay_file);
+		replay_file = NULL;
+		return false;
+	}
+	replay_filename = filename;
+	log_msg("Replaying %s (%u boards)",filename.c_str(),replay_header.num_boards);
+	return true;
+}
+
+bool
+replaying() {
+	return replay_file != NULL;
+}
+
+void
+replayBoardSerials(std::vector<int>& serials) {
+	serials.clear();
+	for (unsigned int i=0;i<replay_header.num_boards;i++) {
+		serials.push_back(replay_header.serials[i]);
+	}
+}
+
+bool
+replayNextLoop() {
+	finishReplayLoop();
+	uint64_t last = replay_loop.loop;
+	if (fread(&replay_loop,sizeof(replay_loop),1,replay_file) != 1) {
+		return false;
+	}
+	if (!replay_loops) {
+		replay_first_loop = replay_loop.loop;
+		replay_first_stamp = replay_loop.stamp;
+		clock_gettime(CLOCK_MONOTONIC,&replay_started);
+		if (replay_loop.loop != 1) {
+			log_warn("Recording starts at loop %lu rather than the first; the replay will likely differ",(unsigned long)replay_loop.loop);
+		}
+	} else if (replay_loop.loop != last + 1) {
+		log_err("Recording skips from loop %lu to %lu; stopping the replay there",(unsigned long)last,(unsigned long)replay_loop.loop);
+		replay_loop.loop = last;
+		return false;
+	}
+	replay_loops++;
+
+	for (int b=0;b<MAX_MECH;b++) {
+		replay_written[b] = false;
+	}
+	replay_loop_differs = false;
+	replay_loop_open = true;
+
+	ros::Time stamp;
+	stamp.fromNSec(replay_loop.stamp);
+	LoopClock::set(stamp);
+	ros::Time::setNow(stamp);
+	return true;
+}
+
+int
+replayUsbRead(int id, void* buffer, size_t len) {
+	int b = boardIndex(replay_header,id);
+	if (b < 0) {
+		return -ENODEV;
+	}
+	const FlightBoard& board = replay_loop.boards[b];
+	if (board.read_len == FLIGHT_NOT_CALLED) {
+		// not read in the recording; nothing new
+		return 0;
+	}
+	if (board.read_len > 0) {
+		memcpy(buffer,board.read,std::min(len,(size_t)board.read_len));
+	}
+	return board.read_len;
+}
+
+int
+replayUsbWrite(int id, const void* buffer, size_t len) {
+	int b = boardIndex(replay_header,id);
+	if (b < 0) {
+		return -ENODEV;
+	}
+	replay_written[b] = true;
+	const FlightBoard& board = replay_loop.boards[b];
+	if (board.write_len == FLIGHT_NOT_CALLED) {
+		replay_write_mismatches++;
+		replay_loop_differs = true;
+		return len;
+	}
+
+	const uint8_t* packet = (const uint8_t*)buffer;
+	for (int ch=0;ch<MAX_DOF_PER_MECH;ch++) {
+		int recorded = dacFromPacket(board.write,ch);
+		int replayed = dacFromPacket(packet,ch);
+		int diff = abs(replayed - recorded);
+		if (!diff) {
+			continue;
+		}
+		replay_loop_differs = true;
+		replay_dac_diffs[b][ch]++;
+		if (diff > replay_max_dac_diff[b][ch]) {
+			replay_max_dac_diff[b][ch] = diff;
+		}
+		if (!replay_have_first) {
+			replay_have_first = true;
+			replay_first_diff_loop = replay_loop.loop;
+			replay_first_diff_board = b;
+			replay_first_diff_channel = ch;
+			replay_first_diff_recorded = recorded;
+			replay_first_diff_replayed = replayed;
+		}
+	}
+	if (packet[OUT_LENGTH-1] != board.write[OUT_LENGTH-1]) {
+		replay_output_mismatches++;
+		replay_loop_differs = true;
+	}
+	return len;
+}
+
+bool
+replayRcvdParams(struct param_pass* params) {
+	if (replay_loop.rcvd) {
+		memcpy(params,&replay_loop.params,sizeof(*params));
+	}
+	return replay_loop.rcvd;
+}
+
+unsigned long
+replayReport() {
+	if (!replay_file) {
+		return 0;
+	}
+	finishReplayLoop();
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC,&now);
+	double took = (now.tv_sec - replay_started.tv_sec) + (now.tv_nsec - replay_started.tv_nsec) * 1e-9;
+	double recorded = replay_loops ? (replay_loop.stamp - replay_first_stamp) * 1e-9 : 0;
+
+	log_msg("Replayed loops %lu-%lu of %s: %.1f s of recording in %.1f s",
+			(unsigned long)replay_first_loop,(unsigned long)replay_loop.loop,replay_filename.c_str(),recorded,took);
+	if (!replay_differing_loops) {
+		log_msg("DAC commands match the recording in every loop");
+	} else {
+		log_err("Output differs from the recording in %lu of %lu loops",replay_differing_loops,replay_loops);
+		if (replay_have_first) {
+			log_err("  first DAC difference: loop %lu, %s channel %d: recorded %d, replayed %d",
+					(unsigned long)replay_first_diff_loop,armNameFromSerial(replay_header.serials[replay_first_diff_board]).c_str(),
+					replay_first_diff_channel,replay_first_diff_recorded,replay_first_diff_replayed);
+		}
+		for (unsigned int b=0;b<replay_header.num_boards;b++) {
+			for (int ch=0;ch<MAX_DOF_PER_MECH;ch++) {
+				if (replay_dac_diffs[b][ch]) {
+					log_err("  %s channel %d: differs in %lu loops, by up to %d",
+							armNameFromSerial(replay_header.serials[b]).c_str(),ch,replay_dac_diffs[b][ch],replay_max_dac_diff[b][ch]);
+				}
+			}
+		}
+		if (replay_output_mismatches) {
+			log_err("  output pins differ in %lu packets",replay_output_mismatches);
+		}
+		if (replay_write_mismatches) {
+			log_err("  %lu packets were written in only one of the runs",replay_write_mismatches);
+		}
+	}
+	fclose(replay_file);
+	replay_file = NULL;
+	return replay_differing_loops;
+}
@@ -14,6 +14,7 @@
 #include <raven/state/device.h>
 #include <sstream>
 #include <raven/util/timing.h>
+#include "status_service.h"
 
 extern unsigned long int gTime;
 
@@ -36,7 +37,7 @@ void getUSBPackets(struct device *device0)
     USBTimingInfo::clear(timing);
 
 #ifdef USE_NEW_DEVICE
-    Device::beginCurrentUpdate(ros::Time::now());
+    Device::beginCurrentUpdate(LoopClock::now());
 #endif
 
 
@@ -44,9 +45,11 @@ void getUSBPackets(struct device *device0)
     for (i = 0; i < USBBoards.activeAtStart; i++)
     {
         err = getUSBPacket( USBBoards.boards[i], &(device0->mech[i] ) );
-        if (  err == -USB_WRITE_ERROR)
+        if (  err == -USB_READ_ERROR)
         {
-            log_msg("Error (%d) reading from USB Board %d (%s) on loop %d!\n", err, USBBoards.boards[i], armNameFromSerial(USBBoards.boards[i]).c_str(), gTime);
+            statusCountFault(STATUS_FAULT_USB_READ);
+            // a board that stops answering fails every cycle, so the message is rate limited
+            log_err_throttle(1,"Error (%d) reading from USB Board %d on loop %lu!\n", err, USBBoards.boards[i], gTime);
         }
     }
 
@@ -67,7 +70,7 @@ void getUSBPackets(struct device *device0)
  * inputs - mechanism - the data structure to fill
  *          id - the USB board to read from
  *
- * output - returns success of procedure
+ * output - 0 on success, -USB_READ_ERROR if no complete packet was read
  *
  */
 int getUSBPacket(int id, struct mechanism *mech)
@@ -78,25 +81,15 @@ int getUSBPacket(int id, struct mechanism *mech)
     timing.mark_get_packet_start();
     //Read USB Packet
     result = usb_read(id,buffer,IN_LENGTH);
+    struct timespec read_stamp;
+    clock_gettime(CLOCK_REALTIME, &read_stamp);
     timing.mark_get_packet_intermediate();
 
     // -- Check for read errors --
-    ///TODO: Fix error codes and error handling
-    //No Packet found
-    if (result == 0)
-        return result;
-
-    //Device Busy error
-    else if (result == -EBUSY)
-        return result;
-
-    //Packet incorrect length
-    else if ((result > 0) && (result != IN_LENGTH))
-        return result;
-
-    //Unknown error
-    else if (result < 0)
-        return result;
+    // No packet found (0), device busy (-EBUSY), incorrect length, or another
+    // errno: all are the one read error the caller counts
+    if (result != IN_LENGTH)
+        return -USB_READ_ERROR;
 
     // -- Good packet so process it --
 
@@ -109,6 +102,7 @@ int getUSBPacket(int id, struct mechanism *mech)
         //Handle and Encoder USB packet
     case ENC:
         processEncoderPacket(mech, buffer);
+        mech->enc_stamp = read_stamp;
         break;
     }
     timing.mark_process_packet_intermediate();
@@ -67,8 +67,9 @@ int raven_homing(struct device *device0, struct param_pass *currParams, int begi
     if (begin_homing || !homing_inited)
     {
 #ifdef USE_NEW_DEVICE
+    	OldControlInputPtr oldInput = ControlInput::oldControlInputRtUpdateBegin();
     	FOREACH_ARM_IN_DEVICE(arm,Device::currentNoCloneMutable()) {
-    		OldArmInputData& armData = ControlInput::getOldControlInput()->armById(arm->id());
+    		OldArmInputData& armData = oldInput->armById(arm->id());
     		for (size_t i=0;i<arm->motors().size();i++) {
     			armData.motorTorque(i) = 0;
     			armData.motorPosition(i) = arm->motor(i)->position();
@@ -79,6 +80,7 @@ int raven_homing(struct device *device0, struct param_pass *currParams, int begi
     			arm->joint(i)->setState(Joint::State::NOT_READY);
     		}
     	}
+    	ControlInput::oldControlInputRtUpdateEnd();
 #endif
     	// Zero out joint torques, and control inputs. Set joint.state=not_ready.
         _mech = NULL;  _joint = NULL;
@@ -452,7 +452,7 @@ void initDOFs(struct device *device0)
 }
 
 /**
- * init_ravengains( ros::NodeHandle n)
+ * fetch_ravengains( ros::NodeHandle n, RavenGains& gains)
  *
  *  Get ravengains from ROS parameter server.
  *
@@ -460,35 +460,24 @@ void initDOFs(struct device *device0)
  *      The order of gains in the parameter is very important.
  *      Make sure that numerical order of parameters matches the numerical order of the dof types.
  *
- *  postcondition: dof_types[].kp and dof_types[].kd have been set from ROS parameters
+ *  postcondition: gains holds the parameters by arm id, or zeros if they weren't all there
+ *  \return true if the gains were found
  */
-int init_ravengains(ros::NodeHandle n, struct device *device0)
+bool fetch_ravengains(ros::NodeHandle n, RavenGains& gains)
 {
     XmlRpc::XmlRpcValue kp_green, kp_gold, kd_green, kd_gold, ki_green, ki_gold;
     bool res=0;
     ROS_INFO("Getting gains params...");
 
-    // initialize all gains to zero
-    for (int i = 0; i < MAX_MECH * MAX_DOF_PER_MECH; i++)
-    {
-        DOF_types[i].KP = DOF_types[i].KD = DOF_types[i].KI  = 0.0;
-    }
+    memset(&gains, 0, sizeof(gains));
 
-    /// Get gains from parameter server, use default value of 0.0 if parameters ain't found
-    if (n.hasParam("/gains_gold_kp") &&
-            n.hasParam("/gains_gold_kd") &&
-            n.hasParam("/gains_gold_ki") &&
-            n.hasParam("/gains_green_kp") &&
-            n.hasParam("/gains_green_kd") &&
-            n.hasParam("/gains_green_ki") )
-    {
-        res =  n.getParam("/gains_green_kp", kp_green);
-        res &= n.getParam("/gains_green_kd", kd_green);
-        res &= n.getParam("/gains_green_ki", ki_green);
-        res &= n.getParam("/gains_gold_kp", kp_gold);
-        res &= n.getParam("/gains_gold_kd", kd_gold);
-        res &= n.getParam("/gains_gold_ki", ki_gold);
-    }
+    /// Get gains from parameter server.  getParam fails on a missing parameter, so stop at the first one.
+    res =  n.getParam("/gains_green_kp", kp_green);
+    res = res && n.getParam("/gains_green_kd", kd_green);
+    res = res && n.getParam("/gains_green_ki", ki_green);
+    res = res && n.getParam("/gains_gold_kp", kp_gold);
+    res = res && n.getParam("/gains_gold_kd", kd_gold);
+    res = res && n.getParam("/gains_gold_ki", ki_gold);
 
     // Did we get the gains??
     if ( !res ||
@@ -500,64 +489,100 @@ int init_ravengains(ros::NodeHandle n, struct device *device0)
             (ki_gold.size()  != MAX_DOF_PER_MECH) )
     {
         ROS_ERROR("Gains parameters failed.  Setting zero gains");
+        return false;
+    }
+
+    for (int j = 0; j < MAX_DOF_PER_MECH; j++)
+    {
+        gains.kp[GOLD_ARM_ID][j] = (double)kp_gold[j];   // Cast XMLRPC value to a double and set gain
+        gains.kd[GOLD_ARM_ID][j] = (double)kd_gold[j];   //   ""
+        gains.ki[GOLD_ARM_ID][j] = (double)ki_gold[j];   //   ""
+        gains.kp[GREEN_ARM_ID][j] = (double)kp_green[j]; //   ""
+        gains.kd[GREEN_ARM_ID][j] = (double)kd_green[j]; //   ""
+        gains.ki[GREEN_ARM_ID][j] = (double)ki_green[j]; //   ""
+    }
+    return true;
+}
+
+/**
+ * apply_ravengains( const RavenGains& gains, struct device *device0)
+ *
+ *  postcondition: dof_types[].kp, kd and ki have been set from gains for the arms in device0
+ */
+void apply_ravengains(const RavenGains& gains, struct device *device0)
+{
+    // initialize all gains to zero
+    for (int i = 0; i < MAX_MECH * MAX_DOF_PER_MECH; i++)
+    {
+        DOF_types[i].KP = DOF_types[i].KD = DOF_types[i].KI  = 0.0;
     }
-    else
+
+    bool initgold=0, initgreen=0;
+    for (int i = 0; i < NUM_MECH; i++)
     {
-        bool initgold=0, initgreen=0;
-        for (int i = 0; i < NUM_MECH; i++)
+        int armId = armIdFromMechType(device0->mech[i].type);
+        for (int j = 0; j < MAX_DOF_PER_MECH; j++)
         {
-        	int armId = armIdFromMechType(device0->mech[i].type);
-            for (int j = 0; j < MAX_DOF_PER_MECH; j++)
+            int dofindex =combinedJointIndex(armId,j);
+
+            // Set gains for gold and green arms
+            if ( device0->mech[i].type == GOLD_ARM)
             {
-                int dofindex =combinedJointIndex(armId,j);
-
-                // Set gains for gold and green arms
-                if ( device0->mech[i].type == GOLD_ARM)
-                {
-                    initgold=true;
-                    DOF_types[dofindex].KP = (double)kp_gold[j];   // Cast XMLRPC value to a double and set gain
-                    DOF_types[dofindex].KD = (double)kd_gold[j];   //   ""
-                    DOF_types[dofindex].KI = (double)ki_gold[j];   //   ""
-                }
-                else if ( device0->mech[i].type == GREEN_ARM)
-                {
-                    initgreen=true;
-                    DOF_types[dofindex].KP = (double)kp_green[j];  //   ""
-                    DOF_types[dofindex].KD = (double)kd_green[j];  //   ""
-                    DOF_types[dofindex].KI = (double)ki_green[j];  //   ""
-                }
-                else
-                {
-                    ROS_ERROR("What device is this?? %d\n",device0->mech[i].type);
-                }
+                initgold=true;
             }
+            else if ( device0->mech[i].type == GREEN_ARM)
+            {
+                initgreen=true;
+            }
+            else
+            {
+                ROS_ERROR("What device is this?? %d\n",device0->mech[i].type);
+                continue;
+            }
+            DOF_types[dofindex].KP = gains.kp[armId][j];
+            DOF_types[dofindex].KD = gains.kd[armId][j];
+            DOF_types[dofindex].KI = gains.ki[armId][j];
         }
-        if (!initgold){
-            ROS_ERROR("Failed to set gains for gold arm (ser:%d not %d).  Set to zero", device0->mech[0].type, GOLD_ARM);
-        }
-        if (!initgreen){
-            ROS_ERROR("Failed to set gains for green arm (ser:%d not %d).  Set to zero", device0->mech[1].type, GREEN_ARM);
-        }
-        ROS_INFO("  PD gains set to");
-        ROS_INFO("    green: %.3lf/%.3lf/%.3lf, %.3lf/%.3lf/%.3lf, %.3lf/%.3lf/%.3lf, %.3lf/%.3lf/%.3lf, %.3lf/%.3lf/%.3lf, %.3lf/%.3lf/%.3lf, %.3lf/%.3lf/%.3lf, %.3lf/%.3lf/%.3lf",
-            DOF_types[0].KP, DOF_types[0].KD, DOF_types[0].KI,
-            DOF_types[1].KP, DOF_types[1].KD, DOF_types[1].KI,
-            DOF_types[2].KP, DOF_types[2].KD, DOF_types[2].KI,
-            DOF_types[3].KP, DOF_types[3].KD, DOF_types[3].KI,
-            DOF_types[4].KP, DOF_types[4].KD, DOF_types[4].KI,
-            DOF_types[5].KP, DOF_types[5].KD, DOF_types[5].KI,
-            DOF_types[6].KP, DOF_types[6].KD, DOF_types[6].KI,
-            DOF_types[7].KP, DOF_types[7].KD, DOF_types[7].KI);
-        ROS_INFO("    gold: %.3lf/%.3lf/%.3lf, %.3lf/%.3lf/%.3lf, %.3lf/%.3lf/%.3lf, %.3lf/%.3lf/%.3lf, %.3lf/%.3lf/%.3lf, %.3lf/%.3lf/%.3lf, %.3lf/%.3lf/%.3lf, %.3lf/%.3lf/%.3lf",
-            DOF_types[8].KP, DOF_types[8].KD, DOF_types[8].KI,
-            DOF_types[9].KP, DOF_types[9].KD, DOF_types[9].KI,
-            DOF_types[10].KP, DOF_types[10].KD, DOF_types[10].KI,
-            DOF_types[11].KP, DOF_types[11].KD, DOF_types[11].KI,
-            DOF_types[12].KP, DOF_types[12].KD, DOF_types[12].KI,
-            DOF_types[13].KP, DOF_types[13].KD, DOF_types[13].KI,
-            DOF_types[14].KP, DOF_types[14].KD, DOF_types[14].KI,
-            DOF_types[15].KP, DOF_types[15].KD, DOF_types[15].KI);
     }
+    if (!initgold){
+        ROS_ERROR("Failed to set gains for gold arm (ser:%d not %d).  Set to zero", device0->mech[0].type, GOLD_ARM);
+    }
+    if (!initgreen){
+        ROS_ERROR("Failed to set gains for green arm (ser:%d not %d).  Set to zero", device0->mech[1].type, GREEN_ARM);
+    }
+    ROS_INFO("  PD gains set to");
+    ROS_INFO("    green: %.3lf/%.3lf/%.3lf, %.3lf/%.3lf/%.3lf, %.3lf/%.3lf/%.3lf, %.3lf/%.3lf/%.3lf, %.3lf/%.3lf/%.3lf, %.3lf/%.3lf/%.3lf, %.3lf/%.3lf/%.3lf, %.3lf/%.3lf/%.3lf",
+        DOF_types[0].KP, DOF_types[0].KD, DOF_types[0].KI,
+        DOF_types[1].KP, DOF_types[1].KD, DOF_types[1].KI,
+        DOF_types[2].KP, DOF_types[2].KD, DOF_types[2].KI,
+        DOF_types[3].KP, DOF_types[3].KD, DOF_types[3].KI,
+        DOF_types[4].KP, DOF_types[4].KD, DOF_types[4].KI,
+        DOF_types[5].KP, DOF_types[5].KD, DOF_types[5].KI,
+        DOF_types[6].KP, DOF_types[6].KD, DOF_types[6].KI,
+        DOF_types[7].KP, DOF_types[7].KD, DOF_types[7].KI);
+    ROS_INFO("    gold: %.3lf/%.3lf/%.3lf, %.3lf/%.3lf/%.3lf, %.3lf/%.3lf/%.3lf, %.3lf/%.3lf/%.3lf, %.3lf/%.3lf/%.3lf, %.3lf/%.3lf/%.3lf, %.3lf/%.3lf/%.3lf, %.3lf/%.3lf/%.3lf",
+        DOF_types[8].KP, DOF_types[8].KD, DOF_types[8].KI,
+        DOF_types[9].KP, DOF_types[9].KD, DOF_types[9].KI,
+        DOF_types[10].KP, DOF_types[10].KD, DOF_types[10].KI,
+        DOF_types[11].KP, DOF_types[11].KD, DOF_types[11].KI,
+        DOF_types[12].KP, DOF_types[12].KD, DOF_types[12].KI,
+        DOF_types[13].KP, DOF_types[13].KD, DOF_types[13].KI,
+        DOF_types[14].KP, DOF_types[14].KD, DOF_types[14].KI,
+        DOF_types[15].KP, DOF_types[15].KD, DOF_types[15].KI);
+}
+
+/**
+ * init_ravengains( ros::NodeHandle n)
+ *
+ *  Get ravengains from ROS parameter server and set them.
+ *
+ *  postcondition: dof_types[].kp and dof_types[].kd have been set from ROS parameters
+ */
+int init_ravengains(ros::NodeHandle n, struct device *device0)
+{
+    RavenGains gains;
+    fetch_ravengains(n, gains);
+    apply_ravengains(gains, device0);
     return 0;
 }
 
@@ -583,8 +608,10 @@ void setStartXYZ(struct device *device0)
 #ifdef USE_NEW_DEVICE
     	ArmPtr arm = Device::currentNoCloneMutable()->getArmById(device0->mech[i].type);
     	btTransform tf = toBt(device0->mech[i].pos,device0->mech[i].ori);
-    	ControlInput::getOldControlInput()->armById(device0->mech[i].type).pose() = tf;
-    	ControlInput::getOldControlInput()->armById(device0->mech[i].type).grasp() = arm->joint(Joint::IdType::GRASP_)->position();
+    	OldControlInputPtr oldInput = ControlInput::oldControlInputRtUpdateBegin();
+    	oldInput->armById(device0->mech[i].type).pose() = tf;
+    	oldInput->armById(device0->mech[i].type).grasp() = arm->joint(Joint::IdType::GRASP_)->position();
+    	ControlInput::oldControlInputRtUpdateEnd();
 #endif
 
         device0->mech[i].pos_d.x = device0->mech[i].pos.x;
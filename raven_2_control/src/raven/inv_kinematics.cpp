@@ -23,6 +23,7 @@
 #include "t_to_DAC_val.h"
 
 #include <raven/state/runlevel.h>
+#include <raven/util/metrics.h>
 
 #define EPS2 0.00001
 #define EPS 0.01
@@ -38,6 +39,8 @@ static int PRINT_EVERY = PRINT_EVERY_PEDAL_UP;
 
 extern bool disable_arm_id[2];
 extern unsigned long int gTime;
+
+static MetricCounter ik_failures("r2_ik_failures_total","Inverse kinematics calls with no valid solution","solver=\"invMechKinNew\"");
 extern int NUM_MECH;
 int inv_kin_last_err = 0;
 
@@ -95,6 +98,7 @@ void invKin(struct device *device0, struct param_pass* currParams)
 		  ret=0;//invMechKin( &(device0->mech[i]));
 	  }
 	  if (ret < 0) {
+		  ik_failures.inc();
 		  //    	log_msg("inv_kin failed with %d", ret);
 		  return;
 	  }
@@ -0,0 +1,143 @@
+/*
+ * batch_kinematics.cpp
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: agent
+ */
+
+#include <raven/kinematics/batch_kinematics.h>
+
+#include "log.h"
+
+#include <boost/bind.hpp>
+#include <boost/thread/thread.hpp>
+
+#include <algorithm>
+
+void
+BatchInverseKinematicsResult::resize(size_t n) {
+	joints.resize(n);
+	valid.resize(n,0);
+	jointsOutsideLimits.resize(n,0);
+}
+
+size_t
+BatchInverseKinematicsResult::numValid() const {
+	return std::count(valid.begin(),valid.end(),1);
+}
+
+BatchKinematics::BatchKinematics(ArmConstPtr prototype, size_t numThreads) {
+	prototype->cloneInto(prototype_);
+	setNumThreads(numThreads);
+	options_.setVerbose(false);
+}
+
+void
+BatchKinematics::setNumThreads(size_t numThreads) {
+	if (numThreads == 0) {
+		numThreads = boost::thread::hardware_concurrency();
+	}
+	numThreads_ = std::max(numThreads,(size_t)1);
+}
+
+void
+BatchKinematics::setOptions(const InverseKinematicsOptions& options) {
+	options_ = options;
+	options_.setIncremental(false); // warm starts belong to the live arms
+}
+
+size_t
+BatchKinematics::threadsFor(size_t numItems) const {
+	return std::max(std::min(numThreads_,numItems),(size_t)1);
+}
+
+void
+BatchKinematics::inverse(const std::vector<btTransform>& poses, BatchInverseKinematicsResult& result) const {
+	inverse(poses,std::vector<float>(),result);
+}
+
+void
+BatchKinematics::inverse(const std::vector<btTransform>& poses, const std::vector<float>& grasps, BatchInverseKinematicsResult& result) const {
+	if (!grasps.empty() && grasps.size() != poses.size()) {
+		log_err("Batch ik got %d grasps for %d poses",(int)grasps.size(),(int)poses.size());
+		result.resize(0);
+		return;
+	}
+	result.resize(poses.size());
+
+	size_t threads = threadsFor(poses.size());
+	if (threads == 1) {
+		inverseRange(poses,grasps,result,0,poses.size());
+		return;
+	}
+	size_t chunk = (poses.size() + threads - 1) / threads;
+	boost::thread_group group;
+	for (size_t begin=0;begin<poses.size();begin+=chunk) {
+		size_t end = std::min(begin+chunk,poses.size());
+		group.create_thread(boost::bind(&BatchKinematics::inverseRange,this,boost::cref(poses),boost::cref(grasps),boost::ref(result),begin,end));
+	}
+	group.join_all();
+}
+
+void
+BatchKinematics::forward(const std::vector<Eigen::VectorXf>& joints, std::vector<btTransform>& poses) const {
+	poses.resize(joints.size());
+
+	size_t threads = threadsFor(joints.size());
+	if (threads == 1) {
+		forwardRange(joints,poses,0,joints.size());
+		return;
+	}
+	size_t chunk = (joints.size() + threads - 1) / threads;
+	boost::thread_group group;
+	for (size_t begin=0;begin<joints.size();begin+=chunk) {
+		size_t end = std::min(begin+chunk,joints.size());
+		group.create_thread(boost::bind(&BatchKinematics::forwardRange,this,boost::cref(joints),boost::ref(poses),begin,end));
+	}
+	group.join_all();
+}
+
+void
+BatchKinematics::inverseRange(const std::vector<btTransform>& poses, const std::vector<float>& grasps,
+		BatchInverseKinematicsResult& result, size_t begin, size_t end) const {
+	ArmPtr arm;
+	prototype_->cloneInto(arm);
+	Eigen::VectorXf start = prototype_->jointPositionVector();
+	JointPtr graspJoint = arm->getJointById(Joint::IdType::GRASP_);
+	size_t numJoints = std::min(arm->joints().size(),(size_t)start.rows());
+
+	for (size_t i=begin;i<end;i++) {
+		arm->holdUpdateBegin();
+		// start each pose from the prototype so failed solves report its joints
+		for (size_t j=0;j<numJoints;j++) {
+			arm->joint(j)->setPosition(start[j]);
+		}
+		if (!grasps.empty()) {
+			graspJoint->setPosition(grasps[i]);
+		}
+		InverseKinematicsReportPtr report = arm->kinematics().internalInverseSoln(poses[i],arm.get(),options_,NULL);
+		arm->holdUpdateEnd();
+
+		result.joints[i] = arm->jointPositionVector();
+		result.valid[i] = report->success() ? 1 : 0;
+		result.jointsOutsideLimits[i] = report->jointsOutsideLimits();
+	}
+}
+
+void
+BatchKinematics::forwardRange(const std::vector<Eigen::VectorXf>& joints, std::vector<btTransform>& poses,
+		size_t begin, size_t end) const {
+	ArmPtr arm;
+	prototype_->cloneInto(arm);
+	size_t numArmJoints = arm->joints().size();
+
+	for (size_t i=begin;i<end;i++) {
+		arm->holdUpdateBegin();
+		size_t numJoints = std::min(numArmJoints,(size_t)joints[i].rows());
+		for (size_t j=0;j<numJoints;j++) {
+			arm->joint(j)->setPosition(joints[i][j]);
+		}
+		arm->holdUpdateEnd();
+		arm->kinematics().forward(poses[i]);
+	}
+}
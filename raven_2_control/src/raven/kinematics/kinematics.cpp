@@ -9,9 +9,13 @@
 #include <raven/kinematics/kinematics_defines.h>
 
 #include "log.h"
+#include <raven/util/metrics.h>
 
 #include <raven/state/arm.h>
 
+#include <algorithm>
+#include <time.h>
+
 bool
 InverseKinematicsOptions::checkJointLimits() const {
 	return checkJointLimits_;
@@ -82,8 +86,97 @@ InverseKinematicsOptions::clearMaxJointDifferences() {
 	maxJointDifferences_.clear();
 }
 
-InverseKinematicsReport::InverseKinematicsReport() : success_(false) {
+bool
+InverseKinematicsOptions::incremental() const {
+	return incremental_;
+}
+
+void
+InverseKinematicsOptions::setIncremental(bool on) {
+	incremental_ = on;
+}
+
+float
+InverseKinematicsOptions::incrementalThreshold() const {
+	return incrementalThreshold_;
+}
+
+void
+InverseKinematicsOptions::setIncrementalThreshold(float threshold) {
+	incrementalThreshold_ = threshold;
+}
+
+bool
+InverseKinematicsOptions::verbose() const {
+	return verbose_;
+}
+
+void
+InverseKinematicsOptions::setVerbose(bool on) {
+	verbose_ = on;
+}
+
+InverseKinematicsReport::InverseKinematicsReport() : success_(false), incremental_(false), jointsOutsideLimits_(0) {
+
+}
+
+void
+InverseKinematicsReport::setLimit(Joint::IdType joint, float validity) {
+	if (validity != 0) {
+		jointsOutsideLimits_ |= jointLimitBit(joint);
+	}
+}
+
+double
+InverseKinematicsStats::hitRate() const {
+	unsigned long attempts = hits + misses;
+	return attempts ? ((double)hits) / attempts : 0;
+}
+
+double
+InverseKinematicsStats::timeSaved() const {
+	if (!fullSolves) {
+		return 0;
+	}
+	return hits * (fullTime / fullSolves) - incrementalTime;
+}
+
+void
+InverseKinematicsStats::log() const {
+	log_msg("ik incremental hit rate %.1f%% (%lu/%lu), saved %.3f ms",
+			100 * hitRate(),hits,hits + misses,timeSaved() * 1000);
+}
+
+/*
+ * Kept per arm rather than per solver, since solvers are copied with every
+ * device clone, and per thread, since the rt thread and the kinematics
+ * services solve for the same arms.
+ */
+static __thread InverseKinematicsWarmStart WARM_STARTS[KINEMATICS_MAX_ARMS] = { { -1, 0, 0, 0 }, { -1, 0, 0, 0 } };
+
+// atomic, since any thread may solve
+static MetricHistogram ik_incremental_seconds("r2_ik_solve_seconds","inverse kinematics solve time",
+		MetricHistogram::exponentialBounds(1e-6,2,12),"solve=\"incremental\"");
+static MetricHistogram ik_full_seconds("r2_ik_solve_seconds","inverse kinematics solve time",
+		MetricHistogram::exponentialBounds(1e-6,2,12),"solve=\"full\"");
+static MetricCounter ik_incremental_misses("r2_ik_incremental_misses_total","incremental solves that fell back to both branches");
+
+InverseKinematicsStats
+KinematicSolver::incrementalStats() {
+	InverseKinematicsStats stats;
+	stats.hits = ik_incremental_seconds.count();
+	stats.misses = ik_incremental_misses.value();
+	stats.fullSolves = ik_full_seconds.count();
+	stats.incrementalTime = ik_incremental_seconds.sum();
+	stats.fullTime = ik_full_seconds.sum();
+	return stats;
+}
 
+void
+KinematicSolver::resetIncrementalState() {
+	for (int i=0;i<KINEMATICS_MAX_ARMS;i++) {
+		WARM_STARTS[i].set(-1,0,0,0);
+	}
 }
 
 static int numKS = 0;
@@ -157,9 +250,26 @@ KinematicSolver::inverse(const btTransform& pose,const InverseKinematicsOptions&
 		return invKinReport_;
 	}
 
+	int armIndex = armIdFromSerial(arm_->id());
+	InverseKinematicsWarmStart* warm = (armIndex >= 0 && armIndex < KINEMATICS_MAX_ARMS) ? &WARM_STARTS[armIndex] : NULL;
+	bool warmAttempt = warm && options.incremental() && warm->branch >= 0;
+
+	struct timespec start, end;
+	clock_gettime(CLOCK_MONOTONIC,&start);
 	arm_->holdUpdateBegin();
-	InverseKinematicsReportPtr report = internalInverseSoln(pose,arm_,options);
+	InverseKinematicsReportPtr report = internalInverseSoln(pose,arm_,options,warm);
 	arm_->holdUpdateEnd();
+	clock_gettime(CLOCK_MONOTONIC,&end);
+	double elapsed = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) * 1e-9;
+
+	if (report->incremental()) {
+		ik_incremental_seconds.observe(elapsed);
+	} else {
+		if (warmAttempt) {
+			ik_incremental_misses.inc();
+		}
+		ik_full_seconds.observe(elapsed);
+	}
 
 	invKinCached_ = pose;
 	invKinReport_ = report;
@@ -177,7 +287,7 @@ KinematicSolver::inverseSoln(const btTransform& pose, boost::shared_ptr<Arm>& so
 	arm_->cloneInto(soln);
 
 	soln->holdUpdateBegin();
-	InverseKinematicsReportPtr report = internalInverseSoln(pose,soln.get(),options);
+	InverseKinematicsReportPtr report = internalInverseSoln(pose,soln.get(),options,NULL);
 	soln->holdUpdateEnd();
 
 	if (!report->success()) {
@@ -215,7 +325,7 @@ KinematicSolver::motorTorqueVector() const {
 }
 
 InverseKinematicsReportPtr
-KinematicSolver::internalInverseSoln(const btTransform& pose, Arm* arm,const InverseKinematicsOptions& options) const {
+KinematicSolver::internalInverseSoln(const btTransform& pose, Arm* arm,const InverseKinematicsOptions& options,InverseKinematicsWarmStart* warm) const {
 	TRACER_ENTER_SCOPE("KinematicSolver::internalInverseSoln(arm@%p)",arm);
 	InverseKinematicsReportPtr report(new InverseKinematicsReport());
 
@@ -359,6 +469,10 @@ KinematicSolver::internalInverseSoln(const btTransform& pose, Arm* arm,const Inv
 	int validity1[4];
 	bool valid1 = checkJointLimits1(d_act,thp_act,g1_act,g2_act,validity1);
 	if (!valid1) {
+		report->setLimit(Joint::IdType::INSERTION_,validity1[0]);
+		report->setLimit(Joint::IdType::WRIST_,validity1[1]);
+		report->setLimit(Joint::IdType::FINGER1_,validity1[2]);
+		report->setLimit(Joint::IdType::FINGER2_,validity1[3]);
 //		if (_curr_rl == 3 && !(DISABLE_ALL_PRINTING)) {
 //			printf("ik %d invalid --1-- d [%d] % 2.4f \tp [%d] % 3.1f\ty [%d %d] % 3.1f\n",
 //					armId,
@@ -403,7 +517,12 @@ KinematicSolver::internalInverseSoln(const btTransform& pose, Arm* arm,const Inv
 	float the_act[2];
 	float thr_act[2];
 
-	for (int i=0;i<2;i++) {
+	// incremental mode solves the previous branch first and stops there if it is close enough
+	bool useWarm = warm && options.incremental() && warm->branch >= 0;
+	int firstBranch = useWarm ? warm->branch : 0;
+
+	for (int n=0;n<2;n++) {
+		int i = (firstBranch + n) % 2;
 		float sthe_tmp = sin(the_opt[i]);
 		float C1 = ks12*kc23 + kc12*ks23*cthe;
 		float C2 = ks23 * sthe_tmp;
@@ -507,6 +626,32 @@ KinematicSolver::internalInverseSoln(const btTransform& pose, Arm* arm,const Inv
 //				//printf("ik ok! %d\n",_ik_counter);
 //			}
 		}
+
+		if (useWarm && n == 0) {
+			float jump = std::max(fabs(ths_act[i] - warm->ths),std::max(fabs(the_act[i] - warm->the),fabs(thr_act[i] - warm->thr)));
+			if (valid2 && jump <= options.incrementalThreshold()) {
+				warm->set(i,ths_act[i],the_act[i],thr_act[i]);
+				report->success_ = true;
+				report->incremental_ = true;
+				return report;
+			}
+		}
+	}
+
+	if (useWarm && firstBranch == 1 && opts_valid[0] && opts_valid[1]) {
+		// a cold solve leaves the joints of the last valid branch set
+		setJointsWithLimits1(arm,d_act,thp_act,g1_act,g2_act);
+		setJointsWithLimits2(arm,ths_act[1],the_act[1],thr_act[1]);
+	}
+
+	if (warm) {
+		if (opts_valid[1]) {
+			warm->set(1,ths_act[1],the_act[1],thr_act[1]);
+		} else if (opts_valid[0]) {
+			warm->set(0,ths_act[0],the_act[0],thr_act[0]);
+		} else {
+			warm->branch = -1;
+		}
 	}
 
 	if (opts_valid[0]) {
@@ -543,15 +688,22 @@ KinematicSolver::internalInverseSoln(const btTransform& pose, Arm* arm,const Inv
 			valid_dist[i] = sqrt(sum);
 		}
 
+		int closest = valid_dist[0] < valid_dist[1] ? 0 : 1;
+		report->setLimit(Joint::IdType::SHOULDER_,validity2[closest][0]);
+		report->setLimit(Joint::IdType::ELBOW_,validity2[closest][1]);
+		report->setLimit(Joint::IdType::ROTATION_,validity2[closest][2]);
+
 		bool use0 = valid_dist[0] < maxValidDist && valid_dist[0] < valid_dist[1];
 		bool use1 = valid_dist[1] < maxValidDist && valid_dist[0] > valid_dist[1];
-		printf("ik validity distances: (%s | %s) % 1.3f\t%f\n",use0?"Y":" ",use1?"Y":" ",valid_dist[0],valid_dist[1]);
+		if (options.verbose()) {
+			printf("ik validity distances: (%s | %s) % 1.3f\t%f\n",use0?"Y":" ",use1?"Y":" ",valid_dist[0],valid_dist[1]);
+		}
 		if (valid_dist[0] < maxValidDist && valid_dist[0] < valid_dist[1]) {
-			printf("setting joints to ik soln 1\n");
+			if (options.verbose()) { printf("setting joints to ik soln 1\n"); }
 			setJointsWithLimits1(arm,d_act,thp_act,g1_act,g2_act);
 			setJointsWithLimits2(arm,ths_act[0],the_act[0],thr_act[0]);
 		} else if (valid_dist[1] < maxValidDist) {
-			printf("setting joints to ik soln 2\n");
+			if (options.verbose()) { printf("setting joints to ik soln 2\n"); }
 			setJointsWithLimits1(arm,d_act,thp_act,g1_act,g2_act);
 			setJointsWithLimits2(arm,ths_act[1],the_act[1],thr_act[1]);
 		}
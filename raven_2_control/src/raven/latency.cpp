@@ -0,0 +1,225 @@
+/*
+ * latency.cpp
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: agent
+ */
+
+#include "latency.h"
+
+#include <sched.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <vector>
+
+#include <boost/thread/thread.hpp>
+
+#include <raven/util/metrics.h>
+
+#include "log.h"
+#include "flight_recorder.h"
+
+// memory each load thread walks, to keep evicting the rt thread's cache
+#define LATENCY_LOAD_BYTES (8*1024*1024)
+
+static MetricHistogram encoder_to_dac_gold("r2_encoder_to_dac_seconds","encoder packet read to the DAC write it fed",
+		MetricHistogram::exponentialBounds(20e-6,2,10),"arm=\"gold\"");
+static MetricHistogram encoder_to_dac_green("r2_encoder_to_dac_seconds","encoder packet read to the DAC write it fed",
+		MetricHistogram::exponentialBounds(20e-6,2,10),"arm=\"green\"");
+static MetricHistogram master_to_dac("r2_master_to_dac_seconds","kernel receive of a master packet to the first DAC write of its command",
+		MetricHistogram::exponentialBounds(50e-6,2,12));
+static MetricCounter master_superseded("r2_master_commands_superseded_total","master commands replaced before any DAC write carried them");
+
+static u_32 last_param_seq = 0;
+
+struct LatencySeries {
+	const char* name;
+	std::vector<int32_t> samples;   // ns; sized before the rt thread starts
+	size_t count;
+	unsigned long overflow;
+
+	LatencySeries(const char* name) : name(name), count(0), overflow(0) {}
+};
+
+static LatencySeries bench_encoder_gold("encoder->DAC gold");
+static LatencySeries bench_encoder_green("encoder->DAC green");
+static LatencySeries bench_master("master->DAC");
+static unsigned long bench_superseded = 0;
+
+static volatile bool bench_running = false;
+static bool bench_started = false;
+static int64_t bench_start_ns = 0;
+static int64_t bench_end_ns = 0;
+
+static volatile bool load_running = false;
+static std::vector<boost::thread*> load_threads;
+
+static inline int64_t
+toNSec(const struct timespec& t) {
+	return t.tv_sec * (int64_t)1000000000 + t.tv_nsec;
+}
+
+static inline int64_t
+nowNSec() {
+	struct timespec now;
+	clock_gettime(CLOCK_REALTIME,&now);
+	return toNSec(now);
+}
+
+static inline void
+benchSample(LatencySeries& series, int64_t ns) {
+	if (!bench_running) {
+		return;
+	}
+	if (series.count < series.samples.size()) {
+		series.samples[series.count++] = (int32_t)std::min(ns,(int64_t)0x7fffffff);
+	} else {
+		series.overflow++;
+	}
+}
+
+void
+latencyRecordDacWrite(const struct robot_device* device0, const struct mechanism* mech) {
+	// a replay carries the stamps of the recording
+	if (replaying()) {
+		return;
+	}
+	int64_t dac = nowNSec();
+
+	// if this loop's read failed, this is the age of the encoder values the command was computed from
+	if (mech->enc_stamp.tv_sec) {
+		int64_t latency = dac - toNSec(mech->enc_stamp);
+		if (mechIsGold(*mech)) {
+			encoder_to_dac_gold.observe(latency * 1e-9);
+			benchSample(bench_encoder_gold,latency);
+		} else {
+			encoder_to_dac_green.observe(latency * 1e-9);
+			benchSample(bench_encoder_green,latency);
+		}
+	}
+
+	// only the first write of a command counts
+	if (device0->param_seq == last_param_seq) {
+		return;
+	}
+	u_32 skipped = device0->param_seq - last_param_seq - 1;
+	if (skipped) {
+		master_superseded.inc(skipped);
+		if (bench_running) {
+			bench_superseded += skipped;
+		}
+	}
+	last_param_seq = device0->param_seq;
+	if (device0->param_rx.tv_sec) {
+		int64_t latency = dac - toNSec(device0->param_rx);
+		master_to_dac.observe(latency * 1e-9);
+		benchSample(bench_master,latency);
+	}
+}
+
+/************************ benchmark ************************/
+
+static void
+loadProcess(int cpu) {
+	// spread over the CPUs, including the rt thread's
+	int cpus = sysconf(_SC_NPROCESSORS_ONLN);
+	if (cpus > 0) {
+		cpu_set_t set;
+		CPU_ZERO(&set);
+		CPU_SET(cpu % cpus,&set);
+		sched_setaffinity(0,sizeof(set),&set);
+	}
+
+	std::vector<unsigned char> buffer(LATENCY_LOAD_BYTES);
+	unsigned int x = cpu + 1;
+	while (load_running) {
+		for (size_t i=0;i<buffer.size();i+=64) {
+			x = x * 1103515245 + 12345;
+			buffer[i] += x >> 24;
+		}
+	}
+}
+
+void
+latencyBenchStart(float seconds, int loadThreads) {
+	// a sample per arm and per command each loop at most, with a second to spare
+	size_t capacity = (size_t)((seconds + 1) * 1000);
+	bench_encoder_gold.samples.resize(capacity);
+	bench_encoder_green.samples.resize(capacity);
+	bench_master.samples.resize(capacity);
+
+	load_running = true;
+	for (int i=0;i<loadThreads;i++) {
+		load_threads.push_back(new boost::thread(loadProcess,i));
+	}
+
+	bench_start_ns = nowNSec();
+	bench_end_ns = bench_start_ns + (int64_t)(seconds * 1e9);
+	bench_started = true;
+	bench_running = true;
+	log_msg("Measuring latency for %.1f s with %d load threads",seconds,loadThreads);
+}
+
+bool
+latencyBenchDone() {
+	if (!bench_running) {
+		return false;
+	}
+	if (nowNSec() < bench_end_ns) {
+		return false;
+	}
+	bench_running = false;
+	return true;
+}
+
+static void
+reportSeries(const LatencySeries& series) {
+	if (!series.count) {
+		log_msg("  %-20s       no samples",series.name);
+		return;
+	}
+	std::vector<int32_t> sorted(series.samples.begin(),series.samples.begin() + series.count);
+	std::sort(sorted.begin(),sorted.end());
+
+	static const double PERCENTILES[] = { 0.5, 0.9, 0.99, 0.999 };
+	double usec[4];
+	for (int i=0;i<4;i++) {
+		size_t index = std::min(sorted.size() - 1,(size_t)(PERCENTILES[i] * sorted.size()));
+		usec[i] = sorted[index] * 1e-3;
+	}
+	log_msg("  %-20s %8lu %8.1f %8.1f %8.1f %8.1f %8.1f %8.1f",series.name,(unsigned long)series.count,
+			sorted.front() * 1e-3,usec[0],usec[1],usec[2],usec[3],sorted.back() * 1e-3);
+	if (series.overflow) {
+		log_warn("  %-20s %lu samples past the end of the buffer were dropped",series.name,series.overflow);
+	}
+}
+
+void
+latencyBenchReport() {
+	if (!bench_started) {
+		return;
+	}
+	bench_running = false;
+	load_running = false;
+	unsigned long loads = load_threads.size();
+	for (size_t i=0;i<load_threads.size();i++) {
+		load_threads[i]->join();
+		delete load_threads[i];
+	}
+	load_threads.clear();
+
+	double seconds = (std::min(nowNSec(),bench_end_ns) - bench_start_ns) * 1e-9;
+	log_msg("Latency over %.1f s with %lu load threads (usec):",seconds,loads);
+	log_msg("  %-20s %8s %8s %8s %8s %8s %8s %8s","","samples","min","p50","p90","p99","p99.9","max");
+	reportSeries(bench_encoder_gold);
+	reportSeries(bench_encoder_green);
+	reportSeries(bench_master);
+	log_msg("  %lu master commands were replaced before reaching the DAC",bench_superseded);
+	if (!bench_master.count) {
+		log_msg("  (no master packets; run teleop_sim alongside for master->DAC)");
+	}
+}
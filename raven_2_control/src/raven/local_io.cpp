@@ -26,10 +26,12 @@ active use.
 #include <iostream>
 
 #include "log.h"
+#include <raven/util/metrics.h>
 #include "local_io.h"
 #include "utils.h"
 #include "mapping.h"
 #include "itp_teleoperation.h"
+#include "network_layer.h"
 #include <raven/kinematics/kinematics_defines.h>
 #include "shared_modes.h"
 #include "trajectory.h"
@@ -48,6 +50,8 @@ extern unsigned long int gTime;
 #define GREEN_ARM_TELEOP_ID GREEN_ARM_ID
 
 static param_pass data1;
+static TeleopRxStamp data1_rx;  // packets merged into data1 since the rt thread last took it
+static TeleopRxStamp rcvd_rx;   // packets in the rt thread's current copy, waiting for the DAC write
 pthread_mutexattr_t data1MutexAttr;
 pthread_mutex_t data1Mutex;
 
@@ -80,6 +84,8 @@ int initLocalioData(void)
     pthread_mutex_init(&data1Mutex,&data1MutexAttr);
 
     pthread_mutex_lock(&data1Mutex);
+    memset(&data1_rx,0,sizeof(data1_rx));
+    memset(&rcvd_rx,0,sizeof(rcvd_rx));
     for (i=0;i<NUM_MECH;i++) {
         data1.xd[i].x = 0;
         data1.xd[i].y = 0;
@@ -109,9 +115,9 @@ int initLocalioData(void)
 // - Recieve userspace data  - //
 //---------------------------- //
 //int recieveUserspace(unsigned int fifo)
-int recieveUserspace(void *u,int size) {
+int recieveUserspace(void *u,int size,const struct timespec* rx_stamp) {
 	if (size==sizeof(struct u_struct)) {
-		teleopIntoDS1((struct u_struct*)u);
+		teleopIntoDS1((struct u_struct*)u,rx_stamp);
     }
     return 0;
 }
@@ -120,7 +126,26 @@ int recieveUserspace(void *u,int size) {
 //
 //   Input from the master is put into DS1 as pos_d.
 //
-void teleopIntoDS1(struct u_struct *t)
+static void applyTeleop(struct u_struct *t,const struct timespec* rx_stamp);
+
+void teleopIntoDS1(struct u_struct *t,const struct timespec* rx_stamp)
+{
+	if (!checkMasterMode("network"))
+	{
+		return;
+	}
+
+	pthread_mutex_lock(&data1Mutex);
+	applyTeleop(t,rx_stamp);
+	pthread_mutex_unlock(&data1Mutex);
+
+	if (rx_stamp) {
+		networkRecordDS1Update(*rx_stamp);
+	}
+}
+
+// The body of teleopIntoDS1; called with data1Mutex held
+static void applyTeleop(struct u_struct *t,const struct timespec* rx_stamp)
 {
 	static long int last_call = -1;
 
@@ -189,12 +214,6 @@ void teleopIntoDS1(struct u_struct *t)
 //		return;
 //	}
 
-	if (!checkMasterMode("network"))
-	{
-		return;
-	}
-
-	pthread_mutex_lock(&data1Mutex);
 	_localio_counter++;
 
 	if (PRINT) {
@@ -292,6 +311,21 @@ void teleopIntoDS1(struct u_struct *t)
     }
 
     data1.surgeon_mode = t->surgeon_mode;
+
+    data1.seq++;
+    if (rx_stamp) {
+    	data1.master_rx = *rx_stamp;
+    } else {
+    	memset(&data1.master_rx,0,sizeof(data1.master_rx));
+    }
+    if (rx_stamp) {
+    	if (data1_rx.packets == 0) {
+    		data1_rx.oldest = *rx_stamp;
+    	}
+    	data1_rx.newest = *rx_stamp;
+    	data1_rx.sequence = t->sequence;
+    	data1_rx.packets++;
+    }
 #ifdef USE_NEW_DEVICE
         FOREACH_ARM_ID(armId) {
 #else
@@ -302,13 +336,15 @@ void teleopIntoDS1(struct u_struct *t)
     }
 
     isUpdated = TRUE;
-    pthread_mutex_unlock(&data1Mutex);
 }
 
 void writeUpdate(struct param_pass* data_in) {
 	pthread_mutex_lock(&data1Mutex);
 
+	u_32 seq = data1.seq;
 	memcpy(&data1, data_in, sizeof(struct param_pass));
+	data1.seq = seq + 1;
+	memset(&data1.master_rx,0,sizeof(data1.master_rx));
 	isUpdated = TRUE;
 	pthread_mutex_unlock(&data1Mutex);
 
@@ -366,6 +402,9 @@ int checkLocalUpdates()
     return isUpdated;
 }
 
+static MetricCounter data1_trylock_failures("r2_data1_trylock_failures_total",
+		"Cycles the rt thread found data1Mutex held and kept the previous master command");
+
 // Give the latest updated DS1 to the caller.
 // Precondition: d1 is a pointer to allocated memory
 // Postcondition: memory location of d1 contains latest DS1 Data from network/toolkit.
@@ -380,7 +419,18 @@ bool getRcvdParams(struct param_pass* d1)
 	}
 	///TODO: Check performance of trylock / default priority inversion scheme
     if (pthread_mutex_trylock(&data1Mutex)!=0)   //Use trylock since this function is called form rt-thread. return immediately with old values if unable to lock
+    {
+        data1_trylock_failures.inc();
         return false;
+    }
+
+    // jitter buffer output; left in its slot for the next cycle if the trylock failed
+    struct u_struct jitter_u;
+    struct timespec jitter_rx;
+    bool jitter = teleopJitterTake(jitter_u,jitter_rx);
+    if (jitter) {
+    	applyTeleop(&jitter_u,&jitter_rx);
+    }
 
     if (isUpdated || lastUpdated == 0)
 	{
@@ -401,6 +451,17 @@ bool getRcvdParams(struct param_pass* d1)
 		//pthread_mutex_lock(&data1Mutex); //Priority inversion enabled. Should force completion of other parts and enter into this section.
 		memcpy(d1, &data1, sizeof(struct param_pass));
 
+		if (data1_rx.packets) {
+			if (rcvd_rx.packets == 0) {
+				rcvd_rx = data1_rx;
+			} else {
+				rcvd_rx.newest = data1_rx.newest;
+				rcvd_rx.sequence = data1_rx.sequence;
+				rcvd_rx.packets += data1_rx.packets;
+			}
+			data1_rx.packets = 0;
+		}
+
 		everUpdated = true;
 
     }
@@ -409,6 +470,10 @@ bool getRcvdParams(struct param_pass* d1)
 
     isUpdated = 0;
     pthread_mutex_unlock(&data1Mutex);
+
+    if (jitter) {
+    	networkRecordDS1Update(jitter_rx);
+    }
     return wasUpdated;
 }
 
@@ -422,6 +487,17 @@ bool peekRcvdParams(struct param_pass* d1) {
 	return wasUpdated;
 }
 
+// Receive times of the master packets taken by getRcvdParams() since the last call.
+// Called from the rt thread after the DAC write; returns false if no master packets were applied.
+bool getRcvdTeleopStamp(struct TeleopRxStamp* stamp) {
+	if (rcvd_rx.packets == 0) {
+		return false;
+	}
+	*stamp = rcvd_rx;
+	rcvd_rx.packets = 0;
+	return true;
+}
+
 // Reset writable copy of DS1
 void updateMasterRelativeOrigin(struct device *device0)
 {
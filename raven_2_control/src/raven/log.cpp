@@ -1,13 +1,17 @@
-
 /**
 Generic logging function
 
 **/
 #include <stdio.h>
 #include <stdarg.h>
+#include <string.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <algorithm>
 #include <ros/console.h>
 #include <map>
 #include "log.h"
+#include <boost/thread/thread.hpp>
 #include <boost/thread/mutex.hpp>
 
 static float defaultInterval = 1;
@@ -19,30 +23,456 @@ static std::map<std::string,bool> print;
 //printf("%s\n",buf);
 
 #define SET_BUF \
-	static char buf[1024]; \
+	char buf[1024]; \
 	va_list args; \
 	va_start (args, fmt); \
-	vsprintf(buf,fmt,args); \
+	vsnprintf(buf,sizeof(buf),fmt,args); \
+	va_end(args);
+
+/********************* Deferred logging *************************/
+
+// Limits of one queued message; anything past them is cut off
+#define LOG_MAX_ARGS 16
+#define LOG_STRING_SPACE 192
+#define LOG_FORMAT_SPACE 160
+// Messages per thread ring; power of two
+#define LOG_RING_SIZE 128
+// How often the writer thread looks at the rings
+#define LOG_POLL_USEC 2000
+
+enum LogLevel { LOG_LEVEL_INFO, LOG_LEVEL_WARN, LOG_LEVEL_ERROR };
+
+enum LogArgKind { LOG_ARG_INT, LOG_ARG_LONG, LOG_ARG_LLONG, LOG_ARG_DOUBLE, LOG_ARG_PTR, LOG_ARG_STR, LOG_ARG_NONE };
+
+union LogArg {
+	int i;
+	long l;
+	long long ll;
+	double d;
+	const void* p;
+	unsigned int str;  // offset into LogRecord::strings
+};
+
+struct LogRecord {
+	unsigned long seq;
+	unsigned char level;
+	unsigned char nargs;
+	unsigned char truncated;
+	unsigned short strings_used;
+	unsigned char kinds[LOG_MAX_ARGS];
+	LogArg args[LOG_MAX_ARGS];
+	char strings[LOG_STRING_SPACE];
+	char fmt[LOG_FORMAT_SPACE];  // callers may pass a format that doesn't outlive the call
+};
+
+/*
+ * One conversion of a printf format. Both sides walk the format with it: the
+ * caller to pull the arguments off its va_list, the writer to format them again.
+ */
+struct LogSpec {
+	const char* start;   // the '%'
+	const char* end;     // one past the conversion
+	int stars;           // '*' widths/precisions, each an int argument before the value
+	char length;         // 0, 'H' (hh), 'h', 'l', 'q' (ll, j, z, t) or 'L'
+	char conv;
+};
+
+// Finds the next conversion at or after p; false at the end of the format
+static bool
+nextLogSpec(const char*& p, LogSpec& spec) {
+	while ((p = strchr(p,'%'))) {
+		spec.start = p++;
+		if (*p == '%') { p++; continue; }
+		while (*p && strchr("-+ #0'",*p)) { p++; }
+		spec.stars = 0;
+		if (*p == '*') { spec.stars++; p++; } else { while (*p >= '0' && *p <= '9') { p++; } }
+		if (*p == '.') {
+			p++;
+			if (*p == '*') { spec.stars++; p++; } else { while (*p >= '0' && *p <= '9') { p++; } }
+		}
+		spec.length = 0;
+		switch (*p) {
+		case 'h': p++; if (*p == 'h') { p++; spec.length = 'H'; } else { spec.length = 'h'; } break;
+		case 'l': p++; if (*p == 'l') { p++; spec.length = 'q'; } else { spec.length = 'l'; } break;
+		case 'q': case 'j': case 'z': case 't': p++; spec.length = 'q'; break;
+		case 'L': p++; spec.length = 'L'; break;
+		}
+		spec.conv = *p;
+		if (!spec.conv) { return false; }
+		spec.end = ++p;
+		return true;
+	}
+	return false;
+}
+
+static LogArgKind
+logArgKind(const LogSpec& spec) {
+	switch (spec.conv) {
+	case 'd': case 'i': case 'o': case 'u': case 'x': case 'X': case 'c':
+		if (spec.length == 'q') { return LOG_ARG_LLONG; }
+		if (spec.length == 'l') { return LOG_ARG_LONG; }
+		return LOG_ARG_INT;
+	case 'f': case 'F': case 'e': case 'E': case 'g': case 'G': case 'a': case 'A':
+		return LOG_ARG_DOUBLE;
+	case 's':
+		return LOG_ARG_STR;
+	case 'p':
+	case 'n':
+		return LOG_ARG_PTR;
+	default:
+		return LOG_ARG_NONE;
+	}
+}
+
+static void
+captureLogArgs(LogRecord& r, const char* fmt, va_list args) {
+	r.nargs = 0;
+	r.truncated = 0;
+	r.strings_used = 0;
+	size_t len = strlen(fmt);
+	if (len >= LOG_FORMAT_SPACE) {
+		// the arguments past the cut are not taken
+		len = LOG_FORMAT_SPACE - 1;
+		r.truncated = 1;
+	}
+	memcpy(r.fmt,fmt,len);
+	r.fmt[len] = '\0';
+	fmt = r.fmt;
+	const char* p = fmt;
+	LogSpec spec;
+	while (nextLogSpec(p,spec)) {
+		LogArgKind kind = logArgKind(spec);
+		if (kind == LOG_ARG_NONE || r.nargs + spec.stars + 1 > LOG_MAX_ARGS) {
+			r.truncated = 1;
+			return;
+		}
+		for (int i=0;i<spec.stars;i++) {
+			r.kinds[r.nargs] = LOG_ARG_INT;
+			r.args[r.nargs++].i = va_arg(args,int);
+		}
+		LogArg& arg = r.args[r.nargs];
+		r.kinds[r.nargs++] = kind;
+		switch (kind) {
+		case LOG_ARG_INT: arg.i = va_arg(args,int); break;
+		case LOG_ARG_LONG: arg.l = va_arg(args,long); break;
+		case LOG_ARG_LLONG: arg.ll = va_arg(args,long long); break;
+		case LOG_ARG_DOUBLE:
+			if (spec.length == 'L') {
+				arg.d = va_arg(args,long double);
+			} else {
+				arg.d = va_arg(args,double);
+			}
+			break;
+		case LOG_ARG_PTR: arg.p = va_arg(args,void*); break;
+		case LOG_ARG_STR: {
+			// the string may be gone by the time the message is written
+			const char* str = va_arg(args,const char*);
+			if (!str) { str = "(null)"; }
+			size_t space = LOG_STRING_SPACE - r.strings_used;
+			size_t len = strlen(str);
+			if (len >= space) {
+				len = space ? space - 1 : 0;
+				r.truncated = 1;
+			}
+			arg.str = r.strings_used;
+			if (space) {
+				memcpy(r.strings + r.strings_used,str,len);
+				r.strings[r.strings_used + len] = '\0';
+				r.strings_used += len + 1;
+			} else {
+				r.kinds[r.nargs-1] = LOG_ARG_NONE;
+			}
+			break;
+		}
+		default: break;
+		}
+	}
+}
+
+// Puts n more characters (or as many as fit) at out[pos]
+static void
+appendLog(char* out, size_t size, size_t& pos, const char* str, size_t n) {
+	if (pos + 1 >= size) { return; }
+	if (n > size - 1 - pos) { n = size - 1 - pos; }
+	memcpy(out + pos,str,n);
+	pos += n;
+	out[pos] = '\0';
+}
+
+// Format text between conversions, with %% unescaped
+static void
+appendLogLiteral(char* out, size_t size, size_t& pos, const char* from, const char* to) {
+	for (const char* q = from; q != to && *q; q++) {
+		if (*q == '%' && q[1] == '%') { q++; }
+		appendLog(out,size,pos,q,1);
+	}
+}
+
+template<typename T>
+static void
+formatLogArg(char* out, size_t size, size_t& pos, const char* spec, int stars, const int* star, T value) {
+	if (pos + 1 >= size) { return; }
+	int n;
+	switch (stars) {
+	case 0: n = snprintf(out + pos,size - pos,spec,value); break;
+	case 1: n = snprintf(out + pos,size - pos,spec,star[0],value); break;
+	default: n = snprintf(out + pos,size - pos,spec,star[0],star[1],value); break;
+	}
+	if (n > 0) {
+		pos += std::min((size_t)n,size - 1 - pos);
+	}
+}
+
+static void
+formatLogRecord(const LogRecord& r, char* out, size_t size) {
+	size_t pos = 0;
+	out[0] = '\0';
+	const char* p = r.fmt;
+	const char* literal = p;
+	int a = 0;
+	LogSpec spec;
+	while (nextLogSpec(p,spec)) {
+		if (a + spec.stars + 1 > r.nargs) { break; }
+		appendLogLiteral(out,size,pos,literal,spec.start);
+		literal = spec.end;
+
+		// the spec is rebuilt with the length of the type that was stored
+		char conv[64];
+		size_t len = spec.end - spec.start - 1;
+		while (len && strchr("hlqjztL",spec.start[len-1])) { len--; }
+		if (len > sizeof(conv) - 4) { len = sizeof(conv) - 4; }
+		memcpy(conv,spec.start,len);
+		size_t c = len;
+		int star[2];
+		for (int i=0;i<spec.stars;i++) { star[i] = r.args[a++].i; }
+		const LogArg& arg = r.args[a];
+		switch (r.kinds[a++]) {
+		case LOG_ARG_INT:
+			if (spec.length == 'h') { conv[c++] = 'h'; }
+			if (spec.length == 'H') { conv[c++] = 'h'; conv[c++] = 'h'; }
+			conv[c++] = spec.conv; conv[c] = '\0';
+			formatLogArg(out,size,pos,conv,spec.stars,star,arg.i);
+			break;
+		case LOG_ARG_LONG:
+			conv[c++] = 'l'; conv[c++] = spec.conv; conv[c] = '\0';
+			formatLogArg(out,size,pos,conv,spec.stars,star,arg.l);
+			break;
+		case LOG_ARG_LLONG:
+			conv[c++] = 'l'; conv[c++] = 'l'; conv[c++] = spec.conv; conv[c] = '\0';
+			formatLogArg(out,size,pos,conv,spec.stars,star,arg.ll);
+			break;
+		case LOG_ARG_DOUBLE:
+			conv[c++] = spec.conv; conv[c] = '\0';
+			formatLogArg(out,size,pos,conv,spec.stars,star,arg.d);
+			break;
+		case LOG_ARG_PTR:
+			if (spec.conv == 'p') {
+				conv[c++] = 'p'; conv[c] = '\0';
+				formatLogArg(out,size,pos,conv,spec.stars,star,arg.p);
+			}
+			break;
+		case LOG_ARG_STR:
+			conv[c++] = 's'; conv[c] = '\0';
+			formatLogArg(out,size,pos,conv,spec.stars,star,(const char*)(r.strings + arg.str));
+			break;
+		default:
+			break;
+		}
+	}
+	if (a >= r.nargs && !r.truncated) {
+		appendLogLiteral(out,size,pos,literal,NULL);
+	} else {
+		appendLog(out,size,pos," [...]",6);
+	}
+}
+
+/*
+ * A thread's ring. Only its thread pushes and only the writer thread pops.
+ * push() fills the slot in place, so a message costs the argument copy and
+ * two stores.
+ */
+struct LogRing {
+	LogRecord items[LOG_RING_SIZE];
+	volatile unsigned int head;
+	volatile unsigned int tail;
+	volatile bool closed;  // its thread has exited
+	LogRing* next;
+
+	LogRing() : head(0), tail(0), closed(false), next(NULL) {}
+};
+
+static LogRing* volatile log_rings = NULL;   // pushed at the head only, by any thread
+static __thread LogRing* log_ring = NULL;     // __thread rather than thread_specific_ptr: it is on the rt path
+static pthread_key_t log_ring_key;
+static pthread_once_t log_ring_key_once = PTHREAD_ONCE_INIT;
+static volatile unsigned long log_seq = 0;
+static volatile bool log_async = false;
+// messages lost to full rings, across all threads; not kept per ring, as rings are freed
+static volatile unsigned int log_dropped_count = 0;
+static unsigned int log_dropped_reported = 0;  // writer thread only
+static boost::thread* log_thread = NULL;
+
+static void
+closeLogRing(void* ring) {
+	((LogRing*)ring)->closed = true;
+}
+
+static void
+makeLogRingKey() {
+	pthread_key_create(&log_ring_key,closeLogRing);
+}
+
+static LogRing*
+threadLogRing() {
+	if (ROS_UNLIKELY(!log_ring)) {
+		LogRing* ring = new LogRing();
+		pthread_once(&log_ring_key_once,makeLogRingKey);
+		pthread_setspecific(log_ring_key,ring);
+		LogRing* head;
+		do {
+			head = log_rings;
+			ring->next = head;
+		} while (!__sync_bool_compare_and_swap(&log_rings,head,ring));
+		log_ring = ring;
+	}
+	return log_ring;
+}
+
+static void
+emitLog(int level, const char* msg) {
+	switch (level) {
+	case LOG_LEVEL_INFO: ROS_INFO("%s",msg); break;
+	case LOG_LEVEL_WARN: ROS_WARN("%s",msg); break;
+	default: ROS_ERROR("%s",msg); break;
+	}
+}
+
+// Queues the message if the writer thread is running, otherwise writes it now
+static void
+logv(int level, const char* fmt, va_list args) {
+	if (ROS_LIKELY(log_async)) {
+		LogRing* ring = threadLogRing();
+		unsigned int h = ring->head;
+		if (h - ring->tail >= LOG_RING_SIZE) {
+			__sync_fetch_and_add(&log_dropped_count,1);
+			return;
+		}
+		LogRecord& r = ring->items[h & (LOG_RING_SIZE-1)];
+		r.seq = __sync_fetch_and_add(&log_seq,1);
+		r.level = level;
+		captureLogArgs(r,fmt,args);
+		__sync_synchronize();
+		ring->head = h + 1;
+		return;
+	}
+	char buf[1024];
+	vsnprintf(buf,sizeof(buf),fmt,args);
+	emitLog(level,buf);
+}
+
+/*
+ * Writes out everything queued, oldest first across the rings, and frees the
+ * rings of threads that have exited. Only the writer thread (or
+ * log_stop_async() once it has stopped) calls this.
+ */
+static void
+drainLogRings() {
+	static char buf[1024];
+	while (true) {
+		LogRing* oldest = NULL;
+		for (LogRing* ring = log_rings; ring; ring = ring->next) {
+			if (ring->tail != ring->head) {
+				__sync_synchronize();
+				if (!oldest || ring->items[ring->tail & (LOG_RING_SIZE-1)].seq < oldest->items[oldest->tail & (LOG_RING_SIZE-1)].seq) {
+					oldest = ring;
+				}
+			}
+		}
+		if (!oldest) { break; }
+		const LogRecord& r = oldest->items[oldest->tail & (LOG_RING_SIZE-1)];
+		formatLogRecord(r,buf,sizeof(buf));
+		emitLog(r.level,buf);
+		__sync_synchronize();
+		oldest->tail++;
+	}
+
+	unsigned int dropped = log_dropped_count;
+	if (dropped != log_dropped_reported) {
+		ROS_WARN("Log rings full: %u messages dropped (%u new)",dropped,dropped - log_dropped_reported);
+		log_dropped_reported = dropped;
+	}
+
+	// the head stays put: other threads may be pushing in front of it
+	for (LogRing* prev = log_rings; prev && prev->next; ) {
+		LogRing* ring = prev->next;
+		if (ring->closed && ring->tail == ring->head) {
+			prev->next = ring->next;
+			delete ring;
+		} else {
+			prev = ring;
+		}
+	}
+}
+
+static void
+logWriter() {
+	while (log_async) {
+		drainLogRings();
+		usleep(LOG_POLL_USEC);
+	}
+}
+
+void
+log_start_async() {
+	if (log_async) { return; }
+	log_async = true;
+	log_thread = new boost::thread(logWriter);
+}
+
+void
+log_stop_async() {
+	if (!log_async) { return; }
+	log_async = false;
+	log_thread->join();
+	delete log_thread;
+	log_thread = NULL;
+	drainLogRings();
+}
+
+void
+log_prepare_thread() {
+	threadLogRing();
+}
+
+// safe from any thread: it doesn't walk the rings, which the writer frees
+unsigned int
+log_dropped() {
+	return log_dropped_count;
+}
+
+/********************* Log functions *************************/
+
+#define LOG_V(level) \
+	va_list args; \
+	va_start (args, fmt); \
+	logv(level,fmt,args); \
 	va_end(args);
 
 int log_msg(const char* fmt,...)
 {
-	SET_BUF
-	ROS_INFO("%s",buf);
+	LOG_V(LOG_LEVEL_INFO)
     return 0;
 }
 
 int log_warn(const char* fmt,...)
 {
-    SET_BUF
-    ROS_WARN("%s",buf);
+    LOG_V(LOG_LEVEL_WARN)
     return 0;
 }
 
 int log_err(const char* fmt,...)
 {
-	SET_BUF
-    ROS_ERROR("%s",buf);
+	LOG_V(LOG_LEVEL_ERROR)
     return 0;
 }
 
@@ -51,8 +481,7 @@ int log_msg_throttle(float interval,const char* fmt,...) {
 	::ros::Time now = ::ros::Time::now();
 	if (ROS_UNLIKELY(last_hit + interval <= now.toSec())) {
 	  last_hit = now.toSec();
-	  SET_BUF
-	  ROS_INFO("%s",buf);
+	  LOG_V(LOG_LEVEL_INFO)
 	  return 0;
 	}
 	return 1;
@@ -63,8 +492,7 @@ int log_warn_throttle(float interval,const char* fmt,...) {
 	::ros::Time now = ::ros::Time::now();
 	if (ROS_UNLIKELY(last_hit + interval <= now.toSec())) {
 	  last_hit = now.toSec();
-	  SET_BUF
-	  ROS_WARN("%s",buf);
+	  LOG_V(LOG_LEVEL_WARN)
 	  return 0;
 	}
 	return 1;
@@ -75,8 +503,7 @@ int log_err_throttle(float interval,const char* fmt,...) {
 	::ros::Time now = ::ros::Time::now();
 	if (ROS_UNLIKELY(last_hit + interval <= now.toSec())) {
 	  last_hit = now.toSec();
-	  SET_BUF
-	  ROS_ERROR("%s",buf);
+	  LOG_V(LOG_LEVEL_ERROR)
 	  return 0;
 	}
 	return 1;
@@ -84,8 +511,7 @@ int log_err_throttle(float interval,const char* fmt,...) {
 
 int err_msg(const char* fmt,...)
 {
-    SET_BUF
-    ROS_ERROR("%s",buf);
+    LOG_V(LOG_LEVEL_ERROR)
     return 0;
 }
 
@@ -114,8 +540,7 @@ void update_log_throttler() {
 
 int log_msg_throttle(const char* name,const char* fmt, ...) {
 	if (print[std::string(name)]) {
-		SET_BUF
-		ROS_INFO("%s",buf);
+		LOG_V(LOG_LEVEL_INFO)
 		return 0;
 	}
 	return 1;
@@ -0,0 +1,334 @@
+/*
+ * metrics_scrape.cpp
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: agent
+ */
+
+/*
+ * Stand-in for a Prometheus scraper. Fetches /metrics from r2_control (or
+ * anything else using MetricsExporter), checks that it parses as the text
+ * exposition format, and prints it. Exits with 1 if the fetch fails, the text
+ * is malformed, or a --require'd family is missing, so it can gate a test run:
+ *   rosrun raven_2_control r2_control --sim-usb --no-console &
+ *   rosrun raven_2_control metrics_scrape --check --require r2_loop_duration_seconds,r2_usb_errors_total
+ */
+
+#include <raven/util/config.h>
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include <map>
+#include <set>
+#include <sstream>
+#include <string>
+#include <vector>
+
+struct ScrapeConfig : public rosx::ConfigGroup {
+	int port;
+	std::string socket;
+	std::string require;
+	bool check;
+
+	ScrapeConfig() : rosx::ConfigGroup("metrics_scrape") {
+		ConfigGroup_optionWithHelp(port,int,"scrape http://127.0.0.1:<port>/metrics (0 = use --socket)",0);
+		ConfigGroup_optionWithHelp(socket,std::string,"scrape over this Unix socket","/tmp/r2_control_metrics");
+		ConfigGroup_optionWithHelp(require,std::string,"comma separated metric families that must be present","");
+		ConfigGroup_flagWithHelp(check,"only check the exposition; print a summary instead of the metrics");
+	}
+};
+
+static ScrapeConfig Options;
+
+static bool
+fetch(std::string& body) {
+	int sock;
+	if (Options.port > 0) {
+		sock = socket(AF_INET, SOCK_STREAM, 0);
+		struct sockaddr_in addr;
+		memset(&addr,0,sizeof(addr));
+		addr.sin_family = AF_INET;
+		addr.sin_port = htons(Options.port);
+		addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+		if (sock >= 0 && connect(sock,(struct sockaddr*)&addr,sizeof(addr)) < 0) {
+			fprintf(stderr, "port %d: %s\n", Options.port, strerror(errno));
+			close(sock);
+			return false;
+		}
+	} else {
+		sock = socket(AF_UNIX, SOCK_STREAM, 0);
+		struct sockaddr_un addr;
+		memset(&addr,0,sizeof(addr));
+		addr.sun_family = AF_UNIX;
+		strncpy(addr.sun_path,Options.socket.c_str(),sizeof(addr.sun_path)-1);
+		if (sock >= 0 && connect(sock,(struct sockaddr*)&addr,sizeof(addr)) < 0) {
+			fprintf(stderr, "%s: %s\n", Options.socket.c_str(), strerror(errno));
+			close(sock);
+			return false;
+		}
+	}
+	if (sock < 0) {
+		perror("socket");
+		return false;
+	}
+
+	const char* request = "GET /metrics HTTP/1.0\r\nAccept: text/plain\r\n\r\n";
+	if (send(sock,request,strlen(request),MSG_NOSIGNAL) < 0) {
+		perror("send");
+		close(sock);
+		return false;
+	}
+	std::string response;
+	char buf[4096];
+	ssize_t n;
+	while ((n = recv(sock,buf,sizeof(buf),0)) > 0) {
+		response.append(buf,n);
+	}
+	close(sock);
+
+	size_t headerEnd = response.find("\r\n\r\n");
+	if (response.compare(0,9,"HTTP/1.0 ") != 0 || headerEnd == std::string::npos) {
+		fprintf(stderr, "not an HTTP response\n");
+		return false;
+	}
+	std::string statusLine = response.substr(0,response.find("\r\n"));
+	if (statusLine.compare(9,3,"200") != 0) {
+		fprintf(stderr, "%s\n", statusLine.c_str());
+		return false;
+	}
+	body = response.substr(headerEnd + 4);
+	return true;
+}
+
+/************************ exposition checks ************************/
+
+static bool
+isNameChar(char c, bool first) {
+	return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_' || c == ':' || (!first && c >= '0' && c <= '9');
+}
+
+static bool
+parseValue(const std::string& str, double& value) {
+	if (str == "+Inf") { value = 1./0.; return true; }
+	if (str == "-Inf") { value = -1./0.; return true; }
+	if (str == "NaN") { value = 0./0.; return true; }
+	char* end;
+	value = strtod(str.c_str(),&end);
+	return !str.empty() && *end == '\0';
+}
+
+struct Sample {
+	std::string name;
+	std::vector<std::pair<std::string,std::string> > labels;
+	double value;
+};
+
+// name{label="value",...} value
+static bool
+parseSample(const std::string& line, Sample& s) {
+	size_t i = 0;
+	while (i < line.size() && isNameChar(line[i],i == 0)) {
+		i++;
+	}
+	if (i == 0) {
+		return false;
+	}
+	s.name = line.substr(0,i);
+	s.labels.clear();
+	if (i < line.size() && line[i] == '{') {
+		i++;
+		while (i < line.size() && line[i] != '}') {
+			size_t start = i;
+			while (i < line.size() && isNameChar(line[i],i == start)) {
+				i++;
+			}
+			if (i == start || line.compare(i,2,"=\"") != 0) {
+				return false;
+			}
+			std::string key = line.substr(start,i-start);
+			i += 2;
+			std::string value;
+			while (i < line.size() && line[i] != '"') {
+				if (line[i] == '\\' && i+1 < line.size()) {
+					i++;
+				}
+				value += line[i++];
+			}
+			if (i >= line.size()) {
+				return false;
+			}
+			i++;
+			s.labels.push_back(std::make_pair(key,value));
+			if (i < line.size() && line[i] == ',') {
+				i++;
+			}
+		}
+		if (i >= line.size()) {
+			return false;
+		}
+		i++;
+	}
+	if (i >= line.size() || line[i] != ' ') {
+		return false;
+	}
+	std::string value = line.substr(i+1);
+	// an optional timestamp
+	size_t space = value.find(' ');
+	if (space != std::string::npos) {
+		value.resize(space);
+	}
+	return parseValue(value,s.value);
+}
+
+static std::string
+familyOf(const std::string& name, const std::map<std::string,std::string>& types) {
+	static const char* SUFFIXES[] = { "_bucket", "_sum", "_count" };
+	for (int i=0;i<3;i++) {
+		size_t len = strlen(SUFFIXES[i]);
+		if (name.size() > len && name.compare(name.size()-len,len,SUFFIXES[i]) == 0) {
+			std::string base = name.substr(0,name.size()-len);
+			std::map<std::string,std::string>::const_iterator t = types.find(base);
+			if (t != types.end() && t->second == "histogram") {
+				return base;
+			}
+		}
+	}
+	return name;
+}
+
+struct HistogramSeries {
+	double lastBucket;
+	double infBucket;
+	double count;
+	bool hasInf;
+	bool hasCount;
+	HistogramSeries() : lastBucket(0), infBucket(0), count(0), hasInf(false), hasCount(false) {}
+};
+
+static int
+checkExposition(const std::string& body, std::set<std::string>& families, int& samples) {
+	int errors = 0;
+	std::map<std::string,std::string> types;
+	std::map<std::string,HistogramSeries> histograms;
+	std::set<std::string> sampled;
+	std::istringstream in(body);
+	std::string line;
+	int lineno = 0;
+	samples = 0;
+	while (std::getline(in,line)) {
+		lineno++;
+		if (line.empty()) {
+			continue;
+		}
+		if (line[0] == '#') {
+			std::istringstream words(line);
+			std::string hash, keyword, name, rest;
+			words >> hash >> keyword >> name;
+			if (keyword == "TYPE") {
+				words >> rest;
+				if (rest != "counter" && rest != "gauge" && rest != "histogram" && rest != "summary" && rest != "untyped") {
+					fprintf(stderr, "line %d: unknown type '%s'\n", lineno, rest.c_str());
+					errors++;
+				}
+				if (types.count(name) || sampled.count(name)) {
+					fprintf(stderr, "line %d: TYPE for %s after it was used\n", lineno, name.c_str());
+					errors++;
+				}
+				types[name] = rest;
+			}
+			continue;
+		}
+
+		Sample s;
+		if (!parseSample(line,s)) {
+			fprintf(stderr, "line %d: malformed sample: %s\n", lineno, line.c_str());
+			errors++;
+			continue;
+		}
+		samples++;
+		std::string family = familyOf(s.name,types);
+		families.insert(family);
+		sampled.insert(family);
+		if (types[family] == "counter" && s.value < 0) {
+			fprintf(stderr, "line %d: negative counter\n", lineno);
+			errors++;
+		}
+		if (types[family] != "histogram") {
+			continue;
+		}
+
+		// the series is the labels other than le
+		std::string series = family;
+		std::string le;
+		for (size_t l=0;l<s.labels.size();l++) {
+			if (s.labels[l].first == "le") {
+				le = s.labels[l].second;
+			} else {
+				series += "," + s.labels[l].first + "=" + s.labels[l].second;
+			}
+		}
+		HistogramSeries& h = histograms[series];
+		if (s.name == family + "_bucket") {
+			if (s.value < h.lastBucket) {
+				fprintf(stderr, "line %d: bucket counts of %s decrease\n", lineno, series.c_str());
+				errors++;
+			}
+			h.lastBucket = s.value;
+			if (le == "+Inf") {
+				h.infBucket = s.value;
+				h.hasInf = true;
+			}
+		} else if (s.name == family + "_count") {
+			h.count = s.value;
+			h.hasCount = true;
+		}
+	}
+	for (std::map<std::string,HistogramSeries>::iterator itr=histograms.begin();itr!=histograms.end();itr++) {
+		const HistogramSeries& h = itr->second;
+		if (!h.hasInf || !h.hasCount || h.infBucket != h.count) {
+			fprintf(stderr, "histogram %s: +Inf bucket and _count don't match\n", itr->first.c_str());
+			errors++;
+		}
+	}
+	return errors;
+}
+
+int
+main(int argc, char* argv[]) {
+	rosx::Parser parser;
+	parser.addGroup(Options);
+	parser.read(argc, argv);
+
+	std::string body;
+	if (!fetch(body)) {
+		return 1;
+	}
+
+	std::set<std::string> families;
+	int samples;
+	int errors = checkExposition(body,families,samples);
+
+	std::stringstream required(Options.require);
+	std::string name;
+	while (std::getline(required,name,',')) {
+		if (!name.empty() && !families.count(name)) {
+			fprintf(stderr, "missing %s\n", name.c_str());
+			errors++;
+		}
+	}
+
+	if (Options.check) {
+		printf("%lu families, %d samples, %d errors\n", (unsigned long)families.size(), samples, errors);
+	} else {
+		fputs(body.c_str(),stdout);
+	}
+	return errors ? 1 : 0;
+}
@@ -19,8 +19,14 @@ end
 
  *********************************************/
 
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE     // for recvmmsg
+#endif
+
 #include <sys/types.h>  // provides FD_SET, FD_CLR, etc.
-#include <sys/socket.h> // provides socket constants
+#include <sys/socket.h> // provides socket constants, recvmmsg
+#include <sys/uio.h>    // provides iovec
+#include <poll.h>
 #include <sys/time.h>   // provides timers
 #include <netinet/in.h> // defines socket ip protocols/address structs
 #include <netdb.h>      // port/hostname lookup features.
@@ -34,20 +40,36 @@ end
 #include <ros/console.h>
 
 #include <stdlib.h>
+#include <stdint.h>
 #include <string.h>
 #include <unistd.h>
+#include <pthread.h>
 //#include <rtai_fifos.h>
 
 #include "itp_teleoperation.h"
+#include "network_layer.h"
+#include "teleop_protocol.h"
+#include "teleop_jitter_buffer.h"
 #include "DS0.h"
 #include "DS1.h"
 #include "log.h"
+#include "shared_modes.h"
+#include <raven/util/config.h>
+#include <raven/util/metrics.h>
+#include <raven_2_msgs/TeleopLatency.h>
+#include <raven_2_msgs/TeleopRxStats.h>
 
 #define SERVER_PORT  "36000"
+
+extern int NUM_MECH;
+
+// Large enough for either a legacy u_struct or the biggest v2 packet
+#define NET_RX_BUFFER_SIZE (TELEOP_MAX_PACKET_SIZE > sizeof(struct u_struct) ? TELEOP_MAX_PACKET_SIZE : sizeof(struct u_struct))
+#define NET_TX_BUFFER_SIZE (TELEOP_MAX_FEEDBACK_SIZE > sizeof(struct v_struct) ? TELEOP_MAX_FEEDBACK_SIZE : sizeof(struct v_struct))
 //#define SERVER_ADDR  "192.168.0.102"
 #define SERVER_ADDR  "128.95.205.206"
 
-extern int recieveUserspace(void *u,int size);
+extern int recieveUserspace(void *u,int size,const struct timespec* rx_stamp);
 
 int initSock (const char* port )
 {
@@ -113,30 +135,601 @@ int UDPChecksum(struct u_struct *u)
 // Chek packet validity, incl. sequence numbering and checksumming
 //int checkPacket(struct u_struct &u, int seq);
 
+enum NetworkEventType
+{
+    NET_EVENT_WRONG_SIZE,
+    NET_EVENT_BAD_PACKET,
+    NET_EVENT_IGNORED_ARMS,
+    NET_EVENT_REFLECT,
+    NET_EVENT_SKIPPED,
+    NET_EVENT_DUPLICATE,
+    NET_EVENT_RESET,
+    NET_EVENT_OUT_OF_SEQUENCE
+};
+
+struct NetworkEvent
+{
+    int type;
+    unsigned int seq;      // last valid sequence number
+    unsigned int rcvd;     // sequence number (or size, decode result, arm count) of the offending packet
+    struct timespec stamp; // kernel receive time
+};
+
+struct NetworkLatency
+{
+    struct TeleopRxStamp rx;
+    struct timespec dac;   // time the command went out to the DAC
+};
+
+// Receive counters.  Written by the receive thread only, with atomic adds; published by the logging thread.
+struct NetworkCounts
+{
+    volatile unsigned int packets;
+    volatile unsigned int rejected;                         // wrong size or failed v2 decode
+    volatile unsigned int sequence[TELEOP_SEQ_NUM_RESULTS]; // by teleopCheckSequence result
+    volatile unsigned int seq;                              // last sequence number taken
+};
+
+static NetworkCounts net_counts;
+
+// The same counts for the metrics exporter, by sequence result plus "rejected"; made when the receive thread starts
+static MetricCounter* teleop_packet_metrics[TELEOP_SEQ_NUM_RESULTS+1];
+#define TELEOP_METRIC_REJECTED TELEOP_SEQ_NUM_RESULTS
+
+// Kernel receive -> teleopIntoDS1 times, from whichever thread calls teleopIntoDS1
+static volatile unsigned int ds1_updates = 0;
+static volatile int64_t ds1_latency_total = 0;
+static volatile int64_t ds1_latency_max = 0;
+
+static NetworkRing<NetworkEvent,256> net_events;
+static NetworkRing<NetworkLatency,1024> net_latency;
+
+static TeleopJitterBuffer teleop_jitter;
+static bool use_teleop_jitter = false;
+
+// State sampled by the rt thread for one feedback packet
+struct FeedbackRecord
+{
+    struct timespec stamp;
+    unsigned char runlevel;
+    unsigned char sublevel;
+    int numArms;
+    TeleopFeedbackArm arms[TELEOP_MAX_ARMS];
+};
+
+// Where and what the master last sent.
+// Written by the receive thread, read by the feedback thread through a seqlock.
+struct MasterInfo
+{
+    struct sockaddr_in addr;
+    unsigned int sequence;
+    uint64_t senderTime;   // 0 for legacy packets
+    struct timespec rx;
+    bool v2;
+    bool valid;
+};
+
+static NetworkRing<FeedbackRecord,256> net_feedback;
+static MasterInfo master_info;
+static volatile unsigned int master_info_version = 0;
+static volatile unsigned int feedback_sent = 0;
+static volatile unsigned int feedback_dropped = 0;
+static int net_sock = -1;
+
+static inline void pushNetworkEvent(int type, unsigned int seq, unsigned int rcvd, const struct timespec& stamp)
+{
+    NetworkEvent e;
+    e.type = type;
+    e.seq = seq;
+    e.rcvd = rcvd;
+    e.stamp = stamp;
+    net_events.push(e);
+}
+
+void networkRecordDS1Update(const struct timespec& rx)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    int64_t latency = (now.tv_sec - rx.tv_sec) * (int64_t)1000000000 + (now.tv_nsec - rx.tv_nsec);
+
+    __sync_fetch_and_add(&ds1_latency_total, latency);
+    __sync_fetch_and_add(&ds1_updates, 1);
+    int64_t max = ds1_latency_max;
+    while (latency > max)
+    {
+        int64_t prev = __sync_val_compare_and_swap(&ds1_latency_max, max, latency);
+        if (prev == max)
+            break;
+        max = prev;
+    }
+}
+
+void networkRecordDacWrite(const struct TeleopRxStamp& stamp)
+{
+    NetworkLatency l;
+    l.rx = stamp;
+    clock_gettime(CLOCK_REALTIME, &l.dac);
+    net_latency.push(l);
+}
+
+static inline int64_t timespecToNSec(const struct timespec& t)
+{
+    return t.tv_sec * (int64_t)1000000000 + t.tv_nsec;
+}
+
+static inline ros::Time timespecToRos(const struct timespec& t)
+{
+    return ros::Time(t.tv_sec, t.tv_nsec);
+}
+
+// Format and write one sequence anomaly.  Runs on the logging thread only.
+static void logNetworkEvent(int logFile, const NetworkEvent& e)
+{
+    char logbuffer[160];
+    char timebuffer[32];
+    time_t sec = e.stamp.tv_sec;
+    ctime_r(&sec, timebuffer);
+    timebuffer[strcspn(timebuffer, "\n")] = '\0';
+
+    switch (e.type)
+    {
+    case NET_EVENT_WRONG_SIZE:
+        sprintf(logbuffer, "%s Rec'd wrong ustruct size %u on socket\n", timebuffer, e.rcvd);
+        ROS_ERROR("%s", logbuffer);
+        break;
+    case NET_EVENT_BAD_PACKET:
+        sprintf(logbuffer, "%s Rejected teleop packet (%s)\n", timebuffer, teleopDecodeResultString(e.rcvd));
+        ROS_ERROR("%s", logbuffer);
+        break;
+    case NET_EVENT_IGNORED_ARMS:
+        sprintf(logbuffer, "%s Ignored %u arms in packet %u\n", timebuffer, e.rcvd, e.seq);
+        ROS_WARN("%s", logbuffer);
+        break;
+    case NET_EVENT_REFLECT:
+        sprintf(logbuffer, "%s Zero sequence -> reflect packet\n", timebuffer);
+        ROS_INFO("%s", logbuffer);
+        break;
+    case NET_EVENT_SKIPPED:
+        sprintf(logbuffer, "%s Skipped (dropped?) packets %u - %u\n", timebuffer, e.seq+1, e.rcvd-1);
+        ROS_WARN("%s", logbuffer);
+        break;
+    case NET_EVENT_DUPLICATE:
+        sprintf(logbuffer, "%s Duplicated packet %u - %u\n", timebuffer, e.seq, e.rcvd);
+        ROS_ERROR("%s", logbuffer);
+        break;
+    case NET_EVENT_RESET:
+        sprintf(logbuffer, "%s Sequence numbering reset from %u to %u\n", timebuffer, e.seq, e.rcvd);
+        ROS_INFO("%s", logbuffer);
+        break;
+    default:
+        sprintf(logbuffer, "%s Out of sequence packet %u\n", timebuffer, e.seq);
+        ROS_ERROR("%s", logbuffer);
+        break;
+    }
+    if (write(logFile, logbuffer, strlen(logbuffer)) < 0)
+    {
+        // log file is O_NONBLOCK; dropping a line is preferable to stalling
+    }
+}
+
+// Drains the anomaly and latency queues so the receive thread never touches the log file.
+// Latency records are published per DAC write on teleop_latency.
+static void* network_log_process(void* param)
+{
+    int logFile = *(int*)param;
+    char logbuffer[100];
+    time_t now = time(NULL);
+    snprintf(logbuffer, sizeof(logbuffer), "\n\nOpened log file at %s\n", ctime(&now));
+    if (write(logFile, logbuffer, strlen(logbuffer)) < 0)
+    {
+        ROS_WARN("Couldn't write the network log (%s)", strerror(errno));
+    }
+
+    ros::NodeHandle n;
+    ros::Publisher latency_pub = n.advertise<raven_2_msgs::TeleopLatency>("teleop_latency", 100);
+    ros::Publisher stats_pub = n.advertise<raven_2_msgs::TeleopRxStats>("teleop_rx_stats", 10);
+    raven_2_msgs::TeleopLatency msg;
+    raven_2_msgs::TeleopRxStats stats;
+
+    unsigned int events_dropped = 0;
+    unsigned int latency_dropped = 0;
+    int64_t window_count = 0, window_sum = 0, window_max = 0;
+    ros::WallTime window_start = ros::WallTime::now();
+
+    int64_t ds1_total = 0;
+    unsigned int ds1_count = 0;
+    int64_t ds1_window_max = 0;
+    unsigned int window_ds1_count = 0;
+    int64_t window_ds1_total = 0;
+    NetworkCounts window_counts;
+    memset(&window_counts, 0, sizeof(window_counts));
+    ros::WallTime stats_time = window_start;
+
+    while ( ros::ok() )
+    {
+        NetworkEvent e;
+        while (net_events.pop(e))
+        {
+            logNetworkEvent(logFile, e);
+        }
+
+        NetworkLatency l;
+        while (net_latency.pop(l))
+        {
+            int64_t latency = timespecToNSec(l.dac) - timespecToNSec(l.rx.newest);
+            int64_t oldest_latency = timespecToNSec(l.dac) - timespecToNSec(l.rx.oldest);
+
+            msg.header.stamp = timespecToRos(l.dac);
+            msg.sequence = l.rx.sequence;
+            msg.packets = l.rx.packets;
+            msg.receive_stamp = timespecToRos(l.rx.newest);
+            msg.oldest_receive_stamp = timespecToRos(l.rx.oldest);
+            msg.dac_stamp = timespecToRos(l.dac);
+            msg.latency.fromNSec(latency);
+            msg.oldest_latency.fromNSec(oldest_latency);
+            latency_pub.publish(msg);
+
+            window_count++;
+            window_sum += latency;
+            if (latency > window_max)
+                window_max = latency;
+        }
+
+        if (net_events.dropped != events_dropped || net_latency.dropped != latency_dropped)
+        {
+            log_warn_throttle(5, "network log queues full: dropped %u events, %u latency records",
+                              net_events.dropped - events_dropped, net_latency.dropped - latency_dropped);
+            events_dropped = net_events.dropped;
+            latency_dropped = net_latency.dropped;
+        }
+
+        ros::WallTime now = ros::WallTime::now();
+        if (now - stats_time > ros::WallDuration(1))
+        {
+            // the count is read first so the total never trails it
+            ds1_count = ds1_updates;
+            ds1_total += __sync_lock_test_and_set(&ds1_latency_total, 0);
+            int64_t ds1_max = __sync_lock_test_and_set(&ds1_latency_max, 0);
+            if (ds1_max > ds1_window_max)
+                ds1_window_max = ds1_max;
+
+            stats.header.stamp = ros::Time::now();
+            stats.sequence = net_counts.seq;
+            stats.packets = net_counts.packets;
+            stats.rejected = net_counts.rejected;
+            stats.applied = net_counts.sequence[TELEOP_SEQ_APPLIED];
+            stats.reflect = net_counts.sequence[TELEOP_SEQ_REFLECT];
+            stats.skipped = net_counts.sequence[TELEOP_SEQ_SKIPPED];
+            stats.duplicate = net_counts.sequence[TELEOP_SEQ_DUPLICATE];
+            stats.reset = net_counts.sequence[TELEOP_SEQ_RESET];
+            stats.out_of_order = net_counts.sequence[TELEOP_SEQ_OUT_OF_ORDER];
+            stats.ds1_updates = ds1_count;
+            stats.ds1_latency_total.fromNSec(ds1_total);
+            stats.ds1_latency_max.fromNSec(ds1_max);
+            stats_pub.publish(stats);
+            stats_time = now;
+        }
+
+        if (now - window_start > ros::WallDuration(10))
+        {
+            if (net_counts.packets != window_counts.packets)
+            {
+                log_msg("teleop packets: %u received, %u rejected, %u applied, %u skipped, %u duplicate, %u out of order, %u reset",
+                        net_counts.packets - window_counts.packets,
+                        net_counts.rejected - window_counts.rejected,
+                        net_counts.sequence[TELEOP_SEQ_APPLIED] - window_counts.sequence[TELEOP_SEQ_APPLIED],
+                        net_counts.sequence[TELEOP_SEQ_SKIPPED] - window_counts.sequence[TELEOP_SEQ_SKIPPED],
+                        net_counts.sequence[TELEOP_SEQ_DUPLICATE] - window_counts.sequence[TELEOP_SEQ_DUPLICATE],
+                        net_counts.sequence[TELEOP_SEQ_OUT_OF_ORDER] - window_counts.sequence[TELEOP_SEQ_OUT_OF_ORDER],
+                        net_counts.sequence[TELEOP_SEQ_RESET] - window_counts.sequence[TELEOP_SEQ_RESET]);
+                memcpy((void*)&window_counts, (const void*)&net_counts, sizeof(window_counts));
+            }
+            if (ds1_count != window_ds1_count)
+            {
+                log_msg("teleop rx->ds1 latency: avg %lli us, max %lli us over %u updates",
+                        (long long int)((ds1_total - window_ds1_total) / (ds1_count - window_ds1_count) / 1000),
+                        (long long int)(ds1_window_max / 1000),
+                        ds1_count - window_ds1_count);
+                window_ds1_count = ds1_count;
+                window_ds1_total = ds1_total;
+            }
+            ds1_window_max = 0;
+            if (window_count > 0)
+            {
+                log_msg("teleop rx->dac latency: avg %lli us, max %lli us over %lli writes",
+                        (long long int)(window_sum / window_count / 1000),
+                        (long long int)(window_max / 1000),
+                        (long long int)window_count);
+            }
+            if (RavenConfig.feedback_rate > 0)
+            {
+                log_msg("teleop feedback: %u sent, %u dropped", feedback_sent, feedback_dropped);
+            }
+            if (use_teleop_jitter)
+            {
+                TeleopJitterBuffer::Stats js = teleop_jitter.stats();
+                log_msg("teleop jitter buffer: delay %lli us, jitter %lli us, interval %lli us, %u late, %u resets",
+                        (long long int)(js.delay / 1000), (long long int)(js.jitter / 1000),
+                        (long long int)(js.interval / 1000), js.late, js.resets);
+            }
+            window_count = window_sum = window_max = 0;
+            window_start = now;
+        }
+
+        usleep(10000);
+    }
+    return NULL;
+}
+
+// Kernel receive time from the SO_TIMESTAMPNS control message, or now if the kernel didn't supply one
+static void getRxStamp(struct msghdr* hdr, struct timespec* stamp)
+{
+    struct cmsghdr* cmsg;
+    for (cmsg = CMSG_FIRSTHDR(hdr); cmsg != NULL; cmsg = CMSG_NXTHDR(hdr, cmsg))
+    {
+        if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_TIMESTAMPNS)
+        {
+            memcpy(stamp, CMSG_DATA(cmsg), sizeof(*stamp));
+            return;
+        }
+    }
+    clock_gettime(CLOCK_REALTIME, stamp);
+}
+
+// Jitter buffer output waiting for getRcvdParams. Only the rt thread touches it,
+// so it needs no lock.
+static struct u_struct jitter_out;
+static struct timespec jitter_out_rx;
+static bool jitter_out_pending = false;
+
+// Called from the rt thread once per servo cycle, before the DS1 update is read.
+// Leaves the buffered v2 motion for getRcvdParams to take with teleopJitterTake().
+void teleopJitterTick()
+{
+    if (!use_teleop_jitter)
+        return;
+
+    struct u_struct u;
+    struct timespec now, rx;
+    clock_gettime(CLOCK_REALTIME, &now);
+    if (!teleop_jitter.tick(timespecToNSec(now), u, rx))
+        return;
+
+    if (jitter_out_pending)
+    {
+        // getRcvdParams couldn't take the last one; keep its increments
+        for (int arm=0; arm<TELEOP_JITTER_ARMS; arm++)
+        {
+            u.delx[arm] += jitter_out.delx[arm];
+            u.dely[arm] += jitter_out.dely[arm];
+            u.delz[arm] += jitter_out.delz[arm];
+            u.grasp[arm] += jitter_out.grasp[arm];
+        }
+    }
+    jitter_out = u;
+    jitter_out_rx = rx;
+    jitter_out_pending = true;
+}
+
+bool teleopJitterTake(struct u_struct& u, struct timespec& rx)
+{
+    if (!jitter_out_pending)
+        return false;
+    u = jitter_out;
+    rx = jitter_out_rx;
+    jitter_out_pending = false;
+    return true;
+}
+
+static void setMasterInfo(const MasterInfo& info)
+{
+    master_info_version++;
+    __sync_synchronize();
+    master_info = info;
+    __sync_synchronize();
+    master_info_version++;
+}
+
+static void getMasterInfo(MasterInfo& info)
+{
+    unsigned int version;
+    do
+    {
+        version = master_info_version;
+        __sync_synchronize();
+        info = master_info;
+        __sync_synchronize();
+    } while ((version & 1) || version != master_info_version);
+}
+
+// Called from the rt thread every servo cycle; samples the state at --feedback-rate.
+// A phase accumulator spreads the samples evenly for rates that don't divide 1000.
+void networkQueueFeedback(const struct robot_device* device0)
+{
+    static int phase = 0;
+    int rate = RavenConfig.feedback_rate;
+    if (rate <= 0)
+        return;
+    if (rate > 1000)
+        rate = 1000;
+    phase += rate;
+    if (phase < 1000)
+        return;
+    phase -= 1000;
+
+    FeedbackRecord r;
+    clock_gettime(CLOCK_REALTIME, &r.stamp);
+    r.runlevel = device0->runlevel;
+    r.sublevel = device0->sublevel;
+    r.numArms = NUM_MECH < TELEOP_MAX_ARMS ? NUM_MECH : TELEOP_MAX_ARMS;
+
+    // spring force on the position error; pos is in microns
+    float k = RavenConfig.feedback_stiffness * 1e-6f;
+    for (int i=0; i<r.numArms; i++)
+    {
+        const struct mechanism& mech = device0->mech[i];
+        TeleopFeedbackArm& arm = r.arms[i];
+        arm.id = armIdFromMechType(mech.type);
+        arm.surgeonEngaged = device0->surgeon_mode;
+        arm.jointFlags = 0;
+        for (int j=0; j<MAX_DOF_PER_MECH; j++)
+        {
+            if (mech.joint[j].state == jstate_hard_stop)
+                arm.jointFlags |= 1 << j;
+        }
+        arm.force[0] = k * (mech.pos_d.x - mech.pos.x);
+        arm.force[1] = k * (mech.pos_d.y - mech.pos.y);
+        arm.force[2] = k * (mech.pos_d.z - mech.pos.z);
+    }
+
+    if (!net_feedback.push(r))
+        __sync_fetch_and_add(&feedback_dropped, 1);
+}
+
+// Sends queued feedback to the last master address every --feedback-batch-usec,
+// all queued packets in one sendmmsg.  v2 masters get TeleopFeedbackPacket, legacy
+// masters get a v_struct.
+static void* network_feedback_process(void* param)
+{
+    uint8_t txbuf[NET_TX_BATCH][NET_TX_BUFFER_SIZE];
+    struct mmsghdr msgs[NET_TX_BATCH];
+    struct iovec iovecs[NET_TX_BATCH];
+    struct sockaddr_in dest;
+    unsigned int sequence = 0;
+    FeedbackRecord r;
+    MasterInfo master;
+    struct timespec next, now;
+
+    memset(msgs, 0, sizeof(msgs));
+    for (int i=0; i<NET_TX_BATCH; i++)
+    {
+        iovecs[i].iov_base = txbuf[i];
+        msgs[i].msg_hdr.msg_iov = &iovecs[i];
+        msgs[i].msg_hdr.msg_iovlen = 1;
+        msgs[i].msg_hdr.msg_name = &dest;
+        msgs[i].msg_hdr.msg_namelen = sizeof(dest);
+    }
+
+    int64_t period = RavenConfig.feedback_batch_usec * (int64_t)1000;
+    if (period < 100000)
+        period = 100000;
+
+    clock_gettime(CLOCK_MONOTONIC, &next);
+    while ( ros::ok() )
+    {
+        next.tv_nsec += period;
+        while (next.tv_nsec >= 1000000000)
+        {
+            next.tv_nsec -= 1000000000;
+            next.tv_sec++;
+        }
+        clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL);
+
+        getMasterInfo(master);
+        clock_gettime(CLOCK_REALTIME, &now);
+        int64_t hold = timespecToNSec(now) - timespecToNSec(master.rx);
+
+        int n = 0;
+        while (n < NET_TX_BATCH && net_feedback.pop(r))
+        {
+            if (!master.valid)
+                continue; // nobody to send to yet
+            sequence++;
+
+            if (master.v2)
+            {
+                TeleopFeedbackPacket fb;
+                fb.sequence = sequence;
+                fb.runlevel = r.runlevel;
+                fb.sublevel = r.sublevel;
+                fb.masterSequence = master.sequence;
+                fb.masterTime = master.senderTime;
+                fb.holdTime = hold < 0 ? 0 : (hold > 0xFFFFFFFFll ? 0xFFFFFFFFu : (uint32_t)hold);
+                fb.slaveTime = timespecToNSec(r.stamp);
+                fb.numArms = r.numArms;
+                memcpy(fb.arms, r.arms, sizeof(fb.arms));
+                iovecs[n].iov_len = teleopEncodeFeedback(fb, txbuf[n], NET_TX_BUFFER_SIZE);
+            }
+            else
+            {
+                struct v_struct v;
+                memset(&v, 0, sizeof(v));
+                v.sequence = sequence;
+                v.runlevel = r.runlevel;
+                if (r.numArms > 0)
+                {
+                    v.fx = (int)(1000 * r.arms[0].force[0]);  // mN
+                    v.fy = (int)(1000 * r.arms[0].force[1]);
+                    v.fz = (int)(1000 * r.arms[0].force[2]);
+                }
+                for (int i=0; i<r.numArms && i<2; i++)
+                {
+                    v.jointflags |= (r.arms[i].jointFlags & 0xFF) << (8*i);
+                }
+                memcpy(txbuf[n], &v, sizeof(v));
+                iovecs[n].iov_len = sizeof(v);
+            }
+            if (iovecs[n].iov_len > 0)
+                n++;
+        }
+        if (n == 0)
+            continue;
+
+        dest = master.addr;
+        if (RavenConfig.feedback_port > 0)
+            dest.sin_port = htons((u_short)RavenConfig.feedback_port);
+
+        int sent = sendmmsg(net_sock, msgs, n, MSG_DONTWAIT);
+        if (sent < 0)
+            sent = 0;
+        __sync_fetch_and_add(&feedback_sent, sent);
+        __sync_fetch_and_add(&feedback_dropped, n - sent);
+    }
+    return NULL;
+}
+
+static void initNetworkMetrics()
+{
+    const char* help = "Teleop packets received, by how they were handled";
+    for (int r=0; r<TELEOP_SEQ_NUM_RESULTS; r++)
+    {
+        teleop_packet_metrics[r] = new MetricCounter("r2_teleop_packets_total", help,
+                                                     std::string("result=\"") + teleopSequenceResultString(r) + "\"");
+    }
+    teleop_packet_metrics[TELEOP_METRIC_REJECTED] = new MetricCounter("r2_teleop_packets_total", help, "result=\"rejected\"");
+}
+
 // main //
-volatile struct v_struct v;
 
 void* network_process(void* param1)
 {
     int sock;              // sockets.
-    int nfound, maxfd;
     const char *port = SERVER_PORT;
-    fd_set rmask, mask;
-    static struct timeval timeout = { 0, 500000 }; // .5 sec //
+
+    uint8_t rxbuf[NET_RX_BATCH][NET_RX_BUFFER_SIZE];
     struct u_struct u;
+    struct u_struct u_v2;  // keeps the last orientation of arms missing from v2 packets
+    TeleopPacket packet;
+    bool is_v2;
+    unsigned int sequence;
+    struct mmsghdr msgs[NET_RX_BATCH];
+    struct iovec iovecs[NET_RX_BATCH];
+    struct sockaddr_in addrs[NET_RX_BATCH];
+    char control[NET_RX_BATCH][CMSG_SPACE(sizeof(struct timespec))];
+    MasterInfo master;
+    struct timespec rx_stamp;
 
     int uSize=sizeof(struct u_struct);
 
-    struct sockaddr_in clientName;
-    int clientLength=sizeof(clientName);
-    int retval;
     static int k = 0;
-    int logFile;
-    struct timeval tv;
-    struct timezone tz;
-    char logbuffer[100];
+    static int logFile;
     unsigned int seq = 0;
-    volatile int bytesread;
+    unsigned int arm_seqs[TELEOP_MAX_ARMS] = { 0 };
+    int nrcvd;
+    pthread_t log_thread;
+    pthread_t feedback_thread;
+
+    initNetworkMetrics();
 
     // print some status messages
     ROS_INFO("Starting network services...");
@@ -150,9 +743,6 @@ void* network_process(void* param1)
         ROS_ERROR("ERROR: could not open log file.\n");
         exit(1);
     }
-    gettimeofday(&tv,&tz);
-    sprintf(logbuffer, "\n\nOpened log file at %s\n", ctime(&(tv.tv_sec)) );
-    retval = write(logFile,logbuffer, strlen(logbuffer));
 
     /////  open socket
     sock = initSock(port);
@@ -162,62 +752,134 @@ void* network_process(void* param1)
         exit(1);
     }
 
-    ///// setup sendto address
-    memset(&clientName, 0, sizeof(clientName));
-    clientName.sin_family = AF_INET;
-    inet_aton(SERVER_ADDR, &clientName.sin_addr);
-    clientName.sin_port = htons((u_short)atoi(port));
+    ///// socket options
+    int on = 1;
+    if (setsockopt(sock, SOL_SOCKET, SO_TIMESTAMPNS, &on, sizeof(on)) < 0)
+    {
+        ROS_WARN("SO_TIMESTAMPNS unavailable, using user space receive times (%s)", strerror(errno));
+    }
+    if (RavenConfig.net_busy_poll_usec > 0)
+    {
+#ifdef SO_BUSY_POLL
+        int busy_poll = RavenConfig.net_busy_poll_usec;
+        if (setsockopt(sock, SOL_SOCKET, SO_BUSY_POLL, &busy_poll, sizeof(busy_poll)) < 0)
+        {
+            ROS_WARN("SO_BUSY_POLL %d us failed (%s)", busy_poll, strerror(errno));
+        }
+        else
+        {
+            ROS_INFO("  Busy polling socket for %d us", busy_poll);
+        }
+#else
+        ROS_WARN("SO_BUSY_POLL not supported on this system");
+#endif
+    }
+    struct pollfd pfd;
+    pfd.fd = sock;
+    pfd.events = POLLIN;
+
+    ///// setup receive batch
+    memset(msgs, 0, sizeof(msgs));
+    for (int i=0; i<NET_RX_BATCH; i++)
+    {
+        iovecs[i].iov_base = rxbuf[i];
+        iovecs[i].iov_len = NET_RX_BUFFER_SIZE;
+        msgs[i].msg_hdr.msg_iov = &iovecs[i];
+        msgs[i].msg_hdr.msg_iovlen = 1;
+        msgs[i].msg_hdr.msg_control = control[i];
+        msgs[i].msg_hdr.msg_name = &addrs[i];
+    }
+    memset(&master, 0, sizeof(master));
 
-    clientLength=sizeof(clientName);
+    memset(&u_v2, 0, sizeof(u_v2));
+    for (int i=0; i<2; i++)
+    {
+        u_v2.Qw[i] = 1;
+    }
 
-    ///// initialize data polling
-    FD_ZERO(&mask);
-    FD_SET(sock, &mask);
-    maxfd=sock;
+    use_teleop_jitter = !RavenConfig.disable_teleop_jitter_buffer;
+    teleop_jitter.setMaxDelay(RavenConfig.teleop_jitter_max_usec * (int64_t)1000);
+    ROS_INFO("  Jitter buffer for v2 packets %s (max delay %d us)",
+             use_teleop_jitter ? "on" : "off", RavenConfig.teleop_jitter_max_usec);
+
+    pthread_create(&log_thread, NULL, network_log_process, &logFile);
+
+    net_sock = sock;
+    if (RavenConfig.feedback_rate > 0)
+    {
+        ROS_INFO("  Sending feedback to the master at %d Hz", RavenConfig.feedback_rate);
+        pthread_create(&feedback_thread, NULL, network_feedback_process, NULL);
+    }
 
     ROS_INFO("Network layer ready.");
 
     ///// Main read/write loop
     while ( ros::ok() )
     {
-        rmask = mask;
-        timeout.tv_sec = 2;  // hack:reset timer after timeout event.
-        timeout.tv_usec = 0; //        ""
+        for (int i=0; i<NET_RX_BATCH; i++)
+        {
+            msgs[i].msg_hdr.msg_controllen = sizeof(control[i]);
+            msgs[i].msg_hdr.msg_namelen = sizeof(addrs[i]);
+        }
 
-        // wait for i/o lines to change state //
-        nfound = select(maxfd+1, &rmask, (fd_set *)0, (fd_set *)0, &timeout);
+        // Take whatever is queued without waiting; only sleep in poll() once the queue is empty
+        nrcvd = recvmmsg(sock, msgs, NET_RX_BATCH, MSG_DONTWAIT, NULL);
 
-        // Select error
-        if (nfound < 0)
+        if (nrcvd < 0)
         {
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+            {
+                // wake up periodically to check ros::ok()
+                if (poll(&pfd, 1, NET_RX_POLL_MSEC) < 0 && errno != EINTR)
+                {
+                    perror("poll");
+                    break;
+                }
+                continue;
+            }
             if (errno == EINTR)
             {
-                printf("interrupted system call\n");
                 continue;
             }
-            perror("select");
+            perror("recvmmsg");
             break;
         }
 
-        // Select timeout: nothing to do
-        if (nfound == 0)
+        for (int i=0; i<nrcvd; i++)
         {
-            fflush(stdout);
-            continue;
-        }
+            getRxStamp(&msgs[i].msg_hdr, &rx_stamp);
+            __sync_fetch_and_add(&net_counts.packets, 1);
 
-        // Select: data on socket
-        if (FD_ISSET( sock, &rmask))
-        {
-            bytesread = recvfrom(sock,
-                                 &u,
-                                 uSize,
-                                 0,
-                                 NULL,
-                                 NULL);
-            if (bytesread != uSize){
-                ROS_ERROR("ERROR: Rec'd wrong ustruct size on socket!\n");
-                FD_CLR(sock, &rmask);
+            is_v2 = teleopIsV2Packet(rxbuf[i], msgs[i].msg_len);
+            if (msgs[i].msg_hdr.msg_flags & MSG_TRUNC)
+            {
+                pushNetworkEvent(NET_EVENT_WRONG_SIZE, seq, msgs[i].msg_len, rx_stamp);
+                __sync_fetch_and_add(&net_counts.rejected, 1);
+                teleop_packet_metrics[TELEOP_METRIC_REJECTED]->inc();
+                continue;
+            }
+            else if (is_v2)
+            {
+                int result = teleopDecode(rxbuf[i], msgs[i].msg_len, packet);
+                if (result != TELEOP_DECODE_OK)
+                {
+                    pushNetworkEvent(NET_EVENT_BAD_PACKET, seq, result, rx_stamp);
+                    __sync_fetch_and_add(&net_counts.rejected, 1);
+                    teleop_packet_metrics[TELEOP_METRIC_REJECTED]->inc();
+                    continue;
+                }
+                sequence = packet.sequence;
+            }
+            else if ((int)msgs[i].msg_len == uSize)
+            {
+                memcpy(&u, rxbuf[i], uSize);
+                sequence = u.sequence;
+            }
+            else
+            {
+                pushNetworkEvent(NET_EVENT_WRONG_SIZE, seq, msgs[i].msg_len, rx_stamp);
+                __sync_fetch_and_add(&net_counts.rejected, 1);
+                teleop_packet_metrics[TELEOP_METRIC_REJECTED]->inc();
                 continue;
             }
 
@@ -228,73 +890,78 @@ void* network_process(void* param1)
                 log_msg("rec'd socket data x10000");
             }
 
-//
-//            if (u.checksum != UDPChecksum(&u))   // Check checksum
-//            {
-//                gettimeofday(&tv,&tz);
-//                sprintf(logbuffer, "%s Bad Checksum -> rejected packet\n", ctime(&(tv.tv_sec)) );
-//                ROS_ERROR("%s Bad Checksum -> rejected packet\n", ctime(&(tv.tv_sec)) );
-//                retval = write(logFile,logbuffer, strlen(logbuffer));
-//
-//            }
-//            else
-            if (u.sequence == 0)        // Zero seqnum means reflect packet to sender
-            {
-                gettimeofday(&tv,&tz);
-                sprintf(logbuffer, "%s Zero sequence -> reflect packet\n", ctime(&(tv.tv_sec)) );
-                ROS_INFO("%s Zero sequence -> reflect packet\n", ctime(&(tv.tv_sec)) );
-
-                retval = write(logFile,logbuffer, strlen(logbuffer));
+            unsigned int last_seq = seq;
+            int seq_result = teleopCheckSequence(seq, sequence);
+            __sync_fetch_and_add(&net_counts.sequence[seq_result], 1);
+            teleop_packet_metrics[seq_result]->inc();
+            net_counts.seq = seq;
 
-            }
-            else if (u.sequence > seq+1)    // Skipping sequence number (dropped)
+            switch (seq_result)
             {
-                gettimeofday(&tv,&tz);
-                sprintf(logbuffer, "%s Skipped (dropped?) packets %d - %d\n", ctime(&(tv.tv_sec)),seq+1, u.sequence-1 );
-                ROS_WARN("%s Skipped (dropped?) packets %d - %d\n", ctime(&(tv.tv_sec)),seq+1, u.sequence-1 );
-                retval = write(logFile,logbuffer, strlen(logbuffer));
-                seq = u.sequence;
+            case TELEOP_SEQ_REFLECT:        // Zero seqnum means reflect packet to sender
+                pushNetworkEvent(NET_EVENT_REFLECT, last_seq, sequence, rx_stamp);
+                break;
+            case TELEOP_SEQ_SKIPPED:        // Skipping sequence number (dropped)
+                pushNetworkEvent(NET_EVENT_SKIPPED, last_seq, sequence, rx_stamp);
+                break;
+            case TELEOP_SEQ_DUPLICATE:      // Repeated sequence number
+                pushNetworkEvent(NET_EVENT_DUPLICATE, last_seq, sequence, rx_stamp);
+                break;
+            case TELEOP_SEQ_RESET:          // reset sequence(skipped more than 1000 packets)
+                pushNetworkEvent(NET_EVENT_RESET, last_seq, sequence, rx_stamp);
+                break;
+            case TELEOP_SEQ_OUT_OF_ORDER:
+                pushNetworkEvent(NET_EVENT_OUT_OF_SEQUENCE, last_seq, sequence, rx_stamp);
+                break;
+            case TELEOP_SEQ_APPLIED:        // Valid packet
+                break;
+            }
 
+            // v2 arms are applied by their own sequence numbers; the packet's only decides reflection
+            bool apply = seq_result == TELEOP_SEQ_APPLIED;
+            if (is_v2 && seq_result != TELEOP_SEQ_REFLECT)
+            {
+                apply = teleopCheckArmSequences(arm_seqs, packet) > 0;
             }
-            else if (u.sequence == seq)     // Repeated sequence number
+            if (!apply)
             {
-                gettimeofday(&tv,&tz);
-                sprintf(logbuffer, "%s Duplicated packet %d - %d\n", ctime(&(tv.tv_sec)),seq, u.sequence );
-                ROS_ERROR("%s Duplicated packet %d - %d\n", ctime(&(tv.tv_sec)),seq, u.sequence );
-                retval = write(logFile,logbuffer, strlen(logbuffer));
-
+                continue;
             }
 
-            else if (u.sequence > seq)       // Valid packet
+            master.addr = addrs[i];
+            master.sequence = sequence;
+            master.senderTime = is_v2 ? packet.senderTime : 0;
+            master.rx = rx_stamp;
+            master.v2 = is_v2;
+            master.valid = true;
+            setMasterInfo(master);
+
+            if (!is_v2)
+            {
+                recieveUserspace(&u,uSize,&rx_stamp);
+                continue;
+            }
+            int ignored = teleopPacketToUStruct(packet, u_v2);
+            if (ignored)
             {
-                seq = u.sequence;
-                recieveUserspace(&u,uSize);
+                pushNetworkEvent(NET_EVENT_IGNORED_ARMS, seq, ignored, rx_stamp);
             }
-
-            else if (seq > 1000 && u.sequence < seq-1000)       // reset sequence(skipped more than 1000 packets)
+            if (!use_teleop_jitter)
             {
-                gettimeofday(&tv,&tz);
-                sprintf(logbuffer, "%s Sequence numbering reset from %d to %d\n", ctime(&(tv.tv_sec)),seq, u.sequence );
-                ROS_INFO("%s Sequence numbering reset from %d to %d\n", ctime(&(tv.tv_sec)),seq, u.sequence );
-                seq = u.sequence;
-                retval = write(logFile,logbuffer, strlen(logbuffer));
+                recieveUserspace(&u_v2,uSize,&rx_stamp);
             }
-            else
+            else if (checkMasterMode("network"))
             {
-                gettimeofday(&tv,&tz);
-                sprintf(logbuffer, "%s Out of sequence packet %d\n", ctime(&(tv.tv_sec)),seq );
-                ROS_ERROR("%s Out of sequence packet %d\n", ctime(&(tv.tv_sec)),seq );
-                retval = write(logFile,logbuffer, strlen(logbuffer));
+                // teleopIntoDS1 does this check for the other paths; the rt thread plays the buffer out without it
+                teleop_jitter.push(u_v2, packet.senderTime, rx_stamp);
             }
         }
 
-#ifdef NET_SEND
-        sendto ( sock, (void*)&v, vSize, 0,
-                 (struct sockaddr *) &clientName, clientLength);
-#endif
-
     } // while(1)
 
+    if (RavenConfig.feedback_rate > 0)
+        pthread_join(feedback_thread, NULL);
+    pthread_join(log_thread, NULL);
     close(sock);
 
     ROS_INFO("Network socket is shutdown.");
@@ -12,12 +12,17 @@
 #include "defines.h"
 
 #include <raven/state/runlevel.h>
+#include <raven/util/metrics.h>
 
 extern struct DOF_type DOF_types[];
 extern int NUM_MECH;
 extern int soft_estopped;
 extern unsigned long int gTime;
 
+static MetricCounter dac_overcurrent("r2_dac_overcurrent_total","Joint current commands over MAX_INST_DAC, zeroed");
+static MetricCounter dac_clipped_high("r2_dac_clipped_total","Joint current commands clipped to the joint's DAC_max","limit=\"high\"");
+static MetricCounter dac_clipped_low("r2_dac_clipped_total","Joint current commands clipped to the joint's DAC_max","limit=\"low\"");
+
 /*
  * overdriveDetect - Functions to loop through all active joints to detect
  *   current situations that could cause overheating.
@@ -42,6 +47,7 @@ int overdriveDetect(struct device *device0,u_08 runlevel)
     	{
     		log_msg("Joint %s instant current command too high. DAC:%d \t tau:%0.3f \t jpos:%0.3f jpos_d:%0.3f\n", jointIndexAndArmName(_joint->type).c_str(), _joint->current_cmd, _joint->tau_d,_joint->jpos,_joint->jpos_d);
     		_joint->current_cmd = 0;
+    		dac_overcurrent.inc();
     		ret = TRUE;
     	}
 
@@ -51,6 +57,7 @@ int overdriveDetect(struct device *device0,u_08 runlevel)
     		if (gTime %100 == 0 || abs(_joint->current_cmd) > MAX_INST_DAC)
     			log_warn("Joint %s is current clipped high (%d) at DAC:%d\n", jointIndexAndArmName(_joint->type).c_str(), _dac_max, _joint->current_cmd);
     		_joint->current_cmd = _dac_max;
+    		dac_clipped_high.inc();
     	}
 
     	else if ( _joint->current_cmd < _dac_max*-1 )
@@ -59,6 +66,7 @@ int overdriveDetect(struct device *device0,u_08 runlevel)
     		if (gTime %100 == 0 || abs(_joint->current_cmd) > MAX_INST_DAC)
     			log_warn("Joint %s is current clipped low (%d) at DAC:%d\n", jointIndexAndArmName(_joint->type).c_str(), _dac_max*-1,  _joint->current_cmd);
     		_joint->current_cmd = _dac_max*-1;
+    		dac_clipped_low.inc();
     	}
     }
 
@@ -21,6 +21,8 @@
 #include "homing.h"
 
 #include <raven/state/runlevel.h>
+#include <raven/control/pid_kernel.h>
+#include <raven/util/config.h>
 
 #include <iostream>
 #include <fstream>
@@ -28,6 +30,7 @@ using namespace std;
 
 extern struct DOF_type DOF_types[];
 extern unsigned long int gTime;
+extern bool disable_arm_id[2];
 
 static float friction_comp_torque[16] = { 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0 ,
                                             0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0  };
@@ -303,6 +306,90 @@ void mpos_PD_control(struct DOF *joint, int reset_I)
 
 }
 
+/**
+*    mpos_PD_control_all()
+*       Same control law as mpos_PD_control, computed for every joint at once
+*       with the PID kernel. Only joints of enabled arms are controlled, and
+*       only while the pedal is down. If RavenConfig.verify_pid_kernel is set,
+*       the torques already computed by mpos_PD_control are kept and compared
+*       against the kernel output instead of being overwritten.
+*/
+void mpos_PD_control_all(struct device *device0, int reset_I)
+{
+	static PIDKernelGains gains;
+	static PIDKernelState state;
+	static PIDKernelIO io;
+
+	struct DOF *_joint = NULL;
+	struct mechanism* _mech = NULL;
+	int i=0,j=0;
+
+	bool pedalDown = RunLevel::get().isPedalDown();
+
+	for (int k=0;k<PID_KERNEL_SIZE;k++) {
+		io.active[k] = 0;
+	}
+	while (loop_over_joints(device0, _mech, _joint, i,j) ) {
+		int lane = _joint->type;
+		struct DOF_type& type = DOF_types[lane];
+
+		gains.kp[lane] = type.KP;
+		gains.ki[lane] = type.KI;
+		gains.kd[lane] = type.KD;
+		gains.maxVelocityDesired[lane] = type.speed_limit;
+		switch (jointTypeFromCombinedType(lane)) {
+			case GRASP1:
+			case GRASP2:
+				gains.maxPositionError[lane] = type.TR * 40 DEG2RAD;
+				break;
+			case Z_INS:
+				gains.maxPositionError[lane] = 40;
+				break;
+			case ELBOW:
+			case SHOULDER:
+				gains.maxPositionError[lane] = type.TR * 10 DEG2RAD;
+				break;
+		}
+
+		// same arms as the scalar path controls
+		bool active = pedalDown && !disable_arm_id[armIdFromMechType(_mech->type)];
+		io.active[lane] = active ? 1 : 0;
+		io.position[lane] = _joint->mpos;
+		io.velocity[lane] = _joint->mvel;
+		io.positionDesired[lane] = _joint->mpos_d;
+		io.velocityDesired[lane] = _joint->mvel_d;
+	}
+
+	unsigned int capped = pidKernelApply(gains,state,io,ONE_MS,reset_I);
+
+	_mech = NULL;  _joint = NULL;
+	while (loop_over_joints(device0, _mech, _joint, i,j) ) {
+		int lane = _joint->type;
+		if (!io.active[lane]) {
+			continue;
+		}
+		if (capped & (1u << lane)) {
+			err_msg("Capping joint %s pos error %1.4f at %f\n",jointIndexAndArmName(lane).c_str(),_joint->mpos_d - _joint->mpos,io.positionError[lane]);
+		}
+
+		if (RavenConfig.verify_pid_kernel) {
+			float diff = fabs(io.torque[lane] - _joint->tau_d);
+			if (diff > 1e-5 * (1 + fabs(_joint->tau_d))) {
+				log_warn_throttle(1,"PID kernel mismatch on %s: kernel %f legacy %f",jointIndexAndArmName(lane).c_str(),io.torque[lane],_joint->tau_d);
+			}
+			continue;
+		}
+
+		_joint->tau_d = io.torque[lane];
+		short int DACVal = tToDACVal(_joint);
+		if (abs(DACVal) > MAX_INST_DAC) {
+			log_err("****** DAC error on %s DACVal %i over %i with tau %f (err %f errV %f errInt %f) ******",
+					jointIndexAndArmName(lane).c_str(),DACVal,MAX_INST_DAC,io.torque[lane],
+					io.positionError[lane],io.velocityError[lane],state.errorIntegral[lane]);
+		}
+	}
+}
+
 /**
 *    jointVelControl()
 *       Move joints at constant rate.
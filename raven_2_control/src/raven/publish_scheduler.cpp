@@ -0,0 +1,213 @@
+/*
+ * publish_scheduler.cpp
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: agent
+ */
+
+#include "publish_scheduler.h"
+
+#include <sched.h>
+#include <sys/resource.h>
+#include <boost/thread/thread.hpp>
+#include <boost/thread/mutex.hpp>
+
+#include <raven/state/runlevel.h>
+
+#include "log.h"
+#include "shared_modes.h"
+
+extern btVector3 master_raw_position[2];
+extern btVector3 master_position[2];
+extern btMatrix3x3 master_raw_orientation[2];
+extern btMatrix3x3 master_orientation[2];
+
+// nice value of the publisher threads
+#define PUBLISH_THREAD_NICE 10
+// seconds between drop reports per topic
+#define PUBLISH_STATS_PERIOD 10.
+
+LatestBuffer<PublishSnapshot> PublishScheduler::LATEST;
+NetworkRing<PublishSnapshot,PUBLISH_SAMPLE_RING_SIZE> PublishScheduler::SAMPLES;
+std::vector<PublishScheduler::Topic*> PublishScheduler::TOPICS;
+volatile bool PublishScheduler::RUNNING = false;
+
+static boost::mutex frame_mutex; // publisher threads only; the rt thread never takes it
+static MessagePool<PublishFrame> frame_pool;
+static boost::shared_ptr<PublishFrame> frame;
+static boost::thread_group publish_threads;
+static volatile unsigned int publish_allocations = 0;
+
+unsigned int
+publishAllocations() {
+	return publish_allocations;
+}
+
+void
+publishAllocated() {
+	__sync_fetch_and_add(&publish_allocations, 1);
+}
+
+void
+PublishScheduler::capture(struct robot_device* device0) {
+	PublishSnapshot& s = LATEST.back();
+	s.device = *device0;
+	s.seq = LoopNumber::getMain();
+	s.stamp = LoopNumber::getMainTime();
+	RunLevel rl = RunLevel::get();
+	rl.getNumbers<u_08>(s.runlevel,s.sublevel);
+	s.pedal_down = RunLevel::getPedal();
+	s.runlevel_pedal = rl.isPedalDown();
+	s.estop = rl.isEstop();
+	s.controlMode = getControlMode();
+	for (int i=0;i<2;i++) {
+		s.master_position[i] = master_position[i];
+		s.master_orientation[i] = master_orientation[i];
+		s.master_raw_position[i] = master_raw_position[i];
+		s.master_raw_orientation[i] = master_raw_orientation[i];
+	}
+	SAMPLES.push(s);
+	LATEST.publish();
+}
+
+PublishFrameConstPtr
+PublishScheduler::latestFrame() {
+	boost::mutex::scoped_lock _lock(frame_mutex);
+	if (LATEST.acquire()) {
+		// frames still held by a publisher are left alone
+		boost::shared_ptr<PublishFrame> next = frame_pool.get();
+		next->snapshot = LATEST.front();
+		buildPublishFrame(*next);
+		frame = next;
+	}
+	return frame;
+}
+
+bool
+PublishScheduler::popSample(PublishSnapshot& sample) {
+	return SAMPLES.pop(sample);
+}
+
+void
+PublishScheduler::addTopic(const std::string& name, double rate, FrameFunction publish) {
+	if (rate <= 0) {
+		ROS_INFO("  Not publishing %s",name.c_str());
+		return;
+	}
+	Topic* topic = new Topic();
+	topic->name = name;
+	topic->rate = rate;
+	topic->publishFrame = publish;
+	topic->published = 0;
+	topic->dropped = 0;
+	TOPICS.push_back(topic);
+}
+
+void
+PublishScheduler::addSampleTopic(const std::string& name, double rate, SampleFunction publish) {
+	if (rate <= 0) {
+		ROS_INFO("  Not publishing %s",name.c_str());
+		return;
+	}
+	Topic* topic = new Topic();
+	topic->name = name;
+	topic->rate = rate;
+	topic->publishSamples = publish;
+	topic->published = 0;
+	topic->dropped = 0;
+	TOPICS.push_back(topic);
+}
+
+void
+PublishScheduler::start() {
+	RUNNING = true;
+	for (size_t i=0;i<TOPICS.size();i++) {
+		ROS_INFO("  Publishing %s at %g Hz",TOPICS[i]->name.c_str(),TOPICS[i]->rate);
+		publish_threads.create_thread(boost::bind(&PublishScheduler::run,TOPICS[i]));
+	}
+}
+
+void
+PublishScheduler::stop() {
+	RUNNING = false;
+	publish_threads.join_all();
+}
+
+void
+PublishScheduler::run(Topic* topic) {
+	// threads inherit the policy of whoever started them; these must never compete with the rt loop
+	struct sched_param param;
+	param.sched_priority = 0;
+	if (sched_setscheduler(0, SCHED_OTHER, &param) == -1) {
+		log_err("sched_setscheduler failed for publisher %s",topic->name.c_str());
+	}
+	setpriority(PRIO_PROCESS, 0, PUBLISH_THREAD_NICE);
+
+	int64_t period = (int64_t)(1e9 / topic->rate);
+	unsigned int last_dropped = 0;
+	unsigned int last_samples_dropped = 0;
+	unsigned int last_allocations = 0;
+	bool report_allocations = topic == TOPICS[0];
+	bool filling = true; // pools are allowed to grow until the first report
+	ros::WallTime last_stats = ros::WallTime::now();
+
+	struct timespec next, now;
+	clock_gettime(CLOCK_MONOTONIC, &next);
+	while (RUNNING && ros::ok()) {
+		next.tv_nsec += period;
+		while (next.tv_nsec >= 1000000000) {
+			next.tv_nsec -= 1000000000;
+			next.tv_sec++;
+		}
+		clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL);
+
+		// skip the slots we slept through instead of publishing them back to back
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		int64_t late = (now.tv_sec - next.tv_sec) * (int64_t)1000000000 + (now.tv_nsec - next.tv_nsec);
+		if (late >= period) {
+			int64_t missed = late / period;
+			topic->dropped += missed;
+			next.tv_sec += (missed * period) / 1000000000;
+			next.tv_nsec += (missed * period) % 1000000000;
+			while (next.tv_nsec >= 1000000000) {
+				next.tv_nsec -= 1000000000;
+				next.tv_sec++;
+			}
+		}
+
+		if (topic->publishSamples) {
+			topic->publishSamples();
+			topic->published++;
+		} else {
+			PublishFrameConstPtr f = latestFrame();
+			if (f) {
+				topic->publishFrame(*f);
+				topic->published++;
+			}
+		}
+
+		ros::WallTime wall_now = ros::WallTime::now();
+		if ((wall_now - last_stats).toSec() >= PUBLISH_STATS_PERIOD) {
+			last_stats = wall_now;
+			unsigned int dropped = topic->dropped;
+			unsigned int samples_dropped = topic->publishSamples ? samplesDropped() : 0;
+			if (dropped != last_dropped || samples_dropped != last_samples_dropped) {
+				ROS_WARN("Publisher %s: %u published, %u dropped (%u new), %u samples dropped (%u new)",
+						topic->name.c_str(),topic->published,dropped,dropped-last_dropped,
+						samples_dropped,samples_dropped-last_samples_dropped);
+			}
+			last_dropped = dropped;
+			last_samples_dropped = samples_dropped;
+
+			if (report_allocations) {
+				unsigned int allocations = publishAllocations();
+				if (!filling && allocations != last_allocations) {
+					ROS_WARN("Publishers allocated %u message buffers in the last %g s (%u total)",
+							allocations-last_allocations,PUBLISH_STATS_PERIOD,allocations);
+				}
+				last_allocations = allocations;
+				filling = false;
+			}
+		}
+	}
+}
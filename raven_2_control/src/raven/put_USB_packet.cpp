@@ -10,6 +10,8 @@
 #include "put_USB_packet.h"
 #include "USB_init.h"
 #include "update_atmel_io.h"
+#include "status_service.h"
+#include "latency.h"
 
 extern bool disable_arm_id[2];
 extern unsigned long int gTime;
@@ -27,7 +29,14 @@ void putUSBPackets(struct device *device0)
     for (int i = 0; i < USBBoards.activeAtStart; i++)
     {
         if (putUSBPacket(USBBoards.boards[i], &(device0->mech[i])) == -USB_WRITE_ERROR)
+        {
+            statusCountFault(STATUS_FAULT_USB_WRITE);
             log_msg("Error writing to USB Board %d (%s)!\n", USBBoards.boards[i],armNameFromSerial(USBBoards.boards[i]).c_str());
+        }
+        else
+        {
+            latencyRecordDacWrite(device0, &(device0->mech[i]));
+        }
     }
 }
 
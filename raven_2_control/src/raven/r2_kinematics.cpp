@@ -39,6 +39,7 @@
 #include "defines.h"
 #include "kinematics/kinematics_defines.h"
 #include "utils.h"
+#include <raven/util/metrics.h>
 
 extern int NUM_MECH;
 
@@ -50,6 +51,7 @@ using namespace std;
 
 extern unsigned long int gTime;
 
+static MetricCounter ik_failures("r2_ik_failures_total","Inverse kinematics calls with no valid solution","solver=\"r2_inv_kin\"");
 
 // Robot constants
 const double La12 = 75 * M_PI/180;
@@ -380,8 +382,10 @@ int r2_inv_kin(struct device *d0, int runlevel)
 		//		DO IK
 		ik_solution iksol[8] = {{},{},{},{},{},{},{},{}};
 		int ret = inv_kin(xf, arm, iksol);
-		if (ret < 0)
+		if (ret < 0) {
+			ik_failures.inc();
 			cout << "failed gracefully (arm:"<< arm <<" ret:" << ret<< ") j=\t\t(" << thetas[0] << ",\t" << thetas[1] << ",\t" << thetas[2] << ",\t" << thetas[3] << ",\t" << thetas[4] << ",\t" << thetas[5] << ")"<<endl;
+		}
 
 		// Check solutions - compare IK solutions to current joint angles...
 		double wrist2 = (d0->mech[m].joint[GRASP2].jpos - d0->mech[m].joint[GRASP1].jpos) / 2.0; // grep "
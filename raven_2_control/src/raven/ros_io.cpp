@@ -14,10 +14,13 @@
 #include <tf/transform_datatypes.h>
 #include <iostream>
 #include <map>
+#include <algorithm>
+#include <boost/thread/mutex.hpp>
 
 #include <raven/state/runlevel.h>
 #include <raven/state/device.h>
 #include <raven/control/control_input.h>
+#include <raven/kinematics/batch_kinematics.h>
 
 #include "log.h"
 #include "utils.h"
@@ -26,6 +29,9 @@
 #include "itp_teleoperation.h"
 #include "shared_modes.h"
 #include "trajectory.h"
+#include "publish_scheduler.h"
+#include "state_message.h"
+#include <raven/util/timing.h>
 
 #include <tf/transform_datatypes.h>
 #include <raven_2_control/raven_state.h>
@@ -41,6 +47,7 @@
 
 #include <raven_2_msgs/RavenCommand.h>
 #include <raven_2_msgs/RavenTrajectoryCommand.h>
+#include <raven_2_msgs/RavenTrajectoryStatus.h>
 
 #include <raven_2_msgs/ToolCommandStamped.h>
 
@@ -50,7 +57,13 @@
 #include <geometry_msgs/PoseArray.h>
 #include <std_msgs/Float32.h>
 
+#include <ros/callback_queue.h>
+#include <nodelet/loader.h>
+#include <raven_2_msgs/InverseKinematicsBatch.h>
+#include <raven_2_msgs/ForwardKinematicsBatch.h>
+
 #include <raven/util/stringify.h>
+#include <raven/util/config.h>
 
 extern int NUM_MECH;
 extern USBStruct USBBoards;
@@ -69,6 +82,7 @@ static int PRINT_EVERY = PRINT_EVERY_PEDAL_DOWN;
 struct robot_device* device0ptr;
 
 static std::map<std::string,std::map<int,raven_2_msgs::JointCommand> > joint_commands;
+static boost::mutex joint_commands_mutex; // read by the raven_state publisher thread
 
 using namespace raven_2_control;
 // Global publisher for raven data
@@ -89,6 +103,8 @@ ros::Publisher pub_tool_pose_command[2];
 ros::Publisher pub_master_pose[2];
 ros::Publisher pub_master_pose_raw[2];
 
+ros::Publisher pub_traj_status;
+
 ros::Publisher vis_pub1;
 ros::Publisher vis_pub2;
 
@@ -108,10 +124,6 @@ ros::Subscriber joint_sub;
 
 tf::TransformListener* tf_listener;
 
-void publish_joints(struct robot_device*);
-void publish_command_pose(struct robot_device*);
-void publish_tool_pose(struct robot_device*);
-void publish_master_pose(struct robot_device*);
 void publish_marker(struct robot_device*);
 
 #define APPEND_TOPIC(base,topic) (std::string(base) + "/" + std::string(topic))
@@ -137,6 +149,7 @@ void publish_marker(struct robot_device*);
 
 #define RAVEN_COMMAND_TOPIC "raven_command"
 #define RAVEN_COMMAND_TRAJECTORY_TOPIC APPEND_TOPIC(RAVEN_COMMAND_TOPIC,"trajectory")
+#define RAVEN_COMMAND_TRAJECTORY_STATUS_TOPIC APPEND_TOPIC(RAVEN_COMMAND_TRAJECTORY_TOPIC,"status")
 
 #define RAVEN_COMMAND_POSE_TOPIC_BASE APPEND_TOPIC(RAVEN_COMMAND_TOPIC,"pose")
 #define RAVEN_COMMAND_POSE_TOPIC(side) APPEND_TOPIC(RAVEN_COMMAND_POSE_TOPIC_BASE,side)
@@ -148,7 +161,7 @@ void publish_marker(struct robot_device*);
 #define RAVEN_COMMAND_TOOL_TOPIC(side) APPEND_TOPIC(RAVEN_COMMAND_TOOL_TOPIC_BASE,side)
 
 bool checkRate(ros::Time& last_pub,ros::Duration interval,ros::Duration& since_last_pub) {
-	ros::Time now = ros::Time::now();
+	ros::Time now = LoopClock::now();
 	since_last_pub = (now-last_pub);
 	if (last_pub.isZero()) {
 		last_pub = now;
@@ -161,51 +174,10 @@ bool checkRate(ros::Time& last_pub,ros::Duration interval,ros::Duration& since_l
 	}
 }
 
-inline geometry_msgs::Pose toRos(position pos,orientation ori,btMatrix3x3 transform=btMatrix3x3::getIdentity()) {
-	btQuaternion rot;
-	(toBt(ori.R) * transform).getRotation(rot);
-	geometry_msgs::Point p;
-	p.x = ((float)pos.x) / MICRON_PER_M;
-	p.y = ((float)pos.y) / MICRON_PER_M;
-	p.z = ((float)pos.z) / MICRON_PER_M;
-	geometry_msgs::Quaternion q;
-	rot.normalize();
-	q.x = rot.x();
-	q.y = rot.y();
-	q.z = rot.z();
-	q.w = rot.w();
-	geometry_msgs::Pose pose;
-	pose.position = p;
-	pose.orientation  = q;
-	return pose;
-}
-
-inline geometry_msgs::Pose toRos(const btTransform& pose,btMatrix3x3 transform=btMatrix3x3::getIdentity()) {
-	btMatrix3x3 rot_mat = pose.getBasis() * transform;
-	btQuaternion rot;
-	rot_mat.getRotation(rot);
-	geometry_msgs::Point p;
-	p.x = pose.getOrigin().x();
-	p.y = pose.getOrigin().y();
-	p.z = pose.getOrigin().z();
-	geometry_msgs::Quaternion q;
-	rot.normalize();
-	q.x = rot.x();
-	q.y = rot.y();
-	q.z = rot.z();
-	q.w = rot.w();
-	geometry_msgs::Pose pose_msg;
-	pose_msg.position = p;
-	pose_msg.orientation  = q;
-	return pose_msg;
-}
-
-float rosGraspFromMech(int armId,int grasp) {
-	if (armId == GOLD_ARM_ID) {
-		return ((float)grasp) / 1000.;
-	} else {
-		return -((float)grasp) / 1000.;
-	}
+inline btTransform fromRos(const geometry_msgs::Pose& pose,btMatrix3x3 transform=btMatrix3x3::getIdentity()) {
+	btQuaternion rot(pose.orientation.x,pose.orientation.y,pose.orientation.z,pose.orientation.w);
+	btMatrix3x3 rot_mat = btMatrix3x3(rot) * transform.inverse();
+	return btTransform(rot_mat,btVector3(pose.position.x,pose.position.y,pose.position.z));
 }
 
 std::string rosJointName(int jointType) {
@@ -221,19 +193,6 @@ std::string rosJointName(int jointType) {
 	}
 }
 
-
-void getRosArmType(const u_16& type, uint8_t& ros) {
-	switch (type) {
-	case GOLD_ARM:
-		ros = raven_2_msgs::Constants::ARM_TYPE_GOLD;
-		return;
-	case GREEN_ARM:
-		ros = raven_2_msgs::Constants::ARM_TYPE_GREEN;
-		return;
-	}
-	ROS_ERROR_STREAM("Unknown mech type"<<type);
-}
-
 std::string rosArmName(int armId) {
 	switch(armId) {
 	case GOLD_ARM_ID: return "L";
@@ -315,8 +274,30 @@ void cmd_tool_callback(const raven_2_msgs::ToolCommandStampedConstPtr& tool_comm
 	processRavenCmd(cmd);
 }
 
-bool processEndEffectorControl(const raven_2_msgs::RavenCommand& cmd,param_pass& params);
-bool processJointControl(const raven_2_msgs::RavenCommand& cmd,param_pass& params);
+/*
+ * What processEndEffectorControl() and processJointControl() carry from one
+ * command to the next. Commands arriving here work on the master pose globals
+ * and the live device. Trajectories are converted on trajectory_spinner with a
+ * state of their own, seeded from a PublishScheduler snapshot, so the two
+ * threads never share it and neither waits on the other.
+ */
+struct CommandProcessState {
+	ros::Time end_effector_last_call;
+	ros::Time joint_last_call;
+	const struct robot_device* device;
+	btVector3* master_raw_position;
+	btVector3* master_position;
+	btMatrix3x3* master_raw_orientation;
+	btMatrix3x3* master_orientation;
+};
+
+static CommandProcessState command_state = {
+	ros::Time(0), ros::Time(0), NULL,
+	master_raw_position, master_position, master_raw_orientation, master_orientation
+};
+
+bool processEndEffectorControl(const raven_2_msgs::RavenCommand& cmd,param_pass& params,CommandProcessState& state,const ros::Time& now);
+bool processJointControl(const raven_2_msgs::RavenCommand& cmd,param_pass& params,CommandProcessState& state,const ros::Time& now);
 
 void processRavenCmd(const raven_2_msgs::RavenCommand& cmd1) {
 	raven_2_msgs::RavenCommand cmd = cmd1;
@@ -336,11 +317,14 @@ void processRavenCmd(const raven_2_msgs::RavenCommand& cmd1) {
 
 	//printf("cmd callback!\n");
 
-	joint_commands.clear();
-	for (size_t i=0;i<cmd.arms.size();i++) {
-		for (size_t j=0;j<cmd.arms[i].joint_commands.size();j++) {
-			raven_2_msgs::JointCommand jCmd = cmd.arms[i].joint_commands[j];
-			joint_commands[cmd.arm_names[i]][cmd.arms[i].joint_types[j]] = jCmd;
+	{
+		boost::mutex::scoped_lock _lock(joint_commands_mutex);
+		joint_commands.clear();
+		for (size_t i=0;i<cmd.arms.size();i++) {
+			for (size_t j=0;j<cmd.arms[i].joint_commands.size();j++) {
+				raven_2_msgs::JointCommand jCmd = cmd.arms[i].joint_commands[j];
+				joint_commands[cmd.arm_names[i]][cmd.arms[i].joint_types[j]] = jCmd;
+			}
 		}
 	}
 
@@ -359,12 +343,14 @@ void processRavenCmd(const raven_2_msgs::RavenCommand& cmd1) {
 	switch (cmd.controller) {
 	case raven_2_msgs::Constants::CONTROLLER_END_EFFECTOR:
 	case raven_2_msgs::Constants::CONTROLLER_CARTESIAN_SPACE:
-		write = processEndEffectorControl(cmd,params);
+		command_state.device = device0ptr;
+		write = processEndEffectorControl(cmd,params,command_state,ros::Time::now());
 		break;
 	case raven_2_msgs::Constants::CONTROLLER_JOINT_POSITION:
 	case raven_2_msgs::Constants::CONTROLLER_JOINT_VELOCITY:
 	case raven_2_msgs::Constants::CONTROLLER_JOINT_TORQUE:
-		write = processJointControl(cmd,params);
+		command_state.device = device0ptr;
+		write = processJointControl(cmd,params,command_state,ros::Time::now());
 		break;
 	default:
 		log_err("Unknown control mode %s",controlModeToString((t_controlmode) cmd.controller).c_str());
@@ -395,10 +381,14 @@ void processRavenCmd(const raven_2_msgs::RavenCommand& cmd1) {
 //	printf("%s: %f %f %f %f\n",name.c_str(),q.x(),q.y(),q.z(),q.w());
 //}
 
-bool processEndEffectorControl(const raven_2_msgs::RavenCommand& cmd,param_pass& params) {
-	static ros::Time last_call(0);
+bool processEndEffectorControl(const raven_2_msgs::RavenCommand& cmd,param_pass& params,CommandProcessState& state,const ros::Time& now) {
+	ros::Time& last_call = state.end_effector_last_call;
+	const struct robot_device* device0ptr = state.device;
+	btVector3* master_raw_position = state.master_raw_position;
+	btVector3* master_position = state.master_position;
+	btMatrix3x3* master_raw_orientation = state.master_raw_orientation;
+	btMatrix3x3* master_orientation = state.master_orientation;
 
-    ros::Time now = ros::Time::now();
     if (last_call.toSec() == 0) { last_call = now; return false; }
     ros::Duration since_last_call = (now-last_call);
     last_call = now;
@@ -639,10 +629,10 @@ bool processEndEffectorControl(const raven_2_msgs::RavenCommand& cmd,param_pass&
 	return true;
 }
 
-bool processJointControl(const raven_2_msgs::RavenCommand& cmd,param_pass& params) {
-	static ros::Time last_call(0);
+bool processJointControl(const raven_2_msgs::RavenCommand& cmd,param_pass& params,CommandProcessState& state,const ros::Time& now) {
+	ros::Time& last_call = state.joint_last_call;
+	const struct robot_device* device0ptr = state.device;
 
-	ros::Time now = ros::Time::now();
 	if (last_call.toSec() == 0) { last_call = now; return false; }
 	ros::Duration since_last_call = (now-last_call);
 	last_call = now;
@@ -700,6 +690,9 @@ bool processJointControl(const raven_2_msgs::RavenCommand& cmd,param_pass& param
 			case raven_2_msgs::JointCommand::COMMAND_TYPE_VELOCITY:
 				params.jvel_d[joint_ind] = cmd_value;
 				break;
+			case raven_2_msgs::JointCommand::COMMAND_TYPE_MOTOR_POSITION:
+				params.mpos_d[joint_ind] = cmd_value;
+				break;
 			case raven_2_msgs::JointCommand::COMMAND_TYPE_TORQUE:
 				params.torque_vals[joint_ind] = 1000*cmd_value;
 				break;
@@ -740,38 +733,101 @@ bool processJointControl(const raven_2_msgs::RavenCommand& cmd,param_pass& param
 	return true;
 }
 
+bool validateTrajectory(const param_pass_trajectory& traj,std::string& error);
+
+void publishTrajectoryStatus(const raven_2_msgs::RavenTrajectoryCommand& traj_msg,bool accepted,const std::string& error) {
+	raven_2_msgs::RavenTrajectoryStatus status;
+	status.header.stamp = ros::Time::now();
+	status.command_stamp = traj_msg.header.stamp;
+	status.accepted = accepted;
+	status.error = error;
+	double begin_time, end_time;
+	size_t num_points;
+	if (getTrajectoryExtent(begin_time,end_time,num_points)) {
+		status.num_points = num_points;
+		status.begin_time = ros::Time(begin_time);
+		status.end_time = ros::Time(end_time);
+	}
+	pub_traj_status.publish(status);
+	if (!accepted) {
+		log_err("Trajectory rejected: %s",error.c_str());
+	}
+}
+
+/*
+ * Runs on trajectory_spinner, not the rt loop: converting and checking a long
+ * trajectory takes a while.
+ */
 void cmd_trajectory_callback(const raven_2_msgs::RavenTrajectoryCommand& traj_msg) {
-	log_msg("trajectory callback!\n");
 	if (!checkMasterMode(RAVEN_COMMAND_TRAJECTORY_TOPIC)) { return; }
 	if (!checkControlMode(trajectory_control)) { return; }
 
+	if (traj_msg.commands.empty()) {
+		publishTrajectoryStatus(traj_msg,false,"no points");
+		return;
+	}
+
+	// the control mode is trajectory_control by now, so default to cartesian space control
 	t_controlmode controlmode = (t_controlmode)traj_msg.controller;
 	if (traj_msg.controller == raven_2_msgs::Constants::CONTROLLER_NONE) {
-		t_controlmode currentMode = getControlMode();
-		if (currentMode == no_control) {
-			//default to cartesian space control
-			controlmode = (t_controlmode)raven_2_msgs::Constants::CONTROLLER_CARTESIAN_SPACE;
-		} else {
-			controlmode = currentMode;
-		}
+		controlmode = (t_controlmode)raven_2_msgs::Constants::CONTROLLER_CARTESIAN_SPACE;
 	}
 
-	log_msg("Got trajectory with control %s",controlModeToString(controlmode).c_str());
-
-	param_pass_trajectory traj;
-	if (true || traj_msg.header.stamp.isZero()) {
-		ros::Time now = ros::Time::now();
-		traj.begin_time = now.toSec();
-	} else {
-		traj.begin_time = traj_msg.header.stamp.toSec();
+	// the rt thread's newest copy of the device, instead of device0 as it is being written
+	PublishFrameConstPtr frame = PublishScheduler::latestFrame();
+	if (!frame) {
+		publishTrajectoryStatus(traj_msg,false,"no robot state yet");
+		return;
 	}
+	struct robot_device device = frame->snapshot.device;
 
+	param_pass_trajectory traj;
+	ros::Time now = ros::Time::now();
+	traj.begin_time = now.toSec();
 	traj.total_duration = 0;
 	traj.control_mode = controlmode;
 
+	btVector3 traj_master_raw_position[2];
+	btVector3 traj_master_position[2];
+	btMatrix3x3 traj_master_raw_orientation[2];
+	btMatrix3x3 traj_master_orientation[2];
+	for (int i=0;i<2;i++) {
+		traj_master_raw_position[i] = frame->snapshot.master_raw_position[i];
+		traj_master_position[i] = frame->snapshot.master_position[i];
+		traj_master_raw_orientation[i] = frame->snapshot.master_raw_orientation[i];
+		traj_master_orientation[i] = frame->snapshot.master_orientation[i];
+	}
+	// each point is converted at its own time, counted from now
+	CommandProcessState state = {
+		now, now, &device,
+		traj_master_raw_position, traj_master_position, traj_master_raw_orientation, traj_master_orientation
+	};
+
+	// relative commands continue from the setpoint the points follow on from
 	param_pass params;
-	peekRcvdParams(&params);
-	params.surgeon_mode = SURGEON_ENGAGED;
+	t_controlmode playing;
+	bool continues = false;
+	if (traj_msg.mode == raven_2_msgs::RavenTrajectoryCommand::MODE_APPEND) {
+		continues = getTrajectorySetpoint(HUGE_VAL,playing,params);
+	} else if (traj_msg.mode == raven_2_msgs::RavenTrajectoryCommand::MODE_PREEMPT) {
+		continues = getTrajectorySetpoint(std::max(traj_msg.preempt_time.toSec(),traj.begin_time),playing,params);
+	}
+	if (!continues) {
+		peekRcvdParams(&params);
+		// joints a joint or motor trajectory doesn't command stay where they are
+		mechanism* _mech = NULL;
+		DOF* _joint = NULL;
+		int mechnum = 0, jointnum = 0;
+		while (loop_over_joints(&device,_mech,_joint,mechnum,jointnum)) {
+			params.jpos_d[_joint->type] = _joint->jpos_d;
+			params.mpos_d[_joint->type] = _joint->mpos_d;
+		}
+	} else if (playing != controlmode) {
+		publishTrajectoryStatus(traj_msg,false,"controller " + controlModeToString(controlmode) + " does not match the trajectory playing");
+		return;
+	}
+
+	traj.pts.reserve(traj_msg.commands.size());
 	for (size_t i=0;i<traj_msg.commands.size();i++) {
 		param_pass_trajectory_pt pt;
 		pt.time_from_start = traj_msg.commands[i].time_from_start.toSec();
@@ -789,105 +845,139 @@ void cmd_trajectory_callback(const raven_2_msgs::RavenTrajectoryCommand& traj_ms
 		switch (cmd.controller) {
 		case raven_2_msgs::Constants::CONTROLLER_END_EFFECTOR:
 		case raven_2_msgs::Constants::CONTROLLER_CARTESIAN_SPACE:
-			processEndEffectorControl(cmd,params);
+			processEndEffectorControl(cmd,params,state,cmd.header.stamp);
 			break;
-		default:
-			log_err("Unknown control mode for trajectory %s",controlModeToString((t_controlmode) cmd.controller).c_str());
+		// no inverse kinematics: joint positions go through the cable coupling, motor positions straight to the PD loop
+		case raven_2_msgs::Constants::CONTROLLER_JOINT_POSITION:
+		case raven_2_msgs::Constants::CONTROLLER_MOTOR_POSITION:
+			processJointControl(cmd,params,state,cmd.header.stamp);
 			break;
+		default:
+			publishTrajectoryStatus(traj_msg,false,"unknown control mode for trajectory " + controlModeToString((t_controlmode) cmd.controller));
+			return;
 		}
 		pt.param = params;
-
-		printf("(%i,%i,%i)\n",pt.param.xd[0].x,pt.param.xd[0].y,pt.param.xd[0].z);
-
 		traj.pts.push_back(pt);
 	}
 
 	traj.total_duration = traj.pts.back().time_from_start + 1;
 
-	params = traj.pts[0].param;
-	writeUpdate(&params);
+	std::string error;
+	bool cartesian = controlmode == end_effector_control || controlmode == cartesian_space_control;
+	if (traj_msg.validate && cartesian && !validateTrajectory(traj,error)) {
+		publishTrajectoryStatus(traj_msg,false,error);
+		return;
+	}
 
-	setTrajectory(traj);
+	bool accepted;
+	switch (traj_msg.mode) {
+	case raven_2_msgs::RavenTrajectoryCommand::MODE_APPEND:
+		accepted = appendTrajectory(traj);
+		break;
+	case raven_2_msgs::RavenTrajectoryCommand::MODE_PREEMPT:
+		accepted = preemptTrajectory(traj_msg.preempt_time.toSec(),traj);
+		break;
+	default:
+		params = traj.pts[0].param;
+		writeUpdate(&params);
+		accepted = setTrajectory(traj);
+		break;
+	}
+	log_msg("Trajectory (mode %d) with %d points, control %s",(int)traj_msg.mode,(int)traj.pts.size(),controlModeToString(controlmode).c_str());
+	publishTrajectoryStatus(traj_msg,accepted,accepted ? "" : "controller does not match the trajectory playing");
 }
 #ifdef PUBLISH_OLD_STATE
 void publish_ravenstate_old(struct robot_device *device0,u_08 runlevel,u_08 sublevel,ros::Duration since_last_pub);
 #endif
 
-raven_2_msgs::RavenState publish_new_device();
+const raven_2_msgs::RavenState& publish_new_device();
 
+/*
+ * Called from the rt loop. Only takes a snapshot; the topics are published by
+ * the PublishScheduler threads at their configured rates.
+ */
 void publish_ros(struct robot_device *device0,param_pass currParams) {
-#ifdef USE_NEW_DEVICE
-	static DevicePtr dev;
-	Device::current(dev);
-	OldControlInputPtr input = ControlInput::getOldControlInput();
-#endif
+	PublishScheduler::capture(device0);
+}
+
+// Shared so that filling a header copies the frame id instead of building it
+static const std::string ROS_BASE_FRAME("/0_link");
+
+void fillHeader(std_msgs::Header& header,const PublishSnapshot& snapshot) {
+	header.seq = snapshot.seq;
+	header.stamp.sec = snapshot.stamp.tv_sec;
+	header.stamp.nsec = snapshot.stamp.tv_nsec;
+	header.frame_id = ROS_BASE_FRAME;
+}
+
+void fillFastArmInfo(raven_2_msgs::Raven1000HzStateArray& fast_states,struct robot_device* device0) {
 	mechanism* _mech=NULL;
 	DOF* _joint=NULL;
 	int mechnum, jnum;
 
-	u_08 runlevel;
-	u_08 sublevel;
-	RunLevel rl = RunLevel::get();
-	rl.getNumbers<u_08>(runlevel,sublevel);
-
-	static bool hasHomed = false;
-	if (RunLevel::isInitialized()) {
-		hasHomed = true;
-	}
-
-	timespec t = LoopNumber::getMainTime();
-	static std_msgs::Header header;
-	header.seq = LoopNumber::getMain();
-#ifdef USE_NEW_DEVICE
-	header.stamp = dev->timestamp();
-#else
-	//header.stamp = ros::Time::now();
-	header.stamp.sec = t.tv_sec;
-	header.stamp.nsec = t.tv_nsec;
-#endif
-	header.frame_id = "/0_link";
-
-
-	static raven_2_msgs::Raven1000HzStateArray fast_states;
-	static bool fast_states_inited = false;
-	if (!fast_states_inited) {
-		fast_states.arm_info.clear();
-		_mech=NULL;
-		while (loop_over_mechs(device0,_mech,mechnum)) {
-			raven_2_msgs::Raven1000HzArmInfo arm_info;
-			arm_info.name = armNameFromMechType(_mech->type);
-			getRosArmType(_mech->type,arm_info.type);
-			_joint=NULL;
-			while (loop_over_joints(_mech,_joint,jnum)) {
-				uint16_t ros_joint_type;
-				int joint_type = jointTypeFromCombinedType(_joint->type);
-				switch (joint_type) {
-				case SHOULDER: ros_joint_type = raven_2_msgs::Constants::JOINT_TYPE_SHOULDER; break;
-				case ELBOW: ros_joint_type = raven_2_msgs::Constants::JOINT_TYPE_ELBOW; break;
-				case Z_INS: ros_joint_type = raven_2_msgs::Constants::JOINT_TYPE_INSERTION; break;
-				case TOOL_ROT: ros_joint_type = raven_2_msgs::Constants::JOINT_TYPE_ROTATION; break;
-				case WRIST: ros_joint_type = raven_2_msgs::Constants::JOINT_TYPE_PITCH; break;
-				case GRASP1: ros_joint_type = raven_2_msgs::Constants::JOINT_TYPE_GRASP_FINGER1; break;
-				case GRASP2: ros_joint_type = raven_2_msgs::Constants::JOINT_TYPE_GRASP_FINGER2; break;
-				case NO_CONNECTION: continue;
-				}
-				arm_info.joint_types.push_back(ros_joint_type);
+	size_t a = 0;
+	while (loop_over_mechs(device0,_mech,mechnum)) {
+		raven_2_msgs::Raven1000HzArmInfo& arm_info = messageSlot(fast_states.arm_info,a++);
+		arm_info.name = armNameFromMechType(_mech->type);
+		getRosArmType(_mech->type,arm_info.type);
+		size_t j = 0;
+		_joint=NULL;
+		while (loop_over_joints(_mech,_joint,jnum)) {
+			uint16_t ros_joint_type;
+			int joint_type = jointTypeFromCombinedType(_joint->type);
+			switch (joint_type) {
+			case SHOULDER: ros_joint_type = raven_2_msgs::Constants::JOINT_TYPE_SHOULDER; break;
+			case ELBOW: ros_joint_type = raven_2_msgs::Constants::JOINT_TYPE_ELBOW; break;
+			case Z_INS: ros_joint_type = raven_2_msgs::Constants::JOINT_TYPE_INSERTION; break;
+			case TOOL_ROT: ros_joint_type = raven_2_msgs::Constants::JOINT_TYPE_ROTATION; break;
+			case WRIST: ros_joint_type = raven_2_msgs::Constants::JOINT_TYPE_PITCH; break;
+			case GRASP1: ros_joint_type = raven_2_msgs::Constants::JOINT_TYPE_GRASP_FINGER1; break;
+			case GRASP2: ros_joint_type = raven_2_msgs::Constants::JOINT_TYPE_GRASP_FINGER2; break;
+			case NO_CONNECTION: continue;
 			}
-			fast_states.arm_info.push_back(arm_info);
+			messageSlot(arm_info.joint_types,j++) = ros_joint_type;
 		}
+		messageResize(arm_info.joint_types,j);
 	}
+	messageResize(fast_states.arm_info,a);
+}
 
-	static raven_2_msgs::Raven1000HzState fast_state;
-	fast_state.arms.clear();
-	fast_state.header = header;
+void fillFastState(raven_2_msgs::Raven1000HzState& fast_state,PublishSnapshot& sample) {
+	struct robot_device* device0 = &sample.device;
+	mechanism* _mech=NULL;
+	DOF* _joint=NULL;
+	int mechnum, jnum;
 
-	rl.getNumbers<uint8_t>(fast_state.runlevel,fast_state.sublevel);
-	fast_state.pedal_down = RunLevel::getPedal();
+	fillHeader(fast_state.header,sample);
+	fast_state.runlevel = sample.runlevel;
+	fast_state.sublevel = sample.sublevel;
+	fast_state.pedal_down = sample.pedal_down;
 
-	_mech=NULL;
+	size_t a = 0;
 	while (loop_over_mechs(device0,_mech,mechnum)) {
-		raven_2_msgs::Raven1000HzArmState arm_state;
+		raven_2_msgs::Raven1000HzArmState& arm_state = messageSlot(fast_state.arms,a++);
 
+		size_t numJoints = 0;
+		_joint=NULL;
+		while (loop_over_joints(_mech,_joint,jnum)) { numJoints++; }
+
+		messageResize(arm_state.joint_states,numJoints);
+		messageResize(arm_state.motor_encoder_values,numJoints);
+		messageResize(arm_state.motor_encoder_offsets,numJoints);
+		messageResize(arm_state.motor_positions,numJoints);
+		messageResize(arm_state.motor_velocities,numJoints);
+		messageResize(arm_state.joint_positions,numJoints);
+		messageResize(arm_state.joint_velocities,numJoints);
+		messageResize(arm_state.torques,numJoints);
+		messageResize(arm_state.dac_commands,numJoints);
+		messageResize(arm_state.gravity_estimates,numJoints);
+		messageResize(arm_state.integrated_position_errors,numJoints);
+		messageResize(arm_state.set_points.motor_positions,numJoints);
+		messageResize(arm_state.set_points.motor_velocities,numJoints);
+		messageResize(arm_state.set_points.joint_positions,numJoints);
+		messageResize(arm_state.set_points.joint_velocities,numJoints);
+
+		size_t j = 0;
 		_joint=NULL;
 		while (loop_over_joints(_mech,_joint,jnum)) {
 			int16_t joint_state;
@@ -901,324 +991,137 @@ void publish_ros(struct robot_device *device0,param_pass currParams) {
 			case jstate_hard_stop: joint_state = raven_2_msgs::JointState::STATE_HARD_STOP; break;
 			default: joint_state = raven_2_msgs::JointState::STATE_LAST_TYPE; break;
 			}
-			arm_state.joint_states.push_back(joint_state);
+			arm_state.joint_states[j] = joint_state;
 
-			arm_state.motor_encoder_values.push_back(_joint->enc_val);
-			arm_state.motor_encoder_offsets.push_back(_joint->enc_offset);
+			arm_state.motor_encoder_values[j] = _joint->enc_val;
+			arm_state.motor_encoder_offsets[j] = _joint->enc_offset;
 
-			arm_state.motor_positions.push_back(_joint->mpos);
-			arm_state.motor_velocities.push_back(_joint->mvel);
+			arm_state.motor_positions[j] = _joint->mpos;
+			arm_state.motor_velocities[j] = _joint->mvel;
 
-			arm_state.joint_positions.push_back(_joint->jpos);
-			arm_state.joint_velocities.push_back(_joint->jvel);
+			arm_state.joint_positions[j] = _joint->jpos;
+			arm_state.joint_velocities[j] = _joint->jvel;
 
-			arm_state.torques.push_back(_joint->tau_d);
-			arm_state.dac_commands.push_back(_joint->current_cmd);
+			arm_state.torques[j] = _joint->tau_d;
+			arm_state.dac_commands[j] = _joint->current_cmd;
 
-			arm_state.gravity_estimates.push_back(_joint->tau_g);
-			arm_state.integrated_position_errors.push_back(_joint->perror_int);
+			arm_state.gravity_estimates[j] = _joint->tau_g;
+			arm_state.integrated_position_errors[j] = _joint->perror_int;
 
-			arm_state.set_points.motor_positions.push_back(_joint->mpos_d);
-			arm_state.set_points.motor_velocities.push_back(_joint->mvel_d);
+			arm_state.set_points.motor_positions[j] = _joint->mpos_d;
+			arm_state.set_points.motor_velocities[j] = _joint->mvel_d;
 
-			arm_state.set_points.joint_positions.push_back(_joint->jpos_d);
-			arm_state.set_points.joint_velocities.push_back(_joint->jvel_d);
+			arm_state.set_points.joint_positions[j] = _joint->jpos_d;
+			arm_state.set_points.joint_velocities[j] = _joint->jvel_d;
+			j++;
 		}
-		fast_state.arms.push_back(arm_state);
 	}
+	messageResize(fast_state.arms,a);
+}
 
-	fast_states.states.push_back(fast_state);
-
-	static ros::Time last_pub;
-	static ros::Duration interval(0.01);
-	static ros::Duration since_last_pub;
-	if (!checkRate(last_pub,interval,since_last_pub)) { return; }
-
-	publish_master_pose(device0);
+/*
+ * Publishes the rt cycles since the last call in batches of a fixed size, so
+ * every message in the pool keeps the same shape and is only overwritten.
+ * Samples short of a full batch wait for the next call.
+ */
+void publish_fast_states() {
+	static MessagePool<raven_2_msgs::Raven1000HzStateArray> pool;
+	static PublishSnapshot sample;
+	static size_t batch = 0;
+
+	if (!batch) {
+		double per_cycle = RavenConfig.fast_state_publish_rate * STEP_PERIOD;
+		batch = std::max(1,(int)(1 / per_cycle + 0.5));
+		batch = std::min(batch,(size_t)PUBLISH_SAMPLE_RING_SIZE / 2);
+	}
 
-	//Only publish these if we've homed already
-	if (true || hasHomed) {
-		publish_joints(device0);
-		//publish_marker(device0);
-		if (
-				!rl.isEstop()
-				) {
-			publish_command_pose(device0);
+	while (PublishScheduler::samplesQueued() >= batch) {
+		raven_2_msgs::Raven1000HzStateArrayPtr fast_states = pool.get();
+		size_t i;
+		for (i=0;i<batch && PublishScheduler::popSample(sample);i++) {
+			if (fast_states->arm_info.empty()) {
+				fillFastArmInfo(*fast_states,&sample.device);
+			}
+			fillFastState(messageSlot(fast_states->states,i),sample);
 		}
-		publish_tool_pose(device0);
+		messageResize(fast_states->states,i);
+		pub_raven_1000hz_state.publish(fast_states);
 	}
+}
 
-#ifdef PUBLISH_OLD_STATE
-	publish_ravenstate_old(device0,runlevel,sublevel,since_last_pub);
-#endif
+// find rather than operator[], which would insert
+static bool lookupJointCommand(const std::string& arm_name,int joint_type,raven_2_msgs::JointCommand& cmd) {
+	boost::mutex::scoped_lock _lock(joint_commands_mutex);
+	std::map<std::string,std::map<int,raven_2_msgs::JointCommand> >::const_iterator arm_cmds = joint_commands.find(arm_name);
+	if (arm_cmds == joint_commands.end()) {
+		return false;
+	}
+	std::map<int,raven_2_msgs::JointCommand>::const_iterator it = arm_cmds->second.find(joint_type);
+	if (it == arm_cmds->second.end()) {
+		return false;
+	}
+	cmd = it->second;
+	return true;
+}
 
-	//fast state
-	pub_raven_1000hz_state.publish(fast_states);
-	fast_states.states.clear();
+void buildRavenState(PublishFrame& frame) {
+	static MessagePool<raven_2_msgs::RavenState> state_pool;
+	static MessagePool<raven_2_msgs::RavenArrayState> array_state_pool;
 
 	//raven_state
-	static raven_2_msgs::RavenState raven_state;
-	raven_state.arms.clear();
-
-	raven_state.header = header;
-	rl.getNumbers<uint8_t>(raven_state.runlevel,raven_state.sublevel);
-	raven_state.pedal_down = RunLevel::getPedal();
+	state_pool.renew(frame.raven_state);
+	raven_2_msgs::RavenState& raven_state = *frame.raven_state;
 
+	raven_state.header = frame.header;
 	raven_state.master = getMasterModeString();
 
-	//t_controlmode controlMode = (t_controlmode)currParams.robotControlMode;
-	t_controlmode controlMode = getControlMode();
-	raven_state.controller = (uint8_t) controlMode;
-
-	_mech=NULL;
-	_joint=NULL;
-
-	while (loop_over_mechs(device0,_mech,mechnum)) {
-		raven_2_msgs::ArmState arm_state;
-		uint8_t arm_type;
-		btMatrix3x3 transform;
-		switch (_mech->type) {
-		case GOLD_ARM:
-			transform = btMatrix3x3(1,0,0,  0,-1,0,  0,0,-1);
-			break;
-		case GREEN_ARM:
-			transform = btMatrix3x3(1,0,0,  0,-1,0,  0,0,-1);
-			break;
-		default:
-			ROS_ERROR_STREAM("Unknown mech type"<<_mech->type);
-			continue;
-		}
-		arm_state.name = armNameFromMechType(_mech->type);
-		getRosArmType(_mech->type,arm_state.type);
-
-		arm_state.base_pose = toRos(_mech->base_pos,_mech->base_ori,transform);
-
-		switch (_mech->type) {
-		case TOOL_NONE: arm_state.tool_type = raven_2_msgs::Constants::TOOL_TYPE_NONE; break;
-		case TOOL_GRASPER_10MM: arm_state.tool_type = raven_2_msgs::Constants::TOOL_TYPE_GRASPER_10MM; break;
-		case TOOL_GRASPER_8MM: arm_state.tool_type = raven_2_msgs::Constants::TOOL_TYPE_GRASPER_8MM; break;
-		}
-
-		arm_state.tool.pose = toRos(_mech->pos,_mech->ori,transform);
-		arm_state.tool_set_point.pose = toRos(_mech->pos_d,_mech->ori_d,transform);
-
-#ifdef USE_NEW_DEVICE
+	if (frame.snapshot.runlevel_pedal) {
+		fillRavenState(raven_state,frame.snapshot,lookupJointCommand);
+	} else {
 		{
-		btTransform tool_pose(toBt(_mech->ori) * transform,toBt(_mech->pos)/MICRON_PER_M);
-		btQuaternion tool_pose_rot = tool_pose.getRotation();
-		btVector3 tool_pose_pos = tool_pose.getOrigin();
-
-		btTransform tool_pose_new = dev->getArmById(_mech->type)->kinematics().forwardPose();
-		btQuaternion tool_pose_new_rot = tool_pose_new.getRotation();
-		btVector3 tool_pose_new_pos = tool_pose_new.getOrigin();
-
-		btTransform tool_pose_d(toBt(_mech->ori_d) * transform,toBt(_mech->pos_d)/MICRON_PER_M);
-		btQuaternion tool_pose_d_rot = tool_pose_d.getRotation();
-		btVector3 tool_pose_d_pos = tool_pose_d.getOrigin();
-
-		btTransform tool_pose_d_new = input->armById(_mech->type).pose();
-		btQuaternion tool_pose_d_new_rot = tool_pose_d_new.getRotation();
-		btVector3 tool_pose_d_new_pos = tool_pose_d_new.getOrigin();
-
-		double dist = tool_pose_pos.distance(tool_pose_new_pos);
-		double angle = tool_pose_rot.angle(tool_pose_new_rot) * 180 / M_PI;
-
-		double dist_d = tool_pose_d_pos.distance(tool_pose_d_new_pos);
-		double angle_d = tool_pose_d_rot.angle(tool_pose_d_new_rot) * 180 / M_PI;
-
-		if (false && LoopNumber::everyMain(1000)) {
-			log_msg("DIFFS [%.2d,%.1d] [%.2d, %.1d]",dist,angle,dist_d,angle_d);
-			log_msg("(%.2d,%.2d,%.2d) (%.2d,%.2d,%.2d)",tool_pose_pos.x(),tool_pose_pos.y(),tool_pose_pos.z(),tool_pose_new_pos.x(),tool_pose_new_pos.y(),tool_pose_new_pos.z());
-			log_msg("(%.2d,%.2d,%.2d) (%.2d,%.2d,%.2d)",tool_pose_d_pos.x(),tool_pose_d_pos.y(),tool_pose_d_pos.z(),tool_pose_d_new_pos.x(),tool_pose_d_new_pos.y(),tool_pose_d_new_pos.z());
+			boost::mutex::scoped_lock _lock(joint_commands_mutex);
+			joint_commands.clear();
 		}
-		}
-#endif
-
-		arm_state.tool.grasp = rosGraspFromMech(armIdFromMechType(_mech->type),_mech->ori.grasp);
-		arm_state.tool_set_point.grasp = rosGraspFromMech(armIdFromMechType(_mech->type),_mech->ori_d.grasp);
-
-		_joint = NULL;
-		int grasp1_index=-1;
-		int grasp2_index=-1;
-		while (loop_over_joints(_mech,_joint,jnum)) {
-			raven_2_msgs::JointState joint_state;
-			int joint_type = jointTypeFromCombinedType(_joint->type);
-			switch (joint_type) {
-			case SHOULDER: joint_state.type = raven_2_msgs::Constants::JOINT_TYPE_SHOULDER; break;
-			case ELBOW: joint_state.type = raven_2_msgs::Constants::JOINT_TYPE_ELBOW; break;
-			case Z_INS: joint_state.type = raven_2_msgs::Constants::JOINT_TYPE_INSERTION; break;
-			case TOOL_ROT: joint_state.type = raven_2_msgs::Constants::JOINT_TYPE_ROTATION; break;
-			case WRIST: joint_state.type = raven_2_msgs::Constants::JOINT_TYPE_PITCH; break;
-			case GRASP1: joint_state.type = raven_2_msgs::Constants::JOINT_TYPE_GRASP_FINGER1; grasp1_index = jnum; break;
-			case GRASP2: joint_state.type = raven_2_msgs::Constants::JOINT_TYPE_GRASP_FINGER2; grasp2_index = jnum; break;
-			case NO_CONNECTION: continue;
-			}
-
-			switch (_joint->state) {
-			case jstate_not_ready: joint_state.state = raven_2_msgs::JointState::STATE_NOT_READY; break;
-			case jstate_pos_unknown: joint_state.state = raven_2_msgs::JointState::STATE_POS_UNKNOWN; break;
-			case jstate_homing1: joint_state.state = raven_2_msgs::JointState::STATE_HOMING1; break;
-			case jstate_homing2: joint_state.state = raven_2_msgs::JointState::STATE_HOMING2; break;
-			case jstate_ready: joint_state.state = raven_2_msgs::JointState::STATE_READY; break;
-			case jstate_wait: joint_state.state = raven_2_msgs::JointState::STATE_WAIT; break;
-			case jstate_hard_stop: joint_state.state = raven_2_msgs::JointState::STATE_HARD_STOP; break;
-			default: joint_state.state = raven_2_msgs::JointState::STATE_LAST_TYPE; break;
-			}
-
-			joint_state.encoder_value = _joint->enc_val;
-			joint_state.encoder_offset = _joint->enc_offset;
-			joint_state.dac_command = _joint->current_cmd;
-
-			joint_state.position = _joint->jpos;
-			joint_state.velocity = _joint->jvel;
-
-			joint_state.motor_position = _joint->mpos;
-			joint_state.motor_velocity = _joint->mvel;
-
-			joint_state.torque = _joint->tau_d;
-			joint_state.gravity_estimate = _joint->tau_g;
-
-			joint_state.integrated_position_error = _joint->perror_int;
-
-			raven_2_msgs::JointCommand joint_cmd;
-			if (rl.isPedalDown()) {
-					joint_cmd = joint_commands[arm_state.name][joint_state.type];
-			} else {
-				joint_commands.clear();
-			}
-			//joint_cmd.command_type = raven_2_msgs::JointCommand::COMMAND_TYPE_POSITION;
-			//joint_cmd.value = _joint->jpos_d;
-			/*
-	    		joint_cmd.position = _joint->jpos;
-	    		joint_cmd.velocity = _joint->jvel;
-
-	    		joint_cmd.motor_position = _joint->mpos;
-	    		joint_cmd.motor_velocity = _joint->mvel;
-
-	    		joint_cmd.torque = _joint->tau;
-			 */
-
-			joint_state.command = joint_cmd;
-
-			joint_state.set_point.position = _joint->jpos_d;
-			joint_state.set_point.velocity = _joint->jvel_d;
-			joint_state.set_point.motor_position = _joint->mpos_d;
-			joint_state.set_point.motor_velocity = _joint->mvel_d;
-
-			arm_state.joints.push_back(joint_state);
-		}
-
-		raven_2_msgs::JointState yaw_state;
-		raven_2_msgs::JointState grasp_state;
-		yaw_state.type = raven_2_msgs::Constants::JOINT_TYPE_YAW;
-		grasp_state.type = raven_2_msgs::Constants::JOINT_TYPE_GRASP;
-		jointState grasp_combined_state;
-		if (_mech->joint[grasp1_index].state < _mech->joint[grasp2_index].state) {
-			grasp_combined_state = _mech->joint[grasp1_index].state;
-		} else {
-			grasp_combined_state = _mech->joint[grasp2_index].state;
-		}
-
-		switch (grasp_combined_state) {
-		case jstate_not_ready: yaw_state.state = raven_2_msgs::JointState::STATE_NOT_READY; break;
-		case jstate_pos_unknown: yaw_state.state = raven_2_msgs::JointState::STATE_POS_UNKNOWN; break;
-		case jstate_homing1: yaw_state.state = raven_2_msgs::JointState::STATE_HOMING1; break;
-		case jstate_homing2: yaw_state.state = raven_2_msgs::JointState::STATE_HOMING2; break;
-		case jstate_ready: yaw_state.state = raven_2_msgs::JointState::STATE_READY; break;
-		case jstate_wait: yaw_state.state = raven_2_msgs::JointState::STATE_WAIT; break;
-		case jstate_hard_stop: yaw_state.state = raven_2_msgs::JointState::STATE_HARD_STOP; break;
-		default: yaw_state.state = raven_2_msgs::JointState::STATE_LAST_TYPE; break;
-		}
-		grasp_state.state = yaw_state.state;
-
-		yaw_state.position = THY_MECH_FROM_FINGERS(armIdFromMechType(_mech->type),_mech->joint[grasp1_index].jpos,_mech->joint[grasp2_index].jpos);
-		yaw_state.velocity = THY_MECH_FROM_FINGERS(armIdFromMechType(_mech->type),_mech->joint[grasp1_index].jvel,_mech->joint[grasp2_index].jvel);
-
-		// "Motors"
-		yaw_state.motor_position = THY_MECH_FROM_FINGERS(armIdFromMechType(_mech->type),_mech->joint[grasp1_index].mpos,_mech->joint[grasp2_index].mpos);
-		yaw_state.motor_velocity = THY_MECH_FROM_FINGERS(armIdFromMechType(_mech->type),_mech->joint[grasp1_index].mvel,_mech->joint[grasp2_index].mvel);
-
-		yaw_state.set_point.position = THY_MECH_FROM_FINGERS(armIdFromMechType(_mech->type),_mech->joint[grasp1_index].jpos_d,_mech->joint[grasp2_index].jpos_d);
-		yaw_state.set_point.velocity = THY_MECH_FROM_FINGERS(armIdFromMechType(_mech->type),_mech->joint[grasp1_index].jvel_d,_mech->joint[grasp2_index].jvel_d);
-
-		yaw_state.set_point.motor_position = THY_MECH_FROM_FINGERS(armIdFromMechType(_mech->type),_mech->joint[grasp1_index].mpos_d,_mech->joint[grasp2_index].mpos_d);
-		yaw_state.set_point.motor_velocity = THY_MECH_FROM_FINGERS(armIdFromMechType(_mech->type),_mech->joint[grasp1_index].mvel_d,_mech->joint[grasp2_index].mvel_d);
-
-		grasp_state.position = rosGraspFromMech(armIdFromMechType(_mech->type),_mech->ori.grasp);
-		grasp_state.set_point.position = rosGraspFromMech(armIdFromMechType(_mech->type),_mech->ori_d.grasp);
-
-		grasp_state.motor_position = rosGraspFromMech(armIdFromMechType(_mech->type),MECH_GRASP_FROM_MECH_FINGERS(armIdFromMechType(_mech->type),_mech->joint[grasp1_index].mpos,_mech->joint[grasp2_index].mpos));
-		grasp_state.set_point.motor_position = rosGraspFromMech(armIdFromMechType(_mech->type),MECH_GRASP_FROM_MECH_FINGERS(armIdFromMechType(_mech->type),_mech->joint[grasp1_index].mpos_d,_mech->joint[grasp2_index].mpos_d));
-
-		arm_state.joints.push_back(yaw_state);
-		arm_state.joints.push_back(grasp_state);
-
-		raven_state.arms.push_back(arm_state);
+		fillRavenState(raven_state,frame.snapshot,NULL);
 	}
 
-	pub_raven_state.publish(raven_state);
-
-	raven_2_msgs::RavenArrayState array_state;
-	array_state.header = raven_state.header;
-	array_state.runlevel = raven_state.runlevel;
-	array_state.sublevel = raven_state.sublevel;
-	array_state.pedal_down = raven_state.pedal_down;
-	array_state.master = raven_state.master;
-	array_state.controller = raven_state.controller;
-
-	for (int i=0;i<(int)raven_state.arms.size();i++) {
-		raven_2_msgs::ArmState arm = raven_state.arms[i];
-		array_state.arm_names.push_back(arm.name);
-		array_state.arm_types.push_back(arm.type);
-		array_state.base_poses.push_back(arm.base_pose);
-		array_state.tool_types.push_back(arm.tool_type);
-		array_state.tool.poses.push_back(arm.tool.pose);
-		array_state.tool_set_points.poses.push_back(arm.tool_set_point.pose);
-		array_state.tool.grasps.push_back(arm.tool.grasp);
-		array_state.tool_set_points.grasps.push_back(arm.tool_set_point.grasp);
-
-		for (int j=0;j<(int)arm.joints.size();j++) {
-			raven_2_msgs::JointState joint = arm.joints[j];
-			array_state.joint_arm_inds.push_back(i);
-			array_state.joint_types.push_back(joint.type);
-			array_state.joint_states.push_back(joint.state);
-			array_state.motor_encoder_values.push_back(joint.encoder_value);
-			array_state.motor_encoder_offsets.push_back(joint.encoder_offset);
-			array_state.dac_commands.push_back(joint.dac_command);
-			array_state.joint_positions.push_back(joint.position);
-			array_state.joint_velocities.push_back(joint.velocity);
-			array_state.motor_positions.push_back(joint.motor_position);
-			array_state.motor_velocities.push_back(joint.motor_velocity);
-			array_state.torques.push_back(joint.torque);
-			array_state.gravity_estimates.push_back(joint.gravity_estimate);
-			array_state.joint_command_types.push_back(joint.command.command_type);
-			array_state.joint_commands.push_back(joint.command.value);
-			array_state.integrated_position_errors.push_back(joint.integrated_position_error);
-
-			array_state.set_points.joint_positions.push_back(joint.set_point.position);
-			array_state.set_points.joint_velocities.push_back(joint.set_point.velocity);
-			array_state.set_points.motor_positions.push_back(joint.set_point.motor_position);
-			array_state.set_points.motor_velocities.push_back(joint.set_point.motor_velocity);
-		}
+	array_state_pool.renew(frame.array_state);
+	fillRavenArrayState(*frame.array_state,raven_state);
+}
 
-		array_state.input_pins.push_back(arm.input_pins);
-		array_state.output_pins.push_back(arm.output_pins);
-	}
+void publish_raven_state(const PublishFrame& frame) {
+	const raven_2_msgs::RavenState& raven_state = *frame.raven_state;
+	pub_raven_state.publish(frame.raven_state);
+	pub_raven_array_state.publish(frame.array_state);
 
-	pub_raven_array_state.publish(array_state);
+#ifdef PUBLISH_OLD_STATE
+	static ros::Time last_stamp;
+	ros::Duration since_last_pub = frame.header.stamp - last_stamp;
+	last_stamp = frame.header.stamp;
+	struct robot_device device = frame.snapshot.device;
+	publish_ravenstate_old(&device,frame.snapshot.runlevel,frame.snapshot.sublevel,since_last_pub);
+#endif
 
 #ifdef USE_NEW_DEVICE
-	raven_2_msgs::RavenState new_state = publish_new_device();
+	const raven_2_msgs::RavenState& new_state = publish_new_device();
 
-	for (size_t i=0;i<new_state.arms.size();i++) {
-		raven_2_msgs::ArmState armState = new_state.arms[i];
-		raven_2_msgs::ArmState otherArmState;
+	// overwritten in place, so once its arrays have grown to the topology copying into it doesn't allocate
+	static raven_2_msgs::RavenState diff_state;
+	diff_state = new_state;
+
+	for (size_t i=0;i<diff_state.arms.size();i++) {
+		raven_2_msgs::ArmState& armState = diff_state.arms[i];
+		const raven_2_msgs::ArmState* other = NULL;
 		for (size_t ii=0;ii<raven_state.arms.size();ii++) {
 			if (raven_state.arms[ii].name == armState.name) {
-				otherArmState = raven_state.arms[ii];
+				other = &raven_state.arms[ii];
 				break;
 			}
 		}
+		if (!other || other->joints.size() < armState.joints.size()) {
+			continue;
+		}
+		const raven_2_msgs::ArmState& otherArmState = *other;
 		armState.base_pose.position.x -= otherArmState.base_pose.position.x;
 		armState.base_pose.position.y -= otherArmState.base_pose.position.y;
 		armState.base_pose.position.z -= otherArmState.base_pose.position.z;
@@ -1250,8 +1153,8 @@ void publish_ros(struct robot_device *device0,param_pass currParams) {
 		armState.grasp_desired -= otherArmState.grasp_desired;
 
 		for (size_t j=0;j<armState.joints.size();j++) {
-			raven_2_msgs::JointState jointState = armState.joints[j];
-			raven_2_msgs::JointState otherJointState = otherArmState.joints[j];
+			raven_2_msgs::JointState& jointState = armState.joints[j];
+			const raven_2_msgs::JointState& otherJointState = otherArmState.joints[j];
 
 			jointState.encoder_value -= otherJointState.encoder_value;
 			jointState.encoder_offset -= otherJointState.encoder_offset;
@@ -1262,32 +1165,30 @@ void publish_ros(struct robot_device *device0,param_pass currParams) {
 			jointState.motor_velocity -= otherJointState.motor_velocity;
 			jointState.torque -= otherJointState.torque;
 			jointState.command.value -= otherJointState.command.value;
-
-			armState.joints[j] = jointState;
 		}
-
-		new_state.arms[i] = armState;
 	}
 
-	pub_raven_state_test_diff.publish(new_state);
+	pub_raven_state_test_diff.publish(diff_state);
 #endif
 
 }
 
-
-raven_2_msgs::RavenState publish_new_device() {
+// Returns the device's message, which is reused on the next call
+const raven_2_msgs::RavenState& publish_new_device() {
 	static raven_2_msgs::RavenState raven_state;
 #ifdef USE_NEW_DEVICE
 	static DevicePtr dev;
 	Device::current(dev);
-	OldControlInputPtr input = ControlInput::getOldControlInput();
+	// getOldControlInput() is for the rt thread only
+	static OldControlInputPtr input(new OldControlInput());
+	ControlInput::oldControlInputSnapshot(*input);
 
 	u_08 runlevel;
 	u_08 sublevel;
 	RunLevel currRunlevel = RunLevel::get();
 	currRunlevel.getNumbers<u_08>(runlevel,sublevel);
 	static bool hasHomed = false;
-	raven_state.arms.clear();
+	size_t numArms = 0;
 
 	if (
 			RunLevel::isInitialized()
@@ -1308,7 +1209,6 @@ raven_2_msgs::RavenState publish_new_device() {
 	raven_state.controller = (uint8_t) controlMode;
 
 	FOREACH_ARM_IN_DEVICE(arm,dev) {
-		raven_2_msgs::ArmState arm_state;
 		uint8_t arm_type;
 		btMatrix3x3 transform;
 		if (arm->isGold()) {
@@ -1321,6 +1221,9 @@ raven_2_msgs::RavenState publish_new_device() {
 			ROS_ERROR_STREAM("Unknown arm type"<<arm->type());
 			continue;
 		}
+		// the arm and joint arrays are overwritten in place, so they only allocate while growing to the topology
+		raven_2_msgs::ArmState& arm_state = messageSlot(raven_state.arms,numArms++);
+		size_t numJoints = 0;
 		arm_state.name = arm->name();
 		arm_state.type = arm_type;
 
@@ -1339,17 +1242,19 @@ raven_2_msgs::RavenState publish_new_device() {
 		arm_state.grasp_desired = input->armById(arm->id()).grasp();
 
 		FOREACH_JOINT_IN_ARM(joint,arm) {
-			raven_2_msgs::JointState joint_state;
+			uint16_t joint_type;
 			switch (joint->id().index()) {
-			case Joint::IdType::SHOULDER_: joint_state.type = raven_2_msgs::Constants::JOINT_TYPE_SHOULDER; break;
-			case Joint::IdType::ELBOW_: joint_state.type = raven_2_msgs::Constants::JOINT_TYPE_ELBOW; break;
-			case Joint::IdType::INSERTION_: joint_state.type = raven_2_msgs::Constants::JOINT_TYPE_INSERTION; break;
-			case Joint::IdType::ROTATION_: joint_state.type = raven_2_msgs::Constants::JOINT_TYPE_ROTATION; break;
-			case Joint::IdType::WRIST_: joint_state.type = raven_2_msgs::Constants::JOINT_TYPE_PITCH; break;
-			case Joint::IdType::FINGER1_: joint_state.type = raven_2_msgs::Constants::JOINT_TYPE_GRASP_FINGER1; break;
-			case Joint::IdType::FINGER2_: joint_state.type = raven_2_msgs::Constants::JOINT_TYPE_GRASP_FINGER2; break;
+			case Joint::IdType::SHOULDER_: joint_type = raven_2_msgs::Constants::JOINT_TYPE_SHOULDER; break;
+			case Joint::IdType::ELBOW_: joint_type = raven_2_msgs::Constants::JOINT_TYPE_ELBOW; break;
+			case Joint::IdType::INSERTION_: joint_type = raven_2_msgs::Constants::JOINT_TYPE_INSERTION; break;
+			case Joint::IdType::ROTATION_: joint_type = raven_2_msgs::Constants::JOINT_TYPE_ROTATION; break;
+			case Joint::IdType::WRIST_: joint_type = raven_2_msgs::Constants::JOINT_TYPE_PITCH; break;
+			case Joint::IdType::FINGER1_: joint_type = raven_2_msgs::Constants::JOINT_TYPE_GRASP_FINGER1; break;
+			case Joint::IdType::FINGER2_: joint_type = raven_2_msgs::Constants::JOINT_TYPE_GRASP_FINGER2; break;
 			default: continue;
 			}
+			raven_2_msgs::JointState& joint_state = messageSlot(arm_state.joints,numJoints++);
+			joint_state.type = joint_type;
 
 			switch (joint->state().index()) {
 			case jstate_not_ready: joint_state.state = raven_2_msgs::JointState::STATE_NOT_READY; break;
@@ -1393,12 +1298,10 @@ raven_2_msgs::RavenState publish_new_device() {
 			 */
 
 			joint_state.command = joint_cmd;
-
-			arm_state.joints.push_back(joint_state);
 		}
 
-		raven_2_msgs::JointState yaw_state;
-		raven_2_msgs::JointState grasp_state;
+		raven_2_msgs::JointState& yaw_state = messageSlot(arm_state.joints,numJoints++);
+		raven_2_msgs::JointState& grasp_state = messageSlot(arm_state.joints,numJoints++);
 		yaw_state.type = raven_2_msgs::Constants::JOINT_TYPE_YAW;
 		grasp_state.type = raven_2_msgs::Constants::JOINT_TYPE_GRASP;
 
@@ -1419,11 +1322,9 @@ raven_2_msgs::RavenState publish_new_device() {
 
 		grasp_state.position = arm->getJointById(Joint::IdType::GRASP_)->position();
 
-		arm_state.joints.push_back(yaw_state);
-		arm_state.joints.push_back(grasp_state);
-
-		raven_state.arms.push_back(arm_state);
+		messageResize(arm_state.joints,numJoints);
 	}
+	messageResize(raven_state.arms,numArms);
 
 	pub_raven_state_test.publish(raven_state);
 
@@ -1431,72 +1332,27 @@ raven_2_msgs::RavenState publish_new_device() {
 	return raven_state;
 }
 
-void publish_command_pose(struct robot_device* device0) {
-	static ros::Time last_pub;
-	static ros::Duration interval(0.1);
-	static ros::Duration since_last_pub;
-	if (!checkRate(last_pub,interval,since_last_pub)) { return; }
-
-#ifdef USE_NEW_DEVICE
-	ros::Time now = Device::currentTimestamp();
-#else
-	ros::Time now = ros::Time::now();
-#endif
-
-	geometry_msgs::PoseArray command_pose_array;
-	command_pose_array.header.stamp = now;
-	command_pose_array.header.frame_id = "/0_link";
-
-	geometry_msgs::PoseStamped command_pose;
-	command_pose.header = command_pose_array.header;
-
-		mechanism* _mech = NULL;
-	int mechnum = 0;
-	while (loop_over_mechs(device0,_mech,mechnum)) {
-		int armId = armIdFromMechType(_mech->type);
-		btTransform pose;
-
-		btVector3 pos = btVector3((float)_mech->pos_d.x,(float)_mech->pos_d.y,(float)_mech->pos_d.z)/MICRON_PER_M;
-		btQuaternion rot;
-		(toBt(_mech->ori_d.R) * TOOL_POSE_AXES_TRANSFORM.getBasis()).getRotation(rot);
-		pose = btTransform(rot,pos);
-
-		//pose = ik_world_to_actual_world(armId) * pose * Tg.inverse();
+// Per-arm poses; only used from buildPublishFrame()
+static MessagePool<geometry_msgs::PoseStamped> pose_stamped_pool;
 
-		tf::poseTFToMsg(pose,command_pose.pose);
+void buildToolPoses(PublishFrame& frame) {
+	static MessagePool<geometry_msgs::PoseArray> pose_array_pool;
+	struct robot_device* device0 = &frame.snapshot.device;
 
-		command_pose_array.poses.push_back(command_pose.pose);
-
-		pub_tool_pose_command[armId].publish(command_pose);
-	}
-
-	pub_tool_pose_command_array.publish(command_pose_array);
-}
-
-void publish_tool_pose(struct robot_device* device0) {
-	static ros::Time last_pub;
-	static ros::Duration interval(0.1);
-	static ros::Duration since_last_pub;
-	if (!checkRate(last_pub,interval,since_last_pub)) { return; }
-
-#ifdef USE_NEW_DEVICE
-	ros::Time now = Device::currentTimestamp();
-#else
-	ros::Time now = ros::Time::now();
-#endif
-
-	geometry_msgs::PoseArray tool_pose_array;
-	tool_pose_array.header.stamp = now;
-	tool_pose_array.header.frame_id = "/0_link";
-
-	geometry_msgs::PoseStamped tool_pose;
-	tool_pose.header = tool_pose_array.header;
+	pose_array_pool.renew(frame.tool_poses);
+	pose_array_pool.renew(frame.command_poses);
+	frame.tool_poses->header = frame.header;
+	frame.command_poses->header = frame.header;
 
+	frame.numArms = 0;
 	mechanism* _mech = NULL;
 	int mechnum = 0;
 	while (loop_over_mechs(device0,_mech,mechnum)) {
-		int armId = armIdFromMechType(_mech->type);
+		int i = frame.numArms++;
+		frame.armIds[i] = armIdFromMechType(_mech->type);
+
 		btTransform pose;
+		geometry_msgs::Pose& pose_msg = messageSlot(frame.tool_poses->poses,i);
 
 		btVector3 pos = btVector3((float)_mech->pos.x,(float)_mech->pos.y,(float)_mech->pos.z)/MICRON_PER_M;
 		btQuaternion rot;
@@ -1522,47 +1378,46 @@ void publish_tool_pose(struct robot_device* device0) {
 				* TOOL_POSE_AXES_TRANSFORM;
 		*/
 
-		tf::poseTFToMsg(pose,tool_pose.pose);
-
-		tool_pose_array.poses.push_back(tool_pose.pose);
+		tf::poseTFToMsg(pose,pose_msg);
 
-		pub_tool_pose[armId].publish(tool_pose);
-	}
-
-	pub_tool_pose_array.publish(tool_pose_array);
-}
+		pose_stamped_pool.renew(frame.tool_pose[i]);
+		frame.tool_pose[i]->header = frame.header;
+		frame.tool_pose[i]->pose = pose_msg;
 
-void publish_master_pose(struct robot_device* device0) {
-	static ros::Time last_pub;
-	static ros::Duration interval(0.1);
-	static ros::Duration since_last_pub;
-	if (!checkRate(last_pub,interval,since_last_pub)) { return; }
+		geometry_msgs::Pose& command_msg = messageSlot(frame.command_poses->poses,i);
 
-	btQuaternion q;
+		pos = btVector3((float)_mech->pos_d.x,(float)_mech->pos_d.y,(float)_mech->pos_d.z)/MICRON_PER_M;
+		(toBt(_mech->ori_d.R) * TOOL_POSE_AXES_TRANSFORM.getBasis()).getRotation(rot);
+		pose = btTransform(rot,pos);
 
-#ifdef USE_NEW_DEVICE
-	ros::Time now = Device::currentTimestamp();
-#else
-	ros::Time now = ros::Time::now();
-#endif
+		tf::poseTFToMsg(pose,command_msg);
 
-	geometry_msgs::PoseStamped master_pose;
-	master_pose.header.stamp = now;
-	master_pose.header.frame_id = "/0_link";
+		pose_stamped_pool.renew(frame.command_pose[i]);
+		frame.command_pose[i]->header = frame.header;
+		frame.command_pose[i]->pose = command_msg;
+	}
+	messageResize(frame.tool_poses->poses,frame.numArms);
+	messageResize(frame.command_poses->poses,frame.numArms);
+}
 
-	geometry_msgs::PoseStamped master_pose_raw;
-	master_pose_raw.header = master_pose.header;
+void buildMasterPoses(PublishFrame& frame) {
+	const PublishSnapshot& s = frame.snapshot;
+	btQuaternion q;
 
-	mechanism* _mech = NULL;
-	int mechnum = 0;
-	while (loop_over_mechs(device0,_mech,mechnum)) {
-		int armId = armIdFromMechType(_mech->type);
+	for (int i=0;i<frame.numArms;i++) {
+		int armId = frame.armIds[i];
+		pose_stamped_pool.renew(frame.master_pose[i]);
+		pose_stamped_pool.renew(frame.master_pose_raw[i]);
+		geometry_msgs::PoseStamped& master_pose = *frame.master_pose[i];
+		geometry_msgs::PoseStamped& master_pose_raw = *frame.master_pose_raw[i];
+		master_pose.header = frame.header;
+		master_pose_raw.header = frame.header;
 
-		master_pose.pose.position.x = master_position[armId].x();
-		master_pose.pose.position.y = master_position[armId].y();
-		master_pose.pose.position.z = master_position[armId].z();
+		master_pose.pose.position.x = s.master_position[armId].x();
+		master_pose.pose.position.y = s.master_position[armId].y();
+		master_pose.pose.position.z = s.master_position[armId].z();
 
-		master_orientation[armId].getRotation(q);
+		s.master_orientation[armId].getRotation(q);
 
 		master_pose.pose.orientation.x = q.x();
 		master_pose.pose.orientation.y = q.y();
@@ -1570,77 +1425,86 @@ void publish_master_pose(struct robot_device* device0) {
 		master_pose.pose.orientation.w = q.w();
 
 
-		master_pose_raw.pose.position.x = master_raw_position[armId].x();
-		master_pose_raw.pose.position.y = master_raw_position[armId].y();
-		master_pose_raw.pose.position.z = master_raw_position[armId].z();
+		master_pose_raw.pose.position.x = s.master_raw_position[armId].x();
+		master_pose_raw.pose.position.y = s.master_raw_position[armId].y();
+		master_pose_raw.pose.position.z = s.master_raw_position[armId].z();
 
-		master_raw_orientation[armId].getRotation(q);
+		s.master_raw_orientation[armId].getRotation(q);
 
 		master_pose_raw.pose.orientation.x = q.x();
 		master_pose_raw.pose.orientation.y = q.y();
 		master_pose_raw.pose.orientation.z = q.z();
 		master_pose_raw.pose.orientation.w = q.w();
-
-		pub_master_pose[armId].publish(master_pose);
-		pub_master_pose_raw[armId].publish(master_pose_raw);
 	}
 }
 
 /**
-*   publish_joints() - publish joint angles to visualization
+*   jointStateNames() - names for buildJoints(), in the same order
 */
-void publish_joints(struct robot_device* device0){
+void jointStateNames(struct robot_device* device0,std::vector<std::string>& names) {
+    mechanism* _mech=NULL;
+    DOF* _joint=NULL;
+    int mechnum, jnum;
 
-    static int count=0;
-    static ros::Time last_pub;
-    static ros::Duration interval(0.01);
-    static ros::Duration since_last_pub;
-    if (!checkRate(last_pub,interval,since_last_pub)) { return; }
+    names.clear();
+    while (loop_over_mechs(device0,_mech,mechnum)) {
+    	_joint = NULL;
+    	std::string armName = rosArmName(armIdFromMechType(_mech->type));
+    	while (loop_over_joints(_mech,_joint,jnum)) {
+    		names.push_back(rosJointName(jointTypeFromCombinedType(_joint->type)) + "_" + armName);
+    	}
+    	names.push_back("grasper_yaw_" + armName);
+    	names.push_back("grasper_" + armName);
+    }
 
-#ifdef USE_NEW_DEVICE
-	ros::Time now = Device::currentTimestamp();
-#else
-	ros::Time now = ros::Time::now();
-#endif
+    _mech=NULL;
+    _joint=NULL;
+    while (loop_over_mechs(device0,_mech,mechnum)) {
+    	_joint = NULL;
+    	std::string armName = rosArmName(armIdFromMechType(_mech->type));
+    	while (loop_over_joints(_mech,_joint,jnum)) {
+    		names.push_back(rosJointName(jointTypeFromCombinedType(_joint->type)) + "_" + armName + "2");
+    	}
+    	names.push_back("grasper_yaw_" + armName + "2");
+    	names.push_back("grasper_" + armName + "2");
+    }
+}
 
-    sensor_msgs::JointState joint_state;
-    //update joint_state
-    joint_state.header.stamp = now;
-//    joint_state.name.resize(32);
-//    joint_state.position.resize(32);
-//    joint_state.name.resize(14);
-//    joint_state.position.resize(14);
-    int left, right;
-    if (device0->mech[0].type == GOLD_ARM) {
-        left = 0;
-        right = 1;
-    } else {
-        left = 1;
-        right = 0;
+/**
+*   buildJoints() - joint angles for visualization
+*/
+void buildJoints(PublishFrame& frame) {
+    static MessagePool<sensor_msgs::JointState> pool;
+    static std::vector<std::string> names;
+
+    struct robot_device* device0 = &frame.snapshot.device;
+    if (names.empty()) {
+    	jointStateNames(device0,names);
     }
 
+    pool.renew(frame.joint_state);
+    sensor_msgs::JointState& joint_state = *frame.joint_state;
+    joint_state.header.stamp = frame.header.stamp;
+
     mechanism* _mech=NULL;
     DOF* _joint=NULL;
     int mechnum, jnum;
     int grasp1_index, grasp2_index;
+    size_t j = 0;
 
     grasp1_index=-1;
 	grasp2_index=-1;
     while (loop_over_mechs(device0,_mech,mechnum)) {
     	_joint = NULL;
-    	std::string armName = rosArmName(armIdFromMechType(_mech->type));
     	while (loop_over_joints(_mech,_joint,jnum)) {
-    		joint_state.name.push_back(rosJointName(jointTypeFromCombinedType(_joint->type)) + "_" + armName);
-    		joint_state.position.push_back(_joint->jpos);
+    		messageSlot(joint_state.position,j++) = _joint->jpos;
     		switch (jointTypeFromCombinedType(_joint->type)) {
     		case GRASP1: grasp1_index = jnum; break;
     		case GRASP2: grasp2_index = jnum; break;
     		}
     	}
-    	joint_state.name.push_back("grasper_yaw_" + armName);
-    	joint_state.position.push_back(THY_MECH_FROM_FINGERS(armIdFromMechType(_mech->type),_mech->joint[grasp1_index].jpos,_mech->joint[grasp2_index].jpos));
-    	joint_state.name.push_back("grasper_" + armName);
-    	joint_state.position.push_back(rosGraspFromMech(armIdFromMechType(_mech->type),_mech->ori.grasp));
+    	messageSlot(joint_state.position,j++) = THY_MECH_FROM_FINGERS(armIdFromMechType(_mech->type),_mech->joint[grasp1_index].jpos,_mech->joint[grasp2_index].jpos);
+    	messageSlot(joint_state.position,j++) = rosGraspFromMech(armIdFromMechType(_mech->type),_mech->ori.grasp);
     }
 
     _mech=NULL;
@@ -1650,24 +1514,60 @@ void publish_joints(struct robot_device* device0){
     grasp2_index=-1;
     while (loop_over_mechs(device0,_mech,mechnum)) {
     	_joint = NULL;
-    	std::string armName = rosArmName(armIdFromMechType(_mech->type));
     	while (loop_over_joints(_mech,_joint,jnum)) {
-    		joint_state.name.push_back(rosJointName(jointTypeFromCombinedType(_joint->type)) + "_" + armName + "2");
-    		joint_state.position.push_back(_joint->jpos_d);
+    		messageSlot(joint_state.position,j++) = _joint->jpos_d;
     		switch (jointTypeFromCombinedType(_joint->type)) {
     		case GRASP1: grasp1_index = jnum; break;
     		case GRASP2: grasp2_index = jnum; break;
     		}
     	}
-    	joint_state.name.push_back("grasper_yaw_" + armName + "2");
-    	joint_state.position.push_back(THY_MECH_FROM_FINGERS(armIdFromMechType(_mech->type),_mech->joint[grasp1_index].jpos_d,_mech->joint[grasp2_index].jpos_d));
-    	joint_state.name.push_back("grasper_" + armName + "2");
-    	joint_state.position.push_back(rosGraspFromMech(armIdFromMechType(_mech->type),_mech->ori_d.grasp));
+    	messageSlot(joint_state.position,j++) = THY_MECH_FROM_FINGERS(armIdFromMechType(_mech->type),_mech->joint[grasp1_index].jpos_d,_mech->joint[grasp2_index].jpos_d);
+    	messageSlot(joint_state.position,j++) = rosGraspFromMech(armIdFromMechType(_mech->type),_mech->ori_d.grasp);
     }
+    messageResize(joint_state.position,j);
 
-    //Publish the joint states
-    joint_publisher.publish(joint_state);
+    // a pooled message keeps its names once it has them
+    if (joint_state.name.size() != names.size()) {
+    	joint_state.name = names;
+    	publishAllocated();
+    }
+}
 
+void buildPublishFrame(PublishFrame& frame) {
+	fillHeader(frame.header,frame.snapshot);
+	buildRavenState(frame);
+	buildToolPoses(frame);
+	buildMasterPoses(frame);
+	buildJoints(frame);
+}
+
+void publish_command_pose(const PublishFrame& frame) {
+	if (frame.snapshot.estop) { return; }
+
+	for (int i=0;i<frame.numArms;i++) {
+		pub_tool_pose_command[frame.armIds[i]].publish(frame.command_pose[i]);
+	}
+
+	pub_tool_pose_command_array.publish(frame.command_poses);
+}
+
+void publish_tool_pose(const PublishFrame& frame) {
+	for (int i=0;i<frame.numArms;i++) {
+		pub_tool_pose[frame.armIds[i]].publish(frame.tool_pose[i]);
+	}
+
+	pub_tool_pose_array.publish(frame.tool_poses);
+}
+
+void publish_master_pose(const PublishFrame& frame) {
+	for (int i=0;i<frame.numArms;i++) {
+		pub_master_pose[frame.armIds[i]].publish(frame.master_pose[i]);
+		pub_master_pose_raw[frame.armIds[i]].publish(frame.master_pose_raw[i]);
+	}
+}
+
+void publish_joints(const PublishFrame& frame) {
+	joint_publisher.publish(frame.joint_state);
 }
 
 int init_pubs(ros::NodeHandle &n,struct robot_device *device0) {
@@ -1696,6 +1596,8 @@ int init_pubs(ros::NodeHandle &n,struct robot_device *device0) {
 		pub_master_pose_raw[armId] = n.advertise<geometry_msgs::PoseStamped>( MASTER_POSE_RAW_TOPIC(armName), 1);
 	}
 
+	pub_traj_status = n.advertise<raven_2_msgs::RavenTrajectoryStatus>(RAVEN_COMMAND_TRAJECTORY_STATUS_TOPIC, 10);
+
 	vis_pub1 = n.advertise<visualization_msgs::Marker>( "visualization_marker1", 0 );
 	vis_pub2 = n.advertise<visualization_msgs::Marker>( "visualization_marker2", 0 );
 
@@ -1703,13 +1605,22 @@ int init_pubs(ros::NodeHandle &n,struct robot_device *device0) {
 	pub_ravenstate_old = n.advertise<raven_state>("ravenstate_old", 1000);
 #endif
 
+	PublishScheduler::addTopic(RAVEN_STATE_TOPIC,RavenConfig.state_publish_rate,publish_raven_state);
+	PublishScheduler::addSampleTopic(RAVEN_1000HZ_STATE_TOPIC,RavenConfig.fast_state_publish_rate,publish_fast_states);
+	PublishScheduler::addTopic("joint_states",RavenConfig.joint_states_publish_rate,publish_joints);
+	PublishScheduler::addTopic(TOOL_POSE_TOPIC,RavenConfig.tool_pose_publish_rate,publish_tool_pose);
+	PublishScheduler::addTopic(TOOL_POSE_COMMAND_TOPIC,RavenConfig.command_pose_publish_rate,publish_command_pose);
+	PublishScheduler::addTopic(MASTER_POSE_TOPIC_BASE,RavenConfig.master_pose_publish_rate,publish_master_pose);
+	PublishScheduler::start();
+
 	return 0;
 }
 
 void init_subs(ros::NodeHandle &n,struct robot_device *device0) {
 	std::cout << "Initializing ros subscribers" << std::endl;
+	// cmd_callback uses it as soon as it is subscribed
+	tf_listener = new tf::TransformListener();
 	sub_raven_cmd = n.subscribe(RAVEN_COMMAND_TOPIC, 1, cmd_callback);
-	sub_traj_cmd = n.subscribe(RAVEN_COMMAND_TRAJECTORY_TOPIC, 1, cmd_trajectory_callback);
 	mechanism* _mech = NULL;
 	int mechnum = 0;
 	while (loop_over_mechs(device0,_mech,mechnum)) {
@@ -1719,8 +1630,178 @@ void init_subs(ros::NodeHandle &n,struct robot_device *device0) {
 		sub_grasp_cmd[armId] = n.subscribe<std_msgs::Float32>(RAVEN_COMMAND_GRASP_TOPIC(armName), 1, boost::bind(cmd_grasp_callback,_1,armId));
 		sub_tool_cmd[armId] = n.subscribe<raven_2_msgs::ToolCommandStamped>(RAVEN_COMMAND_TOOL_TOPIC(armName), 1, boost::bind(cmd_tool_callback,_1,armId));
 	}
+}
 
-	tf_listener = new tf::TransformListener();
+/*
+ * Batch kinematics services. These can take a while, so they get their own
+ * callback queue and spinner instead of being run by the spinOnce() in the rt loop.
+ */
+ros::CallbackQueue kinematics_queue;
+ros::ServiceServer srv_ik_batch;
+ros::ServiceServer srv_fk_batch;
+boost::shared_ptr<ros::AsyncSpinner> kinematics_spinner;
+
+// same frame change as the tool poses in publish_new_device()
+static const btMatrix3x3 kinematics_service_transform(1,0,0,  0,-1,0,  0,0,-1);
+
+ArmConstPtr findArmByNameOrType(DeviceConstPtr dev,const std::string& name) {
+	FOREACH_ARM_IN_CONST_DEVICE(arm,dev) {
+		if (arm->name() == name || arm->typeStringLower() == name) {
+			return arm;
+		}
+	}
+	return ArmConstPtr();
+}
+
+bool ik_batch_callback(raven_2_msgs::InverseKinematicsBatch::Request& req, raven_2_msgs::InverseKinematicsBatch::Response& res) {
+	DevicePtr dev = Device::current();
+	ArmConstPtr arm = findArmByNameOrType(dev,req.arm_name);
+	if (!arm) {
+		ROS_ERROR("Batch ik: unknown arm %s",req.arm_name.c_str());
+		return false;
+	}
+
+	std::vector<btTransform> poses(req.poses.size());
+	for (size_t i=0;i<req.poses.size();i++) {
+		poses[i] = fromRos(req.poses[i],kinematics_service_transform);
+	}
+	std::vector<float> grasps(req.grasps.begin(),req.grasps.end());
+
+	BatchKinematics batch(arm,req.num_threads);
+	BatchInverseKinematicsResult result;
+	batch.inverse(poses,grasps,result);
+	if (result.size() != poses.size()) {
+		return false;
+	}
+
+	ConstJointList joints = arm->joints();
+	for (size_t j=0;j<joints.size();j++) {
+		res.joint_names.push_back(joints[j]->id().str());
+	}
+	res.joint_positions.reserve(poses.size() * joints.size());
+	res.valid.resize(poses.size());
+	res.joints_outside_limits.resize(poses.size());
+	for (size_t i=0;i<poses.size();i++) {
+		unsigned int limits = 0;
+		for (size_t j=0;j<joints.size();j++) {
+			res.joint_positions.push_back(result.joints[i][j]);
+			if (result.jointsOutsideLimits[i] & jointLimitBit(joints[j]->id())) {
+				limits |= 1u << j;
+			}
+		}
+		res.valid[i] = result.valid[i];
+		res.joints_outside_limits[i] = limits;
+	}
+	return true;
+}
+
+bool fk_batch_callback(raven_2_msgs::ForwardKinematicsBatch::Request& req, raven_2_msgs::ForwardKinematicsBatch::Response& res) {
+	DevicePtr dev = Device::current();
+	ArmConstPtr arm = findArmByNameOrType(dev,req.arm_name);
+	if (!arm) {
+		ROS_ERROR("Batch fk: unknown arm %s",req.arm_name.c_str());
+		return false;
+	}
+
+	size_t numJoints = arm->joints().size();
+	if (numJoints == 0 || req.joint_positions.size() % numJoints != 0) {
+		ROS_ERROR("Batch fk: %d joint values is not a multiple of %d joints",(int)req.joint_positions.size(),(int)numJoints);
+		return false;
+	}
+
+	std::vector<Eigen::VectorXf> joints(req.joint_positions.size() / numJoints);
+	for (size_t i=0;i<joints.size();i++) {
+		joints[i] = Eigen::Map<const Eigen::VectorXf>(&req.joint_positions[i*numJoints],numJoints);
+	}
+
+	BatchKinematics batch(arm,req.num_threads);
+	std::vector<btTransform> poses;
+	batch.forward(joints,poses);
+
+	res.poses.resize(poses.size());
+	for (size_t i=0;i<poses.size();i++) {
+		res.poses[i] = toRos(poses[i],kinematics_service_transform);
+	}
+	return true;
+}
+
+/*
+ * Trajectory commands are converted and checked on their own spinner, so a long
+ * trajectory never holds up the rt loop. Streamed segments queue up rather than
+ * replacing each other.
+ */
+ros::CallbackQueue trajectory_queue;
+boost::shared_ptr<ros::AsyncSpinner> trajectory_spinner;
+
+bool validateTrajectory(const param_pass_trajectory& traj,std::string& error) {
+	DevicePtr dev = Device::current();
+	for (int mech_ind=0;mech_ind<NUM_MECH;mech_ind++) {
+		int arm_id = armIdFromSerial(USBBoards.boards[mech_ind]);
+		std::string armName = armNameFromId(arm_id);
+		ArmConstPtr arm = findArmByNameOrType(dev,armName);
+		if (!arm) {
+			continue;
+		}
+
+		// param_pass poses are already in the kinematics frame
+		std::vector<btTransform> poses(traj.pts.size());
+		std::vector<float> grasps(traj.pts.size());
+		for (size_t i=0;i<traj.pts.size();i++) {
+			const param_pass& p = traj.pts[i].param;
+			poses[i] = btTransform(toBt(p.rd[mech_ind]),toBt(p.xd[mech_ind]) / MICRON_PER_M);
+			grasps[i] = rosGraspFromMech(arm_id,p.rd[mech_ind].grasp);
+		}
+
+		BatchKinematics batch(arm);
+		BatchInverseKinematicsResult result;
+		batch.inverse(poses,grasps,result);
+		for (size_t i=0;i<result.size();i++) {
+			if (!result.valid[i]) {
+				std::stringstream ss;
+				ss << "no inverse kinematics solution for arm " << armName << " at point " << i;
+				error = ss.str();
+				return false;
+			}
+		}
+	}
+	return true;
+}
+
+void init_services(ros::NodeHandle &n) {
+	ros::NodeHandle kn(n);
+	kn.setCallbackQueue(&kinematics_queue);
+	srv_ik_batch = kn.advertiseService("inverse_kinematics_batch",ik_batch_callback);
+	srv_fk_batch = kn.advertiseService("forward_kinematics_batch",fk_batch_callback);
+	kinematics_spinner.reset(new ros::AsyncSpinner(1,&kinematics_queue));
+	kinematics_spinner->start();
+
+	ros::NodeHandle tn(n);
+	tn.setCallbackQueue(&trajectory_queue);
+	sub_traj_cmd = tn.subscribe(RAVEN_COMMAND_TRAJECTORY_TOPIC, 10, cmd_trajectory_callback);
+	trajectory_spinner.reset(new ros::AsyncSpinner(1,&trajectory_queue));
+	trajectory_spinner->start();
+}
+
+/*
+ * With --nodelet-manager, r2_control is also a nodelet manager, so the vision
+ * and teleop nodelets (or any other) can be loaded into it:
+ *   rosrun nodelet nodelet load raven_2_vision/ChessboardTracker r2_control
+ * Subscribers in the process get the pooled state messages by pointer, without
+ * serialization. The load/unload services run on their own spinner, and the
+ * nodelets' callbacks on the loader's worker threads, never the rt loop's
+ * spinOnce().
+ */
+ros::CallbackQueue nodelet_queue;
+boost::shared_ptr<ros::AsyncSpinner> nodelet_spinner;
+boost::shared_ptr<nodelet::Loader> nodelet_loader;
+
+void init_nodelet_manager() {
+	ros::NodeHandle ln("~");
+	ln.setCallbackQueue(&nodelet_queue);
+	nodelet_loader.reset(new nodelet::Loader(ln));
+	nodelet_spinner.reset(new ros::AsyncSpinner(1,&nodelet_queue));
+	nodelet_spinner->start();
+	ROS_INFO("Nodelet manager %s ready",ros::this_node::getName().c_str());
 }
 
 void init_ros_topics(ros::NodeHandle &n,struct robot_device *device0) {
@@ -1729,6 +1810,13 @@ void init_ros_topics(ros::NodeHandle &n,struct robot_device *device0) {
 	init_pubs(n,device0);
 }
 
+void init_ros_services(ros::NodeHandle &n) {
+	init_services(n);
+	if (RavenConfig.nodelet_manager) {
+		init_nodelet_manager();
+	}
+}
+
 void torqueCallback1(const torque_command::ConstPtr& torque_cmd) {
 	printf("torque callback!\n");
 	for (int i=0; i < 8; i++) {
@@ -36,12 +36,23 @@
 #include "control_process.h"
 #include "saveload.h"
 #include "homing.h"
+#include "status_service.h"
+#include "flight_recorder.h"
+#include "calibration.h"
+#include "latency.h"
 
 #include <raven/state/runlevel.h>
 #include <raven/util/timing.h>
 #include <raven/util/config.h>
+#include <raven/util/trace.h>
+#include <raven/util/metrics.h>
+#include <raven/util/startup.h>
+
+#include <boost/thread/thread.hpp>
 
 #include <raven/state/initializer.h>
+#include <raven/state/update_pipeline.h>
+#include <raven/kinematics/kinematics.h>
 
 #include <raven/control/controller.h>
 #include <raven/control/controllers/motor_position_pid.h>
@@ -50,7 +61,6 @@
 using namespace std;
 
 // Defines
-#define POOLSIZE (200*1024*1024) // 200 MB   Size of mlocked memory pool
 
 #define NS  1
 #define US  (1000 * NS)
@@ -78,6 +88,8 @@ pthread_t fiforcv_thread;
 pthread_t fifosend_thread;
 pthread_t console_thread;
 
+static MetricGauge over_time_ratio("r2_loop_over_time_ratio","Fraction of servo cycles since start whose work took over 1 ms (TimingInfo::PCT_OVER_TIME)");
+
 //Global Variables from globals.c
 extern struct DOF_type DOF_types[];
 
@@ -246,8 +258,11 @@ void printmat() {
 */
 int initialize_rt_memory_pool()
 {
+    StartupPhase phase("memory pool");
     int i, page_size;
     char* buffer;
+    // only what the process uses; see report_rt_memory_pool()
+    const int pool_size = Config::Options.memory_pool_mb * 1024 * 1024;
 
     // Now lock all current and future pages from preventing of being paged
     if (mlockall(MCL_CURRENT | MCL_FUTURE ))
@@ -259,11 +274,11 @@ int initialize_rt_memory_pool()
     mallopt (M_MMAP_MAX, 0);         // Turn off mmap usage.
 
     page_size = sysconf(_SC_PAGESIZE);
-    buffer = (char *)malloc(POOLSIZE);
+    buffer = (char *)malloc(pool_size);
 
     // Touch each page in this piece of memory to get it mapped into RAM for performance improvement
     // Once the pagefault is handled a page will be locked in memory and never given back to the system.
-    for (i=0; i < POOLSIZE; i+=page_size)
+    for (i=0; i < pool_size; i+=page_size)
     {
         buffer[i] = 0;
     }
@@ -272,6 +287,19 @@ int initialize_rt_memory_pool()
     return 0;
 }
 
+/**
+ * Logs how far the heap grew.  Past the pool, the growth was paged in while running.
+ */
+void report_rt_memory_pool()
+{
+    struct mallinfo info = mallinfo();  // with trimming off, arena never shrinks
+    double heap_mb = info.arena / (1024. * 1024.);
+    if (heap_mb > Config::Options.memory_pool_mb)
+        log_warn("Heap grew to %.1f MB, past the %d MB memory pool; raise --memory-pool-mb",heap_mb,Config::Options.memory_pool_mb);
+    else
+        log_msg("Heap grew to %.1f MB of the %d MB memory pool",heap_mb,Config::Options.memory_pool_mb);
+}
+
 void _outputTiming();
 void _outputLoopTiming(const TimingInfo& t_info);
 void _testUSBRead();
@@ -295,20 +323,28 @@ static void *rt_process(void* )
     struct timespec t;                           // Tracks the timer value
     int interval= 1 * MS;                        // task period in nanoseconds
 
-    //Lock thread to first available CPU
-    cpu_set_t set;
-    CPU_ZERO(&set);
-    CPU_SET(0,&set);
-    sched_setaffinity(0,sizeof(set),&set);
-
-    log_msg("Using realtime, priority: %d",96);
-    param.sched_priority = 96;
+    // so the first message from the loop doesn't allocate the log ring
+    log_prepare_thread();
+    trace_prepare_thread("rt_process");
 
-    // enable realtime fifo scheduling and set process priority
-    if (sched_setscheduler(0, SCHED_FIFO, &param)==-1)
+    // a replay runs flat out, so it stays an ordinary thread
+    if (!replaying())
     {
-        perror("sched_setscheduler failed");
-        exit(-1);
+        //Lock thread to first available CPU
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(0,&set);
+        sched_setaffinity(0,sizeof(set),&set);
+
+        log_msg("Using realtime, priority: %d",96);
+        param.sched_priority = 96;
+
+        // enable realtime fifo scheduling and set process priority
+        if (sched_setscheduler(0, SCHED_FIFO, &param)==-1)
+        {
+            perror("sched_setscheduler failed");
+            exit(-1);
+        }
     }
 
     log_msg("Starting RT Process...");
@@ -366,11 +402,24 @@ static void *rt_process(void* )
     ///TODO: Break loop when board becomes disconnected.
     //Only run while USB board is attached
     while (ros::ok()) {
-        /// SLEEP until next timer shot
-        clock_nanosleep(CLOCK_REALTIME, TIMER_ABSTIME, &t, NULL);
+        if (replaying()) {
+            // no sleep; the loop clock is the recorded one
+            if (!replayNextLoop()) {
+                break;
+            }
+        } else {
+            /// SLEEP until next timer shot
+            clock_nanosleep(CLOCK_REALTIME, TIMER_ABSTIME, &t, NULL);
+            LoopClock::set(ros::Time::now());
+        }
+        if (latencyBenchDone()) {
+            break;
+        }
         gTime++;
+        flightRecordLoopBegin(gTime);
         LoopNumber::incrementMain();
         int loopNumber = LoopNumber::get();
+        TRACE_SCOPE(TRACE_LOOP,"rt loop");
 
         struct timespec start;
         struct timespec end;
@@ -390,11 +439,11 @@ static void *rt_process(void* )
         LOOP_NUMBER_ONCE(__FILE__,__LINE__) {
         	Device::DEBUG_OUTPUT_TIMING = true;
         }
-        if (!RunLevel::hasHomed() && LoopNumber::onlyEvery("output usb device finish update timing",300,1000)) {
+        if (!RunLevel::hasHomed() && LoopNumber::onlyEvery(LOOP_NUMBER_SITE,300,1000)) {
         	printf("Outputting usb timing [%i]\n",loopNumber);
         	Device::DEBUG_OUTPUT_TIMING = true;
         }
-        if (RunLevel::hasHomed() && LoopNumber::onlyEvery("output usb after homing device finish update timing",4,5000)) {
+        if (RunLevel::hasHomed() && LoopNumber::onlyEvery(LOOP_NUMBER_SITE,4,5000)) {
         	printf("Outputting usb timing [%i]\n",loopNumber);
         	Device::DEBUG_OUTPUT_TIMING = true;
         }
@@ -402,7 +451,9 @@ static void *rt_process(void* )
 
         t_info.mark_usb_read_start();
         //Get and Process USB Packets
+        TRACE_BEGIN(TRACE_LOOP,"usb read");
         getUSBPackets(&device0); //disable usb for parport test
+        TRACE_END(TRACE_LOOP,"usb read");
         t_info.mark_usb_read_end();
 
 #ifdef USE_NEW_DEVICE
@@ -416,7 +467,9 @@ static void *rt_process(void* )
 
         t_info.mark_state_machine_start();
         //Run Safety State Machine
+        TRACE_BEGIN(TRACE_LOOP,"state machine");
         stateMachine(&device0, &currParams, &rcvdParams);
+        TRACE_END(TRACE_LOOP,"state machine");
         t_info.mark_state_machine_end();
 
         TRACER_OFF();
@@ -424,12 +477,17 @@ static void *rt_process(void* )
         t_info.mark_update_state_start();
         //Update Atmel Input Pins
 
+        TRACE_BEGIN(TRACE_LOOP,"update state");
         updateAtmelInputs(device0, currParams.runlevel);
         //Get state updates from master
-        if ( getRcvdParams(&rcvdParams))
+        teleopJitterTick();
+        bool rcvd = replaying() ? replayRcvdParams(&rcvdParams) : getRcvdParams(&rcvdParams);
+        flightRecordRcvdParams(rcvd, &rcvdParams);
+        if (rcvd)
             updateDeviceState(&currParams, &rcvdParams, &device0);
         else
             rcvdParams.runlevel = currParams.runlevel;
+        TRACE_END(TRACE_LOOP,"update state");
         t_info.mark_update_state_end();
 
         //Clear DAC Values (set current_cmd to zero on all joints)
@@ -437,6 +495,7 @@ static void *rt_process(void* )
 
         t_info.mark_control_start();
         // Calculate Raven control
+        TRACE_BEGIN(TRACE_LOOP,"control");
         if (!RunLevel::hasHomed()) {
         	controlRaven(&device0, &currParams);
         } else {
@@ -448,12 +507,12 @@ static void *rt_process(void* )
         		printf("***Newly homed! [%i]\n",loopNumber);
         		scope_tracer_on = true;
         	}
-        	if (LoopNumber::onlyEvery("tracer control",5,1000)) {
+        	if (LoopNumber::onlyEvery(LOOP_NUMBER_SITE,5,1000)) {
         		//scope_tracer_on = true;
         	}
         	TRACER_ON_IN_SCOPE_IF(scope_tracer_on);
         	*/
-        	if (RunLevel::newlyHomed() || LoopNumber::onlyEvery("output device finish update timing",4,5000)) {
+        	if (RunLevel::newlyHomed() || LoopNumber::onlyEvery(LOOP_NUMBER_SITE,4,5000)) {
         		Device::DEBUG_OUTPUT_TIMING = true;
         		if (Device::DEBUG_OUTPUT_TIMING) printf("Outputting controller timing [%i]\n",loopNumber);
 
@@ -467,11 +526,11 @@ static void *rt_process(void* )
         		printf("HAS HOMED %i\n",LoopNumber::get());
         	}
 #ifdef TEST_NEW_CONTROLLER
-        	OldControlInputPtr ptr = ControlInput::oldControlInputUpdateBegin();
+        	OldControlInputPtr ptr = ControlInput::oldControlInputRtUpdateBegin();
         	FOREACH_ARM_IN_DEVICE(arm,Device::currentNoClone()) {
         		ptr->armById(arm->id()).pose() = arm->pose();
         	}
-        	ControlInput::oldControlInputUpdateEnd();
+        	ControlInput::oldControlInputRtUpdateEnd();
 
         	int ctrl_ret = Controller::executeInProcessControl();
 
@@ -506,24 +565,38 @@ static void *rt_process(void* )
         // Check for overcurrent and impose safe torque limits
         if (overdriveDetect(&device0,currParams.runlevel)) {
             log_warn("Setting soft e stop");
+            statusCountFault(STATUS_FAULT_OVERDRIVE);
             RunLevel::eStop();
         }
 
+        TRACE_END(TRACE_LOOP,"control");
         t_info.mark_control_end();
 
         t_info.mark_usb_write_start();
         //Update Atmel Output Pins
+        TRACE_BEGIN(TRACE_LOOP,"usb write");
         updateAtmelOutputs(&device0, currParams.runlevel);
 
         //Fill USB Packet and send it out
         putUSBPackets(&device0); //disable usb for par port test
+        TRACE_END(TRACE_LOOP,"usb write");
         t_info.mark_usb_write_end();
 
+        //Report master packet -> DAC latency for the packets that went out with this write
+        TeleopRxStamp rx_stamp;
+        if (getRcvdTeleopStamp(&rx_stamp)) {
+            networkRecordDacWrite(rx_stamp);
+        }
+        networkQueueFeedback(&device0);
+        flightRecordLoopEnd();
+
         t_info.mark_ros_start();
         //Publish current raven state
+        TRACE_BEGIN(TRACE_LOOP,"ros");
         publish_ros(&device0,currParams);   // from local_io
 
         ros::spinOnce();
+        TRACE_END(TRACE_LOOP,"ros");
 
         t_info.mark_ros_end();
 
@@ -538,8 +611,11 @@ static void *rt_process(void* )
         //bool over_time = t_info.overall() > ros::Duration(1./1000);
         if (over_time) {
         	TimingInfo::NUM_OVER_TIME += 1;
+        	statusCountFault(STATUS_FAULT_OVER_TIME);
         }
+        statusRecordLoop(start_ns,end_ns);
         TimingInfo::PCT_OVER_TIME = ((float)TimingInfo::NUM_OVER_TIME) / loopNumber;
+        over_time_ratio.set(TimingInfo::PCT_OVER_TIME);
 
         //clock interrupt on 1ms boundaries
         int64_t t_ns;
@@ -565,6 +641,7 @@ static void *rt_process(void* )
 /**Initialize by initializing usb boards, etc*/
 int init_module(void)
 {
+    StartupPhase phase("boards");
     log_msg("Initializing USB I/O...");
 
     //Initialize USB Board
@@ -581,43 +658,85 @@ int init_module(void)
     return 0;
 }
 
-int init_ros(int& argc, char**& argv)
+int init_ros(const RavenGains& gains)
 {
     /**
     * Initialize ros and rosrt
     */
+    StartupPhase phase("ros");
 	log_msg("Initializing ROS...");
-    ros::init(argc, argv, "r2_control");
     ros::NodeHandle n;
 //    rosrt::init();
-    init_ravengains(n, &device0);
+    apply_ravengains(gains, &device0);
     saveDOFInfo();
+    // before the rt loop, whose spinOnce() runs the subscriber callbacks
     init_ros_topics(n,&device0);
 
     return 0;
 }
 
+/**
+ * The services, trajectory subscriber and nodelet manager run on spinners of their own,
+ * never the rt loop's, so they come up while it runs.
+ */
+static void init_ros_services_process()
+{
+    StartupPhase phase("ros services");
+    ros::NodeHandle n;
+    init_ros_services(n);
+}
+
+static void init_module_process(int* status)
+{
+    *status = init_module();
+}
+
+static void fetch_gains_process(RavenGains* gains)
+{
+    StartupPhase phase("gains");
+    ros::NodeHandle n;
+    if (fetch_ravengains(n, *gains))
+        saveGains(*gains);
+}
+
+/**
+ * Started with --gains-cache: read the parameter server now that the loop is running
+ * and refresh the cache if its gains changed.  They are not switched under the running loop.
+ */
+static void refresh_gains_process(RavenGains cached)
+{
+    struct sched_param param;
+    param.sched_priority = 0;
+    sched_setscheduler(0, SCHED_OTHER, &param);
+    setpriority(PRIO_PROCESS, 0, 10);
+
+    ros::NodeHandle n;
+    RavenGains gains;
+    if (!fetch_ravengains(n, gains))
+    {
+        log_warn("Keeping the cached gains");
+        return;
+    }
+    if (memcmp(&gains, &cached, sizeof(gains)) == 0)
+        return;
+    saveGains(gains);
+    log_err("Gains on the parameter server changed since they were cached; running on the cached gains. "
+            "Restart r2_control to use the new ones, or start without --gains-cache");
+}
+
 int main(int argc, char **argv)
 {
+    StartupPhase options_phase("options");
 	printmat();
 
 	//signal( SIGINT,&sigTrap);                // catch ^C for graceful close.  Unused under ROS
     ioperm(PORT,1,1);                        // set parallelport permissions
-    if ( init_module() )
-    {
-        cerr << "ERROR! Failed to init module.  Exiting.\n";
-        exit(1);
-    }
-    if ( init_ros(argc, argv) )
-    {
-        cerr << "ERROR! Failed to init ROS.  Exiting.\n";
-        exit(1);
-    }
-    if ( initialize_rt_memory_pool() )
-    {
-        cerr << "ERROR! Failed to init memory_pool.  Exiting.\n";
-        exit(1);
-    }
+
+    // ros::init strips the ROS remapping arguments, so it goes before our own parsing;
+    // the options have to be read before the USB boards are set up (--sim-usb)
+    ros::init(argc, argv, "r2_control");
+    // keeps the node up while no NodeHandle exists, between the startup phases
+    ros::start();
 
     rosx::Parser parser;
 	parser.addGroup(Config::Options);
@@ -650,21 +769,112 @@ int main(int argc, char **argv)
 		*/
 	}
 
-    pthread_create(&net_thread, NULL, network_process, NULL); //Start the network thread
+    if (!Config::Options.replay_file.empty() && !replayOpen(Config::Options.replay_file))
+    {
+        cerr << "ERROR! Failed to open the recording.  Exiting.\n";
+        exit(1);
+    }
+    options_phase.end();
+
+    // The boards, the gains and the memory pool don't depend on each other, so they come up together.
+    // The pool stays on this thread so it is prefaulted in the main malloc arena.
+    int module_status = 0;
+    boost::thread module_thread(init_module_process, &module_status);
+    RavenGains gains;
+    bool gains_cached = Config::Options.gains_cache && loadGains(gains);
+    boost::thread* gains_thread = NULL;
+    if (!gains_cached)
+        gains_thread = new boost::thread(fetch_gains_process, &gains);
+    if ( initialize_rt_memory_pool() )
+    {
+        cerr << "ERROR! Failed to init memory_pool.  Exiting.\n";
+        exit(1);
+    }
+    module_thread.join();
+    if ( module_status )
+    {
+        cerr << "ERROR! Failed to init module.  Exiting.\n";
+        exit(1);
+    }
+    if (gains_thread)
+    {
+        gains_thread->join();
+        delete gains_thread;
+    }
+    else
+    {
+        log_msg("Using the cached gains; checking them against the parameter server after startup");
+    }
+
+    // needs the boards; the services are set up once the loop runs
+    if ( init_ros(gains) )
+    {
+        cerr << "ERROR! Failed to init ROS.  Exiting.\n";
+        exit(1);
+    }
+
+    // from here on messages are written by the log thread; failures above still get out before exit()
+    if (!Config::Options.sync_log) {
+        log_start_async();
+    }
+    if (!Config::Options.trace_file.empty()) {
+        trace_start();
+    }
+    if (!Config::Options.status_socket.empty()) {
+        initStatusService(Config::Options.status_socket);
+    }
+    if (Config::Options.metrics_port > 0 || !Config::Options.metrics_socket.empty()) {
+        MetricsExporter::start(Config::Options.metrics_port,Config::Options.metrics_socket);
+    }
+
+    if (!Config::Options.record_file.empty() && !replaying()) {
+        flightRecorderStart(Config::Options.record_file);
+    }
+    // the rt thread saves the offsets once homed
+    calibrationWriterStart();
+    if (Config::Options.latency_bench > 0) {
+        latencyBenchStart(Config::Options.latency_bench, Config::Options.latency_bench_load);
+    }
+
+    // a replay takes the master commands and keys from the recording
+    if (!replaying()) {
+        pthread_create(&net_thread, NULL, network_process, NULL); //Start the network thread
+    }
 //    pthread_create(&fiforcv_thread, NULL, data_fifo_rcv_process, NULL); //Start the    thread
 //    pthread_create(&fifosend_thread, NULL, data_fifo_send_process, NULL); //Start the   thread
-    pthread_create(&console_thread, NULL, console_process, NULL); //Start the     thread
+    if (!Config::Options.no_console && !replaying()) {
+        pthread_create(&console_thread, NULL, console_process, NULL); //Start the     thread
+    }
     //pthread_create(&control_thread, NULL, control_process, NULL);
     pthread_create(&rt_thread, NULL, rt_process, NULL); //Start the   thread
 
+    boost::thread ros_services_thread(init_ros_services_process);
+    ros_services_thread.join();
+    StartupPhase::report();
+    if (gains_cached)
+        boost::thread(refresh_gains_process, gains).detach();
+
     //ros::spin();
 
     pthread_join(rt_thread,NULL); //Suspend main until rt thread terminates
+    unsigned long replay_differences = replayReport();
+    latencyBenchReport();
+    flightRecorderStop();
+    calibrationWriterStop();
+    report_rt_memory_pool();
+    if (RavenConfig.use_incremental_ik)
+        KinematicSolver::incrementalStats().log();
 
     log_msg("\n\n\nI'm shutting down now... Please close the USB!\n\n\n");
+    stopStatusService();
+    MetricsExporter::stop();
+    if (!Config::Options.trace_file.empty()) {
+        trace_write_chrome(Config::Options.trace_file);
+    }
+    log_stop_async();
     usleep(1e6); //Sleep for 1 second
 
-    exit(0);
+    exit(replay_differences ? 1 : 0);
 }
 
 /********************* Utility functions *************************/
@@ -705,6 +915,7 @@ void _outputTiming() {
 	printf("\tarm_hue_green:\t\t%7lli\n",(long long int)TempTiming::arm_hue_green.toNSec());
 
 	printf("dev_ifu:\t\t\t%7lli\n",(long long int)TempTiming::dev_ifu.toNSec());
+	printf("%s\n",UpdatePipeline::statsString().c_str());
 }
 
 void _testUSBRead() {
@@ -838,9 +1049,9 @@ void _testClone() {
 
 void _outputLoopTiming(const TimingInfo& t_info) {
 	bool printTiming =
-			LoopNumber::only("rt_proc print timing",2)
+			LoopNumber::only(LOOP_NUMBER_SITE,2)
 	|| RunLevel::newlyHomed()
-	|| (TimingInfo::cn_overall_max_all() > ros::Duration(0.001) && LoopNumber::once("ctrl max'd"))
+	|| (TimingInfo::cn_overall_max_all() > ros::Duration(0.001) && LoopNumber::once(LOOP_NUMBER_SITE))
 	|| t_info.cn_overall() > ros::Duration(0.001);
 
 	if (printTiming) {
@@ -57,6 +57,7 @@ typedef int(*controller)(struct device*,struct param_pass*);
 int raven_cartesian_space_command (struct device *device0, struct param_pass *currParams);
 int raven_joint_velocity_control  (struct device *device0, struct param_pass *currParams);
 int raven_motor_position_control  (struct device *device0, struct param_pass *currParams);
+int raven_motor_position_setpoint_control(struct device *device0, struct param_pass *currParams);
 int raven_homing                  (struct device *device0, struct param_pass *currParams, int begin_homing=0);
 int applyTorque                   (struct device *device0, struct param_pass *currParams);
 int raven_sinusoidal_joint_motion (struct device *device0, struct param_pass *currParams);
@@ -91,6 +92,8 @@ controller getController(t_controlmode mode) {
 	case motor_pd_control:
 //		initialized = false;
 		return &raven_motor_position_control;
+	case motor_position_control:
+		return &raven_motor_position_setpoint_control;
 	case joint_velocity_control:
 //		initialized = false;
 		return &raven_joint_velocity_control;
@@ -372,14 +375,21 @@ int raven_cartesian_space_command(struct device *device0, struct param_pass *cur
     	}
     	if (!RunLevel::get().isPedalDown() || disable_arm_id[armIdFromMechType(_mech->type)]) {
     		_joint->tau_d=0;
-        } else {
+        } else if (!RavenConfig.use_pid_kernel || RavenConfig.verify_pid_kernel) {
             mpos_PD_control(_joint);
         }
 //        if (_joint->type == TOOL_ROT_GREEN)
 //            log_msg("trg: jp:%0.4f\t jpd:%0.4f\t taud:%0.4f",
 //                _joint->jpos, _joint->jpos_d, _joint->tau_d);
 
-        TorqueToDAC(device0);
+        if (!RavenConfig.use_pid_kernel) {
+        	TorqueToDAC(device0);
+        }
+    }
+
+    if (RavenConfig.use_pid_kernel || RavenConfig.verify_pid_kernel) {
+    	mpos_PD_control_all(device0);
+    	TorqueToDAC(device0);
     }
     //    gravComp(device0);
 
@@ -432,7 +442,7 @@ int raven_sinusoidal_joint_motion(struct device *device0, struct param_pass *cur
         }
 
 #ifdef USE_NEW_DEVICE
-        OldControlInputPtr input = ControlInput::oldControlInputUpdateBegin();
+        OldControlInputPtr input = ControlInput::oldControlInputRtUpdateBegin();
     	FOREACH_ARM_IN_CONST_DEVICE(arm,Device::currentNoClone()) {
     		OldArmInputData& armData = input->armById(arm->id());
     		for (size_t i=0;i<arm->motors().size();i++) {
@@ -443,7 +453,7 @@ int raven_sinusoidal_joint_motion(struct device *device0, struct param_pass *cur
     			armData.jointPosition(i) = arm->joint(i)->position();
     		}
     	}
-    	ControlInput::oldControlInputUpdateEnd();
+    	ControlInput::oldControlInputRtUpdateEnd();
 #endif
         return 0;
     }
@@ -520,34 +530,16 @@ int applyTorque(struct device *device0, struct param_pass *currParams)
 
 
 /**
-* raven_motor_position_control()
-*     runs pd control on motor position
+* motor_position_PD()
+*     runs pd control from mpos_d on all the joints
 */
-int raven_motor_position_control(struct device *device0, struct param_pass *currParams)
+static int motor_position_PD(struct device *device0, int& controlStart)
 {
-    static int controlStart = 0;
-    static unsigned long int delay=0;
-
     struct DOF *_joint = NULL;
     struct mechanism* _mech = NULL;
     int i=0,j=0;
 
-    if (!RunLevel::get().isPedalDown()) {
-        set_posd_to_pos(device0);
-        updateMasterRelativeOrigin(device0);
-    } else {
-    	_mech = NULL;  _joint = NULL;
-    	while (loop_over_joints(device0, _mech, _joint, i,j) ) {
-    		_joint->jpos_d = currParams->jpos_d[_joint->type];
-    		//_joint->jpos_d = _joint->jpos;
-    	}
-    }
-
-    //Inverse Cable Coupling
-    invCableCoupling(device0, currParams->runlevel);
-
     // Do PD control on all the joints
-    _mech = NULL;  _joint = NULL;
     while (loop_over_joints(device0, _mech, _joint, i,j) ) {
     	if (RavenConfig.disable_gold_grasp2 && _joint->type == GRASP2_GOLD) {
 			static bool printed_warning = false;
@@ -560,11 +552,15 @@ int raven_motor_position_control(struct device *device0, struct param_pass *curr
 
     	if (!RunLevel::get().isPedalDown() || disable_arm_id[armIdFromMechType(_mech->type)]) {
 			_joint->tau_d=0;
-		} else {
+		} else if (!RavenConfig.use_pid_kernel || RavenConfig.verify_pid_kernel) {
 			mpos_PD_control(_joint,!controlStart);
 		}
 	}
 
+    if (RavenConfig.use_pid_kernel || RavenConfig.verify_pid_kernel) {
+    	mpos_PD_control_all(device0,!controlStart);
+    }
+
     TorqueToDAC(device0);
 
     if (RunLevel::get().isPedalDown()) {
@@ -575,6 +571,64 @@ int raven_motor_position_control(struct device *device0, struct param_pass *curr
     return 0;
 }
 
+/**
+* raven_motor_position_control()
+*     runs pd control on motor position
+*/
+int raven_motor_position_control(struct device *device0, struct param_pass *currParams)
+{
+    static int controlStart = 0;
+
+    struct DOF *_joint = NULL;
+    struct mechanism* _mech = NULL;
+    int i=0,j=0;
+
+    if (!RunLevel::get().isPedalDown()) {
+        set_posd_to_pos(device0);
+        updateMasterRelativeOrigin(device0);
+    } else {
+    	_mech = NULL;  _joint = NULL;
+    	while (loop_over_joints(device0, _mech, _joint, i,j) ) {
+    		_joint->jpos_d = currParams->jpos_d[_joint->type];
+    		//_joint->jpos_d = _joint->jpos;
+    	}
+    }
+
+    //Inverse Cable Coupling
+    invCableCoupling(device0, currParams->runlevel);
+
+    return motor_position_PD(device0, controlStart);
+}
+
+/**
+* raven_motor_position_setpoint_control()
+*     runs pd control on the motor positions in currParams->mpos_d,
+*     bypassing the cable coupling (replay of recorded motor positions)
+*/
+int raven_motor_position_setpoint_control(struct device *device0, struct param_pass *currParams)
+{
+    static int controlStart = 0;
+
+    struct DOF *_joint = NULL;
+    struct mechanism* _mech = NULL;
+    int i=0,j=0;
+
+    if (!RunLevel::get().isPedalDown()) {
+        set_posd_to_pos(device0);
+        updateMasterRelativeOrigin(device0);
+        // set_posd_to_pos() leaves mpos_d alone
+        while (loop_over_joints(device0, _mech, _joint, i,j) ) {
+        	_joint->mpos_d = _joint->mpos;
+        }
+    } else {
+    	while (loop_over_joints(device0, _mech, _joint, i,j) ) {
+    		_joint->mpos_d = currParams->mpos_d[_joint->type];
+    	}
+    }
+
+    return motor_position_PD(device0, controlStart);
+}
+
 /**
 * raven_joint_velocity_control()
 *     runs pi_control on joint velocity.
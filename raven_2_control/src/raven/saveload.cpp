@@ -6,15 +6,21 @@
 #include <fstream>
 #include <vector>
 
+#include <string.h>
+
 #include "saveload.h"
 #include "DOF_type.h"
+#include "calibration.h"
+#include "defines.h"
+#include "log.h"
 
 #include <raven/state/device.h>
 
 namespace fs = boost::filesystem;
 using namespace std;
 
-static std::vector<int> origOffsets;
+extern int NUM_MECH;
+extern DOF_type DOF_types[];
 
 fs::path getRosDir() {
   char const* home = getenv("HOME");  
@@ -23,74 +29,143 @@ fs::path getRosDir() {
   return rosDir;  
 }
 
-bool loadOffsets(robot_device& dev) {  
-  fs::path rosDir = getRosDir();
-  fs::path offsetPath = rosDir / "offsets.txt";
+// transmission ratios the encoder offsets of an arm depend on
+static void currentTR(int serial, float* tr) {
+  int armId = armIdFromSerial(serial);
+  for (int iJoint = 0; iJoint < MAX_DOF_PER_MECH; iJoint++) {
+    tr[iJoint] = DOF_types[combinedJointIndex(armId,iJoint)].TR;
+  }
+}
+
+// offsets.txt from before the calibration files, by mech index
+static bool loadLegacyOffsets(float offsets[2][8]) {
+  fs::path offsetPath = getRosDir() / "offsets.txt";
   ifstream infile(offsetPath.string().c_str());
   if (infile.fail()) return false;
-  
+
   for (int iMech = 0; iMech < 2; iMech++) {
     for (int iJoint = 0; iJoint < 8; iJoint++) {
-      float x;
-      infile >> x;
-      dev.mech[iMech].joint[iJoint].enc_offset = x;
-      origOffsets.push_back(x);
+      infile >> offsets[iMech][iJoint];
+    }
+  }
+  return !infile.fail();
+}
+
+bool loadOffsets(robot_device& dev) {  
+  bool loaded[MAX_MECH] = { false };
+  bool rejected[MAX_MECH] = { false };
+  bool all = true;
+  for (int iMech = 0; iMech < NUM_MECH; iMech++) {
+    mechanism& mech = dev.mech[iMech];
+    CalibrationRecord cal;
+    if (!calibrationLoad(mech.type, cal) || !(cal.fields & CALIBRATION_OFFSETS)) {
+      all = false;
+      continue;
+    }
+    float tr[MAX_DOF_PER_MECH];
+    currentTR(mech.type, tr);
+    if (!(cal.fields & CALIBRATION_TR) || memcmp(tr, cal.tr, sizeof(tr))) {
+      // offsets.txt predates the ratio check, so it is no better; the arm homes instead
+      log_warn("Offsets of arm %d were saved with other transmission ratios; not using them", mech.type);
+      rejected[iMech] = true;
+      all = false;
+      continue;
+    }
+    for (int iJoint = 0; iJoint < MAX_DOF_PER_MECH; iJoint++) {
+      mech.joint[iJoint].enc_offset = cal.enc_offset[iJoint];
+    }
+    loaded[iMech] = true;
+  }
+
+  // only for arms that have no offsets of their own
+  float legacy[2][8];
+  if (!all && loadLegacyOffsets(legacy)) {
+    all = true;
+    for (int iMech = 0; iMech < NUM_MECH; iMech++) {
+      if (loaded[iMech]) continue;
+      if (rejected[iMech] || iMech >= 2) {
+        all = false;
+        continue;
+      }
+      for (int iJoint = 0; iJoint < 8; iJoint++) {
+        dev.mech[iMech].joint[iJoint].enc_offset = legacy[iMech][iJoint];
+      }
+      loaded[iMech] = true;
+    }
+  }
+
 #ifdef USE_NEW_DEVICE
+  // all of the offsets in one update
+  Device::beginCurrentUpdate(ros::Time(0));
+  for (int iMech = 0; iMech < NUM_MECH; iMech++) {
+    if (!loaded[iMech]) continue;
+    ArmPtr arm = Device::currentNoCloneMutable()->getArmById(dev.mech[iMech].type);
+    for (int iJoint = 0; iJoint < MAX_DOF_PER_MECH; iJoint++) {
       int joint_ind = iJoint;
-	  if (joint_ind != 3) {
-		if (joint_ind > 3) joint_ind--;
-		Device::beginCurrentUpdate(ros::Time(0));
-		ArmPtr arm = Device::currentNoCloneMutable()->getArmById(dev.mech[iMech].type);
-		MotorPtr motor = arm->motor(joint_ind);
-		motor->setEncoderOffset(x);
-		Device::finishCurrentUpdate();
-	  }
-#endif
+      if (joint_ind == 3) continue;
+      if (joint_ind > 3) joint_ind--;
+      arm->motor(joint_ind)->setEncoderOffset(dev.mech[iMech].joint[iJoint].enc_offset);
     }
   }
-  assert(!infile.fail());  
-  return true;
-  
-}
+  Device::finishCurrentUpdate();
+#endif
 
+  return all;
+}
 
+// called from the rt thread once homing is done, so the write is queued for the calibration writer
 bool saveOffsets(robot_device& dev) {
-  fs::path rosDir = getRosDir();
-  if (!fs::exists(rosDir)) {
-    bool success = create_directory(rosDir);
-    if (!success) return false;
-  }
-  
-  fs::path offsetPath = rosDir / "offsets.txt";
-  ofstream outfile(offsetPath.string().c_str());
-  if (outfile.fail()) return false;
-  
-  int ind=0;
-  //std::cout << "Offset diffs:";
-  for (int iMech = 0; iMech < 2; iMech++) {
-    for (int iJoint = 0; iJoint < 8; iJoint++) {
-      outfile << dev.mech[iMech].joint[iJoint].enc_offset<< " ";
-      //std::cout << " " << origOffsets[ind] - dev.mech[iMech].joint[iJoint].enc_offset;
+  for (int iMech = 0; iMech < NUM_MECH; iMech++) {
+    mechanism& mech = dev.mech[iMech];
+    CalibrationRecord cal;
+    memset(&cal, 0, sizeof(cal));
+    cal.serial = mech.type;
+    for (int iJoint = 0; iJoint < MAX_DOF_PER_MECH; iJoint++) {
+      cal.enc_offset[iJoint] = mech.joint[iJoint].enc_offset;
     }
+    currentTR(mech.type, cal.tr);
+    calibrationUpdateAsync(cal, CALIBRATION_OFFSETS | CALIBRATION_TR);
   }
-  //std::cout << std::endl;
   return true;
-  
 }
 
 bool saveDOFInfo() {
-  fs::path rosDir = getRosDir() / "dof_info.txt";
-  fs::path offsetPath = rosDir / "offsets.txt";
+  fs::path rosDir = getRosDir();
+  fs::path infoPath = rosDir / "dof_info.txt";
   
   
-  FILE* outFile = fopen (offsetPath.string().c_str(),"w");
+  FILE* outFile = fopen (infoPath.string().c_str(),"w");
   if (outFile == NULL) return false;
   
-  extern DOF_type DOF_types[];  
-  
   for (int iDOF = 0; iDOF < 16; iDOF++) {
     DOF_type& dof = DOF_types[iDOF];
-    fprintf(outFile, "%i %.5f %.5f %.5f %.5f %.5f", iDOF, dof.home_position, dof.max_position, dof.KP, dof.KD, dof.KI);
+    fprintf(outFile, "%i %.5f %.5f %.5f %.5f %.5f\n", iDOF, dof.home_position, dof.max_position, dof.KP, dof.KD, dof.KI);
   }
+  fclose(outFile);
   return true;  
 }
+
+bool loadGains(RavenGains& gains) {
+  for (int armId = 0; armId < MAX_MECH; armId++) {
+    CalibrationRecord cal;
+    if (!calibrationLoad(armSerialFromID(armId), cal) || !(cal.fields & CALIBRATION_GAINS)) return false;
+    memcpy(gains.kp[armId], cal.kp, sizeof(cal.kp));
+    memcpy(gains.kd[armId], cal.kd, sizeof(cal.kd));
+    memcpy(gains.ki[armId], cal.ki, sizeof(cal.ki));
+  }
+  return true;
+}
+
+bool saveGains(const RavenGains& gains) {
+  bool success = true;
+  for (int armId = 0; armId < MAX_MECH; armId++) {
+    CalibrationRecord cal;
+    memset(&cal, 0, sizeof(cal));
+    cal.serial = armSerialFromID(armId);
+    memcpy(cal.kp, gains.kp[armId], sizeof(cal.kp));
+    memcpy(cal.kd, gains.kd[armId], sizeof(cal.kd));
+    memcpy(cal.ki, gains.ki[armId], sizeof(cal.ki));
+    success = calibrationUpdate(cal, CALIBRATION_GAINS) && success;
+  }
+  return success;
+}
@@ -109,6 +109,7 @@ std::string controlModeToString(t_controlmode mode) {
 	CASE_CONTROL_MODE(multi_dof_sinusoid);
 	CASE_CONTROL_MODE(joint_torque_control);
 	CASE_CONTROL_MODE(trajectory_control);
+	CASE_CONTROL_MODE(motor_position_control);
 	default:
 		std::cerr << "Unknown control mode " << mode << std::endl;
 		return "no_control";
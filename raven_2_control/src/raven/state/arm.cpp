@@ -129,16 +129,7 @@ Arm::init(ArmPtr arm) {
 bool
 Arm::processNotification(Updateable* sender) {
 	TRACER_ENTER_SCOPE("Arm[%s]@%p::processNotification(%s)",name_.c_str(),this,typeid(*sender).name());
-	MotorList::iterator motorItr;
-	for (motorItr=motors_.begin();motorItr!=motors_.end();motorItr++) {
-		if (motorItr->get() == sender) {
-			break;
-		}
-	}
-	//MotorList::iterator motorItr = find(motors_.begin(),motors_.end(),sender);
-	if (motorItr != motors_.end()) {
-		updateJointsFromMotors();
-	}
+	// internalUpdate() does the coupling, once, after this returns
 	return true;
 }
 
@@ -6,9 +6,11 @@
  */
 
 #include <raven/state/device.h>
+#include <raven/state/update_pipeline.h>
 #include "log.h"
 
 #include <raven/util/timing.h>
+#include <raven/util/trace.h>
 
 #include "defines.h"
 
@@ -76,6 +78,8 @@ Device::currentTimestamp() {
 }
 
 Device::Device(DeviceType type) : Updateable(false,false), type_(type), timestamp_(0) {
+	updateBegan_.tv_sec = 0;
+	updateBegan_.tv_nsec = 0;
 
 }
 
@@ -127,6 +131,7 @@ Device::init(DevicePtr dev) {
 DevicePtr
 Device::beginCurrentUpdate(ros::Time updateTime) {
 	TRACER_ENTER_SCOPE("Device::beginCurrentUpdate()");
+	TRACE_SCOPE(TRACE_STATE,"Device::beginCurrentUpdate");
 	deviceInstanceMutex.lock();
 	if (updateTime.isZero()) {
 		theUpdateTime = Device::INSTANCE->timestamp();
@@ -144,6 +149,7 @@ Device::beginCurrentUpdate(ros::Time updateTime) {
 void
 Device::finishCurrentUpdate() {
 	TRACER_ENTER_SCOPE("Device::finishCurrentUpdate()");
+	TRACE_SCOPE(TRACE_STATE,"Device::finishCurrentUpdate");
 	Device::INSTANCE->internalFinishUpdate(false);
 	Device::INSTANCE->timestamp_ = theUpdateTime;
 	theUpdateTime = ros::Time(0);
@@ -154,8 +160,63 @@ Device::finishCurrentUpdate() {
 void
 Device::beginUpdate() {
 	TRACER_ENTER_SCOPE("Device@%p::beginUpdate()",this);
-	BOOST_FOREACH(ArmPtr arm,arms_) {
-		arm->holdUpdateBegin();
+	UpdatePipeline::begin(arms_,updateBegan_);
+}
+
+// Keeps the DEBUG_OUTPUT_TIMING breakdown: the filter timing is copied out as each filter finishes
+static void
+copyStageTiming(size_t armIndex, const ArmPtr& arm, UpdatePipeline::Stage stage, int64_t nsec) {
+	if (!Device::DEBUG_OUTPUT_TIMING) {
+		return;
+	}
+	ros::Duration d(nsec / 1000000000,nsec % 1000000000);
+	bool slow = d > TempTiming::mf_au;
+	switch (stage) {
+	case UpdatePipeline::STATE_FILTER:
+		if (arm->isGold()) {
+			TempTiming::s_nmf_iau_gold = slow ? TempTiming::nmf_iau : ros::Duration(0);
+			TempTiming::s_mf_iau_gold = slow ? TempTiming::mf_iau : ros::Duration(0);
+			TempTiming::s_mf_mu_gold = slow ? TempTiming::mf_mu : ros::Duration(0);
+			TempTiming::s_mf_mu_avg_gold = slow ? TempTiming::mf_mu_avg : ros::Duration(0);
+			TempTiming::s_mf_au_gold = slow ? TempTiming::mf_au : ros::Duration(0);
+			TempTiming::arm_smf_gold = d;
+		} else {
+			TempTiming::s_nmf_iau_green = slow ? TempTiming::nmf_iau : ros::Duration(0);
+			TempTiming::s_mf_iau_green = slow ? TempTiming::mf_iau : ros::Duration(0);
+			TempTiming::s_mf_mu_green = slow ? TempTiming::mf_mu : ros::Duration(0);
+			TempTiming::s_mf_mu_avg_green = slow ? TempTiming::mf_mu_avg : ros::Duration(0);
+			TempTiming::s_mf_au_green = slow ? TempTiming::mf_au : ros::Duration(0);
+			TempTiming::arm_smf_green = d;
+		}
+		break;
+	case UpdatePipeline::CONTROL_FILTER:
+		if (arm->isGold()) {
+			TempTiming::c_nmf_iau_gold = slow ? TempTiming::nmf_iau : ros::Duration(0);
+			TempTiming::c_mf_iau_gold = slow ? TempTiming::mf_iau : ros::Duration(0);
+			TempTiming::c_mf_mu_gold = slow ? TempTiming::mf_mu : ros::Duration(0);
+			TempTiming::c_mf_mu_avg_gold = slow ? TempTiming::mf_mu_avg : ros::Duration(0);
+			TempTiming::c_mf_au_gold = slow ? TempTiming::mf_au : ros::Duration(0);
+			TempTiming::arm_cmf_gold = d;
+		} else {
+			TempTiming::c_nmf_iau_green = slow ? TempTiming::nmf_iau : ros::Duration(0);
+			TempTiming::c_mf_iau_green = slow ? TempTiming::mf_iau : ros::Duration(0);
+			TempTiming::c_mf_mu_green = slow ? TempTiming::mf_mu : ros::Duration(0);
+			TempTiming::c_mf_mu_avg_green = slow ? TempTiming::mf_mu_avg : ros::Duration(0);
+			TempTiming::c_mf_au_green = slow ? TempTiming::mf_au : ros::Duration(0);
+			TempTiming::arm_cmf_green = d;
+		}
+		break;
+	case UpdatePipeline::COUPLING:
+		if (arm->isGold()) {
+			TempTiming::arm_hue_gold = d;
+			TempTiming::arm_gold = TempTiming::arm_smf_gold + TempTiming::arm_cmf_gold + d;
+		} else {
+			TempTiming::arm_hue_green = d;
+			TempTiming::arm_green = TempTiming::arm_smf_green + TempTiming::arm_cmf_green + d;
+		}
+		break;
+	default:
+		break;
 	}
 }
 
@@ -163,130 +224,17 @@ void
 Device::internalFinishUpdate(bool updateTimestamp) {
 	TRACER_ENTER_SCOPE("Device@%p::internalFinishUpdate(%i)",this,updateTimestamp);
 	ros::Time start = ros::Time::now();
-	BOOST_FOREACH(ArmPtr arm,arms_) {
-		if (DEBUG_OUTPUT_TIMING) {
-			//printf("Device@%p::internalFinishUpdate() arm %i %p %p\n",this,arm->id(),arm->controlMotorFilter().get(),arm->stateMotorFilter().get());
-		}
-		ros::Time arm1 = ros::Time::now();
-		ros::Time smf1 = arm1;
-		arm->stateMotorFilter()->applyUpdate();
-		ros::Time smf2 = ros::Time::now();
-
-		if (DEBUG_OUTPUT_TIMING) {
-			if ((smf2-smf1) > TempTiming::mf_au) {
-				if (arm->isGold()) {
-					TempTiming::s_nmf_iau_gold = TempTiming::nmf_iau;
-					TempTiming::s_mf_iau_gold = TempTiming::mf_iau;
-
-					TempTiming::s_mf_mu_gold = TempTiming::mf_mu;
-					TempTiming::s_mf_mu_avg_gold = TempTiming::mf_mu_avg;
-
-					TempTiming::s_mf_au_gold = TempTiming::mf_au;
-				} else {
-					TempTiming::s_nmf_iau_green = TempTiming::nmf_iau;
-					TempTiming::s_mf_iau_green = TempTiming::mf_iau;
-
-					TempTiming::s_mf_mu_green = TempTiming::mf_mu;
-					TempTiming::s_mf_mu_avg_green = TempTiming::mf_mu_avg;
-
-					TempTiming::s_mf_au_green = TempTiming::mf_au;
-				}
-			} else {
-				if (arm->isGold()) {
-					TempTiming::s_nmf_iau_gold = ros::Duration(0);
-					TempTiming::s_mf_iau_gold = ros::Duration(0);
-
-					TempTiming::s_mf_mu_gold = ros::Duration(0);
-					TempTiming::s_mf_mu_avg_gold = ros::Duration(0);
-
-					TempTiming::s_mf_au_gold = ros::Duration(0);
-				} else {
-					TempTiming::s_nmf_iau_green = ros::Duration(0);
-					TempTiming::s_mf_iau_green = ros::Duration(0);
-
-					TempTiming::s_mf_mu_green = ros::Duration(0);
-					TempTiming::s_mf_mu_avg_green = ros::Duration(0);
-
-					TempTiming::s_mf_au_green = ros::Duration(0);
-				}
-			}
-		}
-
-		ros::Time cmf1 = smf2;
-		arm->controlMotorFilter()->applyUpdate();
-		ros::Time cmf2 = ros::Time::now();
-
-		if (DEBUG_OUTPUT_TIMING) {
-			if ((cmf2-cmf1) > TempTiming::mf_au) {
-				if (arm->isGold()) {
-					TempTiming::c_nmf_iau_gold = TempTiming::nmf_iau;
-					TempTiming::c_mf_iau_gold = TempTiming::mf_iau;
-
-					TempTiming::c_mf_mu_gold = TempTiming::mf_mu;
-					TempTiming::c_mf_mu_avg_gold = TempTiming::mf_mu_avg;
-
-					TempTiming::c_mf_au_gold = TempTiming::mf_au;
-				} else {
-					TempTiming::c_nmf_iau_green = TempTiming::nmf_iau;
-					TempTiming::c_mf_iau_green = TempTiming::mf_iau;
-
-					TempTiming::c_mf_mu_green = TempTiming::mf_mu;
-					TempTiming::c_mf_mu_avg_green = TempTiming::mf_mu_avg;
-
-					TempTiming::c_mf_au_green = TempTiming::mf_au;
-				}
-			} else {
-				if (arm->isGold()) {
-					TempTiming::c_nmf_iau_gold = ros::Duration(0);
-					TempTiming::c_mf_iau_gold = ros::Duration(0);
-
-					TempTiming::c_mf_mu_gold = ros::Duration(0);
-					TempTiming::c_mf_mu_avg_gold = ros::Duration(0);
-
-					TempTiming::c_mf_au_gold = ros::Duration(0);
-				} else {
-					TempTiming::c_nmf_iau_green = ros::Duration(0);
-					TempTiming::c_mf_iau_green = ros::Duration(0);
-
-					TempTiming::c_mf_mu_green = ros::Duration(0);
-					TempTiming::c_mf_mu_avg_green = ros::Duration(0);
-
-					TempTiming::c_mf_au_green = ros::Duration(0);
-				}
-			}
-		}
-
-		ros::Time hue1 = cmf2;
-		arm->holdUpdateEnd();
-		ros::Time hue2 = ros::Time::now();
-
-		ros::Time arm2 = hue2;
-
-		if (updateTimestamp && arm->timestamp() > timestamp_) {
-			timestamp_ = arm->timestamp();
-		}
+	UpdatePipeline::finish(arms_,updateBegan_,copyStageTiming);
 
-		if (DEBUG_OUTPUT_TIMING) {
-//			printf("Arm %i:\t%8lli\n",arm->id(),(long long int)(arm2-arm1).toNSec());
-//			printf(" smf:\t%8lli\n",(long long int)(smf2-smf1).toNSec());
-//			printf(" cmf:\t%8lli\n",(long long int)(cmf2-cmf1).toNSec());
-//			printf(" hue:\t%8lli\n",(long long int)(hue2-hue1).toNSec());
-			if (arm->isGold()) {
-				TempTiming::arm_gold = arm2-arm1;
-				TempTiming::arm_smf_gold = smf2-smf1;
-				TempTiming::arm_cmf_gold = cmf2-cmf1;
-				TempTiming::arm_hue_gold = hue2-hue1;
-			} else {
-				TempTiming::arm_green = arm2-arm1;
-				TempTiming::arm_smf_green = smf2-smf1;
-				TempTiming::arm_cmf_green = cmf2-cmf1;
-				TempTiming::arm_hue_green = hue2-hue1;
+	if (updateTimestamp) {
+		BOOST_FOREACH(ArmPtr arm,arms_) {
+			if (arm->timestamp() > timestamp_) {
+				timestamp_ = arm->timestamp();
 			}
 		}
 	}
 	ros::Time end = ros::Time::now();
 	if (DEBUG_OUTPUT_TIMING) {
-		//printf("Device@%p::internalFinishUpdate(): %8lli\n",this,(long long int)(end-start).toNSec());
 		TempTiming::dev_ifu = end-start;
 	}
 }
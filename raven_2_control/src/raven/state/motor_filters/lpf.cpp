@@ -8,6 +8,7 @@
 #include <raven/state/motor_filters/lpf.h>
 
 #include "defines.h"
+#include <raven/util/timing.h>
 
 static int numLF = 0;
 template<int order>
@@ -35,7 +36,7 @@ template<int order>
 void
 LowPassMotorFilter<order>::internalApplyUpdate() {
 	TRACER_ENTER_SCOPE("LowPassMotorFilter<order>::internalApplyUpdate");
-	ros::Time callTime = ros::Time::now();
+	ros::Time callTime = LoopClock::now();
 	for (size_t i=0;i<motorsForUpdate_.size();i++) {
 		bool resized = false;
 
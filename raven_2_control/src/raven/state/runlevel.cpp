@@ -252,7 +252,7 @@ boost::mutex loopNumberMutex;
 std::map<std::string,int> LoopNumber::NAMED_INTERVALS;
 boost::thread_specific_ptr< std::map<std::string,LoopNumber::CountInfo> > LoopNumber::NAMED_COUNTS;
 
-boost::thread_specific_ptr<int> LoopNumber::LOOP_NUMBER;
+__thread int LoopNumber::LOOP_NUMBER = -1;
 int LoopNumber::MAIN_LOOP_NUMBER = -1;
 
 boost::thread_specific_ptr<timespec> LoopNumber::LOOP_TIME;
@@ -264,30 +264,28 @@ timespec LoopNumber::MAIN_LOOP_TIME_DELTA = {0};
 //#define USE_LOOP_MUTEX_FOR_ALL
 #define USE_LOOP_MUTEX_FOR_NAMED_INTERVALS
 
-int
-LoopNumber::internalGet() {
-	if (ROS_LIKELY(!LOOP_NUMBER.get())) {
-		LOOP_NUMBER.reset(new int(-1));
-	}
-	return *LOOP_NUMBER;
+// The time and its delta are always created together, so either one being set means both are
+void
+LoopNumber::internalInitTime() {
+	LOOP_TIME.reset(new timespec());
+	clock_gettime(CLOCK_REALTIME,LOOP_TIME.get());
+	LOOP_TIME_DELTA.reset(new timespec());
+	LOOP_TIME_DELTA->tv_sec = 0;
+	LOOP_TIME_DELTA->tv_nsec = 0;
 }
 
 timespec
 LoopNumber::internalGetTime() {
-	if (ROS_LIKELY(!LOOP_TIME.get())) {
-		LOOP_TIME.reset(new timespec());
-		clock_gettime(CLOCK_REALTIME,LOOP_TIME.get());
-
+	if (ROS_UNLIKELY(!LOOP_TIME.get())) {
+		internalInitTime();
 	}
 	return *LOOP_TIME;
 }
 
 timespec
 LoopNumber::internalGetTimeDelta() {
-	if (ROS_LIKELY(!LOOP_TIME_DELTA.get())) {
-		LOOP_TIME_DELTA.reset(new timespec());
-		LOOP_TIME_DELTA->tv_sec = 0;
-		LOOP_TIME_DELTA->tv_nsec = 0;
+	if (ROS_UNLIKELY(!LOOP_TIME_DELTA.get())) {
+		internalInitTime();
 	}
 	return *LOOP_TIME_DELTA;
 }
@@ -336,17 +334,12 @@ LoopNumber::getMainTimeDelta() {
 
 void
 LoopNumber::internalIncrement(int amt) {
-	if (ROS_UNLIKELY(!LOOP_NUMBER.get())) {
-		LOOP_NUMBER.reset(new int(-1));
-		*LOOP_NUMBER += amt;
-		LOOP_TIME.reset(new timespec());
-		clock_gettime(CLOCK_REALTIME,LOOP_TIME.get());
-		LOOP_TIME_DELTA.reset(new timespec());
-		LOOP_TIME_DELTA->tv_sec = 0;
-		LOOP_TIME_DELTA->tv_nsec = 0;
+	if (ROS_UNLIKELY(!LOOP_TIME.get())) {
+		LOOP_NUMBER += amt;
+		internalInitTime();
 		return;
 	}
-	*LOOP_NUMBER += amt;
+	LOOP_NUMBER += amt;
 	timespec t_old = *LOOP_TIME;
 	clock_gettime(CLOCK_REALTIME,LOOP_TIME.get());
 	timespec delta;
@@ -369,7 +362,7 @@ LoopNumber::incrementMain(int amt) {
 	boost::mutex::scoped_lock _l(loopNumberMutex);
 	internalIncrement(amt);
 
-	MAIN_LOOP_NUMBER = *LOOP_NUMBER;
+	MAIN_LOOP_NUMBER = LOOP_NUMBER;
 	MAIN_LOOP_TIME = *LOOP_TIME;
 	MAIN_LOOP_TIME_DELTA = *LOOP_TIME_DELTA;
 }
@@ -0,0 +1,142 @@
+/*
+ * update_pipeline.cpp
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: agent
+ */
+
+#include <raven/state/update_pipeline.h>
+#include <raven/util/trace.h>
+
+#include <string.h>
+#include <sstream>
+
+UpdatePipeline::StageStats UpdatePipeline::STATS[UpdatePipeline::NUM_STAGES];
+int64_t UpdatePipeline::ARM_LAST[UPDATE_PIPELINE_MAX_ARMS][UpdatePipeline::NUM_STAGES];
+
+static inline int64_t
+nsecSince(const struct timespec& since, struct timespec& now) {
+	clock_gettime(CLOCK_MONOTONIC,&now);
+	return (now.tv_sec - since.tv_sec) * (int64_t)1000000000 + (now.tv_nsec - since.tv_nsec);
+}
+
+void
+UpdatePipeline::record(size_t armIndex, Stage stage, int64_t nsec) {
+	if (armIndex >= UPDATE_PIPELINE_MAX_ARMS) {
+		armIndex = UPDATE_PIPELINE_MAX_ARMS - 1;
+	}
+	ARM_LAST[armIndex][stage] = nsec;
+	STATS[stage].last += nsec;
+	STATS[stage].runs++;
+}
+
+void
+UpdatePipeline::begin(const ArmList& arms, struct timespec& began) {
+	TRACE_BEGIN(TRACE_STATE,"encoders");
+	for (size_t i=0;i<arms.size();i++) {
+		arms[i]->holdUpdateBegin();
+	}
+	clock_gettime(CLOCK_MONOTONIC,&began);
+}
+
+bool
+UpdatePipeline::finish(const ArmList& arms, const struct timespec& began, StageObserver observer) {
+	TRACE_END(TRACE_STATE,"encoders");
+	struct timespec t;
+	int64_t encoders = nsecSince(began,t);
+	for (int s=0;s<NUM_STAGES;s++) {
+		STATS[s].last = 0;
+	}
+	for (size_t i=0;i<UPDATE_PIPELINE_MAX_ARMS;i++) {
+		memset(ARM_LAST[i],0,sizeof(ARM_LAST[i]));
+	}
+	STATS[ENCODERS].last = encoders;
+	STATS[ENCODERS].runs++;
+
+	bool anyChanged = false;
+	for (size_t i=0;i<arms.size();i++) {
+		const ArmPtr& arm = arms[i];
+		struct timespec start = t;
+		int64_t nsec;
+
+		{
+			TRACE_SCOPE(TRACE_STATE,"state filter");
+			arm->stateMotorFilter()->applyUpdate();
+		}
+		nsec = nsecSince(start,t);
+		record(i,STATE_FILTER,nsec);
+		if (observer) { observer(i,arm,STATE_FILTER,nsec); }
+
+		start = t;
+		{
+			TRACE_SCOPE(TRACE_STATE,"control filter");
+			arm->controlMotorFilter()->applyUpdate();
+		}
+		nsec = nsecSince(start,t);
+		record(i,CONTROL_FILTER,nsec);
+		if (observer) { observer(i,arm,CONTROL_FILTER,nsec); }
+
+		// the filters and encoders only marked the arm; this is the one recoupling
+		start = t;
+		bool changed;
+		{
+			TRACE_SCOPE(TRACE_STATE,"coupling");
+			changed = arm->holdUpdateEnd();
+		}
+		nsec = nsecSince(start,t);
+		if (changed) {
+			record(i,COUPLING,nsec);
+		}
+		if (observer) { observer(i,arm,COUPLING,nsec); }
+
+		anyChanged = anyChanged || changed;
+	}
+
+	for (int s=0;s<NUM_STAGES;s++) {
+		StageStats& stats = STATS[s];
+		stats.ticks++;
+		stats.total += stats.last;
+		if (stats.last > stats.max) {
+			stats.max = stats.last;
+		}
+	}
+	return anyChanged;
+}
+
+const char*
+UpdatePipeline::stageName(Stage stage) {
+	switch (stage) {
+	case ENCODERS: return "encoders";
+	case STATE_FILTER: return "state filter";
+	case CONTROL_FILTER: return "control filter";
+	case COUPLING: return "coupling";
+	default: return "unknown";
+	}
+}
+
+int64_t
+UpdatePipeline::armStageTime(size_t armIndex, Stage stage) {
+	if (armIndex >= UPDATE_PIPELINE_MAX_ARMS) {
+		armIndex = UPDATE_PIPELINE_MAX_ARMS - 1;
+	}
+	return ARM_LAST[armIndex][stage];
+}
+
+void
+UpdatePipeline::resetStats() {
+	memset(STATS,0,sizeof(STATS));
+}
+
+std::string
+UpdatePipeline::statsString() {
+	std::stringstream ss;
+	for (int s=0;s<NUM_STAGES;s++) {
+		const StageStats& stats = STATS[s];
+		ss << stageName((Stage)s) << ": last " << stats.last << " ns, max " << stats.max << " ns, avg "
+				<< (stats.ticks ? stats.total / (int64_t)stats.ticks : 0) << " ns, " << stats.runs << " runs in " << stats.ticks << " ticks";
+		if (s+1 < NUM_STAGES) {
+			ss << std::endl;
+		}
+	}
+	return ss.str();
+}
@@ -0,0 +1,328 @@
+/*
+ * state_message.cpp
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: agent
+ */
+
+#include "state_message.h"
+
+#include <ros/ros.h>
+
+#include <raven/kinematics/kinematics_defines.h>
+#include <raven/state/runlevel.h>
+#include <raven/state/device.h>
+#include <raven/control/control_input.h>
+#include <raven_2_msgs/Constants.h>
+
+#include "log.h"
+
+float rosGraspFromMech(int armId,int grasp) {
+	if (armId == GOLD_ARM_ID) {
+		return ((float)grasp) / 1000.;
+	} else {
+		return -((float)grasp) / 1000.;
+	}
+}
+
+void getRosArmType(const u_16& type, uint8_t& ros) {
+	switch (type) {
+	case GOLD_ARM:
+		ros = raven_2_msgs::Constants::ARM_TYPE_GOLD;
+		return;
+	case GREEN_ARM:
+		ros = raven_2_msgs::Constants::ARM_TYPE_GREEN;
+		return;
+	}
+	ROS_ERROR_STREAM("Unknown mech type"<<type);
+}
+
+void
+fillRavenState(raven_2_msgs::RavenState& raven_state,const PublishSnapshot& snapshot,JointCommandLookup commands) {
+#ifdef USE_NEW_DEVICE
+	static DevicePtr dev;
+	Device::current(dev);
+	// getOldControlInput() is for the rt thread only
+	static OldControlInputPtr input(new OldControlInput());
+	ControlInput::oldControlInputSnapshot(*input);
+#endif
+	// the snapshot is only read, but loop_over_mechs() takes a mutable device
+	struct robot_device* device0 = const_cast<struct robot_device*>(&snapshot.device);
+	mechanism* _mech=NULL;
+	DOF* _joint=NULL;
+	int mechnum, jnum;
+
+	raven_state.runlevel = snapshot.runlevel;
+	raven_state.sublevel = snapshot.sublevel;
+	raven_state.pedal_down = snapshot.pedal_down;
+	raven_state.controller = (uint8_t) snapshot.controlMode;
+
+
+	size_t numArms = 0;
+	while (loop_over_mechs(device0,_mech,mechnum)) {
+		btMatrix3x3 transform;
+		switch (_mech->type) {
+		case GOLD_ARM:
+			transform = btMatrix3x3(1,0,0,  0,-1,0,  0,0,-1);
+			break;
+		case GREEN_ARM:
+			transform = btMatrix3x3(1,0,0,  0,-1,0,  0,0,-1);
+			break;
+		default:
+			ROS_ERROR_STREAM("Unknown mech type"<<_mech->type);
+			continue;
+		}
+		raven_2_msgs::ArmState& arm_state = messageSlot(raven_state.arms,numArms++);
+		arm_state.name = armNameFromMechType(_mech->type);
+		getRosArmType(_mech->type,arm_state.type);
+
+		arm_state.base_pose = toRos(_mech->base_pos,_mech->base_ori,transform);
+
+		switch (_mech->type) {
+		case TOOL_NONE: arm_state.tool_type = raven_2_msgs::Constants::TOOL_TYPE_NONE; break;
+		case TOOL_GRASPER_10MM: arm_state.tool_type = raven_2_msgs::Constants::TOOL_TYPE_GRASPER_10MM; break;
+		case TOOL_GRASPER_8MM: arm_state.tool_type = raven_2_msgs::Constants::TOOL_TYPE_GRASPER_8MM; break;
+		}
+
+		arm_state.tool.pose = toRos(_mech->pos,_mech->ori,transform);
+		arm_state.tool_set_point.pose = toRos(_mech->pos_d,_mech->ori_d,transform);
+
+#ifdef USE_NEW_DEVICE
+		{
+		btTransform tool_pose(toBt(_mech->ori) * transform,toBt(_mech->pos)/MICRON_PER_M);
+		btQuaternion tool_pose_rot = tool_pose.getRotation();
+		btVector3 tool_pose_pos = tool_pose.getOrigin();
+
+		btTransform tool_pose_new = dev->getArmById(_mech->type)->kinematics().forwardPose();
+		btQuaternion tool_pose_new_rot = tool_pose_new.getRotation();
+		btVector3 tool_pose_new_pos = tool_pose_new.getOrigin();
+
+		btTransform tool_pose_d(toBt(_mech->ori_d) * transform,toBt(_mech->pos_d)/MICRON_PER_M);
+		btQuaternion tool_pose_d_rot = tool_pose_d.getRotation();
+		btVector3 tool_pose_d_pos = tool_pose_d.getOrigin();
+
+		btTransform tool_pose_d_new = input->armById(_mech->type).pose();
+		btQuaternion tool_pose_d_new_rot = tool_pose_d_new.getRotation();
+		btVector3 tool_pose_d_new_pos = tool_pose_d_new.getOrigin();
+
+		double dist = tool_pose_pos.distance(tool_pose_new_pos);
+		double angle = tool_pose_rot.angle(tool_pose_new_rot) * 180 / M_PI;
+
+		double dist_d = tool_pose_d_pos.distance(tool_pose_d_new_pos);
+		double angle_d = tool_pose_d_rot.angle(tool_pose_d_new_rot) * 180 / M_PI;
+
+		if (false && LoopNumber::everyMain(1000)) {
+			log_msg("DIFFS [%.2d,%.1d] [%.2d, %.1d]",dist,angle,dist_d,angle_d);
+			log_msg("(%.2d,%.2d,%.2d) (%.2d,%.2d,%.2d)",tool_pose_pos.x(),tool_pose_pos.y(),tool_pose_pos.z(),tool_pose_new_pos.x(),tool_pose_new_pos.y(),tool_pose_new_pos.z());
+			log_msg("(%.2d,%.2d,%.2d) (%.2d,%.2d,%.2d)",tool_pose_d_pos.x(),tool_pose_d_pos.y(),tool_pose_d_pos.z(),tool_pose_d_new_pos.x(),tool_pose_d_new_pos.y(),tool_pose_d_new_pos.z());
+		}
+		}
+#endif
+
+		arm_state.tool.grasp = rosGraspFromMech(armIdFromMechType(_mech->type),_mech->ori.grasp);
+		arm_state.tool_set_point.grasp = rosGraspFromMech(armIdFromMechType(_mech->type),_mech->ori_d.grasp);
+
+		_joint = NULL;
+		size_t j = 0;
+		int grasp1_index=-1;
+		int grasp2_index=-1;
+		while (loop_over_joints(_mech,_joint,jnum)) {
+			uint16_t ros_joint_type;
+			int joint_type = jointTypeFromCombinedType(_joint->type);
+			switch (joint_type) {
+			case SHOULDER: ros_joint_type = raven_2_msgs::Constants::JOINT_TYPE_SHOULDER; break;
+			case ELBOW: ros_joint_type = raven_2_msgs::Constants::JOINT_TYPE_ELBOW; break;
+			case Z_INS: ros_joint_type = raven_2_msgs::Constants::JOINT_TYPE_INSERTION; break;
+			case TOOL_ROT: ros_joint_type = raven_2_msgs::Constants::JOINT_TYPE_ROTATION; break;
+			case WRIST: ros_joint_type = raven_2_msgs::Constants::JOINT_TYPE_PITCH; break;
+			case GRASP1: ros_joint_type = raven_2_msgs::Constants::JOINT_TYPE_GRASP_FINGER1; grasp1_index = jnum; break;
+			case GRASP2: ros_joint_type = raven_2_msgs::Constants::JOINT_TYPE_GRASP_FINGER2; grasp2_index = jnum; break;
+			case NO_CONNECTION: continue;
+			}
+			raven_2_msgs::JointState& joint_state = messageSlot(arm_state.joints,j++);
+			joint_state.type = ros_joint_type;
+
+			switch (_joint->state) {
+			case jstate_not_ready: joint_state.state = raven_2_msgs::JointState::STATE_NOT_READY; break;
+			case jstate_pos_unknown: joint_state.state = raven_2_msgs::JointState::STATE_POS_UNKNOWN; break;
+			case jstate_homing1: joint_state.state = raven_2_msgs::JointState::STATE_HOMING1; break;
+			case jstate_homing2: joint_state.state = raven_2_msgs::JointState::STATE_HOMING2; break;
+			case jstate_ready: joint_state.state = raven_2_msgs::JointState::STATE_READY; break;
+			case jstate_wait: joint_state.state = raven_2_msgs::JointState::STATE_WAIT; break;
+			case jstate_hard_stop: joint_state.state = raven_2_msgs::JointState::STATE_HARD_STOP; break;
+			default: joint_state.state = raven_2_msgs::JointState::STATE_LAST_TYPE; break;
+			}
+
+			joint_state.encoder_value = _joint->enc_val;
+			joint_state.encoder_offset = _joint->enc_offset;
+			joint_state.dac_command = _joint->current_cmd;
+
+			joint_state.position = _joint->jpos;
+			joint_state.velocity = _joint->jvel;
+
+			joint_state.motor_position = _joint->mpos;
+			joint_state.motor_velocity = _joint->mvel;
+
+			joint_state.torque = _joint->tau_d;
+			joint_state.gravity_estimate = _joint->tau_g;
+
+			joint_state.integrated_position_error = _joint->perror_int;
+
+			raven_2_msgs::JointCommand joint_cmd;
+			if (commands) {
+				commands(arm_state.name,joint_state.type,joint_cmd);
+			}
+			//joint_cmd.command_type = raven_2_msgs::JointCommand::COMMAND_TYPE_POSITION;
+			//joint_cmd.value = _joint->jpos_d;
+			/*
+	    		joint_cmd.position = _joint->jpos;
+	    		joint_cmd.velocity = _joint->jvel;
+
+	    		joint_cmd.motor_position = _joint->mpos;
+	    		joint_cmd.motor_velocity = _joint->mvel;
+
+	    		joint_cmd.torque = _joint->tau;
+			 */
+
+			joint_state.command = joint_cmd;
+
+			joint_state.set_point.position = _joint->jpos_d;
+			joint_state.set_point.velocity = _joint->jvel_d;
+			joint_state.set_point.motor_position = _joint->mpos_d;
+			joint_state.set_point.motor_velocity = _joint->mvel_d;
+		}
+
+		raven_2_msgs::JointState& yaw_state = messageSlot(arm_state.joints,j++);
+		raven_2_msgs::JointState& grasp_state = messageSlot(arm_state.joints,j++);
+		yaw_state.type = raven_2_msgs::Constants::JOINT_TYPE_YAW;
+		grasp_state.type = raven_2_msgs::Constants::JOINT_TYPE_GRASP;
+		jointState grasp_combined_state;
+		if (_mech->joint[grasp1_index].state < _mech->joint[grasp2_index].state) {
+			grasp_combined_state = _mech->joint[grasp1_index].state;
+		} else {
+			grasp_combined_state = _mech->joint[grasp2_index].state;
+		}
+
+		switch (grasp_combined_state) {
+		case jstate_not_ready: yaw_state.state = raven_2_msgs::JointState::STATE_NOT_READY; break;
+		case jstate_pos_unknown: yaw_state.state = raven_2_msgs::JointState::STATE_POS_UNKNOWN; break;
+		case jstate_homing1: yaw_state.state = raven_2_msgs::JointState::STATE_HOMING1; break;
+		case jstate_homing2: yaw_state.state = raven_2_msgs::JointState::STATE_HOMING2; break;
+		case jstate_ready: yaw_state.state = raven_2_msgs::JointState::STATE_READY; break;
+		case jstate_wait: yaw_state.state = raven_2_msgs::JointState::STATE_WAIT; break;
+		case jstate_hard_stop: yaw_state.state = raven_2_msgs::JointState::STATE_HARD_STOP; break;
+		default: yaw_state.state = raven_2_msgs::JointState::STATE_LAST_TYPE; break;
+		}
+		grasp_state.state = yaw_state.state;
+
+		yaw_state.position = THY_MECH_FROM_FINGERS(armIdFromMechType(_mech->type),_mech->joint[grasp1_index].jpos,_mech->joint[grasp2_index].jpos);
+		yaw_state.velocity = THY_MECH_FROM_FINGERS(armIdFromMechType(_mech->type),_mech->joint[grasp1_index].jvel,_mech->joint[grasp2_index].jvel);
+
+		// "Motors"
+		yaw_state.motor_position = THY_MECH_FROM_FINGERS(armIdFromMechType(_mech->type),_mech->joint[grasp1_index].mpos,_mech->joint[grasp2_index].mpos);
+		yaw_state.motor_velocity = THY_MECH_FROM_FINGERS(armIdFromMechType(_mech->type),_mech->joint[grasp1_index].mvel,_mech->joint[grasp2_index].mvel);
+
+		yaw_state.set_point.position = THY_MECH_FROM_FINGERS(armIdFromMechType(_mech->type),_mech->joint[grasp1_index].jpos_d,_mech->joint[grasp2_index].jpos_d);
+		yaw_state.set_point.velocity = THY_MECH_FROM_FINGERS(armIdFromMechType(_mech->type),_mech->joint[grasp1_index].jvel_d,_mech->joint[grasp2_index].jvel_d);
+
+		yaw_state.set_point.motor_position = THY_MECH_FROM_FINGERS(armIdFromMechType(_mech->type),_mech->joint[grasp1_index].mpos_d,_mech->joint[grasp2_index].mpos_d);
+		yaw_state.set_point.motor_velocity = THY_MECH_FROM_FINGERS(armIdFromMechType(_mech->type),_mech->joint[grasp1_index].mvel_d,_mech->joint[grasp2_index].mvel_d);
+
+		grasp_state.position = rosGraspFromMech(armIdFromMechType(_mech->type),_mech->ori.grasp);
+		grasp_state.set_point.position = rosGraspFromMech(armIdFromMechType(_mech->type),_mech->ori_d.grasp);
+
+		grasp_state.motor_position = rosGraspFromMech(armIdFromMechType(_mech->type),MECH_GRASP_FROM_MECH_FINGERS(armIdFromMechType(_mech->type),_mech->joint[grasp1_index].mpos,_mech->joint[grasp2_index].mpos));
+		grasp_state.set_point.motor_position = rosGraspFromMech(armIdFromMechType(_mech->type),MECH_GRASP_FROM_MECH_FINGERS(armIdFromMechType(_mech->type),_mech->joint[grasp1_index].mpos_d,_mech->joint[grasp2_index].mpos_d));
+
+		messageResize(arm_state.joints,j);
+	}
+	messageResize(raven_state.arms,numArms);
+
+}
+
+void
+fillRavenArrayState(raven_2_msgs::RavenArrayState& array_state,const raven_2_msgs::RavenState& raven_state) {
+	size_t numArms = raven_state.arms.size();
+	size_t numJoints = 0;
+	for (size_t i=0;i<numArms;i++) {
+		numJoints += raven_state.arms[i].joints.size();
+	}
+
+	array_state.header = raven_state.header;
+	array_state.runlevel = raven_state.runlevel;
+	array_state.sublevel = raven_state.sublevel;
+	array_state.pedal_down = raven_state.pedal_down;
+	array_state.master = raven_state.master;
+	array_state.controller = raven_state.controller;
+
+	messageResize(array_state.arm_names,numArms);
+	messageResize(array_state.arm_types,numArms);
+	messageResize(array_state.base_poses,numArms);
+	messageResize(array_state.tool_types,numArms);
+	messageResize(array_state.tool.poses,numArms);
+	messageResize(array_state.tool_set_points.poses,numArms);
+	messageResize(array_state.tool.grasps,numArms);
+	messageResize(array_state.tool_set_points.grasps,numArms);
+	messageResize(array_state.input_pins,numArms);
+	messageResize(array_state.output_pins,numArms);
+
+	messageResize(array_state.joint_arm_inds,numJoints);
+	messageResize(array_state.joint_types,numJoints);
+	messageResize(array_state.joint_states,numJoints);
+	messageResize(array_state.motor_encoder_values,numJoints);
+	messageResize(array_state.motor_encoder_offsets,numJoints);
+	messageResize(array_state.dac_commands,numJoints);
+	messageResize(array_state.joint_positions,numJoints);
+	messageResize(array_state.joint_velocities,numJoints);
+	messageResize(array_state.motor_positions,numJoints);
+	messageResize(array_state.motor_velocities,numJoints);
+	messageResize(array_state.torques,numJoints);
+	messageResize(array_state.gravity_estimates,numJoints);
+	messageResize(array_state.joint_command_types,numJoints);
+	messageResize(array_state.joint_commands,numJoints);
+	messageResize(array_state.integrated_position_errors,numJoints);
+	messageResize(array_state.set_points.joint_positions,numJoints);
+	messageResize(array_state.set_points.joint_velocities,numJoints);
+	messageResize(array_state.set_points.motor_positions,numJoints);
+	messageResize(array_state.set_points.motor_velocities,numJoints);
+
+	size_t k = 0;
+	for (size_t i=0;i<numArms;i++) {
+		const raven_2_msgs::ArmState& arm = raven_state.arms[i];
+		array_state.arm_names[i] = arm.name;
+		array_state.arm_types[i] = arm.type;
+		array_state.base_poses[i] = arm.base_pose;
+		array_state.tool_types[i] = arm.tool_type;
+		array_state.tool.poses[i] = arm.tool.pose;
+		array_state.tool_set_points.poses[i] = arm.tool_set_point.pose;
+		array_state.tool.grasps[i] = arm.tool.grasp;
+		array_state.tool_set_points.grasps[i] = arm.tool_set_point.grasp;
+
+		for (size_t j=0;j<arm.joints.size();j++,k++) {
+			const raven_2_msgs::JointState& joint = arm.joints[j];
+			array_state.joint_arm_inds[k] = i;
+			array_state.joint_types[k] = joint.type;
+			array_state.joint_states[k] = joint.state;
+			array_state.motor_encoder_values[k] = joint.encoder_value;
+			array_state.motor_encoder_offsets[k] = joint.encoder_offset;
+			array_state.dac_commands[k] = joint.dac_command;
+			array_state.joint_positions[k] = joint.position;
+			array_state.joint_velocities[k] = joint.velocity;
+			array_state.motor_positions[k] = joint.motor_position;
+			array_state.motor_velocities[k] = joint.motor_velocity;
+			array_state.torques[k] = joint.torque;
+			array_state.gravity_estimates[k] = joint.gravity_estimate;
+			array_state.joint_command_types[k] = joint.command.command_type;
+			array_state.joint_commands[k] = joint.command.value;
+			array_state.integrated_position_errors[k] = joint.integrated_position_error;
+
+			array_state.set_points.joint_positions[k] = joint.set_point.position;
+			array_state.set_points.joint_velocities[k] = joint.set_point.velocity;
+			array_state.set_points.motor_positions[k] = joint.set_point.motor_position;
+			array_state.set_points.motor_velocities[k] = joint.set_point.motor_velocity;
+		}
+
+		array_state.input_pins[i] = arm.input_pins;
+		array_state.output_pins[i] = arm.output_pins;
+	}
+}
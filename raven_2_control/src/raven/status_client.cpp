@@ -0,0 +1,97 @@
+/*
+ * status_client.cpp
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: agent
+ */
+
+/*
+ * Prints the status r2_control serves on its status socket (see status_service.h).
+ * Any number can run at once, and none of them touches the rt thread:
+ *   rosrun raven_2_control r2_status                 full status, once
+ *   rosrun raven_2_control r2_status --watch 0.5     refreshed every half second
+ *   rosrun raven_2_control r2_status timing          status, timing, faults or reset
+ */
+
+#include <raven/util/config.h>
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include <string>
+
+struct StatusClientConfig : public rosx::ConfigGroup {
+	std::string socket;
+	float watch;
+
+	StatusClientConfig() : rosx::ConfigGroup("r2_status") {
+		ConfigGroup_optionWithHelp(socket,std::string,"r2_control status socket (--status-socket)","/tmp/r2_control_status");
+		ConfigGroup_optionWithHelp(watch,float,"seconds between refreshes (0 = print once)",0.f);
+	}
+};
+
+static StatusClientConfig Options;
+
+static bool
+requestStatus(const std::string& request, std::string& reply) {
+	struct sockaddr_un addr;
+	memset(&addr,0,sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strncpy(addr.sun_path,Options.socket.c_str(),sizeof(addr.sun_path)-1);
+
+	int sock = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (sock < 0 || connect(sock,(struct sockaddr*)&addr,sizeof(addr)) < 0) {
+		fprintf(stderr, "%s: %s (is r2_control running?)\n", Options.socket.c_str(), strerror(errno));
+		if (sock >= 0) {
+			close(sock);
+		}
+		return false;
+	}
+	std::string line = request + "\n";
+	if (send(sock,line.data(),line.size(),MSG_NOSIGNAL) < 0) {
+		perror("send");
+		close(sock);
+		return false;
+	}
+	reply.clear();
+	char buf[4096];
+	ssize_t n;
+	while ((n = recv(sock,buf,sizeof(buf),0)) > 0) {
+		reply.append(buf,n);
+	}
+	close(sock);
+	return true;
+}
+
+int
+main(int argc, char* argv[]) {
+	rosx::Parser parser;
+	parser.addGroup(Options);
+	parser.addArg<std::string>("request");
+	parser.read(argc, argv);
+
+	std::string request = parser.hasArg("request") ? parser.getArg<std::string>("request") : "status";
+
+	std::string reply;
+	if (Options.watch <= 0) {
+		if (!requestStatus(request,reply)) {
+			return 1;
+		}
+		fputs(reply.c_str(),stdout);
+		return 0;
+	}
+
+	while (true) {
+		if (!requestStatus(request,reply)) {
+			return 1;
+		}
+		// clear the terminal so the snapshot stays in place
+		printf("\033[H\033[2J%s", reply.c_str());
+		fflush(stdout);
+		usleep((useconds_t)(Options.watch * 1e6));
+	}
+}
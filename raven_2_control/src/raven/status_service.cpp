@@ -0,0 +1,371 @@
+/*
+ * status_service.cpp
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: agent
+ */
+
+#include "status_service.h"
+
+#include <errno.h>
+#include <poll.h>
+#include <sched.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include <iomanip>
+#include <set>
+#include <sstream>
+
+#include <boost/thread/thread.hpp>
+
+#include <raven/util/timing.h>
+#include <raven/util/metrics.h>
+
+#include "log.h"
+#include "defines.h"
+#include "utils.h"
+#include "shared_modes.h"
+#include "publish_scheduler.h"
+
+// nice value of the server thread
+#define STATUS_THREAD_NICE 10
+// how long a client gets to send its request
+#define STATUS_REQUEST_TIMEOUT_MSEC 200
+
+// upper edges of the loop timing buckets; the last bucket is everything above
+static const int64_t HISTOGRAM_EDGES_USEC[] = {100, 200, 300, 400, 500, 600, 700, 800, 900, 1000, 1100, 1200, 1500, 2000, 5000};
+#define HISTOGRAM_BUCKETS (sizeof(HISTOGRAM_EDGES_USEC)/sizeof(HISTOGRAM_EDGES_USEC[0]) + 1)
+
+// Written by the rt thread only; the server reads it without locking
+struct LoopHistogram {
+	volatile unsigned int counts[HISTOGRAM_BUCKETS];
+	volatile int64_t max_ns;
+	volatile unsigned int total;
+
+	void add(int64_t ns) {
+		int64_t usec = ns / 1000;
+		size_t b = 0;
+		while (b < HISTOGRAM_BUCKETS-1 && usec >= HISTOGRAM_EDGES_USEC[b]) {
+			b++;
+		}
+		counts[b]++;
+		total++;
+		if (ns > max_ns) {
+			max_ns = ns;
+		}
+	}
+	void clear() {
+		for (size_t b=0;b<HISTOGRAM_BUCKETS;b++) {
+			counts[b] = 0;
+		}
+		max_ns = 0;
+		total = 0;
+	}
+};
+
+static LoopHistogram loop_histogram;    // start to end of the cycle's work
+static LoopHistogram period_histogram;  // start to start
+static int64_t last_start_ns = 0;
+static volatile bool histogram_reset = false; // set by the server, done by the rt thread
+
+// The same buckets for the metrics exporter, in seconds. These are never reset.
+static std::vector<double>
+histogramBoundsSec() {
+	std::vector<double> bounds;
+	for (size_t b=0;b<HISTOGRAM_BUCKETS-1;b++) {
+		bounds.push_back(HISTOGRAM_EDGES_USEC[b] * 1e-6);
+	}
+	return bounds;
+}
+static MetricHistogram loop_metric("r2_loop_duration_seconds","Time from the start to the end of the work of a servo cycle",histogramBoundsSec());
+static MetricHistogram period_metric("r2_loop_period_seconds","Time between the starts of consecutive servo cycles",histogramBoundsSec());
+
+static MetricCounter usb_read_errors("r2_usb_errors_total","USB packets that failed to transfer","direction=\"read\"");
+static MetricCounter usb_write_errors("r2_usb_errors_total","USB packets that failed to transfer","direction=\"write\"");
+static MetricCounter over_time_cycles("r2_loop_over_time_total","Servo cycles whose work took over 1 ms");
+static MetricCounter overdrive_estops("r2_overdrive_estops_total","Soft e-stops set by overdriveDetect");
+
+// by StatusFault
+static MetricCounter* const fault_counts[NUM_STATUS_FAULTS] = { &usb_read_errors, &usb_write_errors, &over_time_cycles, &overdrive_estops };
+
+static int status_sock = -1;
+static std::string status_path;
+static volatile bool status_running = false;
+static boost::thread* status_thread = NULL;
+
+void
+statusRecordLoop(int64_t start_ns, int64_t end_ns) {
+	if (histogram_reset) {
+		loop_histogram.clear();
+		period_histogram.clear();
+		last_start_ns = 0;
+		histogram_reset = false;
+	}
+	loop_histogram.add(end_ns - start_ns);
+	loop_metric.observe((end_ns - start_ns) * 1e-9);
+	if (last_start_ns) {
+		period_histogram.add(start_ns - last_start_ns);
+		period_metric.observe((start_ns - last_start_ns) * 1e-9);
+	}
+	last_start_ns = start_ns;
+}
+
+void
+statusCountFault(StatusFault fault) {
+	fault_counts[fault]->inc();
+}
+
+static const char*
+faultName(int fault) {
+	switch (fault) {
+	case STATUS_FAULT_USB_READ: return "usb read errors";
+	case STATUS_FAULT_USB_WRITE: return "usb write errors";
+	case STATUS_FAULT_OVER_TIME: return "cycles over time";
+	case STATUS_FAULT_OVERDRIVE: return "overdrive estops";
+	default: return "unknown";
+	}
+}
+
+static const char*
+jointStateName(int state) {
+	switch (state) {
+	case jstate_not_ready: return "not_ready";
+	case jstate_pos_unknown: return "pos_unknown";
+	case jstate_homing1: return "homing1";
+	case jstate_homing2: return "homing2";
+	case jstate_ready: return "ready";
+	case jstate_wait: return "wait";
+	case jstate_hard_stop: return "hard_stop";
+	default: return "unknown";
+	}
+}
+
+static void
+writeHistogram(std::ostream& out, const char* name, const LoopHistogram& h) {
+	// copied first so the lines add up even while the rt thread keeps counting
+	unsigned int counts[HISTOGRAM_BUCKETS];
+	unsigned int total = 0;
+	for (size_t b=0;b<HISTOGRAM_BUCKETS;b++) {
+		counts[b] = h.counts[b];
+		total += counts[b];
+	}
+	out << name << ": " << total << " cycles, max " << h.max_ns / 1000 << " us" << std::endl;
+	for (size_t b=0;b<HISTOGRAM_BUCKETS;b++) {
+		if (!counts[b]) {
+			continue;
+		}
+		if (b < HISTOGRAM_BUCKETS-1) {
+			out << "  < " << std::setw(5) << HISTOGRAM_EDGES_USEC[b] << " us: ";
+		} else {
+			out << "  >=" << std::setw(5) << HISTOGRAM_EDGES_USEC[b-1] << " us: ";
+		}
+		out << std::setw(9) << counts[b] << "  " << std::fixed << std::setprecision(3) << 100. * counts[b] / total << "%" << std::endl;
+	}
+}
+
+static void
+writeTiming(std::ostream& out) {
+	writeHistogram(out,"cycle time",loop_histogram);
+	writeHistogram(out,"cycle period",period_histogram);
+	out << TIMING_STATS(TimingInfo,usb_read) << std::endl;
+	out << TIMING_STATS(TimingInfo,state_machine) << std::endl;
+	out << TIMING_STATS(TimingInfo,update_state) << std::endl;
+	out << TIMING_STATS(TimingInfo,control) << std::endl;
+	out << TIMING_STATS(TimingInfo,usb_write) << std::endl;
+	out << TIMING_STATS(TimingInfo,ros) << std::endl;
+	out << TIMING_STATS(TimingInfo,overall) << std::endl;
+}
+
+static void
+writeFaults(std::ostream& out) {
+	for (int f=0;f<NUM_STATUS_FAULTS;f++) {
+		out << faultName(f) << ": " << fault_counts[f]->value() << std::endl;
+	}
+	out << "log messages dropped: " << log_dropped() << std::endl;
+	out << "state samples dropped: " << PublishScheduler::samplesDropped() << std::endl;
+}
+
+static void
+writeModes(std::ostream& out, const PublishSnapshot& s) {
+	MasterMode masterMode;
+	std::set<MasterMode> masterConflicts;
+	getMasterModeConflicts(masterMode,masterConflicts);
+	out << "master mode: " << masterModeToString(masterMode);
+	for (std::set<MasterMode>::iterator itr=masterConflicts.begin();itr!=masterConflicts.end();itr++) {
+		out << (itr == masterConflicts.begin() ? " (conflicts:" : "") << " " << masterModeToString(*itr);
+	}
+	out << (masterConflicts.empty() ? "" : ")") << std::endl;
+
+	t_controlmode controlMode;
+	std::set<t_controlmode> controlConflicts;
+	getControlModeConflicts(controlMode,controlConflicts);
+	out << "control mode: " << controlModeToString(s.controlMode);
+	for (std::set<t_controlmode>::iterator itr=controlConflicts.begin();itr!=controlConflicts.end();itr++) {
+		out << (itr == controlConflicts.begin() ? " (conflicts:" : "") << " " << controlModeToString(*itr);
+	}
+	out << (controlConflicts.empty() ? "" : ")") << std::endl;
+}
+
+static void
+writeJoints(std::ostream& out, const PublishSnapshot& snapshot) {
+	struct robot_device device = snapshot.device;
+	struct mechanism* _mech = NULL;
+	int mechnum = 0;
+	while (loop_over_mechs(&device,_mech,mechnum)) {
+		out << std::endl << armNameFromMechType(_mech->type) << " arm (board " << mechnum << ")" << std::endl;
+		out << std::left << std::setw(16) << "joint" << std::setw(12) << "state" << std::right
+				<< std::setw(9) << "enc_val" << std::setw(9) << "enc_off"
+				<< std::setw(9) << "mpos" << std::setw(9) << "mpos_d"
+				<< std::setw(9) << "jpos" << std::setw(9) << "jpos_d"
+				<< std::setw(9) << "tau_d" << std::setw(7) << "dac" << std::endl;
+		struct DOF* _joint = NULL;
+		int jnum = 0;
+		while (loop_over_joints(_mech,_joint,jnum)) {
+			out << std::left << std::setw(16) << jointIndexAndArmName(_joint->type) << std::setw(12) << jointStateName(_joint->state) << std::right
+					<< std::setw(9) << _joint->enc_val << std::setw(9) << _joint->enc_offset
+					<< std::fixed << std::setprecision(3)
+					<< std::setw(9) << _joint->mpos << std::setw(9) << _joint->mpos_d
+					<< std::setw(9) << _joint->jpos << std::setw(9) << _joint->jpos_d
+					<< std::setw(9) << _joint->tau_d << std::setw(7) << _joint->current_cmd << std::endl;
+		}
+	}
+}
+
+static std::string
+statusReply(const std::string& request) {
+	std::stringstream out;
+	if (request == "timing") {
+		writeTiming(out);
+	} else if (request == "faults") {
+		writeFaults(out);
+	} else if (request == "reset") {
+		histogram_reset = true;
+		out << "histograms cleared" << std::endl;
+	} else if (request.empty() || request == "status") {
+		PublishFrameConstPtr frame = PublishScheduler::latestFrame();
+		if (!frame) {
+			out << "no state yet" << std::endl;
+			return out.str();
+		}
+		const PublishSnapshot& s = frame->snapshot;
+		out << "loop " << s.seq << " at " << s.stamp.tv_sec << "." << std::setw(9) << std::setfill('0') << s.stamp.tv_nsec << std::setfill(' ') << std::endl;
+		out << "runlevel: " << runLevelName(s.runlevel) << " (" << (int)s.runlevel << "." << (int)s.sublevel << ")"
+				<< (s.estop ? ", estop" : "") << ", pedal " << (s.pedal_down ? "down" : "up") << std::endl;
+		writeModes(out,s);
+		writeJoints(out,s);
+		out << std::endl;
+		writeTiming(out);
+		out << std::endl;
+		writeFaults(out);
+	} else {
+		out << "unknown request '" << request << "' (status, timing, faults, reset)" << std::endl;
+	}
+	return out.str();
+}
+
+static void
+serveClient(int fd) {
+	std::string request;
+	char buf[128];
+	struct pollfd pfd;
+	pfd.fd = fd;
+	pfd.events = POLLIN;
+	// a client that sends nothing gets the full status
+	while (request.size() < sizeof(buf) && poll(&pfd,1,STATUS_REQUEST_TIMEOUT_MSEC) > 0) {
+		ssize_t n = recv(fd,buf,sizeof(buf),0);
+		if (n <= 0) {
+			break;
+		}
+		request.append(buf,n);
+		if (request.find('\n') != std::string::npos) {
+			break;
+		}
+	}
+	size_t end = request.find_first_of("\r\n");
+	if (end != std::string::npos) {
+		request.resize(end);
+	}
+
+	std::string reply = statusReply(request);
+	size_t sent = 0;
+	while (sent < reply.size()) {
+		ssize_t n = send(fd,reply.data() + sent,reply.size() - sent,MSG_NOSIGNAL);
+		if (n <= 0) {
+			break;
+		}
+		sent += n;
+	}
+	close(fd);
+}
+
+static void
+statusProcess() {
+	struct sched_param param;
+	param.sched_priority = 0;
+	if (sched_setscheduler(0, SCHED_OTHER, &param) == -1) {
+		log_err("sched_setscheduler failed for the status service");
+	}
+	setpriority(PRIO_PROCESS, 0, STATUS_THREAD_NICE);
+
+	struct pollfd pfd;
+	pfd.fd = status_sock;
+	pfd.events = POLLIN;
+	while (status_running) {
+		if (poll(&pfd,1,250) <= 0) {
+			continue;
+		}
+		int fd = accept(status_sock,NULL,NULL);
+		if (fd < 0) {
+			continue;
+		}
+		serveClient(fd);
+	}
+}
+
+bool
+initStatusService(const std::string& path) {
+	struct sockaddr_un addr;
+	if (path.size() >= sizeof(addr.sun_path)) {
+		log_err("Status socket path too long: %s",path.c_str());
+		return false;
+	}
+	status_sock = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (status_sock < 0) {
+		log_err("Could not create status socket: %s",strerror(errno));
+		return false;
+	}
+	memset(&addr,0,sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strncpy(addr.sun_path,path.c_str(),sizeof(addr.sun_path)-1);
+	// left over from a previous run
+	unlink(path.c_str());
+	if (bind(status_sock,(struct sockaddr*)&addr,sizeof(addr)) < 0 || listen(status_sock,8) < 0) {
+		log_err("Could not listen on status socket %s: %s",path.c_str(),strerror(errno));
+		close(status_sock);
+		status_sock = -1;
+		return false;
+	}
+	status_path = path;
+	status_running = true;
+	status_thread = new boost::thread(statusProcess);
+	log_msg("Status service on %s",path.c_str());
+	return true;
+}
+
+void
+stopStatusService() {
+	if (!status_running) {
+		return;
+	}
+	status_running = false;
+	status_thread->join();
+	delete status_thread;
+	status_thread = NULL;
+	close(status_sock);
+	status_sock = -1;
+	unlink(status_path.c_str());
+}
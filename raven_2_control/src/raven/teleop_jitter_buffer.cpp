@@ -0,0 +1,271 @@
+/*
+ * teleop_jitter_buffer.cpp
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: agent
+ */
+
+#include <raven/teleop_jitter_buffer.h>
+
+#include <math.h>
+#include <string.h>
+
+static inline int64_t
+toNSec(const struct timespec& t) {
+	return t.tv_sec * (int64_t)1000000000 + t.tv_nsec;
+}
+
+static inline int64_t
+roundToInt(double x) {
+	return (int64_t)floor(x + 0.5);
+}
+
+static void
+slerp(const double* q0, const double* q1_in, double alpha, double* out) {
+	double q1[4];
+	double dot = 0;
+	for (int i=0;i<4;i++) {
+		dot += q0[i] * q1_in[i];
+	}
+	// take the short way around
+	double sign = dot < 0 ? -1 : 1;
+	for (int i=0;i<4;i++) {
+		q1[i] = sign * q1_in[i];
+	}
+	dot *= sign;
+
+	double w0, w1;
+	if (dot > 0.9995) {
+		w0 = 1 - alpha;
+		w1 = alpha;
+	} else {
+		double theta = acos(dot);
+		double s = sin(theta);
+		w0 = sin((1 - alpha) * theta) / s;
+		w1 = sin(alpha * theta) / s;
+	}
+
+	double norm = 0;
+	for (int i=0;i<4;i++) {
+		out[i] = w0 * q0[i] + w1 * q1[i];
+		norm += out[i] * out[i];
+	}
+	norm = sqrt(norm);
+	if (norm > 0) {
+		for (int i=0;i<4;i++) {
+			out[i] /= norm;
+		}
+	}
+}
+
+static inline void
+getRotation(const struct u_struct& u, int arm, double* q) {
+	q[0] = u.Qx[arm];
+	q[1] = u.Qy[arm];
+	q[2] = u.Qz[arm];
+	q[3] = u.Qw[arm];
+}
+
+static inline void
+setRotation(struct u_struct& u, int arm, const double* q) {
+	u.Qx[arm] = q[0];
+	u.Qy[arm] = q[1];
+	u.Qz[arm] = q[2];
+	u.Qw[arm] = q[3];
+}
+
+TeleopJitterBuffer::TeleopJitterBuffer(int64_t maxDelay) : maxDelay_(maxDelay), late_(0), resets_(0) {
+	memset(position_,0,sizeof(position_));
+	memset(emitted_,0,sizeof(emitted_));
+	memset(grasp_,0,sizeof(grasp_));
+	memset(graspEmitted_,0,sizeof(graspEmitted_));
+	restart();
+	resets_ = 0;
+}
+
+void
+TeleopJitterBuffer::restart() {
+	// position_, grasp_ and their emitted sums carry over, so motion that was received but not
+	// yet played out is still delivered with the next packet
+	first_ = 0;
+	count_ = 0;
+	numTransits_ = 0;
+	minTransit_ = 0;
+	lastTransit_ = 0;
+	jitter_ = 0;
+	interval_ = 0;
+	delay_ = 0;
+	playedUntil_ = 0;
+	playedNewest_ = true;
+	resets_++;
+}
+
+bool
+TeleopJitterBuffer::push(const struct u_struct& u, int64_t sendTime, const struct timespec& rx) {
+	Input in;
+	in.u = u;
+	in.send = sendTime;
+	in.rx = rx;
+	return input_.push(in);
+}
+
+void
+TeleopJitterBuffer::add(const Input& in) {
+	int64_t transit = toNSec(in.rx) - in.send;
+
+	if (numTransits_ > 0) {
+		int64_t d = transit - lastTransit_;
+		if (d > TELEOP_JITTER_RESET_TRANSIT || d < -TELEOP_JITTER_RESET_TRANSIT) {
+			restart();
+		} else if (count_ > 0 && in.send <= entry(count_-1).send) {
+			// reordered; the sequence checks normally catch this first
+			return;
+		}
+	}
+
+	if (numTransits_ > 0) {
+		int64_t d = transit - lastTransit_;
+		jitter_ += ((d < 0 ? -d : d) - jitter_) / 16;
+	}
+	lastTransit_ = transit;
+
+	transits_[numTransits_ % TELEOP_JITTER_TRANSIT_WINDOW] = transit;
+	numTransits_++;
+	unsigned int n = numTransits_ < TELEOP_JITTER_TRANSIT_WINDOW ? numTransits_ : TELEOP_JITTER_TRANSIT_WINDOW;
+	minTransit_ = transits_[0];
+	for (unsigned int i=1;i<n;i++) {
+		if (transits_[i] < minTransit_) {
+			minTransit_ = transits_[i];
+		}
+	}
+
+	if (count_ > 0) {
+		int64_t interval = in.send - entry(count_-1).send;
+		if (interval < TELEOP_JITTER_MAX_GAP) {
+			interval_ = interval_ == 0 ? interval : interval_ + (interval - interval_) / 16;
+		}
+	}
+
+	if (count_ > 0 && in.send < playedUntil_) {
+		late_++;
+	}
+
+	if (count_ == TELEOP_JITTER_SIZE) {
+		first_ = (first_ + 1) % TELEOP_JITTER_SIZE;
+		count_--;
+	}
+	Entry& e = entry(count_);
+	count_++;
+
+	e.send = in.send;
+	e.rx = in.rx;
+	e.u = in.u;
+	for (int arm=0;arm<TELEOP_JITTER_ARMS;arm++) {
+		position_[arm][0] += in.u.delx[arm];
+		position_[arm][1] += in.u.dely[arm];
+		position_[arm][2] += in.u.delz[arm];
+		for (int j=0;j<3;j++) {
+			e.position[arm][j] = position_[arm][j];
+		}
+		grasp_[arm] += in.u.grasp[arm];
+		e.grasp[arm] = grasp_[arm];
+	}
+	playedNewest_ = false;
+}
+
+bool
+TeleopJitterBuffer::tick(int64_t now, struct u_struct& out, struct timespec& rx) {
+	Input in;
+	while (input_.pop(in)) {
+		add(in);
+	}
+	if (count_ == 0) {
+		return false;
+	}
+
+	int64_t target = interval_ + 3 * jitter_;
+	if (target > maxDelay_) {
+		target = maxDelay_;
+	}
+	delay_ += (target - delay_) / 32;
+
+	int64_t playout = now - minTransit_ - delay_;
+
+	// keep only the newest entry at or before the playout point
+	while (count_ > 1 && entry(1).send <= playout) {
+		first_ = (first_ + 1) % TELEOP_JITTER_SIZE;
+		count_--;
+	}
+
+	Entry& a = entry(0);
+	if (playout < a.send) {
+		return false;
+	}
+
+	double position[TELEOP_JITTER_ARMS][3];
+	double rotation[TELEOP_JITTER_ARMS][4];
+
+	if (count_ == 1) {
+		if (playedNewest_) {
+			return false;
+		}
+		playedNewest_ = true;
+		for (int arm=0;arm<TELEOP_JITTER_ARMS;arm++) {
+			for (int j=0;j<3;j++) {
+				position[arm][j] = a.position[arm][j];
+			}
+			getRotation(a.u,arm,rotation[arm]);
+		}
+	} else {
+		Entry& b = entry(1);
+		int64_t start = a.send;
+		if (b.send - start > TELEOP_JITTER_MAX_GAP) {
+			start = b.send - TELEOP_JITTER_MAX_GAP;
+		}
+		double alpha = playout <= start ? 0 : ((double)(playout - start)) / (b.send - start);
+		for (int arm=0;arm<TELEOP_JITTER_ARMS;arm++) {
+			for (int j=0;j<3;j++) {
+				position[arm][j] = a.position[arm][j] + alpha * (b.position[arm][j] - a.position[arm][j]);
+			}
+			double qa[4], qb[4];
+			getRotation(a.u,arm,qa);
+			getRotation(b.u,arm,qb);
+			slerp(qa,qb,alpha,rotation[arm]);
+		}
+	}
+
+	// buttons and surgeon mode come from the last packet reached; its grasp
+	// increment, and those of the packets skipped over, only the first time
+	out = a.u;
+	rx = a.rx;
+	for (int arm=0;arm<TELEOP_JITTER_ARMS;arm++) {
+		out.grasp[arm] = a.grasp[arm] - graspEmitted_[arm];
+		graspEmitted_[arm] = a.grasp[arm];
+
+		int64_t p[3];
+		for (int j=0;j<3;j++) {
+			p[j] = roundToInt(position[arm][j]);
+		}
+		out.delx[arm] = p[0] - emitted_[arm][0];
+		out.dely[arm] = p[1] - emitted_[arm][1];
+		out.delz[arm] = p[2] - emitted_[arm][2];
+		for (int j=0;j<3;j++) {
+			emitted_[arm][j] = p[j];
+		}
+		setRotation(out,arm,rotation[arm]);
+	}
+	playedUntil_ = playout;
+	return true;
+}
+
+TeleopJitterBuffer::Stats
+TeleopJitterBuffer::stats() const {
+	Stats s;
+	s.delay = delay_;
+	s.jitter = jitter_;
+	s.interval = interval_;
+	s.transit = minTransit_;
+	s.late = late_;
+	s.resets = resets_;
+	return s;
+}
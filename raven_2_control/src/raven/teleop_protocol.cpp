@@ -0,0 +1,345 @@
+/*
+ * teleop_protocol.cpp
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: agent
+ */
+
+#include <raven/teleop_protocol.h>
+#include <raven/util/crc32.h>
+
+#include <string.h>
+
+#define U_STRUCT_ARMS 2
+
+const char*
+teleopDecodeResultString(int result) {
+	switch (result) {
+	case TELEOP_DECODE_OK: return "ok";
+	case TELEOP_DECODE_NOT_V2: return "not a v2 packet";
+	case TELEOP_DECODE_BAD_VERSION: return "unsupported version";
+	case TELEOP_DECODE_BAD_LENGTH: return "bad length";
+	case TELEOP_DECODE_BAD_CRC: return "bad crc";
+	default: return "unknown";
+	}
+}
+
+const char*
+teleopSequenceResultString(int result) {
+	switch (result) {
+	case TELEOP_SEQ_APPLIED: return "applied";
+	case TELEOP_SEQ_REFLECT: return "reflect";
+	case TELEOP_SEQ_SKIPPED: return "skipped";
+	case TELEOP_SEQ_DUPLICATE: return "duplicate";
+	case TELEOP_SEQ_RESET: return "reset";
+	case TELEOP_SEQ_OUT_OF_ORDER: return "out of order";
+	default: return "unknown";
+	}
+}
+
+int
+teleopCheckSequence(unsigned int& seq, unsigned int sequence) {
+	if (sequence == 0) {
+		return TELEOP_SEQ_REFLECT;
+	} else if (sequence > seq+1) {
+		seq = sequence;
+		return TELEOP_SEQ_SKIPPED;
+	} else if (sequence == seq) {
+		return TELEOP_SEQ_DUPLICATE;
+	} else if (sequence > seq) {
+		seq = sequence;
+		return TELEOP_SEQ_APPLIED;
+	} else if (seq > TELEOP_SEQ_RESET_GAP && sequence < seq-TELEOP_SEQ_RESET_GAP) {
+		seq = sequence;
+		return TELEOP_SEQ_RESET;
+	}
+	return TELEOP_SEQ_OUT_OF_ORDER;
+}
+
+int
+teleopCheckArmSequences(unsigned int seqs[TELEOP_MAX_ARMS], TeleopPacket& packet) {
+	int kept = 0;
+	for (int i=0;i<packet.numArms;i++) {
+		const TeleopArmCommand& arm = packet.arms[i];
+		if (arm.id >= TELEOP_MAX_ARMS) {
+			// teleopPacketToUStruct counts it as ignored
+			packet.arms[kept++] = arm;
+		} else if (teleopCheckSequence(seqs[arm.id],arm.sequence) == TELEOP_SEQ_APPLIED) {
+			packet.arms[kept++] = arm;
+		}
+	}
+	packet.numArms = kept;
+	return kept;
+}
+
+/************************ little-endian helpers ************************/
+
+static inline void put16(uint8_t*& p, uint16_t v) {
+	p[0] = v; p[1] = v >> 8;
+	p += 2;
+}
+
+static inline void put32(uint8_t*& p, uint32_t v) {
+	p[0] = v; p[1] = v >> 8; p[2] = v >> 16; p[3] = v >> 24;
+	p += 4;
+}
+
+static inline void put64(uint8_t*& p, uint64_t v) {
+	put32(p,(uint32_t)v);
+	put32(p,(uint32_t)(v >> 32));
+}
+
+static inline void putDouble(uint8_t*& p, double d) {
+	uint64_t v;
+	memcpy(&v,&d,sizeof(v));
+	put64(p,v);
+}
+
+static inline void putFloat(uint8_t*& p, float f) {
+	uint32_t v;
+	memcpy(&v,&f,sizeof(v));
+	put32(p,v);
+}
+
+static inline uint16_t get16(const uint8_t*& p) {
+	uint16_t v = p[0] | (p[1] << 8);
+	p += 2;
+	return v;
+}
+
+static inline uint32_t get32(const uint8_t*& p) {
+	uint32_t v = (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+	p += 4;
+	return v;
+}
+
+static inline uint64_t get64(const uint8_t*& p) {
+	uint64_t lo = get32(p);
+	uint64_t hi = get32(p);
+	return lo | (hi << 32);
+}
+
+static inline double getDouble(const uint8_t*& p) {
+	uint64_t v = get64(p);
+	double d;
+	memcpy(&d,&v,sizeof(d));
+	return d;
+}
+
+static inline float getFloat(const uint8_t*& p) {
+	uint32_t v = get32(p);
+	float f;
+	memcpy(&f,&v,sizeof(f));
+	return f;
+}
+
+/************************ encode/decode ************************/
+
+bool
+teleopIsV2Packet(const uint8_t* buf, size_t len) {
+	if (len < 4) {
+		return false;
+	}
+	const uint8_t* p = buf;
+	return get32(p) == TELEOP_PROTOCOL_MAGIC;
+}
+
+size_t
+teleopEncode(const TeleopPacket& packet, uint8_t* buf, size_t len) {
+	if (packet.numArms < 1 || packet.numArms > TELEOP_MAX_ARMS) {
+		return 0;
+	}
+	size_t size = TELEOP_PACKET_SIZE(packet.numArms);
+	if (len < size) {
+		return 0;
+	}
+
+	uint8_t* p = buf;
+	put32(p,TELEOP_PROTOCOL_MAGIC);
+	*p++ = TELEOP_PROTOCOL_VERSION;
+	*p++ = packet.numArms;
+	put16(p,packet.flags);
+	put32(p,packet.sequence);
+	put64(p,packet.senderTime);
+
+	for (int i=0;i<packet.numArms;i++) {
+		const TeleopArmCommand& arm = packet.arms[i];
+		*p++ = arm.id;
+		*p++ = arm.buttons;
+		put16(p,0);
+		put32(p,arm.sequence);
+		for (int j=0;j<3;j++) {
+			put32(p,(uint32_t)arm.delta[j]);
+		}
+		for (int j=0;j<4;j++) {
+			putDouble(p,arm.rotation[j]);
+		}
+		put32(p,(uint32_t)arm.grasp);
+	}
+
+	put32(p,crc32Ieee(buf,p - buf));
+	return size;
+}
+
+int
+teleopDecode(const uint8_t* buf, size_t len, TeleopPacket& packet) {
+	if (!teleopIsV2Packet(buf,len)) {
+		return TELEOP_DECODE_NOT_V2;
+	}
+	if (len < TELEOP_PACKET_SIZE(1)) {
+		return TELEOP_DECODE_BAD_LENGTH;
+	}
+
+	const uint8_t* p = buf + 4;
+	uint8_t version = *p++;
+	if (version != TELEOP_PROTOCOL_VERSION) {
+		return TELEOP_DECODE_BAD_VERSION;
+	}
+	uint8_t numArms = *p++;
+	if (numArms < 1 || numArms > TELEOP_MAX_ARMS || len != (size_t)TELEOP_PACKET_SIZE(numArms)) {
+		return TELEOP_DECODE_BAD_LENGTH;
+	}
+
+	const uint8_t* crc_p = buf + len - TELEOP_CRC_SIZE;
+	if (get32(crc_p) != crc32Ieee(buf,len - TELEOP_CRC_SIZE)) {
+		return TELEOP_DECODE_BAD_CRC;
+	}
+
+	packet.numArms = numArms;
+	packet.flags = get16(p);
+	packet.sequence = get32(p);
+	packet.senderTime = get64(p);
+
+	for (int i=0;i<numArms;i++) {
+		TeleopArmCommand& arm = packet.arms[i];
+		arm.id = *p++;
+		arm.buttons = *p++;
+		get16(p);
+		arm.sequence = get32(p);
+		for (int j=0;j<3;j++) {
+			arm.delta[j] = (int32_t)get32(p);
+		}
+		for (int j=0;j<4;j++) {
+			arm.rotation[j] = getDouble(p);
+		}
+		arm.grasp = (int32_t)get32(p);
+	}
+
+	return TELEOP_DECODE_OK;
+}
+
+size_t
+teleopEncodeFeedback(const TeleopFeedbackPacket& packet, uint8_t* buf, size_t len) {
+	if (packet.numArms < 1 || packet.numArms > TELEOP_MAX_ARMS) {
+		return 0;
+	}
+	size_t size = TELEOP_FEEDBACK_SIZE(packet.numArms);
+	if (len < size) {
+		return 0;
+	}
+
+	uint8_t* p = buf;
+	put32(p,TELEOP_FEEDBACK_MAGIC);
+	*p++ = TELEOP_PROTOCOL_VERSION;
+	*p++ = packet.numArms;
+	*p++ = packet.runlevel;
+	*p++ = packet.sublevel;
+	put32(p,packet.sequence);
+	put32(p,packet.masterSequence);
+	put64(p,packet.masterTime);
+	put32(p,packet.holdTime);
+	put64(p,packet.slaveTime);
+
+	for (int i=0;i<packet.numArms;i++) {
+		const TeleopFeedbackArm& arm = packet.arms[i];
+		*p++ = arm.id;
+		*p++ = arm.surgeonEngaged;
+		put16(p,arm.jointFlags);
+		for (int j=0;j<3;j++) {
+			putFloat(p,arm.force[j]);
+		}
+	}
+
+	put32(p,crc32Ieee(buf,p - buf));
+	return size;
+}
+
+int
+teleopDecodeFeedback(const uint8_t* buf, size_t len, TeleopFeedbackPacket& packet) {
+	const uint8_t* p = buf;
+	if (len < 4 || get32(p) != TELEOP_FEEDBACK_MAGIC) {
+		return TELEOP_DECODE_NOT_V2;
+	}
+	if (len < TELEOP_FEEDBACK_SIZE(1)) {
+		return TELEOP_DECODE_BAD_LENGTH;
+	}
+
+	uint8_t version = *p++;
+	if (version != TELEOP_PROTOCOL_VERSION) {
+		return TELEOP_DECODE_BAD_VERSION;
+	}
+	uint8_t numArms = *p++;
+	if (numArms < 1 || numArms > TELEOP_MAX_ARMS || len != (size_t)TELEOP_FEEDBACK_SIZE(numArms)) {
+		return TELEOP_DECODE_BAD_LENGTH;
+	}
+
+	const uint8_t* crc_p = buf + len - TELEOP_CRC_SIZE;
+	if (get32(crc_p) != crc32Ieee(buf,len - TELEOP_CRC_SIZE)) {
+		return TELEOP_DECODE_BAD_CRC;
+	}
+
+	packet.numArms = numArms;
+	packet.runlevel = *p++;
+	packet.sublevel = *p++;
+	packet.sequence = get32(p);
+	packet.masterSequence = get32(p);
+	packet.masterTime = get64(p);
+	packet.holdTime = get32(p);
+	packet.slaveTime = get64(p);
+
+	for (int i=0;i<numArms;i++) {
+		TeleopFeedbackArm& arm = packet.arms[i];
+		arm.id = *p++;
+		arm.surgeonEngaged = *p++;
+		arm.jointFlags = get16(p);
+		for (int j=0;j<3;j++) {
+			arm.force[j] = getFloat(p);
+		}
+	}
+
+	return TELEOP_DECODE_OK;
+}
+
+int
+teleopPacketToUStruct(const TeleopPacket& packet, struct u_struct& u) {
+	int ignored = 0;
+
+	u.sequence = packet.sequence;
+	u.pactyp = TELEOP_PROTOCOL_VERSION;
+	u.version = TELEOP_PROTOCOL_VERSION;
+	u.surgeon_mode = packet.surgeonEngaged() ? SURGEON_ENGAGED : SURGEON_DISENGAGED;
+	u.checksum = 0;
+	for (int i=0;i<U_STRUCT_ARMS;i++) {
+		u.delx[i] = u.dely[i] = u.delz[i] = 0;
+		u.buttonstate[i] = 0;
+		u.grasp[i] = 0;
+	}
+
+	for (int i=0;i<packet.numArms;i++) {
+		const TeleopArmCommand& arm = packet.arms[i];
+		if (arm.id >= U_STRUCT_ARMS) {
+			ignored++;
+			continue;
+		}
+		u.delx[arm.id] = arm.delta[0];
+		u.dely[arm.id] = arm.delta[1];
+		u.delz[arm.id] = arm.delta[2];
+		u.Qx[arm.id] = arm.rotation[0];
+		u.Qy[arm.id] = arm.rotation[1];
+		u.Qz[arm.id] = arm.rotation[2];
+		u.Qw[arm.id] = arm.rotation[3];
+		u.buttonstate[arm.id] = arm.buttons;
+		u.grasp[arm.id] = arm.grasp;
+	}
+	return ignored;
+}
@@ -0,0 +1,511 @@
+/*
+ * teleop_sim.cpp
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: agent
+ */
+
+/*
+ * Master console simulator and teleop load generator.
+ *
+ * Sends master packets (legacy u_struct or v2) to r2_control at 1-10 kHz, with
+ * optional loss, reordering, duplication and send jitter, then compares the
+ * sequence handling r2_control reports on teleop_rx_stats against what
+ * teleopCheckSequence predicts for the order the packets went out in, and
+ * reports the kernel receive -> teleopIntoDS1 latency. v2 feedback (run
+ * r2_control with --feedback-rate) is used for the round trip time.
+ *
+ * Needs no hardware when r2_control runs with --sim-usb:
+ *   rosrun raven_2_control r2_control --sim-usb --feedback-rate 1000
+ *   rosrun raven_2_control teleop_sim --rate 5000 --loss 0.01 --reorder 0.01 --duplicate 0.01 --jitter-usec 200
+ */
+
+#include <ros/ros.h>
+#include <raven_2_msgs/TeleopRxStats.h>
+#include <boost/thread/mutex.hpp>
+
+#include <raven/util/config.h>
+#include <raven/teleop_protocol.h>
+#include <itp_teleoperation.h>
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <errno.h>
+#include <math.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <queue>
+#include <vector>
+
+#define SIM_ARMS_LEGACY 2
+#define SIM_MOTION_HZ 0.5
+#define SIM_NEVER 0x7FFFFFFFFFFFFFFFll
+#define SIM_PACKET_BUFFER_SIZE (TELEOP_MAX_PACKET_SIZE > sizeof(struct u_struct) ? TELEOP_MAX_PACKET_SIZE : sizeof(struct u_struct))
+
+struct SimConfig : public rosx::ConfigGroup {
+	std::string host;
+	int port;
+	int rate;
+	float duration;
+	float loss;
+	float reorder;
+	float duplicate;
+	int jitter_usec;
+	int protocol;
+	int arms;
+	int amplitude;
+	int start_sequence;
+	int seed;
+	bool no_stats;
+
+	SimConfig() : rosx::ConfigGroup("teleop_sim") {
+		ConfigGroup_optionWithHelp(host,std::string,"r2_control host","127.0.0.1");
+		ConfigGroup_optionWithHelp(port,int,"r2_control teleop port",36000);
+		ConfigGroup_optionWithHelp(rate,int,"packets per second (1-10000)",1000);
+		ConfigGroup_optionWithHelp(duration,float,"seconds to send for",10.f);
+		ConfigGroup_optionWithHelp(loss,float,"probability a packet is never sent",0.f);
+		ConfigGroup_optionWithHelp(reorder,float,"probability a packet is held back behind the next two",0.f);
+		ConfigGroup_optionWithHelp(duplicate,float,"probability a packet is sent twice",0.f);
+		ConfigGroup_optionWithHelp(jitter_usec,int,"max random delay added to each send",0);
+		ConfigGroup_optionWithHelp(protocol,int,"1 = legacy u_struct, 2 = versioned packets",2);
+		ConfigGroup_optionWithHelp(arms,int,"arms per v2 packet (ids past 1 are ignored by the slave)",2);
+		ConfigGroup_optionWithHelp(amplitude,int,"radius of the simulated hand motion (microns)",10000);
+		ConfigGroup_optionWithHelp(start_sequence,int,"first sequence number (-1 = follow on from the slave)",-1);
+		ConfigGroup_optionWithHelp(seed,int,"random seed",1);
+		ConfigGroup_flagWithHelp(no_stats,"don't wait for teleop_rx_stats from r2_control");
+	}
+};
+
+static SimConfig Options;
+
+struct ScheduledPacket {
+	int64_t time;          // when to send (CLOCK_REALTIME ns)
+	unsigned int order;    // tie breaker, keeps equal times in generation order
+	unsigned int sequence;
+	size_t len;
+	uint8_t data[SIM_PACKET_BUFFER_SIZE];
+};
+
+struct SendsLater {
+	bool operator()(const ScheduledPacket& a, const ScheduledPacket& b) const {
+		return a.time != b.time ? a.time > b.time : a.order > b.order;
+	}
+};
+
+struct SimFeedback {
+	int sock;
+	volatile bool done;
+	unsigned int packets;
+	unsigned int bad;
+	std::vector<int64_t> roundTrip;  // ns, master send time -> feedback received
+	std::vector<int64_t> hold;       // ns, slave receive -> feedback sent
+};
+
+/************************ stats from r2_control ************************/
+
+static boost::mutex stats_mutex;
+static raven_2_msgs::TeleopRxStats last_stats;
+static bool have_stats = false;
+static bool measuring = false;
+static ros::Duration measured_ds1_max;
+
+static void
+statsCallback(const raven_2_msgs::TeleopRxStats::ConstPtr& msg) {
+	boost::mutex::scoped_lock lock(stats_mutex);
+	last_stats = *msg;
+	have_stats = true;
+	if (measuring && msg->ds1_latency_max > measured_ds1_max) {
+		measured_ds1_max = msg->ds1_latency_max;
+	}
+}
+
+// Waits for a teleop_rx_stats message stamped after since
+static bool
+waitForStats(const ros::Time& since, double timeout, raven_2_msgs::TeleopRxStats& stats) {
+	ros::WallTime end = ros::WallTime::now() + ros::WallDuration(timeout);
+	while (ros::ok() && ros::WallTime::now() < end) {
+		{
+			boost::mutex::scoped_lock lock(stats_mutex);
+			if (have_stats && last_stats.header.stamp > since) {
+				stats = last_stats;
+				return true;
+			}
+		}
+		ros::WallDuration(0.05).sleep();
+	}
+	return false;
+}
+
+/************************ helpers ************************/
+
+static inline int64_t
+nowNSec() {
+	struct timespec t;
+	clock_gettime(CLOCK_REALTIME, &t);
+	return t.tv_sec * (int64_t)1000000000 + t.tv_nsec;
+}
+
+static inline void
+sleepUntil(int64_t t) {
+	struct timespec ts;
+	ts.tv_sec = t / 1000000000;
+	ts.tv_nsec = t % 1000000000;
+	while (clock_nanosleep(CLOCK_REALTIME, TIMER_ABSTIME, &ts, NULL) == EINTR);
+}
+
+static int64_t
+percentile(std::vector<int64_t>& v, double p) {
+	if (v.empty()) {
+		return 0;
+	}
+	size_t i = (size_t)(p * (v.size() - 1));
+	std::nth_element(v.begin(), v.begin() + i, v.end());
+	return v[i];
+}
+
+static int64_t
+average(const std::vector<int64_t>& v) {
+	if (v.empty()) {
+		return 0;
+	}
+	int64_t sum = 0;
+	for (size_t i=0;i<v.size();i++) {
+		sum += v[i];
+	}
+	return sum / (int64_t)v.size();
+}
+
+// Simulated hand position (microns) of arm at time t (s): a circle in x/y
+static void
+handPosition(int arm, double t, int64_t* p) {
+	double phase = 2 * M_PI * SIM_MOTION_HZ * t + arm * M_PI / 2;
+	p[0] = (int64_t)floor(Options.amplitude * (cos(phase) - cos(arm * M_PI / 2)) + 0.5);
+	p[1] = (int64_t)floor(Options.amplitude * (sin(phase) - sin(arm * M_PI / 2)) + 0.5);
+	p[2] = 0;
+}
+
+// Same sum as UDPChecksum in network_layer.cpp
+static int
+legacyChecksum(const struct u_struct& u) {
+	int chk = u.surgeon_mode;
+	chk += u.delx[0] + u.dely[0] + u.delz[0];
+	chk += u.delx[1] + u.dely[1] + u.delz[1];
+	chk += u.buttonstate[0];
+	chk += u.buttonstate[1];
+	chk += (int)u.sequence;
+	return chk;
+}
+
+static size_t
+encodePacket(unsigned int sequence, int64_t sendTime, int64_t delta[TELEOP_MAX_ARMS][3], uint8_t* buf) {
+	if (Options.protocol == 1) {
+		struct u_struct u;
+		memset(&u, 0, sizeof(u));
+		u.sequence = sequence;
+		u.surgeon_mode = SURGEON_ENGAGED;
+		for (int arm=0;arm<SIM_ARMS_LEGACY;arm++) {
+			u.delx[arm] = delta[arm][0];
+			u.dely[arm] = delta[arm][1];
+			u.delz[arm] = delta[arm][2];
+			u.Qw[arm] = 1;
+		}
+		u.checksum = legacyChecksum(u);
+		memcpy(buf, &u, sizeof(u));
+		return sizeof(u);
+	}
+
+	TeleopPacket packet;
+	memset(&packet, 0, sizeof(packet));
+	packet.sequence = sequence;
+	packet.senderTime = sendTime;
+	packet.flags = TELEOP_FLAG_SURGEON_ENGAGED;
+	packet.numArms = Options.arms;
+	for (int arm=0;arm<Options.arms;arm++) {
+		TeleopArmCommand& cmd = packet.arms[arm];
+		cmd.id = arm;
+		cmd.sequence = sequence;
+		for (int j=0;j<3;j++) {
+			cmd.delta[j] = delta[arm][j];
+		}
+		cmd.rotation[3] = 1;
+	}
+	return teleopEncode(packet, buf, SIM_PACKET_BUFFER_SIZE);
+}
+
+static void*
+feedbackProcess(void* param) {
+	SimFeedback* fb = (SimFeedback*)param;
+	uint8_t buf[TELEOP_MAX_FEEDBACK_SIZE + 64];
+	TeleopFeedbackPacket packet;
+
+	while (!fb->done) {
+		ssize_t len = recv(fb->sock, buf, sizeof(buf), 0);
+		if (len < 0) {
+			continue; // timeout, check done
+		}
+		int64_t now = nowNSec();
+		fb->packets++;
+		if ((size_t)len == sizeof(struct v_struct)) {
+			continue; // legacy feedback carries no timing
+		}
+		if (teleopDecodeFeedback(buf, len, packet) != TELEOP_DECODE_OK) {
+			fb->bad++;
+			continue;
+		}
+		if (packet.masterTime != 0) {
+			fb->roundTrip.push_back(now - (int64_t)packet.masterTime);
+			fb->hold.push_back(packet.holdTime);
+		}
+	}
+	return NULL;
+}
+
+/************************ main ************************/
+
+int
+main(int argc, char* argv[]) {
+	ros::init(argc, argv, "teleop_sim", ros::init_options::AnonymousName | ros::init_options::NoSigintHandler);
+
+	rosx::Parser parser;
+	parser.addGroup(Options);
+	parser.read(argc, argv);
+
+	if (Options.rate < 1 || Options.rate > 10000) {
+		fprintf(stderr, "--rate must be 1-10000\n");
+		return 2;
+	}
+	if (Options.protocol != 1 && Options.protocol != 2) {
+		fprintf(stderr, "--protocol must be 1 or 2\n");
+		return 2;
+	}
+	if (Options.arms < 1 || Options.arms > TELEOP_MAX_ARMS) {
+		fprintf(stderr, "--arms must be 1-%d\n", TELEOP_MAX_ARMS);
+		return 2;
+	}
+
+	unsigned short xsubi[3] = { 0x330E, (unsigned short)Options.seed, (unsigned short)(Options.seed >> 16) };
+
+	///// socket
+	struct addrinfo hints, *dest;
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_INET;
+	hints.ai_socktype = SOCK_DGRAM;
+	char port[16];
+	snprintf(port, sizeof(port), "%d", Options.port);
+	int err = getaddrinfo(Options.host.c_str(), port, &hints, &dest);
+	if (err != 0) {
+		fprintf(stderr, "%s: %s\n", Options.host.c_str(), gai_strerror(err));
+		return 1;
+	}
+	int sock = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+	if (sock < 0 || connect(sock, dest->ai_addr, dest->ai_addrlen) < 0) {
+		perror("socket");
+		return 1;
+	}
+	freeaddrinfo(dest);
+	struct timeval timeout = { 0, 100000 };
+	setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+	///// stats from r2_control
+	ros::NodeHandle n;
+	ros::Subscriber stats_sub = n.subscribe<raven_2_msgs::TeleopRxStats>("teleop_rx_stats", 10, statsCallback);
+	ros::AsyncSpinner spinner(1);
+	spinner.start();
+
+	raven_2_msgs::TeleopRxStats before, after;
+	bool use_stats = !Options.no_stats;
+	if (use_stats && !waitForStats(ros::Time(0), 3, before)) {
+		fprintf(stderr, "no teleop_rx_stats from r2_control; only reporting the send side\n");
+		use_stats = false;
+	}
+
+	unsigned int sequence;
+	if (Options.start_sequence >= 0) {
+		sequence = Options.start_sequence;
+	} else {
+		sequence = use_stats ? before.sequence + 1 : 1;
+	}
+	unsigned int slave_seq = use_stats ? before.sequence : 0;
+
+	///// feedback
+	SimFeedback fb;
+	fb.sock = sock;
+	fb.done = false;
+	fb.packets = 0;
+	fb.bad = 0;
+	unsigned int num_packets = (unsigned int)(Options.duration * Options.rate);
+	fb.roundTrip.reserve(num_packets);
+	fb.hold.reserve(num_packets);
+	pthread_t feedback_thread;
+	pthread_create(&feedback_thread, NULL, feedbackProcess, &fb);
+
+	///// send
+	int64_t period = 1000000000ll / Options.rate;
+	int64_t jitter = Options.jitter_usec * (int64_t)1000;
+	std::priority_queue<ScheduledPacket, std::vector<ScheduledPacket>, SendsLater> queue;
+	std::vector<unsigned int> sent_order;
+	std::vector<int64_t> lateness;
+	sent_order.reserve(num_packets * 2);
+	lateness.reserve(num_packets * 2);
+
+	unsigned int lost = 0, duplicated = 0, reordered = 0, send_errors = 0;
+	int64_t last_pos[TELEOP_MAX_ARMS][3];
+	for (int arm=0;arm<TELEOP_MAX_ARMS;arm++) {
+		handPosition(arm, 0, last_pos[arm]);
+	}
+
+	{
+		boost::mutex::scoped_lock lock(stats_mutex);
+		measuring = true;
+	}
+
+	ScheduledPacket p;
+	unsigned int generated = 0, order = 0;
+	int64_t start = nowNSec() + 10000000;
+	while (generated < num_packets || !queue.empty()) {
+		int64_t wake = generated < num_packets ? start + generated * period : SIM_NEVER;
+		if (!queue.empty() && queue.top().time < wake) {
+			wake = queue.top().time;
+		}
+		sleepUntil(wake);
+		int64_t now = nowNSec();
+
+		for (; generated < num_packets && start + generated * period <= now; generated++) {
+			int64_t t = start + generated * period;
+			int64_t delta[TELEOP_MAX_ARMS][3];
+			for (int arm=0;arm<TELEOP_MAX_ARMS;arm++) {
+				int64_t pos[3];
+				handPosition(arm, (t - start) * 1e-9, pos);
+				for (int j=0;j<3;j++) {
+					delta[arm][j] = pos[j] - last_pos[arm][j];
+					last_pos[arm][j] = pos[j];
+				}
+			}
+			unsigned int s = sequence++;
+			if (erand48(xsubi) < Options.loss) {
+				lost++;
+				continue;
+			}
+
+			p.sequence = s;
+			p.len = encodePacket(s, t, delta, p.data);
+			p.time = t + (jitter > 0 ? (int64_t)(erand48(xsubi) * jitter) : 0);
+			if (erand48(xsubi) < Options.reorder) {
+				p.time += 2 * period + jitter;
+				reordered++;
+			}
+			p.order = order++;
+			queue.push(p);
+			if (erand48(xsubi) < Options.duplicate) {
+				p.time += period / 2;
+				p.order = order++;
+				queue.push(p);
+				duplicated++;
+			}
+		}
+
+		while (!queue.empty() && queue.top().time <= now) {
+			const ScheduledPacket& q = queue.top();
+			if (send(sock, q.data, q.len, 0) != (ssize_t)q.len) {
+				send_errors++;
+			} else {
+				sent_order.push_back(q.sequence);
+				lateness.push_back(nowNSec() - q.time);
+			}
+			queue.pop();
+		}
+	}
+	int64_t end = nowNSec();
+
+	///// predicted sequence handling
+	unsigned int expected[TELEOP_SEQ_NUM_RESULTS];
+	memset(expected, 0, sizeof(expected));
+	for (size_t i=0;i<sent_order.size();i++) {
+		expected[teleopCheckSequence(slave_seq, sent_order[i])]++;
+	}
+
+	if (use_stats && !waitForStats(ros::Time::now() + ros::Duration(0.1), 3, after)) {
+		fprintf(stderr, "lost teleop_rx_stats from r2_control\n");
+		use_stats = false;
+	}
+	{
+		boost::mutex::scoped_lock lock(stats_mutex);
+		measuring = false;
+	}
+
+	fb.done = true;
+	pthread_join(feedback_thread, NULL);
+	close(sock);
+
+	///// report
+	printf("sent %u packets (%d Hz, protocol %d) over %.2f s: %u lost, %u duplicated, %u reordered, %u send errors\n",
+			(unsigned int)sent_order.size(), Options.rate, Options.protocol, (end - start) * 1e-9,
+			lost, duplicated, reordered, send_errors);
+	printf("send pacing: avg %lli us, p99 %lli us, max %lli us late\n",
+			(long long int)(average(lateness) / 1000),
+			(long long int)(percentile(lateness, 0.99) / 1000),
+			(long long int)(percentile(lateness, 1.0) / 1000));
+
+	bool ok = true;
+	if (use_stats) {
+		unsigned int measured[TELEOP_SEQ_NUM_RESULTS];
+		measured[TELEOP_SEQ_APPLIED] = after.applied - before.applied;
+		measured[TELEOP_SEQ_REFLECT] = after.reflect - before.reflect;
+		measured[TELEOP_SEQ_SKIPPED] = after.skipped - before.skipped;
+		measured[TELEOP_SEQ_DUPLICATE] = after.duplicate - before.duplicate;
+		measured[TELEOP_SEQ_RESET] = after.reset - before.reset;
+		measured[TELEOP_SEQ_OUT_OF_ORDER] = after.out_of_order - before.out_of_order;
+
+		printf("%-14s %10s %10s\n", "", "expected", "measured");
+		printf("%-14s %10u %10u\n", "received", (unsigned int)sent_order.size(), after.packets - before.packets);
+		printf("%-14s %10u %10u\n", "rejected", 0, after.rejected - before.rejected);
+		ok = after.packets - before.packets == sent_order.size() && after.rejected == before.rejected;
+		for (int i=0;i<TELEOP_SEQ_NUM_RESULTS;i++) {
+			printf("%-14s %10u %10u\n", teleopSequenceResultString(i), expected[i], measured[i]);
+			ok = ok && expected[i] == measured[i];
+		}
+
+		unsigned int updates = after.ds1_updates - before.ds1_updates;
+		if (updates > 0) {
+			int64_t total = after.ds1_latency_total.toNSec() - before.ds1_latency_total.toNSec();
+			printf("rx->teleopIntoDS1 latency: avg %lli us, max %lli us over %u updates\n",
+					(long long int)(total / updates / 1000),
+					(long long int)(measured_ds1_max.toNSec() / 1000), updates);
+		} else {
+			printf("rx->teleopIntoDS1 latency: no updates (is the master mode network?)\n");
+		}
+	} else {
+		printf("%-14s %10s\n", "", "expected");
+		for (int i=0;i<TELEOP_SEQ_NUM_RESULTS;i++) {
+			printf("%-14s %10u\n", teleopSequenceResultString(i), expected[i]);
+		}
+	}
+
+	if (fb.packets > 0) {
+		printf("feedback: %u packets, %u bad", fb.packets, fb.bad);
+		if (!fb.roundTrip.empty()) {
+			printf(", round trip avg %lli us, p50 %lli us, p99 %lli us, max %lli us, slave hold avg %lli us",
+					(long long int)(average(fb.roundTrip) / 1000),
+					(long long int)(percentile(fb.roundTrip, 0.5) / 1000),
+					(long long int)(percentile(fb.roundTrip, 0.99) / 1000),
+					(long long int)(percentile(fb.roundTrip, 1.0) / 1000),
+					(long long int)(average(fb.hold) / 1000));
+		}
+		printf("\n");
+	}
+
+	if (!ok) {
+		printf("sequence handling differs from the prediction\n");
+	}
+	spinner.stop();
+	return ok ? 0 : 1;
+}
@@ -10,9 +10,14 @@
 #include "log.h"
 #include "utils.h"
 #include "defines.h"
+#include "shared_modes.h"
 #include <ros/ros.h>
 
-#include <memory>
+#include <raven/trajectory_plan.h>
+#include <raven/util/config.h>
+#include <raven/util/timing.h>
+
+#include <algorithm>
 #include <boost/thread/mutex.hpp>
 
 extern unsigned long int gTime;
@@ -36,7 +41,7 @@ struct _trajectory trajectory[MAX_MECH*MAX_DOF_PER_MECH];
 */
 int start_trajectory(struct DOF* _joint, float _endPos, float _period)
 {
-    trajectory[_joint->type].startTime = trajectory[_joint->type].startTime.now();
+    trajectory[_joint->type].startTime = LoopClock::now();
     trajectory[_joint->type].startPos = _joint->jpos;
     trajectory[_joint->type].startVel = _joint->jvel;
     _joint->jpos_d = _joint->jpos;
@@ -57,7 +62,7 @@ int start_trajectory(struct DOF* _joint, float _endPos, float _period)
 */
 int start_trajectory_mag(struct DOF* _joint, float _mag, float _period)
 {
-    trajectory[_joint->type].startTime = trajectory[_joint->type].startTime.now();
+    trajectory[_joint->type].startTime = LoopClock::now();
     trajectory[_joint->type].startPos = _joint->jpos;
     trajectory[_joint->type].startVel = _joint->jvel;
     _joint->jpos_d = _joint->jpos;
@@ -75,7 +80,7 @@ int start_trajectory_mag(struct DOF* _joint, float _mag, float _period)
 */
 int stop_trajectory(struct DOF* _joint)
 {
-    trajectory[_joint->type].startTime = trajectory[_joint->type].startTime.now();
+    trajectory[_joint->type].startTime = LoopClock::now();
     trajectory[_joint->type].startPos = _joint->jpos;
     trajectory[_joint->type].startVel = 0;
     _joint->jpos_d = _joint->jpos;
@@ -96,7 +101,7 @@ int update_sinusoid_velocity_trajectory(struct DOF* _joint)
     const float maxspeed = 15 DEG2RAD;
     const float f_period = 2000;         // 2 sec
 
-    ros::Duration t = ros::Time::now() - trajectory[_joint->type].startTime;
+    ros::Duration t = LoopClock::now() - trajectory[_joint->type].startTime;
 
    if (_joint->type      == SHOULDER_GOLD)
         _joint->jvel_d = -1 * maxspeed * sin( 2*M_PI * (1/f_period) * t.toSec());
@@ -124,7 +129,7 @@ int update_linear_sinusoid_velocity_trajectory(struct DOF* _joint)
     const float maxspeed[8] = {-4 DEG2RAD, 4 DEG2RAD, 0.02, 15 DEG2RAD};
     const float f_period = 2;         // 2 sec
 
-    ros::Duration t = ros::Time::now() - trajectory[_joint->type].startTime;
+    ros::Duration t = LoopClock::now() - trajectory[_joint->type].startTime;
 
     // Sinusoid portion complete.  Return without changing velocity.
     if (t.toSec() >= f_period/2)
@@ -156,7 +161,7 @@ int update_sinusoid_position_trajectory(struct DOF* _joint)
     float f_magnitude = traj->magnitude;
     float f_period    = traj->period;
 
-    ros::Duration t = ros::Time::now() - traj->startTime;
+    ros::Duration t = LoopClock::now() - traj->startTime;
 
     // Rising sinusoid
     if ( t.toSec() < f_period/4 )
@@ -178,7 +183,7 @@ int update_linear_sinusoid_position_trajectory(struct DOF* _joint)
 //    const float f_period[8] = {7000, 3200, 7000, 0000, 5000, 5000, 5000, 5000};
     struct _trajectory* traj = &(trajectory[_joint->type]);
 
-    ros::Duration t = ros::Time::now() - traj->startTime;
+    ros::Duration t = LoopClock::now() - traj->startTime;
 
     if ( t.toSec() < traj->period/2 )
 //        _joint->jpos_d += ONE_MS * f_magnitude[index] * (1-cos( 2*M_PI * (1/f_period[index]) * t.toSec()));
@@ -201,7 +206,7 @@ int update_position_trajectory(struct DOF* _joint)
     float magnitude = traj->magnitude;
     float period  = traj->period;
 
-    ros::Duration t = ros::Time::now()- traj->startTime;
+    ros::Duration t = LoopClock::now()- traj->startTime;
 
     if ( t.toSec() < period ){
         _joint->jpos_d = 0.5*magnitude * (1-cos( 2*M_PI * (1/(2*period)) * t.toSec())) + traj->startPos;
@@ -211,73 +216,242 @@ int update_position_trajectory(struct DOF* _joint)
     return 0;
 }
 
-boost::mutex trajMutex;
+/*
+ * Trajectory handoff.
+ * setTrajectory() builds the TrajectoryPlan on the caller's thread and leaves it in
+ * pending_plan; the rt thread adopts it with one atomic exchange on its next tick.
+ * Plans the rt thread is done with go onto retired_plans and are deleted by the
+ * next setTrajectory()/clearTrajectory() call, so the rt thread never locks or frees.
+ * A plan with no points stands for "clear".
+ *
+ * hasTrajectory() reads trajectory_state: the sequence number of the latest
+ * handoff shifted left one, or'ed with whether that plan has points. Writers
+ * set it before handing a plan off. When a plan ends, the rt thread clears the
+ * loaded bit with a compare and swap, which fails if another plan was handed
+ * off since.
+ */
+static TrajectoryPlan* volatile pending_plan = NULL;
+static TrajectoryPlan* current_plan = NULL;          // rt thread only
+static TrajectoryPlan* volatile retired_plans = NULL;
+static volatile unsigned int trajectory_state = 0;
+static unsigned int handoff_seq = 0;                 // writers only, under submitted_mutex
+
+static void retirePlan(TrajectoryPlan* plan) {
+	if (!plan) {
+		return;
+	}
+	TrajectoryPlan* head;
+	do {
+		head = retired_plans;
+		plan->retiredNext = head;
+	} while (__sync_val_compare_and_swap(&retired_plans,head,plan) != head);
+}
 
-std::auto_ptr<param_pass_trajectory> traj;
+static void freeRetiredPlans() {
+	TrajectoryPlan* plan = __sync_lock_test_and_set(&retired_plans,(TrajectoryPlan*)NULL);
+	while (plan) {
+		TrajectoryPlan* next = plan->retiredNext;
+		delete plan;
+		plan = next;
+	}
+}
 
-bool setTrajectory(const param_pass_trajectory& new_traj) {
-	trajMutex.lock();
-	if (!traj.get()) {
-		traj.reset(new param_pass_trajectory(new_traj));
+static void handOffPlan(TrajectoryPlan* plan) {
+	freeRetiredPlans();
+	plan->handoffSeq = ++handoff_seq;
+	// before the exchange, so the rt thread can't end the plan before the state names it
+	trajectory_state = (plan->handoffSeq << 1) | (plan->empty() ? 0 : 1);
+	__sync_synchronize();
+	TrajectoryPlan* unused = __sync_lock_test_and_set(&pending_plan,plan);
+	// the rt thread never saw a plan it didn't take out of pending_plan
+	delete unused;
+}
+
+/*
+ * Writer side copy of the trajectory handed to the rt thread, with the times
+ * it was given, for the streaming calls to build on. Only writers take the lock.
+ */
+static boost::mutex submitted_mutex;
+static param_pass_trajectory submitted;
+
+static inline double pointTime(const param_pass_trajectory& traj, size_t i) {
+	return traj.begin_time + traj.pts[i].time_from_start;
+}
+
+static bool submittedPlaying(double now) {
+	if (submitted.pts.empty()) {
+		return false;
+	}
+	return submitted.total_duration == 0 || now <= submitted.begin_time + submitted.total_duration;
+}
+
+static void submit(const param_pass_trajectory& traj) {
+	TrajectoryInterpolation interpolation = trajectoryInterpolationFromString(RavenConfig.trajectory_interpolation);
+	handOffPlan(new TrajectoryPlan(traj,interpolation));
+	submitted = traj;
+}
+
+/*
+ * The part of submitted still to be played at now, up to cut.
+ * The point before now is kept, and the setpoints at now and at cut are added
+ * as points, so the new plan passes through the setpoint the rt thread is at and
+ * follows the old one to cut.
+ */
+static void keepUnplayed(double now, double cut, param_pass_trajectory& out) {
+	const param_pass_trajectory& traj = submitted;
+	size_t n = traj.pts.size();
+	size_t current = 0;
+	while (current + 1 < n && pointTime(traj,current+1) <= now) {
+		current++;
+	}
+	double last = pointTime(traj,n-1);
+
+	out.begin_time = pointTime(traj,current);
+	out.total_duration = 0;
+	out.control_mode = traj.control_mode;
+	out.pts.clear();
+
+	TrajectoryPlan plan(traj,trajectoryInterpolationFromString(RavenConfig.trajectory_interpolation));
+	param_pass_trajectory_pt pt = traj.pts[current];
+	pt.time_from_start = 0;
+	out.pts.push_back(pt);
+	if (now > out.begin_time && now < last && now < cut) {
+		plan.sample(now,pt.param);
+		pt.time_from_start = now - out.begin_time;
+		out.pts.push_back(pt);
+	}
+	for (size_t i=current+1;i<n && pointTime(traj,i) < cut;i++) {
+		pt = traj.pts[i];
+		pt.time_from_start = pointTime(traj,i) - out.begin_time;
+		out.pts.push_back(pt);
+	}
+	if (cut < HUGE_VAL && cut > out.begin_time + out.pts.back().time_from_start) {
+		// past the last point, the old trajectory holds it until cut
+		if (cut < last) {
+			plan.sample(cut,pt.param);
+		} else {
+			pt = traj.pts[n-1];
+		}
+		pt.time_from_start = cut - out.begin_time;
+		out.pts.push_back(pt);
+	}
+}
+
+// Add the points of segment to traj, starting at absolute time start
+static void appendSegment(param_pass_trajectory& traj, const param_pass_trajectory& segment, double start) {
+	if (traj.pts.empty()) {
+		traj.begin_time = start;
+	}
+	for (size_t i=0;i<segment.pts.size();i++) {
+		param_pass_trajectory_pt pt = segment.pts[i];
+		pt.time_from_start += start - traj.begin_time;
+		traj.pts.push_back(pt);
+	}
+	if (segment.total_duration == 0 || traj.pts.empty()) {
+		traj.total_duration = 0;
 	} else {
-		*traj = new_traj;
+		double hold = segment.total_duration - (segment.pts.empty() ? 0 : segment.pts.back().time_from_start);
+		traj.total_duration = traj.pts.back().time_from_start + hold;
+	}
+}
+
+static bool continueTrajectory(double cut, bool cutIsStart, const param_pass_trajectory& segment) {
+	double now = ros::Time::now().toSec();
+	if (cut < now) {
+		cut = now;
 	}
+	boost::mutex::scoped_lock lock(submitted_mutex);
+
+	param_pass_trajectory traj;
+	traj.control_mode = segment.control_mode;
+	double start = now;
+	if (submittedPlaying(now)) {
+		if (submitted.control_mode != segment.control_mode) {
+			log_err("Trajectory controller %s doesn't match the one playing (%s)",
+					controlModeToString(segment.control_mode).c_str(),controlModeToString(submitted.control_mode).c_str());
+			return false;
+		}
+		keepUnplayed(now,cut,traj);
+		start = cutIsStart ? cut : std::max(now,pointTime(submitted,submitted.pts.size()-1));
+	} else if (cutIsStart) {
+		start = cut;
+	}
+	appendSegment(traj,segment,start);
+	submit(traj);
+	return true;
+}
+
+bool setTrajectory(const param_pass_trajectory& new_traj) {
+	boost::mutex::scoped_lock lock(submitted_mutex);
 	//printf("set traj with %u steps, %f %f %f\n",traj->pts.size(),traj->begin_time,traj->total_duration,traj->begin_time + traj->total_duration);
-	trajMutex.unlock();
+	submit(new_traj);
 	return true;
 }
+bool appendTrajectory(const param_pass_trajectory& segment) {
+	return continueTrajectory(HUGE_VAL,false,segment);
+}
+bool preemptTrajectory(double preempt_time, const param_pass_trajectory& segment) {
+	return continueTrajectory(preempt_time,true,segment);
+}
 bool clearTrajectory() {
-	trajMutex.lock();
-	traj.reset();
-	trajMutex.unlock();
+	boost::mutex::scoped_lock lock(submitted_mutex);
+	submit(param_pass_trajectory());
 	return true;
 }
 bool hasTrajectory() {
-	bool hasTraj;
-	trajMutex.lock();
-	hasTraj = traj.get() != 0;
-	trajMutex.unlock();
-	return hasTraj;
+	return trajectory_state & 1;
 }
-bool getTrajectory(param_pass_trajectory& traj_out) {
-	bool gotTraj = false;
-	trajMutex.lock();
-	if (traj.get()) {
-		traj_out = *traj;
-		gotTraj = true;
+bool getTrajectorySetpoint(double t, t_controlmode& controller, param_pass& param) {
+	boost::mutex::scoped_lock lock(submitted_mutex);
+	if (!submittedPlaying(ros::Time::now().toSec())) {
+		return false;
 	}
-	trajMutex.unlock();
-	return gotTraj;
+	controller = submitted.control_mode;
+	t = std::max(t,pointTime(submitted,0));
+	t = std::min(t,pointTime(submitted,submitted.pts.size()-1));
+	TrajectoryPlan plan(submitted,trajectoryInterpolationFromString(RavenConfig.trajectory_interpolation));
+	return plan.sample(t,param) == TrajectoryPlan::OK;
 }
-TrajectoryStatus getCurrentTrajectoryParams(t_controlmode& controller,param_pass& param) {
-	TrajectoryStatus ret = TrajectoryStatus::NO_TRAJECTORY;
-	ros::Time now = ros::Time::now();
-	trajMutex.lock();
-	if (traj.get()) {
-		if (traj->total_duration != 0 && now.toSec() > traj->begin_time + traj->total_duration) {
-			//printf("Clearing traj %f %f %f %f\n",traj->begin_time,traj->total_duration,traj->begin_time + traj->total_duration,now.toSec());
-			traj.reset();
-			ret = TrajectoryStatus::ENDED;
-		} else {
-			controller = traj->control_mode;
-			int ind_to_use = -1;
-			for (int i=0;i<(int)traj->pts.size();i++) {
-				if (traj->begin_time + traj->pts[i].time_from_start < now.toSec()) {
-					ind_to_use = i;
-				} else {
-					break;
-				}
-			}
-			if (ind_to_use != -1) {
-				//log_msg_throttle(0.25,"Time left: %f",traj->begin_time + traj->pts.back().time_from_start - now.toSec());
-				param = traj->pts[ind_to_use].param;
-				ret = TrajectoryStatus::OK;
-			} else {
-				//log_msg_throttle(0.25,"before start, first: %f %f %f %f",traj->begin_time, traj->pts[0].time_from_start,traj->begin_time + traj->pts[0].time_from_start,now.toSec());
-				ret = TrajectoryStatus::BEFORE_START;
+bool getTrajectoryExtent(double& begin_time, double& end_time, size_t& num_points) {
+	boost::mutex::scoped_lock lock(submitted_mutex);
+	num_points = submitted.pts.size();
+	if (!num_points) {
+		return false;
+	}
+	begin_time = pointTime(submitted,0);
+	end_time = pointTime(submitted,num_points-1);
+	return true;
+}
+TrajectoryStatus getCurrentTrajectoryParams(t_controlmode& controller,param_pass& param,TrajectoryVelocity* vel) {
+	if (pending_plan) {
+		TrajectoryPlan* plan = __sync_lock_test_and_set(&pending_plan,(TrajectoryPlan*)NULL);
+		if (plan) {
+			retirePlan(current_plan);
+			if (plan->empty()) {
+				retirePlan(plan);
+				plan = NULL;
 			}
+			current_plan = plan;
 		}
 	}
-	trajMutex.unlock();
-	return ret;
+	if (!current_plan) {
+		return TrajectoryStatus::NO_TRAJECTORY;
+	}
+
+	controller = current_plan->controlMode();
+	switch (current_plan->sample(LoopClock::now().toSec(),param,vel)) {
+	case TrajectoryPlan::OK:
+		return TrajectoryStatus::OK;
+	case TrajectoryPlan::BEFORE_START:
+		return TrajectoryStatus::BEFORE_START;
+	case TrajectoryPlan::ENDED: {
+		unsigned int ended = (current_plan->handoffSeq << 1) | 1;
+		__sync_bool_compare_and_swap(&trajectory_state,ended,ended & ~1u);
+		retirePlan(current_plan);
+		current_plan = NULL;
+		return TrajectoryStatus::ENDED;
+	}
+	default:
+		return TrajectoryStatus::NO_TRAJECTORY;
+	}
 }
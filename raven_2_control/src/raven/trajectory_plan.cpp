@@ -0,0 +1,360 @@
+/*
+ * trajectory_plan.cpp
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: agent
+ */
+
+#include <raven/trajectory_plan.h>
+
+#include <math.h>
+#include <string.h>
+#include <algorithm>
+
+TrajectoryInterpolation
+trajectoryInterpolationFromString(const std::string& str) {
+	if (str == "step") {
+		return TRAJECTORY_INTERP_STEP;
+	} else if (str == "quintic") {
+		return TRAJECTORY_INTERP_QUINTIC;
+	}
+	return TRAJECTORY_INTERP_CUBIC;
+}
+
+/************************ quaternions ************************/
+
+static void
+matrixToQuaternion(const float R[3][3], double* q) {
+	double trace = R[0][0] + R[1][1] + R[2][2];
+	if (trace > 0) {
+		double s = 0.5 / sqrt(trace + 1.0);
+		q[3] = 0.25 / s;
+		q[0] = (R[2][1] - R[1][2]) * s;
+		q[1] = (R[0][2] - R[2][0]) * s;
+		q[2] = (R[1][0] - R[0][1]) * s;
+	} else if (R[0][0] > R[1][1] && R[0][0] > R[2][2]) {
+		double s = 2.0 * sqrt(1.0 + R[0][0] - R[1][1] - R[2][2]);
+		q[3] = (R[2][1] - R[1][2]) / s;
+		q[0] = 0.25 * s;
+		q[1] = (R[0][1] + R[1][0]) / s;
+		q[2] = (R[0][2] + R[2][0]) / s;
+	} else if (R[1][1] > R[2][2]) {
+		double s = 2.0 * sqrt(1.0 + R[1][1] - R[0][0] - R[2][2]);
+		q[3] = (R[0][2] - R[2][0]) / s;
+		q[0] = (R[0][1] + R[1][0]) / s;
+		q[1] = 0.25 * s;
+		q[2] = (R[1][2] + R[2][1]) / s;
+	} else {
+		double s = 2.0 * sqrt(1.0 + R[2][2] - R[0][0] - R[1][1]);
+		q[3] = (R[1][0] - R[0][1]) / s;
+		q[0] = (R[0][2] + R[2][0]) / s;
+		q[1] = (R[1][2] + R[2][1]) / s;
+		q[2] = 0.25 * s;
+	}
+}
+
+static void
+quaternionToMatrix(const double* q, float R[3][3]) {
+	double x = q[0], y = q[1], z = q[2], w = q[3];
+	R[0][0] = 1 - 2*(y*y + z*z);
+	R[0][1] = 2*(x*y - z*w);
+	R[0][2] = 2*(x*z + y*w);
+	R[1][0] = 2*(x*y + z*w);
+	R[1][1] = 1 - 2*(x*x + z*z);
+	R[1][2] = 2*(y*z - x*w);
+	R[2][0] = 2*(x*z - y*w);
+	R[2][1] = 2*(y*z + x*w);
+	R[2][2] = 1 - 2*(x*x + y*y);
+}
+
+// q0 and q1 must already be in the same hemisphere
+static void
+slerp(const double* q0, const double* q1, double alpha, double* out) {
+	double dot = 0;
+	for (int i=0;i<4;i++) {
+		dot += q0[i] * q1[i];
+	}
+	double w0, w1;
+	if (dot > 0.9995) {
+		w0 = 1 - alpha;
+		w1 = alpha;
+	} else {
+		double theta = acos(dot);
+		double s = sin(theta);
+		w0 = sin((1 - alpha) * theta) / s;
+		w1 = sin(alpha * theta) / s;
+	}
+	double norm = 0;
+	for (int i=0;i<4;i++) {
+		out[i] = w0 * q0[i] + w1 * q1[i];
+		norm += out[i] * out[i];
+	}
+	norm = sqrt(norm);
+	for (int i=0;i<4;i++) {
+		out[i] /= norm;
+	}
+}
+
+static inline int
+roundToInt(double x) {
+	return (int)floor(x + 0.5);
+}
+
+/************************ TrajectoryPlan ************************/
+
+double
+TrajectoryPlan::channelValue(const param_pass& p, const Channel& c) {
+	switch (c.type) {
+	case CHANNEL_XD:
+		return c.axis == 0 ? p.xd[c.index].x : (c.axis == 1 ? p.xd[c.index].y : p.xd[c.index].z);
+	case CHANNEL_GRASP:
+		return p.rd[c.index].grasp;
+	case CHANNEL_MPOS:
+		return p.mpos_d[c.index];
+	default:
+		return p.jpos_d[c.index];
+	}
+}
+
+void
+TrajectoryPlan::setChannelValue(param_pass& p, const Channel& c, double v) {
+	switch (c.type) {
+	case CHANNEL_XD:
+		if (c.axis == 0) {
+			p.xd[c.index].x = roundToInt(v);
+		} else if (c.axis == 1) {
+			p.xd[c.index].y = roundToInt(v);
+		} else {
+			p.xd[c.index].z = roundToInt(v);
+		}
+		break;
+	case CHANNEL_GRASP:
+		p.rd[c.index].grasp = roundToInt(v);
+		break;
+	case CHANNEL_MPOS:
+		p.mpos_d[c.index] = v;
+		break;
+	default:
+		p.jpos_d[c.index] = v;
+		break;
+	}
+}
+
+TrajectoryPlan::TrajectoryPlan()
+	: beginTime_(0), endTime_(0), controlMode_(no_control), interpolation_(TRAJECTORY_INTERP_STEP), cursor_(0), retiredNext(0), handoffSeq(0) {
+	memset(rotates_,0,sizeof(rotates_));
+}
+
+TrajectoryPlan::TrajectoryPlan(const param_pass_trajectory& traj, TrajectoryInterpolation interpolation)
+	: beginTime_(traj.begin_time), controlMode_(traj.control_mode), interpolation_(interpolation), cursor_(0), retiredNext(0), handoffSeq(0) {
+	endTime_ = traj.total_duration != 0 ? traj.begin_time + traj.total_duration : HUGE_VAL;
+	memset(rotates_,0,sizeof(rotates_));
+
+	size_t n = traj.pts.size();
+	times_.resize(n);
+	params_.resize(n);
+	for (size_t i=0;i<n;i++) {
+		times_[i] = traj.begin_time + traj.pts[i].time_from_start;
+		if (i > 0 && times_[i] < times_[i-1]) {
+			times_[i] = times_[i-1];
+		}
+		params_[i] = traj.pts[i].param;
+	}
+	if (n < 2 || interpolation_ == TRAJECTORY_INTERP_STEP) {
+		return;
+	}
+
+	for (int m=0;m<MAX_MECH_PER_DEV;m++) {
+		for (int axis=0;axis<3;axis++) {
+			addChannelIfVaries(CHANNEL_XD,m,axis);
+		}
+		addChannelIfVaries(CHANNEL_GRASP,m,0);
+	}
+	for (int j=0;j<MAX_MECH_PER_DEV*MAX_DOF_PER_MECH;j++) {
+		addChannelIfVaries(CHANNEL_JPOS,j,0);
+		addChannelIfVaries(CHANNEL_MPOS,j,0);
+	}
+
+	size_t nc = channels_.size();
+	values_.resize(n * nc);
+	for (size_t i=0;i<n;i++) {
+		for (size_t c=0;c<nc;c++) {
+			values_[i*nc + c] = channelValue(params_[i],channels_[c]);
+		}
+	}
+	computeTangents();
+
+	bool anyRotates = false;
+	for (int m=0;m<MAX_MECH_PER_DEV;m++) {
+		for (size_t i=1;i<n && !rotates_[m];i++) {
+			rotates_[m] = memcmp(params_[i].rd[m].R,params_[0].rd[m].R,sizeof(params_[0].rd[m].R)) != 0;
+		}
+		anyRotates = anyRotates || rotates_[m];
+	}
+	if (anyRotates) {
+		quats_.resize(n * MAX_MECH_PER_DEV * 4);
+		for (int m=0;m<MAX_MECH_PER_DEV;m++) {
+			if (!rotates_[m]) {
+				continue;
+			}
+			for (size_t i=0;i<n;i++) {
+				double* q = &quats_[(i*MAX_MECH_PER_DEV + m)*4];
+				matrixToQuaternion(params_[i].rd[m].R,q);
+				if (i > 0) {
+					// keep consecutive points in the same hemisphere so slerp takes the short way
+					const double* prev = &quats_[((i-1)*MAX_MECH_PER_DEV + m)*4];
+					double dot = prev[0]*q[0] + prev[1]*q[1] + prev[2]*q[2] + prev[3]*q[3];
+					if (dot < 0) {
+						for (int k=0;k<4;k++) {
+							q[k] = -q[k];
+						}
+					}
+				}
+			}
+		}
+	}
+}
+
+void
+TrajectoryPlan::addChannelIfVaries(int type, int index, int axis) {
+	Channel c;
+	c.type = type;
+	c.index = index;
+	c.axis = axis;
+	double first = channelValue(params_[0],c);
+	for (size_t i=1;i<params_.size();i++) {
+		if (channelValue(params_[i],c) != first) {
+			channels_.push_back(c);
+			return;
+		}
+	}
+}
+
+/*
+ * Fritsch-Butland tangents: the weighted harmonic mean of the neighbouring
+ * slopes, and zero where the slope changes sign. This keeps every cubic
+ * segment monotone, so with cubic interpolation the setpoint never goes past a
+ * point. The quintic basis doesn't keep that guarantee. The ends are at rest.
+ */
+void
+TrajectoryPlan::computeTangents() {
+	size_t n = times_.size();
+	size_t nc = channels_.size();
+	tangents_.assign(n * nc, 0);
+	for (size_t i=1;i+1<n;i++) {
+		double h0 = times_[i] - times_[i-1];
+		double h1 = times_[i+1] - times_[i];
+		if (h0 <= 0 || h1 <= 0) {
+			continue;
+		}
+		for (size_t c=0;c<nc;c++) {
+			double d0 = (values_[i*nc + c] - values_[(i-1)*nc + c]) / h0;
+			double d1 = (values_[(i+1)*nc + c] - values_[i*nc + c]) / h1;
+			if (d0 * d1 <= 0) {
+				continue;
+			}
+			double w0 = 2*h1 + h0;
+			double w1 = h1 + 2*h0;
+			tangents_[i*nc + c] = (w0 + w1) / (w0 / d0 + w1 / d1);
+		}
+	}
+}
+
+size_t
+TrajectoryPlan::findSegment(double t) {
+	if (times_[cursor_] > t) {
+		// time went backwards; only happens on clock adjustments
+		cursor_ = std::upper_bound(times_.begin(),times_.end(),t) - times_.begin() - 1;
+	}
+	while (cursor_ + 1 < times_.size() && times_[cursor_+1] <= t) {
+		cursor_++;
+	}
+	return cursor_;
+}
+
+TrajectoryPlan::Status
+TrajectoryPlan::sample(double t, param_pass& param, TrajectoryVelocity* vel) {
+	if (times_.empty()) {
+		return EMPTY;
+	}
+	if (t > endTime_) {
+		return ENDED;
+	}
+	if (t < times_[0]) {
+		return BEFORE_START;
+	}
+	if (vel) {
+		memset(vel,0,sizeof(*vel));
+	}
+
+	size_t i = findSegment(t);
+	param = params_[i];
+	if (interpolation_ == TRAJECTORY_INTERP_STEP) {
+		return OK;
+	}
+
+	size_t nc = channels_.size();
+	double h = i + 1 < times_.size() ? times_[i+1] - times_[i] : 0;
+	if (h <= 0) {
+		// past the last point: hold it, at rest
+		for (size_t c=0;c<nc;c++) {
+			if (channels_[c].type == CHANNEL_JPOS) {
+				param.jvel_d[channels_[c].index] = 0;
+			}
+		}
+		return OK;
+	}
+
+	double s = (t - times_[i]) / h;
+	double s2 = s * s;
+	double s3 = s2 * s;
+	// Hermite basis for p0, h*m0, h*m1, p1 and their derivatives wrt s
+	double b0, b1, b2, b3, db0, db1, db2, db3;
+	if (interpolation_ == TRAJECTORY_INTERP_QUINTIC) {
+		double s4 = s3 * s;
+		double s5 = s4 * s;
+		b3 = 10*s3 - 15*s4 + 6*s5;
+		b0 = 1 - b3;
+		b1 = s - 6*s3 + 8*s4 - 3*s5;
+		b2 = -4*s3 + 7*s4 - 3*s5;
+		db3 = 30*s2 - 60*s3 + 30*s4;
+		db0 = -db3;
+		db1 = 1 - 18*s2 + 32*s3 - 15*s4;
+		db2 = -12*s2 + 28*s3 - 15*s4;
+	} else {
+		b3 = 3*s2 - 2*s3;
+		b0 = 1 - b3;
+		b1 = s3 - 2*s2 + s;
+		b2 = s3 - s2;
+		db3 = 6*s - 6*s2;
+		db0 = -db3;
+		db1 = 3*s2 - 4*s + 1;
+		db2 = 3*s2 - 2*s;
+	}
+
+	const double* p0 = &values_[i*nc];
+	const double* p1 = &values_[(i+1)*nc];
+	const double* m0 = &tangents_[i*nc];
+	const double* m1 = &tangents_[(i+1)*nc];
+	for (size_t c=0;c<nc;c++) {
+		const Channel& ch = channels_[c];
+		double v = b0*p0[c] + b1*h*m0[c] + b2*h*m1[c] + b3*p1[c];
+		double dv = (db0*p0[c] + db1*h*m0[c] + db2*h*m1[c] + db3*p1[c]) / h;
+		setChannelValue(param,ch,v);
+		if (ch.type == CHANNEL_JPOS) {
+			param.jvel_d[ch.index] = dv;
+		} else if (ch.type == CHANNEL_XD && vel) {
+			vel->xd[ch.index][ch.axis] = dv;
+		}
+	}
+
+	for (int m=0;m<MAX_MECH_PER_DEV;m++) {
+		if (!rotates_[m]) {
+			continue;
+		}
+		double q[4];
+		slerp(&quats_[(i*MAX_MECH_PER_DEV + m)*4],&quats_[((i+1)*MAX_MECH_PER_DEV + m)*4],s,q);
+		quaternionToMatrix(q,param.rd[m].R);
+	}
+	return OK;
+}
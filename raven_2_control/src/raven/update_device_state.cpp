@@ -32,6 +32,12 @@ t_controlmode newRobotControlMode = homing_mode;
  */
 int updateDeviceState(struct param_pass *currParams, struct param_pass *rcvdParams, struct device *device0)
 {
+	// where the command came from, for the latency of its DAC write
+	currParams->seq = rcvdParams->seq;
+	currParams->master_rx = rcvdParams->master_rx;
+	device0->param_seq = rcvdParams->seq;
+	device0->param_rx = rcvdParams->master_rx;
+
 	for (int i = 0; i < NUM_MECH; i++)
     {
         currParams->xd[i].x = rcvdParams->xd[i].x;
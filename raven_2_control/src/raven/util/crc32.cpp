@@ -0,0 +1,36 @@
+/*
+ * crc32.cpp
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: agent
+ */
+
+#include <raven/util/crc32.h>
+
+static uint32_t CRC_TABLE[256];
+static bool CRC_TABLE_INITED = false;
+
+static void
+initCrcTable() {
+	for (uint32_t i=0;i<256;i++) {
+		uint32_t c = i;
+		for (int k=0;k<8;k++) {
+			c = (c & 1) ? (0xEDB88320u ^ (c >> 1)) : (c >> 1);
+		}
+		CRC_TABLE[i] = c;
+	}
+	CRC_TABLE_INITED = true;
+}
+
+uint32_t
+crc32Ieee(const void* data, size_t len) {
+	if (!CRC_TABLE_INITED) {
+		initCrcTable();
+	}
+	const uint8_t* bytes = static_cast<const uint8_t*>(data);
+	uint32_t c = 0xFFFFFFFFu;
+	for (size_t i=0;i<len;i++) {
+		c = CRC_TABLE[(c ^ bytes[i]) & 0xFF] ^ (c >> 8);
+	}
+	return c ^ 0xFFFFFFFFu;
+}
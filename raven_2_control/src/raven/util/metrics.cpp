@@ -0,0 +1,404 @@
+/*
+ * metrics.cpp
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: agent
+ */
+
+#include <raven/util/metrics.h>
+
+#include <errno.h>
+#include <math.h>
+#include <poll.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include <algorithm>
+
+#include <boost/thread/thread.hpp>
+#include <ros/console.h>
+
+// nice value of the exporter thread
+#define METRICS_THREAD_NICE 10
+// how long a scraper gets to send its request
+#define METRICS_REQUEST_TIMEOUT_MSEC 500
+
+Metric* volatile Metric::HEAD = NULL;
+
+/************************ metrics ************************/
+
+static std::string
+formatValue(double v) {
+	if (isnan(v)) {
+		return "NaN";
+	} else if (isinf(v)) {
+		return v > 0 ? "+Inf" : "-Inf";
+	}
+	// shortest form that reads back the same, so bucket bounds stay readable
+	char buf[32];
+	snprintf(buf,sizeof(buf),"%.15g",v);
+	if (strtod(buf,NULL) != v) {
+		snprintf(buf,sizeof(buf),"%.17g",v);
+	}
+	return buf;
+}
+
+static std::string
+formatValue(uint64_t v) {
+	char buf[32];
+	snprintf(buf,sizeof(buf),"%llu",(unsigned long long)v);
+	return buf;
+}
+
+Metric::Metric(Type type, const std::string& name, const std::string& help, const std::string& labels)
+	: name_(name), help_(help), labels_(labels), type_(type) {
+	Metric* head;
+	do {
+		head = HEAD;
+		next_ = head;
+	} while (!__sync_bool_compare_and_swap(&HEAD,head,this));
+}
+
+std::string
+Metric::labelString(const std::string& extra) const {
+	if (labels_.empty() && extra.empty()) {
+		return "";
+	}
+	return "{" + labels_ + (labels_.empty() || extra.empty() ? "" : ",") + extra + "}";
+}
+
+std::vector<const Metric*>
+Metric::all() {
+	std::vector<const Metric*> registered;
+	for (const Metric* m = HEAD; m; m = m->next_) {
+		registered.push_back(m);
+	}
+	// the list is newest first
+	std::reverse(registered.begin(),registered.end());
+
+	std::vector<const Metric*> grouped;
+	std::vector<bool> taken(registered.size(),false);
+	for (size_t i=0;i<registered.size();i++) {
+		if (taken[i]) {
+			continue;
+		}
+		for (size_t j=i;j<registered.size();j++) {
+			if (!taken[j] && registered[j]->name_ == registered[i]->name_) {
+				grouped.push_back(registered[j]);
+				taken[j] = true;
+			}
+		}
+	}
+	return grouped;
+}
+
+std::string
+Metric::exposition() {
+	static const char* TYPE_NAMES[] = { "counter", "gauge", "histogram" };
+	std::vector<const Metric*> metrics = all();
+	std::string out;
+	for (size_t i=0;i<metrics.size();i++) {
+		const Metric* m = metrics[i];
+		if (i == 0 || metrics[i-1]->name_ != m->name_) {
+			out += "# HELP " + m->name_ + " " + m->help_ + "\n";
+			out += "# TYPE " + m->name_ + " " + TYPE_NAMES[m->type_] + "\n";
+		}
+		m->writeSamples(out);
+	}
+	return out;
+}
+
+void
+MetricCounter::writeSamples(std::string& out) const {
+	out += name() + labelString() + " " + formatValue(value()) + "\n";
+}
+
+void
+MetricGauge::add(double d) {
+	uint64_t prev;
+	do {
+		prev = bits_;
+	} while (!__sync_bool_compare_and_swap(&bits_,prev,toBits(fromBits(prev) + d)));
+}
+
+void
+MetricGauge::writeSamples(std::string& out) const {
+	out += name() + labelString() + " " + formatValue(value()) + "\n";
+}
+
+MetricHistogram::MetricHistogram(const std::string& name, const std::string& help, const std::vector<double>& bounds, const std::string& labels)
+	: Metric(HISTOGRAM,name,help,labels), bounds_(bounds), sumBits_(0) {
+	std::sort(bounds_.begin(),bounds_.end());
+	counts_ = new uint64_t[bounds_.size()+1];
+	for (size_t b=0;b<=bounds_.size();b++) {
+		counts_[b] = 0;
+	}
+	double zero = 0;
+	memcpy((void*)&sumBits_,&zero,sizeof(zero));
+}
+
+MetricHistogram::~MetricHistogram() {
+	delete[] counts_;
+}
+
+void
+MetricHistogram::observe(double v) {
+	size_t b = std::lower_bound(bounds_.begin(),bounds_.end(),v) - bounds_.begin();
+	__sync_fetch_and_add(&counts_[b],1);
+
+	uint64_t prev, next;
+	do {
+		prev = sumBits_;
+		double sum;
+		memcpy(&sum,&prev,sizeof(sum));
+		sum += v;
+		memcpy(&next,&sum,sizeof(next));
+	} while (!__sync_bool_compare_and_swap(&sumBits_,prev,next));
+}
+
+uint64_t
+MetricHistogram::count() const {
+	uint64_t n = 0;
+	for (size_t b=0;b<=bounds_.size();b++) {
+		n += counts_[b];
+	}
+	return n;
+}
+
+double
+MetricHistogram::sum() const {
+	uint64_t bits = sumBits_;
+	double sum;
+	memcpy(&sum,&bits,sizeof(sum));
+	return sum;
+}
+
+std::vector<double>
+MetricHistogram::exponentialBounds(double start, double factor, int count) {
+	std::vector<double> bounds;
+	for (int i=0;i<count;i++) {
+		bounds.push_back(start);
+		start *= factor;
+	}
+	return bounds;
+}
+
+void
+MetricHistogram::writeSamples(std::string& out) const {
+	// copied first so the buckets add up to the count even while observe() runs
+	std::vector<uint64_t> counts(bounds_.size()+1);
+	for (size_t b=0;b<counts.size();b++) {
+		counts[b] = counts_[b];
+	}
+	uint64_t sumBits = sumBits_;
+	double sum;
+	memcpy(&sum,&sumBits,sizeof(sum));
+
+	uint64_t cumulative = 0;
+	for (size_t b=0;b<counts.size();b++) {
+		cumulative += counts[b];
+		std::string le = b < bounds_.size() ? formatValue(bounds_[b]) : "+Inf";
+		out += name() + "_bucket" + labelString("le=\"" + le + "\"") + " " + formatValue(cumulative) + "\n";
+	}
+	out += name() + "_sum" + labelString() + " " + formatValue(sum) + "\n";
+	out += name() + "_count" + labelString() + " " + formatValue(cumulative) + "\n";
+}
+
+/************************ exporter ************************/
+
+static int metrics_tcp_sock = -1;
+static int metrics_unix_sock = -1;
+static std::string metrics_unix_path;
+static volatile bool metrics_running = false;
+static boost::thread* metrics_thread = NULL;
+
+static void
+sendAll(int fd, const std::string& data) {
+	size_t sent = 0;
+	while (sent < data.size()) {
+		ssize_t n = send(fd,data.data() + sent,data.size() - sent,MSG_NOSIGNAL);
+		if (n <= 0) {
+			return;
+		}
+		sent += n;
+	}
+}
+
+static void
+serveScrape(int fd) {
+	// only the request line matters; read up to the end of the headers
+	std::string request;
+	char buf[512];
+	struct pollfd pfd;
+	pfd.fd = fd;
+	pfd.events = POLLIN;
+	while (request.size() < 8192 && request.find("\r\n\r\n") == std::string::npos && request.find("\n\n") == std::string::npos
+			&& poll(&pfd,1,METRICS_REQUEST_TIMEOUT_MSEC) > 0) {
+		ssize_t n = recv(fd,buf,sizeof(buf),0);
+		if (n <= 0) {
+			break;
+		}
+		request.append(buf,n);
+	}
+
+	std::string line = request.substr(0,request.find_first_of("\r\n"));
+	std::string status;
+	std::string body;
+	if (line.compare(0,4,"GET ") != 0) {
+		status = "405 Method Not Allowed";
+		body = "only GET\n";
+	} else {
+		std::string path = line.substr(4,line.find(' ',4) - 4);
+		if (path == "/metrics" || path == "/") {
+			status = "200 OK";
+			body = Metric::exposition();
+		} else {
+			status = "404 Not Found";
+			body = "see /metrics\n";
+		}
+	}
+
+	char header[256];
+	snprintf(header,sizeof(header),
+			"HTTP/1.0 %s\r\nContent-Type: text/plain; version=0.0.4\r\nContent-Length: %lu\r\nConnection: close\r\n\r\n",
+			status.c_str(),(unsigned long)body.size());
+	sendAll(fd,header);
+	sendAll(fd,body);
+	close(fd);
+}
+
+static void
+metricsProcess() {
+	struct sched_param param;
+	param.sched_priority = 0;
+	if (sched_setscheduler(0, SCHED_OTHER, &param) == -1) {
+		ROS_ERROR("sched_setscheduler failed for the metrics exporter");
+	}
+	setpriority(PRIO_PROCESS, 0, METRICS_THREAD_NICE);
+
+	struct pollfd pfds[2];
+	int nfds = 0;
+	if (metrics_tcp_sock >= 0) {
+		pfds[nfds].fd = metrics_tcp_sock;
+		pfds[nfds++].events = POLLIN;
+	}
+	if (metrics_unix_sock >= 0) {
+		pfds[nfds].fd = metrics_unix_sock;
+		pfds[nfds++].events = POLLIN;
+	}
+	while (metrics_running) {
+		if (poll(pfds,nfds,250) <= 0) {
+			continue;
+		}
+		for (int i=0;i<nfds;i++) {
+			if (!(pfds[i].revents & POLLIN)) {
+				continue;
+			}
+			int fd = accept(pfds[i].fd,NULL,NULL);
+			if (fd >= 0) {
+				serveScrape(fd);
+			}
+		}
+	}
+}
+
+static int
+listenTcp(int port) {
+	int sock = socket(AF_INET, SOCK_STREAM, 0);
+	if (sock < 0) {
+		return -1;
+	}
+	int on = 1;
+	setsockopt(sock,SOL_SOCKET,SO_REUSEADDR,&on,sizeof(on));
+	struct sockaddr_in addr;
+	memset(&addr,0,sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_port = htons(port);
+	// local only; put a real Prometheus behind an ssh tunnel or a proxy
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	if (bind(sock,(struct sockaddr*)&addr,sizeof(addr)) < 0 || listen(sock,8) < 0) {
+		close(sock);
+		return -1;
+	}
+	return sock;
+}
+
+static int
+listenUnix(const std::string& path) {
+	struct sockaddr_un addr;
+	if (path.size() >= sizeof(addr.sun_path)) {
+		errno = ENAMETOOLONG;
+		return -1;
+	}
+	int sock = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (sock < 0) {
+		return -1;
+	}
+	memset(&addr,0,sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strncpy(addr.sun_path,path.c_str(),sizeof(addr.sun_path)-1);
+	// left over from a previous run
+	unlink(path.c_str());
+	if (bind(sock,(struct sockaddr*)&addr,sizeof(addr)) < 0 || listen(sock,8) < 0) {
+		close(sock);
+		return -1;
+	}
+	return sock;
+}
+
+bool
+MetricsExporter::start(int port, const std::string& socketPath) {
+	if (metrics_running) {
+		return true;
+	}
+	if (port > 0) {
+		metrics_tcp_sock = listenTcp(port);
+		if (metrics_tcp_sock < 0) {
+			ROS_ERROR("Could not serve metrics on port %d: %s",port,strerror(errno));
+		} else {
+			ROS_INFO("Serving metrics on http://127.0.0.1:%d/metrics",port);
+		}
+	}
+	if (!socketPath.empty()) {
+		metrics_unix_sock = listenUnix(socketPath);
+		if (metrics_unix_sock < 0) {
+			ROS_ERROR("Could not serve metrics on %s: %s",socketPath.c_str(),strerror(errno));
+		} else {
+			metrics_unix_path = socketPath;
+			ROS_INFO("Serving metrics on %s",socketPath.c_str());
+		}
+	}
+	if (metrics_tcp_sock < 0 && metrics_unix_sock < 0) {
+		return false;
+	}
+	metrics_running = true;
+	metrics_thread = new boost::thread(metricsProcess);
+	return true;
+}
+
+void
+MetricsExporter::stop() {
+	if (!metrics_running) {
+		return;
+	}
+	metrics_running = false;
+	metrics_thread->join();
+	delete metrics_thread;
+	metrics_thread = NULL;
+	if (metrics_tcp_sock >= 0) {
+		close(metrics_tcp_sock);
+		metrics_tcp_sock = -1;
+	}
+	if (metrics_unix_sock >= 0) {
+		close(metrics_unix_sock);
+		metrics_unix_sock = -1;
+		unlink(metrics_unix_path.c_str());
+	}
+}
@@ -0,0 +1,79 @@
+/*
+ * startup.cpp
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: agent
+ */
+
+#include <raven/util/startup.h>
+
+#include <stdint.h>
+#include <time.h>
+
+#include <algorithm>
+#include <vector>
+
+#include <boost/thread/mutex.hpp>
+
+#include <raven/util/metrics.h>
+#include "log.h"
+
+struct StartupRecord {
+	std::string name;
+	int64_t start;
+	int64_t end;
+};
+
+static int64_t
+monotonicNSec() {
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC,&now);
+	return now.tv_sec * (int64_t)1000000000 + now.tv_nsec;
+}
+
+static bool
+startedBefore(const StartupRecord& a, const StartupRecord& b) {
+	return a.start < b.start;
+}
+
+// static initialization is as close to exec as we get
+static int64_t startup_begin = monotonicNSec();
+static boost::mutex startup_mutex;
+static std::vector<StartupRecord> startup_records;
+
+StartupPhase::StartupPhase(const std::string& name) : name_(name), start_(monotonicNSec()), ended_(false) {}
+
+void
+StartupPhase::end() {
+	if (ended_) {
+		return;
+	}
+	ended_ = true;
+	StartupRecord r;
+	r.name = name_;
+	r.start = start_;
+	r.end = monotonicNSec();
+	boost::mutex::scoped_lock lock(startup_mutex);
+	startup_records.push_back(r);
+}
+
+void
+StartupPhase::report() {
+	boost::mutex::scoped_lock lock(startup_mutex);
+	int64_t now = monotonicNSec();
+	log_msg("Started in %.1f ms:",(now - startup_begin) * 1e-6);
+	// phases are recorded as they end, in any order
+	std::vector<StartupRecord> records(startup_records);
+	std::stable_sort(records.begin(),records.end(),startedBefore);
+	for (size_t i=0;i<records.size();i++) {
+		const StartupRecord& r = records[i];
+		double seconds = (r.end - r.start) * 1e-9;
+		log_msg("  %7.1f + %7.1f ms  %s",(r.start - startup_begin) * 1e-6,seconds * 1e3,r.name.c_str());
+
+		// exported until exit, like any metric
+		MetricGauge* gauge = new MetricGauge("r2_startup_phase_seconds","time taken by each phase of the last startup","phase=\"" + r.name + "\"");
+		gauge->set(seconds);
+	}
+	MetricGauge* total = new MetricGauge("r2_startup_seconds","time from process start to the startup report");
+	total->set((now - startup_begin) * 1e-9);
+}
@@ -12,6 +12,8 @@
 #undef TIMING_STRUCT_SETUP
 #define TIMING_STRUCT_SETUP(StructName) TIMING_STRUCT_SETUP_SOURCE(StructName)
 
+volatile int64_t LoopClock::NOW_NSEC = 0;
+
 TIMING_STRUCT_SETUP(TimingInfo)
 
 TIMING_STRUCT_FIELD(overall)
@@ -0,0 +1,157 @@
+/*
+ * trace.cpp
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: agent
+ */
+
+#include <raven/util/trace.h>
+
+#include <stdio.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <ros/console.h>
+
+volatile bool trace_recording = false;
+__thread TraceRing* trace_ring = NULL;
+
+static TraceRing* volatile trace_rings = NULL;
+// clock at trace_start(), to convert ticks to time
+static uint64_t trace_start_ticks = 0;
+static struct timespec trace_start_time;
+
+static int64_t
+monotonicNsec() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC,&ts);
+	return ts.tv_sec * (int64_t)1000000000 + ts.tv_nsec;
+}
+
+TraceRing*
+trace_thread_ring() {
+	if (!trace_ring) {
+		TraceRing* ring = new TraceRing();
+		ring->count = 0;
+		ring->tid = syscall(SYS_gettid);
+		ring->thread_name = NULL;
+		TraceRing* head;
+		do {
+			head = trace_rings;
+			ring->next = head;
+		} while (!__sync_bool_compare_and_swap(&trace_rings,head,ring));
+		trace_ring = ring;
+	}
+	return trace_ring;
+}
+
+void
+trace_prepare_thread(const char* thread_name) {
+	if (trace_recording) {
+		trace_thread_ring()->thread_name = thread_name;
+	}
+}
+
+void
+trace_start() {
+	if (!trace_compiled_in()) {
+		ROS_WARN("Tracing requested, but r2_control was built without trace categories (TRACE_CATEGORIES)");
+	}
+	clock_gettime(CLOCK_MONOTONIC,&trace_start_time);
+	trace_start_ticks = trace_ticks();
+	trace_recording = true;
+}
+
+void
+trace_stop() {
+	trace_recording = false;
+}
+
+static void
+writeJsonString(FILE* f, const char* str) {
+	fputc('"',f);
+	for (const char* c = str ? str : ""; *c; c++) {
+		if (*c == '"' || *c == '\\') {
+			fputc('\\',f);
+			fputc(*c,f);
+		} else if ((unsigned char)*c < 0x20) {
+			fprintf(f,"\\u%04x",*c);
+		} else {
+			fputc(*c,f);
+		}
+	}
+	fputc('"',f);
+}
+
+static const char*
+categoryName(int category) {
+	switch (category) {
+	case TRACE_LOOP: return "loop";
+	case TRACE_STATE: return "state";
+	case TRACE_CONTROL: return "control";
+	case TRACE_IO: return "io";
+	default: return "other";
+	}
+}
+
+bool
+trace_write_chrome(const std::string& filename) {
+	trace_stop();
+	// let writers that already passed the recording check finish their event
+	usleep(1000);
+
+	// ticks per nanosecond over the whole recording; the cycle counter has to be constant rate
+	uint64_t end_ticks = trace_ticks();
+	int64_t elapsed = monotonicNsec() - (trace_start_time.tv_sec * (int64_t)1000000000 + trace_start_time.tv_nsec);
+	double ns_per_tick = elapsed > 0 ? elapsed / (double)(end_ticks - trace_start_ticks) : 1.;
+
+	FILE* f = fopen(filename.c_str(),"w");
+	if (!f) {
+		ROS_ERROR("Could not open trace file %s",filename.c_str());
+		return false;
+	}
+
+	int pid = getpid();
+	size_t written = 0;
+	bool first = true;
+	fprintf(f,"{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n");
+	for (TraceRing* ring = trace_rings; ring; ring = ring->next) {
+		if (ring->thread_name) {
+			fprintf(f,"%s{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":%d,\"tid\":%d,\"args\":{\"name\":",first ? "" : ",\n",pid,ring->tid);
+			writeJsonString(f,ring->thread_name);
+			fprintf(f,"}}");
+			first = false;
+		}
+
+		uint64_t count = ring->count;
+		uint64_t begin = count > TRACE_RING_SIZE ? count - TRACE_RING_SIZE : 0;
+		int depth = 0;
+		for (uint64_t n = begin; n < count; n++) {
+			const TraceEvent& e = ring->events[n & (TRACE_RING_SIZE-1)];
+			if (e.ticks < trace_start_ticks) {
+				continue;
+			}
+			// exits whose enter was overwritten
+			if (e.phase == 'E') {
+				if (depth == 0) { continue; }
+				depth--;
+			} else if (e.phase == 'B') {
+				depth++;
+			}
+			double us = (e.ticks - trace_start_ticks) * ns_per_tick / 1000.;
+			fprintf(f,"%s{\"ph\":\"%c\",\"cat\":\"%s\",\"name\":",first ? "" : ",\n",e.phase,categoryName(e.category));
+			writeJsonString(f,e.name);
+			fprintf(f,",\"ts\":%.3f,\"pid\":%d,\"tid\":%d%s}",us,pid,ring->tid,e.phase == 'i' ? ",\"s\":\"t\"" : "");
+			first = false;
+			written++;
+		}
+	}
+	fprintf(f,"\n]}\n");
+	bool ok = !ferror(f);
+	ok = (fclose(f) == 0) && ok;
+	if (ok) {
+		ROS_INFO("Wrote %lu trace events to %s",(unsigned long)written,filename.c_str());
+	} else {
+		ROS_ERROR("Error writing trace file %s",filename.c_str());
+	}
+	return ok;
+}
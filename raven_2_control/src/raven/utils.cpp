@@ -348,9 +348,9 @@ void getQuaternion(float* Q, float mat[3][3])
 void set_posd_to_pos(struct robot_device* device0)
 {
 #ifdef USE_NEW_DEVICE
-	OldControlInputPtr input = ControlInput::oldControlInputUpdateBegin();
+	OldControlInputPtr input = ControlInput::oldControlInputRtUpdateBegin();
 	input->setFrom(Device::currentNoClone());
-	ControlInput::oldControlInputUpdateEnd();
+	ControlInput::oldControlInputRtUpdateEnd();
 #endif
     for (int m = 0; m < NUM_MECH; m++) {
 //#ifdef USE_NEW_DEVICE
@@ -0,0 +1,155 @@
+/*
+ * pid_kernel_test.cpp
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: agent
+ */
+
+#include <gtest/gtest.h>
+
+#include <math.h>
+
+#include "pid_control.h"
+#include "defines.h"
+#include "DOF_type.h"
+#include "utils.h"
+
+#include <raven/state/runlevel.h>
+#include <raven/control/pid_kernel.h>
+#include <raven/util/config.h>
+
+/*
+ * Replays generated joint trajectories through the production control laws:
+ * mpos_PD_control (pid_control.cpp), one joint at a time, and
+ * mpos_PD_control_all, which runs the PID kernel over the whole device. The
+ * torques must agree every tick.
+ */
+
+// defined with the rt loop in rt_process_preempt.cpp
+unsigned long int gTime = 0;
+int NUM_MECH = 2;
+bool disable_arm_id[2] = { false, false };
+
+extern struct DOF_type DOF_types[];
+
+#define TICKS 5000
+#define DT 0.001f  // ONE_MS, the period both control laws integrate over
+
+#define RUNLEVEL_PEDAL_UP 2
+#define RUNLEVEL_PEDAL_DOWN 3
+
+// deterministic, so a failure replays the same way
+static unsigned int rng_state = 12345;
+static float
+uniform(float lo, float hi) {
+	rng_state = rng_state * 1103515245 + 12345;
+	return lo + (hi - lo) * ((rng_state >> 8) & 0xffff) / 65535.f;
+}
+
+class PIDKernelReplay : public ::testing::Test {
+protected:
+	struct robot_device device;
+
+	float amplitude[PID_KERNEL_SIZE];
+	float frequency[PID_KERNEL_SIZE];
+	float lag[PID_KERNEL_SIZE];
+
+	virtual void SetUp() {
+		rng_state = 12345;
+		memset(&device,0,sizeof(device));
+		device.mech[0].type = GOLD_ARM;
+		device.mech[1].type = GREEN_ARM;
+		for (int i=0;i<PID_KERNEL_SIZE;i++) {
+			device.mech[i / MAX_DOF_PER_MECH].joint[i % MAX_DOF_PER_MECH].type = i;
+
+			DOF_type& type = DOF_types[i];
+			type.KP = uniform(0,2);
+			type.KI = uniform(0,0.5f);
+			type.KD = uniform(0,0.05f);
+			// small ratios and speed limits on some lanes, so capping is exercised
+			type.TR = i % 3 == 0 ? uniform(0.3f,1) : uniform(5,20);
+			type.speed_limit = i % 4 == 1 ? uniform(0.5f,2) : 1000;
+			// no DAC counts, so no torque is reported as over the DAC limit
+			type.tau_per_amp = 1;
+			type.DAC_per_amp = 0;
+
+			amplitude[i] = uniform(0.1f,3);
+			frequency[i] = uniform(0.2f,5);
+			lag[i] = uniform(0.001f,0.05f);
+		}
+		disable_arm_id[GOLD_ARM_ID] = false;
+		disable_arm_id[GREEN_ARM_ID] = false;
+		RavenConfig.verify_pid_kernel = false;
+	}
+
+	// desired follows a sine, actual follows it with a lag and some noise
+	void replay(bool (*pedalAt)(int tick), int disabledArm=-1) {
+		for (int t=0;t<TICKS;t++) {
+			bool pedal = pedalAt(t);
+			RunLevel::updateRunlevel(pedal ? RUNLEVEL_PEDAL_DOWN : RUNLEVEL_PEDAL_UP);
+			for (int a=0;a<2;a++) {
+				disable_arm_id[a] = a == disabledArm;
+			}
+
+			int reset = t % 1000 == 0;
+			float time = t * DT;
+			for (int i=0;i<PID_KERNEL_SIZE;i++) {
+				DOF& joint = device.mech[i / MAX_DOF_PER_MECH].joint[i % MAX_DOF_PER_MECH];
+				float w = 2 * M_PI * frequency[i];
+				joint.mpos_d = amplitude[i] * sinf(w * time);
+				joint.mvel_d = amplitude[i] * w * cosf(w * time);
+				joint.mpos = amplitude[i] * sinf(w * (time - lag[i])) + uniform(-0.01f,0.01f);
+				joint.mvel = amplitude[i] * w * cosf(w * (time - lag[i])) + uniform(-0.1f,0.1f);
+			}
+
+			// the scalar path controls the joints of enabled arms while the pedal is down
+			float legacy[PID_KERNEL_SIZE];
+			bool controlled[PID_KERNEL_SIZE] = { false };
+			struct mechanism* _mech = NULL;
+			struct DOF* _joint = NULL;
+			int m=0,j=0;
+			while (loop_over_joints(&device,_mech,_joint,m,j)) {
+				if (pedal) {
+					mpos_PD_control(_joint,reset);
+					legacy[_joint->type] = _joint->tau_d;
+					controlled[_joint->type] = true;
+				}
+				_joint->tau_d = NAN;
+			}
+
+			mpos_PD_control_all(&device,reset);
+
+			for (int i=0;i<PID_KERNEL_SIZE;i++) {
+				float tau = device.mech[i / MAX_DOF_PER_MECH].joint[i % MAX_DOF_PER_MECH].tau_d;
+				if (!controlled[i]) {
+					// left alone, or not visited at all
+					ASSERT_TRUE(isnan(tau) || tau == 0.f) << "lane " << i << " tick " << t;
+					continue;
+				}
+				ASSERT_NEAR(legacy[i],tau,1e-5 * (1 + fabsf(legacy[i]))) << "lane " << i << " tick " << t;
+			}
+		}
+	}
+};
+
+static bool pedalDown(int) {
+	return true;
+}
+
+// pedal toggling every 250 ms
+static bool pedalToggling(int tick) {
+	return (tick / 250) % 2 == 0;
+}
+
+TEST_F(PIDKernelReplay, MatchesLegacyControlLaw) {
+	replay(pedalDown);
+}
+
+TEST_F(PIDKernelReplay, InactiveLanesHoldTheirIntegral) {
+	replay(pedalToggling,GREEN_ARM_ID);
+}
+
+int main(int argc, char** argv) {
+	::testing::InitGoogleTest(&argc,argv);
+	return RUN_ALL_TESTS();
+}
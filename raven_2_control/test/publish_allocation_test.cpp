@@ -0,0 +1,224 @@
+/*
+ * publish_allocation_test.cpp
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: agent
+ */
+
+#include <gtest/gtest.h>
+
+#include <stdlib.h>
+#include <string.h>
+#include <new>
+
+#include <raven/publish_scheduler.h>
+#include <raven/state_message.h>
+#include <raven_2_msgs/Constants.h>
+
+#include "defines.h"
+
+/*
+ * Fills the state messages with the publishers' own fill functions
+ * (state_message.cpp) and MessagePool, and counts every heap allocation in the
+ * process to check that once the messages have grown to the device topology,
+ * publishing doesn't allocate.
+ */
+
+static volatile unsigned long heap_allocations = 0;
+
+void* operator new(size_t size) throw(std::bad_alloc) {
+	__sync_fetch_and_add(&heap_allocations,1);
+	void* p = malloc(size ? size : 1);
+	if (!p) {
+		throw std::bad_alloc();
+	}
+	return p;
+}
+
+void* operator new[](size_t size) throw(std::bad_alloc) {
+	return operator new(size);
+}
+
+void operator delete(void* p) throw() {
+	free(p);
+}
+
+void operator delete[](void* p) throw() {
+	free(p);
+}
+
+// publish_scheduler.cpp's counter, without the scheduler
+static volatile unsigned int publish_allocations = 0;
+
+unsigned int
+publishAllocations() {
+	return publish_allocations;
+}
+
+void
+publishAllocated() {
+	__sync_fetch_and_add(&publish_allocations,1);
+}
+
+// defined with the rt loop in rt_process_preempt.cpp
+unsigned long int gTime = 0;
+int NUM_MECH = 2;
+bool disable_arm_id[2] = { false, false };
+
+#define TICKS 1000
+// the seven connected joints, then yaw and grasp
+#define JOINTS_PER_ARM 9
+
+static PublishSnapshot snapshot;
+
+static void
+initSnapshot() {
+	memset(&snapshot.device,0,sizeof(snapshot.device));
+	snapshot.device.mech[0].type = GOLD_ARM;
+	snapshot.device.mech[1].type = GREEN_ARM;
+	for (int m=0;m<2;m++) {
+		mechanism& mech = snapshot.device.mech[m];
+		for (int i=0;i<3;i++) {
+			mech.ori.R[i][i] = 1;
+			mech.ori_d.R[i][i] = 1;
+		}
+		for (int j=0;j<MAX_DOF_PER_MECH;j++) {
+			mech.joint[j].type = m * MAX_DOF_PER_MECH + j;
+			mech.joint[j].state = jstate_ready;
+		}
+	}
+	snapshot.runlevel = 3;
+	snapshot.runlevel_pedal = true;
+}
+
+// what the raven_state publisher's snapshot looks like at tick t
+static void
+advanceSnapshot(int t) {
+	snapshot.seq = t;
+	snapshot.pedal_down = t % 2;
+	for (int m=0;m<2;m++) {
+		mechanism& mech = snapshot.device.mech[m];
+		mech.pos.x = t;
+		mech.pos_d.x = -t;
+		mech.ori.grasp = t % 1000;
+		for (int j=0;j<MAX_DOF_PER_MECH;j++) {
+			mech.joint[j].jpos = t * 0.01f + j;
+			mech.joint[j].mpos = t * 0.1f + j;
+			mech.joint[j].enc_val = t;
+		}
+	}
+}
+
+static bool
+lookupCommand(const std::string& arm_name,int joint_type,raven_2_msgs::JointCommand& cmd) {
+	cmd.command_type = raven_2_msgs::JointCommand::COMMAND_TYPE_POSITION;
+	cmd.value = joint_type;
+	return true;
+}
+
+// what buildRavenState() in ros_io.cpp does with a frame
+static void
+fillState(raven_2_msgs::RavenState& state,raven_2_msgs::RavenArrayState& array_state,int tick) {
+	advanceSnapshot(tick);
+	state.header.seq = tick;
+	state.header.frame_id = "/0_link";
+	fillRavenState(state,snapshot,lookupCommand);
+	fillRavenArrayState(array_state,state);
+}
+
+class PublishAllocation : public ::testing::Test {
+protected:
+	unsigned long heapBefore;
+	unsigned int publishBefore;
+
+	raven_2_msgs::RavenState state;
+	raven_2_msgs::RavenArrayState array_state;
+
+	virtual void SetUp() {
+		NUM_MECH = 2;
+		initSnapshot();
+	}
+
+	void mark() {
+		heapBefore = heap_allocations;
+		publishBefore = publishAllocations();
+	}
+	void expectNoAllocations() {
+		EXPECT_EQ(heapBefore,heap_allocations);
+		EXPECT_EQ(publishBefore,publishAllocations());
+	}
+};
+
+TEST_F(PublishAllocation, RefillingAMessageDoesNotAllocate) {
+	mark();
+	fillState(state,array_state,0);
+	// the first fill grows the arrays, and the counters see it
+	EXPECT_LT(heapBefore,heap_allocations);
+	EXPECT_LT(publishBefore,publishAllocations());
+
+	mark();
+	for (int t=1;t<TICKS;t++) {
+		fillState(state,array_state,t);
+	}
+	expectNoAllocations();
+	ASSERT_EQ(2u,state.arms.size());
+	ASSERT_EQ((size_t)JOINTS_PER_ARM,state.arms[1].joints.size());
+	EXPECT_EQ(2u * JOINTS_PER_ARM,array_state.joint_positions.size());
+	EXPECT_EQ(TICKS-1,(int)state.header.seq);
+	EXPECT_FLOAT_EQ((TICKS-1) * 0.01f,state.arms[0].joints[0].position);
+	EXPECT_EQ((int)raven_2_msgs::JointCommand::COMMAND_TYPE_POSITION,(int)state.arms[0].joints[0].command.command_type);
+}
+
+TEST_F(PublishAllocation, SmallerTopologyShrinksInPlace) {
+	fillState(state,array_state,0);
+
+	NUM_MECH = 1;
+	mark();
+	fillState(state,array_state,1);
+	expectNoAllocations();
+	EXPECT_EQ(1u,state.arms.size());
+	EXPECT_EQ(1u,array_state.arm_names.size());
+	EXPECT_EQ((size_t)JOINTS_PER_ARM,array_state.joint_positions.size());
+}
+
+// without the pedal down, joints report no command
+TEST_F(PublishAllocation, NoCommandsDoesNotAllocate) {
+	fillState(state,array_state,0);
+
+	mark();
+	for (int t=1;t<TICKS;t++) {
+		advanceSnapshot(t);
+		fillRavenState(state,snapshot,NULL);
+		fillRavenArrayState(array_state,state);
+	}
+	expectNoAllocations();
+	EXPECT_EQ(0,array_state.joint_commands[0]);
+}
+
+// a subscriber holding the last message makes the pool hand out another, once
+TEST_F(PublishAllocation, PoolOnlyGrowsWhileMessagesAreHeld) {
+	MessagePool<raven_2_msgs::RavenState> pool;
+	raven_2_msgs::RavenStatePtr msg;
+	raven_2_msgs::RavenStatePtr held;
+	for (int t=0;t<2;t++) {
+		pool.renew(msg);
+		fillState(*msg,array_state,t);
+		held = msg;
+	}
+	EXPECT_EQ(2u,pool.size());
+
+	mark();
+	for (int t=2;t<TICKS;t++) {
+		pool.renew(msg);
+		fillState(*msg,array_state,t);
+		held = msg;
+	}
+	expectNoAllocations();
+	EXPECT_EQ(2u,pool.size());
+	EXPECT_EQ(TICKS-1,(int)held->header.seq);
+}
+
+int main(int argc, char** argv) {
+	::testing::InitGoogleTest(&argc,argv);
+	return RUN_ALL_TESTS();
+}
@@ -0,0 +1,22 @@
+#include <nodelet/nodelet.h>
+#include <pluginlib/class_list_macros.h>
+#include <boost/shared_ptr.hpp>
+#include "hydra_viz.h"
+
+namespace raven_2_teleop {
+
+/*
+ * hydra_viz as a nodelet. Loaded into the same manager as the hydra driver,
+ * the calibration messages and markers are passed by pointer.
+ */
+class HydraVizNodelet : public nodelet::Nodelet {
+  boost::shared_ptr<HydraViz> m_viz;
+
+  virtual void onInit() {
+    m_viz.reset(new HydraViz(getNodeHandle()));
+  }
+};
+
+}
+
+PLUGINLIB_DECLARE_CLASS(raven_2_teleop, HydraViz, raven_2_teleop::HydraVizNodelet, nodelet::Nodelet)
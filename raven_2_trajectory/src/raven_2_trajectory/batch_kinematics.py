@@ -0,0 +1,44 @@
+import roslib; roslib.load_manifest('raven_2_trajectory')
+import rospy
+import tfx
+import numpy as np
+
+from raven_2_msgs.srv import InverseKinematicsBatch, ForwardKinematicsBatch
+
+IK_BATCH_SERVICE = 'inverse_kinematics_batch'
+FK_BATCH_SERVICE = 'forward_kinematics_batch'
+
+class BatchIKResult(object):
+	"""Solutions of a batch ik call, one row per pose"""
+	def __init__(self,response,num_poses):
+		self.joint_names = list(response.joint_names)
+		self.joints = np.array(response.joint_positions).reshape((num_poses,len(self.joint_names)))
+		self.valid = np.array(response.valid,dtype=bool)
+		self.joints_outside_limits = np.array(response.joints_outside_limits,dtype=np.uint32)
+	
+	def outside_limits(self,joint_name):
+		"""Boolean array of the poses for which the given joint was outside its limits"""
+		bit = 1 << self.joint_names.index(joint_name)
+		return (self.joints_outside_limits & bit) != 0
+	
+	def __len__(self):
+		return len(self.valid)
+
+def inverse_kinematics(arm,poses,grasps=None,num_threads=0,timeout=None):
+	"""Solve ik for a list of poses (anything tfx.pose accepts) for the arm with the given name or type.
+	grasps is None to use the arm's current grasp, or one value per pose."""
+	rospy.wait_for_service(IK_BATCH_SERVICE,timeout)
+	ik = rospy.ServiceProxy(IK_BATCH_SERVICE,InverseKinematicsBatch)
+	pose_msgs = [tfx.pose(pose).msg.Pose() for pose in poses]
+	if grasps is None:
+		grasps = []
+	response = ik(arm_name=arm,poses=pose_msgs,grasps=list(grasps),num_threads=num_threads)
+	return BatchIKResult(response,len(pose_msgs))
+
+def forward_kinematics(arm,joints,num_threads=0,timeout=None):
+	"""Solve fk for an N x num_joints array of joint positions, in the joint order of BatchIKResult.joint_names"""
+	rospy.wait_for_service(FK_BATCH_SERVICE,timeout)
+	fk = rospy.ServiceProxy(FK_BATCH_SERVICE,ForwardKinematicsBatch)
+	joints = np.asarray(joints,dtype=float)
+	response = fk(arm_name=arm,joint_positions=joints.flatten().tolist(),num_threads=num_threads)
+	return [tfx.pose(pose) for pose in response.poses]
@@ -104,6 +104,87 @@ class Stage(object):
 			stage_breaks.append(stage.duration + stage_breaks[-1])
 		return stage_breaks
 
+class TrajectoryStreamer(object):
+	"""Sends trajectories to r2_control (raven_command/trajectory) in chunks,
+	keeping about lead_time of it queued ahead of the robot, so long
+	trajectories need neither one huge message nor a command per step."""
+	def __init__(self,controller=Constants.CONTROLLER_CARTESIAN_SPACE,frame_id='/0_link',
+				validate=True,chunk_duration=1.,lead_time=2.):
+		self.controller = controller
+		self.frame_id = frame_id
+		self.validate = validate
+		self.chunk_duration = chunk_duration
+		self.lead_time = lead_time
+		
+		self.status = None
+		self._statuses = {}
+		self.pub = rospy.Publisher('raven_command/trajectory', RavenTrajectoryCommand)
+		self.sub = rospy.Subscriber('raven_command/trajectory/status', RavenTrajectoryStatus, self._status_callback)
+	
+	def _status_callback(self,msg):
+		self._statuses[msg.command_stamp] = msg
+	
+	def wait_for_connection(self):
+		while self.pub.get_num_connections() == 0 and not rospy.is_shutdown():
+			rospy.sleep(0.02)
+	
+	def _send(self,points,mode):
+		cmd = RavenTrajectoryCommand()
+		cmd.header.stamp = rospy.Time.now()
+		cmd.header.frame_id = self.frame_id
+		cmd.controller = self.controller
+		cmd.mode = mode
+		cmd.validate = self.validate
+		cmd.commands = points
+		self.pub.publish(cmd)
+		timeout = rospy.Time.now() + rospy.Duration(5)
+		while cmd.header.stamp not in self._statuses and rospy.Time.now() < timeout and not rospy.is_shutdown():
+			rospy.sleep(0.01)
+		status = self._statuses.pop(cmd.header.stamp,None)
+		if status is None:
+			rospy.logerr('No answer to trajectory command')
+		elif not status.accepted:
+			rospy.logerr('Trajectory rejected: %s',status.error)
+			status = None
+		return status
+	
+	def play(self,points,check=None):
+		"""Send points, a list of (seconds from the start, RavenTrajectoryCommandPoint).
+		The first chunk replaces whatever is playing unless this streamer is still
+		feeding it. Returns once the last chunk is queued; False on error or if
+		check() returns False."""
+		last_time = 0.
+		ind = 0
+		while ind < len(points):
+			chunk = []
+			chunk_end = last_time + self.chunk_duration
+			while ind < len(points) and (not chunk or points[ind][0] <= chunk_end):
+				t, pt = points[ind]
+				pt.time_from_start = rospy.Duration(t - last_time)
+				chunk.append(pt)
+				ind += 1
+			last_time = points[ind-1][0]
+			
+			if self.status is not None:
+				while (self.status.end_time - rospy.Time.now()).to_sec() > self.lead_time and not rospy.is_shutdown():
+					rospy.sleep(0.02)
+			if rospy.is_shutdown() or (check is not None and not check()):
+				return False
+			mode = RavenTrajectoryCommand.MODE_REPLACE if self.status is None else RavenTrajectoryCommand.MODE_APPEND
+			self.status = self._send(chunk,mode)
+			if self.status is None:
+				return False
+		return True
+	
+	def wait(self):
+		"""Wait for the trajectory to play out"""
+		while self.status is not None and rospy.Time.now() < self.status.end_time and not rospy.is_shutdown():
+			rospy.sleep(0.02)
+	
+	def reset(self):
+		"""Make the next play() start a new trajectory"""
+		self.status = None
+
 class TrajectoryPlayer(object):
 	def __init__(self,tf_listener=None,arms=['R']):
 		self.stages = []
@@ -353,6 +434,68 @@ class TrajectoryPlayer(object):
 		return success
 	
 	
+	def _stream_segments(self,rate):
+		"""Yield the stages as lists of (time from the segment start, RavenCommand),
+		one list per run of stages between pauses, and the pause stages themselves."""
+		segment = []
+		t0 = 0.
+		for stage in self.stages:
+			if stage.is_pause:
+				if segment:
+					yield segment
+				yield stage
+				segment = []
+				t0 = 0.
+				continue
+			steps = max(1,int(ceil(stage.duration.to_sec() * rate)))
+			for step in xrange(1,steps+1):
+				t = float(step) / steps
+				cmd = RavenCommand()
+				cmd.header = self.header
+				cmd.pedal_down = True
+				stage.cb(cmd,t)
+				segment.append((t0 + t * stage.duration.to_sec(),cmd))
+			t0 += stage.duration.to_sec()
+		if segment:
+			yield segment
+	
+	def stream(self,rate=50,chunk_duration=1.,lead_time=2.,validate=True):
+		"""Play the stages as a trajectory sent to r2_control in chunks of chunk_duration,
+		keeping about lead_time of it queued ahead of the robot. The stages are
+		sampled at rate points per second up front, so they must not depend on the
+		robot state. Pauses wait for the trajectory to finish before prompting."""
+		streamer = TrajectoryStreamer(frame_id=self.header.frame_id,validate=validate,
+									chunk_duration=chunk_duration,lead_time=lead_time)
+		while self.current_state is None and not rospy.is_shutdown():
+			rospy.sleep(0.02)
+		streamer.wait_for_connection()
+		
+		def running():
+			if self.current_state.runlevel == 0:
+				rospy.logerr('Raven in E-STOP, exiting')
+				return False
+			return True
+		
+		for segment in self._stream_segments(rate):
+			if isinstance(segment,Stage):
+				streamer.wait()
+				rospy.loginfo("Stage %s",segment.name)
+				segment.cb()
+				streamer.reset()
+				continue
+			points = []
+			for t, cmd in segment:
+				pt = RavenTrajectoryCommandPoint()
+				pt.arm_names = cmd.arm_names
+				pt.arms = cmd.arms
+				points.append((t,pt))
+			if not streamer.play(points,running):
+				return False
+		
+		streamer.wait()
+		rospy.loginfo("Finished!")
+		return not rospy.is_shutdown()
+	
 	@staticmethod
 	def add_arm_cmd(cmd,arm_name,
 				tool_pose=None,pose_option=ToolCommand.POSE_OFF,
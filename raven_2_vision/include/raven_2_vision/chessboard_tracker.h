@@ -0,0 +1,53 @@
+#pragma once
+#include <string>
+#include <opencv2/core/core.hpp>
+#include <ros/ros.h>
+#include <sensor_msgs/Image.h>
+#include <sensor_msgs/CameraInfo.h>
+
+struct ChessboardTrackerOptions {
+	int width;
+	int height;
+	float square;
+	std::string topic;
+	std::string image_topic;
+	std::string info_topic;
+	bool rect;
+	float detection_interval;
+	float print_interval;
+	std::string frame_id;
+	std::string window_name; // draws the corners in this highgui window; empty for none
+
+	ChessboardTrackerOptions();
+	// overrides from the private parameters, named like the chessboard_tracker options
+	void readParams(const ros::NodeHandle& nh);
+};
+
+/*
+ * Finds a chessboard in each image and publishes its pose, at most once per
+ * detection interval. Used by both the chessboard_tracker node and the
+ * ChessboardTracker nodelet. The image is only copied when the corners are
+ * drawn, and the pose is published by pointer, so in a nodelet manager
+ * nothing is serialized either way.
+ */
+class ChessboardTracker {
+	ChessboardTrackerOptions opts_;
+	ros::Subscriber image_sub_;
+	ros::Subscriber info_sub_;
+	ros::Publisher pose_pub_;
+	ros::Timer print_timer_;
+
+	bool have_info_;
+	cv::Mat_<double> cameraMatrix_;
+	cv::Mat_<double> distCoeffs_;
+
+	ros::Time last_detection_;
+	int num_poses_since_print_;
+	int total_num_poses_;
+
+	void infoCallback(const sensor_msgs::CameraInfoConstPtr& info);
+	void imageCallback(const sensor_msgs::ImageConstPtr& msg);
+	void printCallback(const ros::TimerEvent&);
+public:
+	ChessboardTracker(ros::NodeHandle& nh, const ChessboardTrackerOptions& opts);
+};
@@ -0,0 +1,116 @@
+#include "raven_2_vision/chessboard_tracker.h"
+#include "raven_2_vision/raven_vision.h"
+#include <geometry_msgs/PoseStamped.h>
+#include <cv_bridge/cv_bridge.h>
+
+using namespace std;
+using namespace cv;
+
+ChessboardTrackerOptions::ChessboardTrackerOptions() :
+	width(7), height(9), square(.01),
+	topic("chessboard_pose"), image_topic("BC/right/image_raw"), info_topic("BC/right/camera_info"),
+	rect(true), detection_interval(0.1), print_interval(1), frame_id("left_BC") {
+}
+
+void ChessboardTrackerOptions::readParams(const ros::NodeHandle& nh) {
+	nh.getParam("width", width);
+	nh.getParam("height", height);
+	double d;
+	if (nh.getParam("square", d)) { square = d; }
+	nh.getParam("topic", topic);
+	nh.getParam("image", image_topic);
+	nh.getParam("info", info_topic);
+	nh.getParam("rect", rect);
+	if (nh.getParam("detection_interval", d)) { detection_interval = d; }
+	if (nh.getParam("print_interval", d)) { print_interval = d; }
+	nh.getParam("frame", frame_id);
+}
+
+ChessboardTracker::ChessboardTracker(ros::NodeHandle& nh, const ChessboardTrackerOptions& opts) :
+	opts_(opts), have_info_(false), num_poses_since_print_(0), total_num_poses_(0) {
+	string image_topic;
+	if (opts_.image_topic != "") {
+		image_topic = opts_.image_topic;
+	} else {
+		if (opts_.rect) {
+			image_topic = "image_mono";
+		} else {
+			image_topic = "image_rect";
+		}
+	}
+
+	string info_topic;
+	if (opts_.info_topic != "") {
+		info_topic = opts_.info_topic;
+	} else {
+		info_topic = "camera_info";
+	}
+
+	if (opts_.rect) {
+		ROS_INFO_STREAM("Rectifying image data from topic " << image_topic);
+	} else {
+		ROS_INFO_STREAM("Not rectifying image data from topic " << image_topic);
+	}
+
+	pose_pub_ = nh.advertise<geometry_msgs::PoseStamped>(opts_.topic,1);
+	info_sub_ = nh.subscribe(info_topic, 1, &ChessboardTracker::infoCallback, this);
+	image_sub_ = nh.subscribe(image_topic, 1, &ChessboardTracker::imageCallback, this);
+	print_timer_ = nh.createTimer(ros::Duration(opts_.print_interval), &ChessboardTracker::printCallback, this);
+}
+
+void ChessboardTracker::infoCallback(const sensor_msgs::CameraInfoConstPtr& info) {
+	cameraMatrix_ = cv::Mat_<double>(3,3, const_cast<double*>(&info->K[0])).clone();
+	if (opts_.rect) {
+		distCoeffs_ = cv::Mat_<double>(5,1, const_cast<double*>(&info->D[0])).clone();
+	} else {
+		distCoeffs_ = cv::Mat_<double>(cv::Size(5,1), 0);
+	}
+	have_info_ = true;
+	info_sub_.shutdown(); // the intrinsics don't change
+}
+
+void ChessboardTracker::imageCallback(const sensor_msgs::ImageConstPtr& msg) {
+	if (!have_info_) {
+		ROS_WARN_THROTTLE(5, "Chessboard tracker has no camera info yet");
+		return;
+	}
+	ros::Time now = ros::Time::now();
+	if ((now - last_detection_).toSec() < opts_.detection_interval) {
+		return;
+	}
+	last_detection_ = now;
+
+	// detection only reads the image; drawing the corners needs a copy of its own
+	bool draw = !opts_.window_name.empty();
+	cv_bridge::CvImageConstPtr cv_image = draw ? cv_bridge::toCvCopy(msg) : cv_bridge::toCvShare(msg);
+	cv::Mat image = cv_image->image;
+
+	geometry_msgs::PoseStampedPtr ps(new geometry_msgs::PoseStamped);
+	bool gotPose;
+	cv::vector<cv::Point2f> cornersImage;
+	const char* windowName = draw ? opts_.window_name.c_str() : 0;
+	if (opts_.rect) {
+		gotPose = getChessboardPoseRect(image, Size(opts_.width, opts_.height), opts_.square, cameraMatrix_, distCoeffs_, ps->pose, cornersImage, draw, windowName);
+	} else {
+		gotPose = getChessboardPoseNoRect(image, Size(opts_.width, opts_.height), opts_.square, cameraMatrix_, distCoeffs_, ps->pose, cornersImage, draw, windowName);
+	}
+	if (gotPose) {
+		num_poses_since_print_++;
+		total_num_poses_++;
+		ps->header.frame_id = opts_.frame_id;
+		//ps->header.frame_id = msg->header.frame_id;
+		ps->header.stamp = now;
+		pose_pub_.publish(ps);
+	}
+}
+
+void ChessboardTracker::printCallback(const ros::TimerEvent&) {
+	if (!total_num_poses_) {
+		ROS_INFO("Chessboards:    NONE RECEIVED   %s",pose_pub_.getTopic().c_str());
+	} else if (num_poses_since_print_) {
+		ROS_INFO("Chessboards: %10d (%5d) %s",num_poses_since_print_,total_num_poses_,pose_pub_.getTopic().c_str());
+	} else {
+		ROS_INFO("Chessboards: NO UPDATES (%5d) %s",total_num_poses_,pose_pub_.getTopic().c_str());
+	}
+	num_poses_since_print_ = 0;
+}
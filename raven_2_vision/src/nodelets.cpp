@@ -0,0 +1,26 @@
+#include <nodelet/nodelet.h>
+#include <pluginlib/class_list_macros.h>
+#include <boost/shared_ptr.hpp>
+#include "raven_2_vision/chessboard_tracker.h"
+
+namespace raven_2_vision {
+
+/*
+ * chessboard_tracker as a nodelet, configured from its private parameters
+ * (width, height, square, topic, image, info, rect, detection_interval,
+ * print_interval, frame). Loaded into the camera driver's manager, images
+ * arrive without being copied or deserialized. It never opens a window.
+ */
+class ChessboardTrackerNodelet : public nodelet::Nodelet {
+	boost::shared_ptr<ChessboardTracker> tracker_;
+
+	virtual void onInit() {
+		ChessboardTrackerOptions opts;
+		opts.readParams(getPrivateNodeHandle());
+		tracker_.reset(new ChessboardTracker(getNodeHandle(), opts));
+	}
+};
+
+}
+
+PLUGINLIB_DECLARE_CLASS(raven_2_vision, ChessboardTracker, raven_2_vision::ChessboardTrackerNodelet, nodelet::Nodelet)